@@ -4,10 +4,14 @@
 // Using this package requires cgo and a gnu compiler (clang or gcc), as well as the development version of zlib installed
 // By default, it expect the zlib header and so files to be in the standard include and library path. If not, you can override it
 // by setting the appropriate paths in the environment variables CGO_CFLAGS and CGO_LDFLAGS
-// Internally gozlib utilizes an off-heap memory pool to maximize memory usage. At this moment, allocated memory is never
-// returned to the system so gozlib is best used when gzip operations are frequent and constant.
+// Internally gozlib utilizes an off-heap memory pool to maximize memory usage. Pooled memory is only returned to the system
+// when the pools are trimmed, see TrimPools and StartPoolTrimmer.
 // This pool is also available for use in the Go code as a way to allocate and reuse byte slices.
 // See NativeSlicePool for details
+// Setting CGO_CFLAGS=-DPOOL_THREAD_CACHE enables per thread caches in front of the internal pools, reducing contention
+// when many threads allocate concurrently
+// zlib-ng built in compatibility mode can replace zlib by pointing CGO_CFLAGS and CGO_LDFLAGS to it, and building with the
+// libdeflate tag uses libdeflate for one-shot buffer compression, see SetBufferBackend
 package gozlib
 
 /*
@@ -18,10 +22,18 @@ package gozlib
 */
 import "C"
 import (
+	"encoding/binary"
 	"errors"
 	"fmt"
+	"hash"
 	"io"
+	"math"
+	"os"
 	"reflect"
+	"runtime"
+	"sort"
+	"sync"
+	"time"
 	"unsafe"
 )
 
@@ -39,11 +51,166 @@ for information pertaining to memory usage between Go and C, see also see https:
 type CompressionLevel int
 type TransformMode int
 
+// Any level from CompressionLevelBestSpeed (1) to CompressionLevelBestCompression (9) can be used, as well as the
+// zlib no compression and default levels
 const (
 	CompressionLevelBestCompression CompressionLevel = C.Z_BEST_COMPRESSION
 	CompressionLevelBestSpeed       CompressionLevel = C.Z_BEST_SPEED
+	CompressionLevelNoCompression   CompressionLevel = C.Z_NO_COMPRESSION
+	CompressionLevelDefault         CompressionLevel = C.Z_DEFAULT_COMPRESSION
 )
 
+// CompressionFormat is the container format of compressed data
+type CompressionFormat int
+
+const (
+	CompressionFormatGZip CompressionFormat = 0
+	CompressionFormatZLib CompressionFormat = 1
+	// CompressionFormatRaw is deflate data without header or trailer, as used by the websocket permessage-deflate extension
+	CompressionFormatRaw CompressionFormat = 2
+)
+
+// CompressionStrategy tunes the compression algorithm, see the zlib deflateInit2 documentation
+type CompressionStrategy int
+
+const (
+	CompressionStrategyDefault     CompressionStrategy = C.Z_DEFAULT_STRATEGY
+	CompressionStrategyFiltered    CompressionStrategy = C.Z_FILTERED
+	CompressionStrategyHuffmanOnly CompressionStrategy = C.Z_HUFFMAN_ONLY
+	CompressionStrategyRLE         CompressionStrategy = C.Z_RLE
+	CompressionStrategyFixed       CompressionStrategy = C.Z_FIXED
+)
+
+// FlushMode tells a compressor how much of the data written so far must be flushed to its output, see the zlib deflate documentation
+type FlushMode int
+
+const (
+	// FlushModeSync ends the pending output on a byte boundary with an empty stored block, the 00 00 ff ff marker, so that all
+	// the data written so far can be uncompressed. The stream is kept open, this is the flush used by websocket permessage-deflate
+	FlushModeSync FlushMode = C.Z_SYNC_FLUSH
+	// FlushModePartial is like FlushModeSync with a shorter, empty fixed codes block, not necessarily ending on a byte boundary
+	FlushModePartial FlushMode = C.Z_PARTIAL_FLUSH
+	// FlushModeFull is like FlushModeSync and also clears the history, so uncompression can restart from this point at the cost of ratio
+	FlushModeFull FlushMode = C.Z_FULL_FLUSH
+	// FlushModeFinish ends the stream, like Flush
+	FlushModeFinish FlushMode = C.Z_FINISH
+)
+
+func (mode FlushMode) valid() bool {
+	return mode == FlushModeSync || mode == FlushModePartial || mode == FlushModeFull || mode == FlushModeFinish
+}
+
+const (
+	minWindowBits     = 9
+	defaultWindowBits = C.MAX_WBITS
+	minMemLevel       = 1
+	defaultMemLevel   = C.MAX_MEM_LEVEL
+)
+
+// CompressionOptions holds the deflate parameters used by the *WithOptions compression functions.
+// Unlike the other fields, a zero Level means no compression, set it to CompressionLevelDefault or any level from 1 to 9
+type CompressionOptions struct {
+	Format CompressionFormat
+	Level  CompressionLevel
+	// WindowBits is the base two logarithm of the history window, from 9 to 15. Zero means 15.
+	// Data compressed with a given window must be uncompressed with a window at least as large
+	WindowBits int
+	// MemLevel sets how much memory is used for the compression state, from 1 to 9. Zero means 9.
+	// Together with WindowBits, it determines the memory used by each compressor, roughly 2^(WindowBits+2) + 2^(MemLevel+9) bytes
+	MemLevel int
+	Strategy CompressionStrategy
+	// Adaptive samples each input before compressing it. Inputs that look incompressible, like already compressed data,
+	// are stored or Huffman coded only instead of spending time searching for matches. It applies to buffers and compressors
+	Adaptive bool
+}
+
+// AdaptiveStats counts the inputs sampled by adaptive compression and how many of them were stored or Huffman coded only
+type AdaptiveStats struct {
+	Samples     uint64
+	Stored      uint64
+	HuffmanOnly uint64
+}
+
+func adaptiveStats(stats *C.GoZLibAdaptiveStats) AdaptiveStats {
+	return AdaptiveStats{
+		Samples:     uint64(stats.samples),
+		Stored:      uint64(stats.stored),
+		HuffmanOnly: uint64(stats.huffman_only),
+	}
+}
+
+// BufferAdaptiveStats returns the adaptive compression counters of all the buffers compressed with the Adaptive option
+func BufferAdaptiveStats() AdaptiveStats {
+	var stats C.GoZLibAdaptiveStats
+	C.get_adaptive_buffer_stats(&stats)
+	return adaptiveStats(&stats)
+}
+
+// CompressorAdaptiveStats returns the adaptive compression counters of a compressor created with the Adaptive option,
+// since it was created or last reset with ResetCompressor
+func CompressorAdaptiveStats(compressor io.WriteCloser) AdaptiveStats {
+	holder, isHolder := compressor.(transformerHolder)
+	if !isHolder {
+		return AdaptiveStats{}
+	}
+	return adaptiveStats(&holder.zlibTransformer().transformer.adaptive_stats)
+}
+
+// UncompressionOptions holds the inflate parameters used by the *WithOptions uncompression functions.
+// Both gzip and zlib formats are detected automatically, Format only needs to be set for raw deflate inputs
+type UncompressionOptions struct {
+	Format CompressionFormat
+	// WindowBits is the base two logarithm of the history window, from 9 to 15 and not smaller than the one used to compress. Zero means 15
+	WindowBits int
+}
+
+// zlibWindowBits converts a window size to the deflateInit2/inflateInit2 window bits value for the format
+func zlibWindowBits(format CompressionFormat, windowBits int, uncompress bool) (C.int, error) {
+	if windowBits == 0 {
+		windowBits = defaultWindowBits
+	}
+	if windowBits < minWindowBits || windowBits > C.MAX_WBITS {
+		return 0, InvalidCompressionOptionsError
+	}
+
+	switch format {
+	case CompressionFormatRaw:
+		return C.int(-windowBits), nil
+	case CompressionFormatGZip, CompressionFormatZLib:
+		if uncompress {
+			// automatic gzip and zlib header detection
+			return C.int(windowBits + 32), nil
+		}
+		if format == CompressionFormatGZip {
+			return C.int(windowBits + 16), nil
+		}
+		return C.int(windowBits), nil
+	}
+
+	return 0, InvalidCompressionOptionsError
+}
+
+// deflateParameters validates the options and returns the deflateInit2 level, window bits, memory level and strategy
+func (options *CompressionOptions) deflateParameters() (C.int, C.int, C.int, C.int, error) {
+	windowBits, err := zlibWindowBits(options.Format, options.WindowBits, false)
+	if err != nil {
+		return 0, 0, 0, 0, err
+	}
+
+	memLevel := options.MemLevel
+	if memLevel == 0 {
+		memLevel = defaultMemLevel
+	}
+
+	if memLevel < minMemLevel || memLevel > C.MAX_MEM_LEVEL ||
+		options.Level < CompressionLevelDefault || options.Level > CompressionLevelBestCompression ||
+		options.Strategy < CompressionStrategyDefault || options.Strategy > CompressionStrategyFixed {
+		return 0, 0, 0, 0, InvalidCompressionOptionsError
+	}
+
+	return C.int(options.Level), windowBits, C.int(memLevel), C.int(options.Strategy), nil
+}
+
 const (
 	TransformModeZLib       TransformMode = 0
 	TransformModeGZip       TransformMode = 1
@@ -60,6 +227,9 @@ var (
 	TransformerInitializationError = errors.New("error initializing transformer")
 	TransformerCompressionError    = errors.New("error compressing data")
 
+	// parallel compression
+	ParallelCompressionError = errors.New("error compressing block")
+
 	// streaming
 	StreamCompressError   = errors.New("error streaming compressed data")
 	StreamUncompressError = errors.New("error streaming uncompressed data")
@@ -68,13 +238,31 @@ var (
 	OutputBufferTooSmallError = errors.New("output buffer too small")
 	BufferCompressError       = errors.New("error compressing buffer")
 	BufferUncompressError     = errors.New("error uncompressing buffer")
-)
+	BatchLengthMismatchError  = errors.New("batch inputs and outputs have different lengths")
 
-type transformerWriterHandler struct {
-	writtenBytes     int
-	eventHandlers    *streamEventHandlers
-	eventHandlersPtr unsafe.Pointer
-}
+	InvalidCompressionOptionsError = errors.New("invalid compression options")
+	UnsupportedBufferBackendError  = errors.New("buffer backend not available in this build")
+	InvalidDictionaryError         = errors.New("invalid dictionary")
+
+	// files
+	FileCompressError   = errors.New("error compressing file")
+	FileUncompressError = errors.New("error uncompressing file")
+
+	// random access index
+	IndexBuildError         = errors.New("error building index")
+	InvalidIndexError       = errors.New("invalid index")
+	InvalidIndexOffsetError = errors.New("offset past the end of the indexed data")
+
+	// parallel uncompression
+	ParallelUncompressionError = errors.New("error uncompressing segment")
+
+	// pool trimming
+	InvalidPoolTrimPolicyError = errors.New("invalid pool trim policy")
+	PoolTrimmerStartError      = errors.New("error starting pool trimmer")
+
+	// native slice pool
+	NativeSlicePoolInUseError = errors.New("native slice pool has slices not returned")
+)
 
 // goZLibTransformer provides supports the implementation of compression and uncompression
 // behaviour
@@ -82,7 +270,16 @@ type goZLibTransformer struct {
 	input       io.Reader
 	output      io.Writer
 	transformer *C.GoZLibTransformer
-	twh         *transformerWriterHandler
+}
+
+// transformerHolder is implemented by the compressors and uncompressors built on a transformer, directly or by wrapping
+// another compressor, so that the helpers reading its counters work with all of them
+type transformerHolder interface {
+	zlibTransformer() *goZLibTransformer
+}
+
+func (goTransformer *goZLibTransformer) zlibTransformer() *goZLibTransformer {
+	return goTransformer
 }
 
 type goGZipCompressor struct {
@@ -96,55 +293,91 @@ type goGZipCompressor struct {
 // large enough for the expected input.
 // Returns an io.WriteCloser for writing compressed data and an error, if any.
 func NewGoGZipCompressor(output io.Writer, level CompressionLevel, bufferSize uint32) (io.WriteCloser, error) {
-	twh := &transformerWriterHandler{
-		writtenBytes:     0,
-		eventHandlers:    nil,
-		eventHandlersPtr: nil,
-	}
+	return NewGoCompressorWithOptions(output, CompressionOptions{Format: CompressionFormatGZip, Level: level}, bufferSize)
+}
 
+// NewGoCompressorWithDictionary creates a new compressor like NewGoGZipCompressor, in the format and with the parameters of the dictionary.
+// The dictionary must not be closed before the compressor
+func NewGoCompressorWithDictionary(output io.Writer, dictionary *Dictionary, bufferSize uint32) (io.WriteCloser, error) {
 	goComp := &goGZipCompressor{
 		goZLibTransformer{
 			input:       nil,
 			output:      output,
 			transformer: nil,
-			twh:         twh,
 		},
 	}
 
-	err := initTransformer(&goComp.goZLibTransformer, TransformModeGZip, level, bufferSize)
+	var errorCode C.int = 0
+	goComp.transformer = C.acquire_dictionary_compression_transformer(dictionary.dictionary, C.uInt(bufferSize), &errorCode)
+	if errorCode != C.Z_OK {
+		C.release_compression_transformer(goComp.transformer)
+		return nil, fmt.Errorf(wrapErrorFormat, TransformerInitializationError, errorCode)
+	}
 
-	twh.eventHandlers.onWrite = func(compressed []byte) uint32 {
-		written, werr := goComp.output.Write(compressed)
-		if werr != nil {
-			return 0
-		}
-		return uint32(written)
+	return goComp, nil
+}
+
+// NewGoCompressorWithOptions creates a new compressor for the format, level, window, memory level and strategy in options.
+// It behaves like the compressor returned by NewGoGZipCompressor and can be used with Flush and ResetCompressor.
+// An error is returned if the options are not valid
+func NewGoCompressorWithOptions(output io.Writer, options CompressionOptions, bufferSize uint32) (io.WriteCloser, error) {
+	goComp := &goGZipCompressor{
+		goZLibTransformer{
+			input:       nil,
+			output:      output,
+			transformer: nil,
+		},
 	}
 
+	err := initCompressionTransformer(&goComp.goZLibTransformer, &options, bufferSize)
 	if err != nil {
 		return nil, err
 	}
+
 	return goComp, nil
 }
 
 // Write compresses and writes the given data to the output stream. Returns the
 // number of uncompressed bytes written, and any error that occurred.
+// Compression is driven from Go, one cgo call per filled work buffer, without any C to Go callback.
 func (comp *goGZipCompressor) Write(data []byte) (int, error) {
+	var flush C.int = C.Z_NO_FLUSH
+	if len(data) == 0 {
+		flush = C.Z_FINISH
+	}
+	return comp.compress(data, flush)
+}
+
+func (comp *goGZipCompressor) compress(data []byte, flush C.int) (int, error) {
 	dataLen := len(data)
-	uncompressedLen := C.uInt(dataLen)
+	workBuffer := comp.workBuffer()
+	// taken outside the call, cgo would otherwise box the slice to check the pointer on every step
+	workBufferPtr := unsafe.Pointer(&workBuffer[0])
+
+	consumed := 0
+	for {
+		var uncompressed unsafe.Pointer = nil
+		if consumed < dataLen {
+			uncompressed = unsafe.Pointer(&data[consumed])
+		}
 
-	var uncompressed unsafe.Pointer = nil
-	if dataLen > 0 {
-		uncompressed = unsafe.Pointer(&data[0])
-	}
+		step := C.transformer_compress_step(comp.transformer, uncompressed, C.uInt(dataLen-consumed), workBufferPtr, C.uInt(len(workBuffer)), flush)
+		if step.status < C.Z_OK {
+			return 0, fmt.Errorf(wrapErrorFormat, TransformerCompressionError, step.status)
+		}
+		consumed += int(step.consumed)
 
-	transformCode := C.go_transformer_compress_to_outstream(comp.transformer, uncompressed, uncompressedLen)
+		if step.produced > 0 {
+			if _, werr := comp.output.Write(workBuffer[:step.produced]); werr != nil {
+				return 0, fmt.Errorf(wrapErrorFormat, TransformerCompressionError, C.GOZLIB_STREAM_OUTPUT_WRITE_ERROR)
+			}
+		}
 
-	if transformCode < C.Z_OK {
-		return 0, fmt.Errorf(wrapErrorFormat, TransformerCompressionError, transformCode)
+		// there's room in the work buffer so all the input was consumed or the stream was finished
+		if step.status != C.GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA {
+			return dataLen, nil
+		}
 	}
-
-	return dataLen, nil
 }
 
 // Flush flushes the compressor by invoking Write with a zero input. If there is
@@ -156,76 +389,115 @@ func (comp *goGZipCompressor) Flush() error {
 	return ferr
 }
 
+// FlushWith writes all the data compressed so far to the output with the given flush mode.
+// Unless mode is FlushModeFinish, the stream is kept open and the following writes keep using its history
+func (comp *goGZipCompressor) FlushWith(mode FlushMode) error {
+	if !mode.valid() {
+		return fmt.Errorf(wrapErrorFormat, TransformerCompressionError, C.Z_STREAM_ERROR)
+	}
+
+	_, ferr := comp.compress(nil, C.int(mode))
+	return ferr
+}
+
 // Close releases the resources used by the compressor. It first flushes the compressor,
 // then releases all interenal resources. If there
 // is any error during flushing or releasing, it will be returned.
 // Not calling Close will result in a resource leak
 func (comp *goGZipCompressor) Close() error {
 	ferr := comp.Flush()
-	C.release_compression_transformer(comp.transformer)
-	unregisterStreamEventHandler(comp.twh.eventHandlersPtr)
-	C.pool_free(comp.twh.eventHandlersPtr)
+	comp.release()
 	return ferr
 }
 
+// release releases the transformer without flushing, closed compressors are not taken back by a TransformerPool
+func (comp *goGZipCompressor) release() {
+	C.release_compression_transformer(comp.transformer)
+	comp.transformer = nil
+}
+
 type goUncompressor struct {
 	goZLibTransformer
 	hasMoreData bool
+	// set once a stream that can't be followed by other members ends
+	streamEnded bool
+	// set while a gzip or zlib member is started and hasn't reached its trailer
+	memberOpen bool
 }
 
 // NewGoZLibUncompressor creates a new uncompressor that supports zlib or gzip inputs
 // The input parameter is the io.Reader providing the compressed data to be uncompressed,
 // and the bufferSize parameter is the size of the buffer to use in the internal compression transformer.
 // For best performance, set it to a size that's power 2,
-// large enough for the expected input.
+// large enough for the expected input. Concatenated gzip members are uncompressed as a single stream.
 func NewGoZLibUncompressor(input io.Reader, bufferSize uint32) (io.ReadCloser, error) {
-	twh := &transformerWriterHandler{
-		writtenBytes:     0,
-		eventHandlers:    nil,
-		eventHandlersPtr: nil,
-	}
+	return NewGoUncompressorWithOptions(input, UncompressionOptions{}, bufferSize)
+}
 
+// NewGoUncompressorWithDictionary creates a new uncompressor like NewGoZLibUncompressor for data compressed with the dictionary.
+// The dictionary must not be closed before the uncompressor
+func NewGoUncompressorWithDictionary(input io.Reader, dictionary *Dictionary, bufferSize uint32) (io.ReadCloser, error) {
 	goUncomp := &goUncompressor{
 		goZLibTransformer: goZLibTransformer{
 			output:      nil,
 			input:       input,
 			transformer: nil,
-			twh:         twh,
 		},
 		hasMoreData: false,
 	}
 
-	// no need for level when uncompressing so we set it to zero
-	err := initTransformer(&goUncomp.goZLibTransformer, TransformModeUncompress, 0, bufferSize)
+	var errorCode C.int = 0
+	goUncomp.transformer = C.acquire_dictionary_uncompression_transformer(dictionary.dictionary, C.uInt(bufferSize), &errorCode)
+	if errorCode != C.Z_OK {
+		C.release_uncompression_transformer(goUncomp.transformer)
+		return nil, fmt.Errorf(wrapErrorFormat, TransformerInitializationError, errorCode)
+	}
+
+	return goUncomp, nil
+}
 
-	// we want to write directly into the output buffer
-	// so this handler only tracks the amount written, the actual content
-	// is written by the C code to output
-	twh.eventHandlers.onWrite = func(data []byte) uint32 {
-		twh.writtenBytes = len(data)
-		return uint32(twh.writtenBytes)
+// NewGoUncompressorWithOptions creates a new uncompressor like NewGoZLibUncompressor, using the window and format in options.
+// It is required for raw deflate inputs. An error is returned if the options are not valid
+func NewGoUncompressorWithOptions(input io.Reader, options UncompressionOptions, bufferSize uint32) (io.ReadCloser, error) {
+	goUncomp := &goUncompressor{
+		goZLibTransformer: goZLibTransformer{
+			output:      nil,
+			input:       input,
+			transformer: nil,
+		},
+		hasMoreData: false,
 	}
 
+	err := initUncompressionTransformer(&goUncomp.goZLibTransformer, &options, bufferSize)
 	if err != nil {
 		return nil, err
 	}
+
 	return goUncomp, nil
 }
 
 // Read reads uncompressed data from the input stream and writes it to the output buffer.
 // The function returns the number of bytes read into the output buffer and any error encountered.
 // If there is no more data to be read, Read returns io.EOF.
+// A gzip or zlib input ending before the trailer of the stream returns io.ErrUnexpectedEOF.
 func (unc *goUncompressor) Read(output []byte) (int, error) {
-	unc.twh.writtenBytes = 0
+	if unc.streamEnded {
+		return 0, io.EOF
+	}
+
 	// if there's still data from the previous call to be read
 	if !unc.hasMoreData {
 		readLen, readError := unc.readIntoWorkBuffer()
 		if readError != nil { // this could be EOF
+			// a gzip or zlib stream cut before its trailer, raw streams have no end to wait for
+			if readError == io.EOF && unc.memberOpen {
+				return 0, io.ErrUnexpectedEOF
+			}
 			return 0, readError
 		}
 
 		if readLen == 0 {
-			return unc.twh.writtenBytes, nil
+			return 0, nil
 		}
 
 		// assign the workbuffer as next input
@@ -234,99 +506,152 @@ func (unc *goUncompressor) Read(output []byte) (int, error) {
 
 	// pass the pointer to the output slice so the C code can write directly to it
 	outputSliceHdr := (*reflect.SliceHeader)(unsafe.Pointer(&output))
-	transformCode := C.go_uncompress_to_outstream_step(unc.transformer, unsafe.Pointer(outputSliceHdr.Data), C.uInt(outputSliceHdr.Len))
-
-	if transformCode < C.Z_OK {
-		return 0, fmt.Errorf(wrapErrorFormat, TransformerUncompressionError, transformCode)
-	}
+	step := C.transformer_uncompress_step(unc.transformer, unsafe.Pointer(outputSliceHdr.Data), C.uInt(outputSliceHdr.Len))
 
-	if transformCode == C.Z_STREAM_END {
-		return unc.twh.writtenBytes, nil
+	if step.status < C.Z_OK {
+		return 0, fmt.Errorf(wrapErrorFormat, TransformerUncompressionError, step.status)
 	}
 
-	unc.hasMoreData = transformCode == C.GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA
+	unc.hasMoreData = step.status == C.GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA
+	unc.streamEnded = step.status == C.Z_STREAM_END && !bool(unc.transformer.multi_member)
+	unc.memberOpen = unc.transformer.window_bits > 0 && step.status != C.Z_STREAM_END && (unc.memberOpen || step.consumed > 0)
 
-	return unc.twh.writtenBytes, nil
+	return int(step.produced), nil
 }
 
 // Close closes the uncompressor and releases internal resources
 // Not calling Close will result in a resource leak
 func (unc *goUncompressor) Close() error {
 	C.release_uncompression_transformer(unc.transformer)
-	unregisterStreamEventHandler(unc.twh.eventHandlersPtr)
-	C.pool_free(unc.twh.eventHandlersPtr)
+	unc.transformer = nil
 	return nil
 }
 
 // Transform utility functions
 
+// flusher is implemented by the compressors whose Flush ends the stream
+type flusher interface {
+	Flush() error
+}
+
 // Flush is a helper function to flush a compressor given an interface
 func Flush(compressor io.WriteCloser) error {
-	return compressor.(*goGZipCompressor).Flush()
+	return compressor.(flusher).Flush()
+}
+
+// modeFlusher is implemented by the compressors that can be flushed without ending their stream
+type modeFlusher interface {
+	FlushWith(mode FlushMode) error
+}
+
+// FlushWith is a helper function to flush a compressor given an interface with one of the flush modes.
+// It can be used with the compressors returned by NewGoGZipCompressor, NewGoGZipPipelinedCompressor,
+// NewGoCoalescingCompressor and their *WithOptions and *WithDictionary counterparts
+func FlushWith(compressor io.WriteCloser, mode FlushMode) error {
+	return compressor.(modeFlusher).FlushWith(mode)
+}
+
+// compressorResetter is implemented by the compressors that can be reset with ResetCompressor
+type compressorResetter interface {
+	reset(output io.Writer)
+}
+
+// uncompressorResetter is implemented by the uncompressors that can be reset with ResetUncompressor
+type uncompressorResetter interface {
+	reset(input io.Reader)
 }
 
 // ResetCompressor is a helper function that can be used when pooling compressors
-// The compressor will use the given output to write data to
+// The compressor will use the given output to write data to. Data written and not flushed is dropped.
+// It can be used with the compressors returned by NewGoGZipCompressor, NewGoGZipPipelinedCompressor, NewGoCoalescingCompressor,
+// NewGoParkingCompressor and their *WithOptions and *WithDictionary counterparts, as long as they're not closed
 func ResetCompressor(output io.Writer, compressor io.WriteCloser) {
-	goComp := compressor.(*goGZipCompressor)
-	goComp.output = output
-	C.reset_compression_transformer(goComp.transformer)
+	compressor.(compressorResetter).reset(output)
 }
 
 // ResetUncompressor is a helper function that can be used when pooling uncompressors
 // the uncompressor will use the given input to read data from
 func ResetUncompressor(input io.Reader, uncompressor io.ReadCloser) {
-	goUncomp := uncompressor.(*goUncompressor)
-	goUncomp.input = input
-	C.reset_uncompression_transformer(goUncomp.transformer)
+	uncompressor.(uncompressorResetter).reset(input)
 }
 
-func (unc *goUncompressor) readIntoWorkBuffer() (uint32, error) {
-	var output []byte
+func (comp *goGZipCompressor) reset(output io.Writer) {
+	comp.output = output
+	C.reset_compression_transformer(comp.transformer)
+}
+
+func (unc *goUncompressor) reset(input io.Reader) {
+	unc.input = input
+	unc.hasMoreData = false
+	unc.streamEnded = false
+	unc.memberOpen = false
+	C.reset_uncompression_transformer(unc.transformer)
+}
+
+// workBuffer returns a slice over the C allocated transformer work buffer
+func (goTransformer *goZLibTransformer) workBuffer() []byte {
+	var buffer []byte
 
-	hdr := (*reflect.SliceHeader)(unsafe.Pointer(&output))
+	hdr := (*reflect.SliceHeader)(unsafe.Pointer(&buffer))
 
-	hdr.Data = uintptr(unc.transformer.work_buffer)
-	hdr.Len = int(unc.transformer.work_buffer_cap)
-	hdr.Cap = int(unc.transformer.work_buffer_cap)
+	hdr.Data = uintptr(goTransformer.transformer.work_buffer)
+	hdr.Len = int(goTransformer.transformer.work_buffer_cap)
+	hdr.Cap = int(goTransformer.transformer.work_buffer_cap)
 
-	readLen, readError := unc.input.Read(output)
+	return buffer
+}
+
+func (unc *goUncompressor) readIntoWorkBuffer() (uint32, error) {
+	readLen, readError := unc.input.Read(unc.workBuffer())
 	if readError == io.EOF && readLen > 0 {
 		return uint32(readLen), nil
 	}
 	return uint32(readLen), readError
 }
 
-func initTransformer(goTransformer *goZLibTransformer, mode TransformMode, level CompressionLevel, bufferSize uint32) error {
+func initCompressionTransformer(goTransformer *goZLibTransformer, options *CompressionOptions, bufferSize uint32) error {
+	level, windowBits, memLevel, strategy, err := options.deflateParameters()
+	if err != nil {
+		return err
+	}
 
 	var errorCode C.int = 0
-	if mode == TransformModeGZip {
-		// the result of acquire_gzip_compression_transformer won't be nil even on error
-		// and the result needs to be released on close
-		goTransformer.transformer = C.acquire_gzip_compression_transformer(C.int(level), C.uInt(bufferSize), &errorCode)
-	} else if mode == TransformModeUncompress {
-		goTransformer.transformer = C.acquire_uncompression_transformer(C.uInt(bufferSize), &errorCode)
-	} else {
-		return fmt.Errorf("mode %v not supported", mode)
-	}
+	// the result of acquire_compression_transformer won't be nil even on error
+	// and the result needs to be released on close
+	goTransformer.transformer = C.acquire_compression_transformer(level, windowBits, memLevel, strategy, C.uInt(bufferSize), &errorCode)
 
 	if errorCode != C.Z_OK {
+		C.release_compression_transformer(goTransformer.transformer)
 		return fmt.Errorf(wrapErrorFormat, TransformerInitializationError, errorCode)
 	}
 
-	eventHandlers := &streamEventHandlers{}
-	goTransformer.twh.eventHandlers = eventHandlers
+	if options.Adaptive {
+		C.enable_adaptive_compression(goTransformer.transformer, level, strategy)
+	}
+
+	return nil
+}
+
+func initUncompressionTransformer(goTransformer *goZLibTransformer, options *UncompressionOptions, bufferSize uint32) error {
+	windowBits, err := zlibWindowBits(options.Format, options.WindowBits, true)
+	if err != nil {
+		return err
+	}
+
+	var errorCode C.int = 0
+	goTransformer.transformer = C.acquire_window_uncompression_transformer(windowBits, C.uInt(bufferSize), &errorCode)
+
+	if errorCode != C.Z_OK {
+		C.release_uncompression_transformer(goTransformer.transformer)
+		return fmt.Errorf(wrapErrorFormat, TransformerInitializationError, errorCode)
+	}
 
-	goTransformer.twh.eventHandlersPtr = C.pool_alloc(uintptrSize)
-	// use the address of the C allocated pointer itself as ID
-	goTransformer.transformer.state.data_handler = goTransformer.twh.eventHandlersPtr
-	registerStreamEventHandler(goTransformer.twh.eventHandlersPtr, eventHandlers)
 	return nil
 }
 
 // Streaming
 
-func goCompressOrUncompressStream(compress bool, level CompressionLevel, inputBufferSize uint32, outputBufferSize uint32, inputReader DataStreamEventHandler, outputWriter DataStreamEventHandler) (uint64, error) {
+func goCompressOrUncompressStream(compress bool, level CompressionLevel, dictionary *Dictionary, inputBufferSize uint32, outputBufferSize uint32, inputReader DataStreamEventHandler, outputWriter DataStreamEventHandler) (uint64, error) {
 	zState := C.pool_acquire_zstream_state()
 	defer C.pool_release_zstream_state(zState)
 
@@ -334,22 +659,27 @@ func goCompressOrUncompressStream(compress bool, level CompressionLevel, inputBu
 	handlers.onRead = inputReader
 	handlers.onWrite = outputWriter
 
-	handlersPtr := C.pool_alloc(uintptrSize)
-	defer C.pool_free(handlersPtr)
-	// use the address of the C allocated pointer itself as ID
-	zState.data_handler = handlersPtr
-	registerStreamEventHandler(handlersPtr, handlers)
-	defer unregisterStreamEventHandler(handlersPtr)
+	handlersID := registerStreamEventHandler(handlers)
+	defer unregisterStreamEventHandler(handlersID)
+	C.set_stream_data_handler(zState, C.uintptr_t(handlersID))
 
 	var errorCode C.int = C.Z_OK
 	var outLen C.ulong
 	if compress {
-		outLen = C.go_gzip_compress_stream(zState, C.int(level), C.uInt(inputBufferSize), C.uInt(outputBufferSize), &errorCode)
+		if dictionary != nil {
+			outLen = C.go_dictionary_compress_stream(zState, dictionary.dictionary, C.uInt(inputBufferSize), C.uInt(outputBufferSize), &errorCode)
+		} else {
+			outLen = C.go_gzip_compress_stream(zState, C.int(level), C.uInt(inputBufferSize), C.uInt(outputBufferSize), &errorCode)
+		}
 		if errorCode != C.Z_OK {
 			return 0, fmt.Errorf(wrapErrorFormat, StreamCompressError, errorCode)
 		}
 	} else {
-		outLen = C.go_uncompress_stream(zState, C.uInt(inputBufferSize), C.uInt(outputBufferSize), &errorCode)
+		if dictionary != nil {
+			outLen = C.go_dictionary_uncompress_stream(zState, dictionary.dictionary, C.uInt(inputBufferSize), C.uInt(outputBufferSize), &errorCode)
+		} else {
+			outLen = C.go_uncompress_stream(zState, C.uInt(inputBufferSize), C.uInt(outputBufferSize), &errorCode)
+		}
 		if errorCode != C.Z_OK {
 			return 0, fmt.Errorf(wrapErrorFormat, StreamUncompressError, errorCode)
 		}
@@ -365,7 +695,7 @@ func goCompressOrUncompressStream(compress bool, level CompressionLevel, inputBu
 // `inputBufferSize` and `outputBufferSize` are the sizes of the internal work buffers. For best performance, use large enough power of 2 sizes
 // The function returns the number of bytes written to the output stream and an error, if any.
 func GoGZipCompressStream(level CompressionLevel, inputBufferSize uint32, outputBufferSize uint32, inputReader DataStreamEventHandler, outputWriter DataStreamEventHandler) (uint64, error) {
-	return goCompressOrUncompressStream(true, level, inputBufferSize, outputBufferSize, inputReader, outputWriter)
+	return goCompressOrUncompressStream(true, level, nil, inputBufferSize, outputBufferSize, inputReader, outputWriter)
 }
 
 // GoUncompressStream uncompresses a stream of data in gzip or standard zlib format
@@ -374,31 +704,68 @@ func GoGZipCompressStream(level CompressionLevel, inputBufferSize uint32, output
 // `inputBufferSize` and `outputBufferSize` are the sizes of the internal work buffers. For best performance, use large enough power of 2 sizes
 // The function returns the number of bytes written to the output stream and an error, if any.
 func GoUncompressStream(inputBufferSize uint32, outputBufferSize uint32, inputReader DataStreamEventHandler, outputWriter DataStreamEventHandler) (uint64, error) {
-	return goCompressOrUncompressStream(false, 0, inputBufferSize, outputBufferSize, inputReader, outputWriter)
+	return goCompressOrUncompressStream(false, 0, nil, inputBufferSize, outputBufferSize, inputReader, outputWriter)
 }
 
-// Buffer to buffer operations
+// GoCompressStreamWithDictionary compresses a stream of data like GoGZipCompressStream, in the format and with the
+// parameters of the dictionary
+func GoCompressStreamWithDictionary(dictionary *Dictionary, inputBufferSize uint32, outputBufferSize uint32, inputReader DataStreamEventHandler, outputWriter DataStreamEventHandler) (uint64, error) {
+	return goCompressOrUncompressStream(true, 0, dictionary, inputBufferSize, outputBufferSize, inputReader, outputWriter)
+}
 
-// GoGZipCompressBuffer compresses data in gzip format, reading from input and
-// writing to a pre allocated output buffer. If the output is too small to contain the compressed data, an error is returned
-func GoGZipCompressBuffer(level CompressionLevel, input []byte, output []byte) (uint64, error) {
-	inputCap := cap(input)
-	outputCap := cap(output)
-	if outputCap == 0 {
-		return 0, OutputBufferTooSmallError
+// GoUncompressStreamWithDictionary uncompresses a stream of data compressed with the dictionary, see GoUncompressStream
+func GoUncompressStreamWithDictionary(dictionary *Dictionary, inputBufferSize uint32, outputBufferSize uint32, inputReader DataStreamEventHandler, outputWriter DataStreamEventHandler) (uint64, error) {
+	return goCompressOrUncompressStream(false, 0, dictionary, inputBufferSize, outputBufferSize, inputReader, outputWriter)
+}
+
+// Preset dictionaries
+
+// Dictionary is a preset dictionary used to compress and uncompress small payloads that share content with it, such as
+// JSON documents with the same keys. Only the zlib and raw deflate formats support dictionaries.
+// Each dictionary keeps its own pool of compression contexts primed with it. Priming hashes the dictionary, which
+// is done when a context is created and again each time it's released after use, so its cost is proportional to the
+// dictionary length and independent of the payload. Keep dictionaries small, a few KB is usually enough.
+// A Dictionary must only be closed after all compressors and uncompressors using it are closed
+type Dictionary struct {
+	dictionary *C.GoZLibDictionary
+}
+
+// NewDictionary creates a dictionary from data, used with the format, level, window, memory level and strategy in options
+func NewDictionary(data []byte, options CompressionOptions) (*Dictionary, error) {
+	if options.Format == CompressionFormatGZip || len(data) == 0 {
+		return nil, InvalidDictionaryError
 	}
 
-	var inputPtr unsafe.Pointer = nil
-	if inputCap > 0 {
-		inputPtr = unsafe.Pointer(&input[0])
+	level, windowBits, memLevel, strategy, err := options.deflateParameters()
+	if err != nil {
+		return nil, err
 	}
 
-	outputHdr := (*reflect.SliceHeader)(unsafe.Pointer(&output))
-	outputPtr := unsafe.Pointer(outputHdr.Data)
+	var errorCode C.int = C.Z_OK
+	dictionary := C.create_zlib_dictionary(unsafe.Pointer(&data[0]), C.uInt(len(data)), level, windowBits, memLevel, strategy, &errorCode)
+	if dictionary == nil {
+		return nil, fmt.Errorf(wrapErrorFormat, InvalidDictionaryError, errorCode)
+	}
+
+	return &Dictionary{dictionary: dictionary}, nil
+}
+
+// Close releases the dictionary and its pooled contexts
+func (dict *Dictionary) Close() {
+	C.free_zlib_dictionary(dict.dictionary)
+	dict.dictionary = nil
+}
+
+// GoCompressBufferWithDictionary compresses data like GoGZipCompressBuffer, in the format and with the parameters of the dictionary
+func GoCompressBufferWithDictionary(dictionary *Dictionary, input []byte, output []byte) (uint64, error) {
+	inputPtr, inputCap, outputPtr, outputCap, err := bufferPointers(input, output)
+	if err != nil {
+		return 0, err
+	}
 
 	var errorCode C.int = C.Z_OK
 
-	compLen := C.gzip_compress_buffer(C.int(level), inputPtr, C.uInt(inputCap), outputPtr, C.uInt(outputCap), &errorCode)
+	compLen := C.dictionary_compress_buffer(dictionary.dictionary, inputPtr, inputCap, outputPtr, outputCap, &errorCode)
 
 	if errorCode != C.Z_OK {
 		return 0, fmt.Errorf(wrapErrorFormat, BufferCompressError, errorCode)
@@ -407,26 +774,16 @@ func GoGZipCompressBuffer(level CompressionLevel, input []byte, output []byte) (
 	return uint64(compLen), nil
 }
 
-// GoUncompressBuffer uncompresses a gzip or standard zlib input buffer writing to a pre allocated output
-// if the output is too small to contain the compressed data, an error is returned
-func GoUncompressBuffer(input []byte, output []byte) (uint64, error) {
-	inputCap := cap(input)
-	outputCap := cap(output)
-	if outputCap == 0 {
-		return 0, OutputBufferTooSmallError
-	}
-
-	var inputPtr unsafe.Pointer = nil
-	if inputCap > 0 {
-		inputPtr = unsafe.Pointer(&input[0])
+// GoUncompressBufferWithDictionary uncompresses data compressed with the dictionary, see GoUncompressBuffer
+func GoUncompressBufferWithDictionary(dictionary *Dictionary, input []byte, output []byte) (uint64, error) {
+	inputPtr, inputCap, outputPtr, outputCap, err := bufferPointers(input, output)
+	if err != nil {
+		return 0, err
 	}
 
-	outputHdr := (*reflect.SliceHeader)(unsafe.Pointer(&output))
-	outputPtr := unsafe.Pointer(outputHdr.Data)
-
 	var errorCode C.int = C.Z_OK
 
-	uncompLen := C.uncompress_buffer_any(inputPtr, C.uInt(inputCap), outputPtr, C.uInt(outputCap), &errorCode)
+	uncompLen := C.dictionary_uncompress_buffer(dictionary.dictionary, inputPtr, inputCap, outputPtr, outputCap, &errorCode)
 
 	if errorCode != C.Z_OK {
 		return 0, fmt.Errorf(wrapErrorFormat, BufferUncompressError, errorCode)
@@ -435,48 +792,2535 @@ func GoUncompressBuffer(input []byte, output []byte) (uint64, error) {
 	return uint64(uncompLen), nil
 }
 
-// native slice pool
+// Pipelined compression
 
-// NativeSlicePool is a byte slice pool manager where memory allocated for each slice is allocated off-heap
-// The pool allows for slices of various types to be allocated and returned but given the way memory is internally tracked
-// slices of sizes that are power of 2 provide an optimal memory utilization.
-type NativeSlicePool struct {
-	pool *C.struct_MultiPool
+// DefaultPipelineDepth is the number of compressed buffers a pipelined compressor can have waiting to be written, unless specified otherwise
+const DefaultPipelineDepth = 2
+
+// goPipelinedCompressor compresses into a rotating set of output buffers, the transformer work buffer being the first of them.
+// Full buffers are written to the output by a writer goroutine while compression goes on into the next free buffer
+type goPipelinedCompressor struct {
+	goZLibTransformer
+	current []byte
+	closed  bool
+
+	free       chan []byte
+	full       chan []byte
+	pending    sync.WaitGroup
+	writerDone chan struct{}
+
+	errLock sync.Mutex
+	err     error
 }
 
-// NewNativeSlicePool creates a new slice pool.
-// Manually call NewNativeSlicePool.Free() to release the resouces allocated by the returned NewNativeSlicePool.
-func NewNativeSlicePool() *NativeSlicePool {
-	return &NativeSlicePool{
-		pool: C.multipool_create(),
+// NewGoGZipPipelinedCompressor creates a gzip compressor like NewGoGZipCompressor that overlaps compression with writing to output.
+// Compressed data is written from a writer goroutine, one bufferSize buffer at a time, while the following buffer is being compressed.
+// Up to depth full buffers can wait to be written, Write blocks once they're all in use. If depth is zero or negative,
+// DefaultPipelineDepth is used. Output write errors are returned by the following Write, Flush or Close.
+// Flush finishes the stream and waits until it's been written. Close must be invoked to stop the writer goroutine
+func NewGoGZipPipelinedCompressor(output io.Writer, level CompressionLevel, bufferSize uint32, depth int) (io.WriteCloser, error) {
+	return NewGoPipelinedCompressorWithOptions(output, CompressionOptions{Format: CompressionFormatGZip, Level: level}, bufferSize, depth)
+}
+
+// NewGoPipelinedCompressorWithOptions creates a pipelined compressor like NewGoGZipPipelinedCompressor for the format, level, window,
+// memory level and strategy in options. An error is returned if the options are not valid
+func NewGoPipelinedCompressorWithOptions(output io.Writer, options CompressionOptions, bufferSize uint32, depth int) (io.WriteCloser, error) {
+	if depth <= 0 {
+		depth = DefaultPipelineDepth
+	}
+
+	pc := &goPipelinedCompressor{
+		goZLibTransformer: goZLibTransformer{
+			input:       nil,
+			output:      output,
+			transformer: nil,
+		},
+		// one buffer being compressed into and depth buffers being written or waiting to be
+		free:       make(chan []byte, depth+1),
+		full:       make(chan []byte, depth+1),
+		writerDone: make(chan struct{}),
+	}
+
+	err := initCompressionTransformer(&pc.goZLibTransformer, &options, bufferSize)
+	if err != nil {
+		return nil, err
 	}
+
+	pc.current = pc.workBuffer()[:0]
+	for i := 0; i < depth; i++ {
+		pc.free <- make([]byte, 0, cap(pc.current))
+	}
+
+	go pc.writeBuffers()
+
+	return pc, nil
 }
 
-// Acquire acquires a new byte array. For optimal memory utilization use sizes that are power of 2
-// The maximum size of a slice is limited to 4Mb and the returned slice cannot have its capacity changed.
-// The returned slice is not zeroed out and it has length zero but capacity equals to size
-func (nsp *NativeSlicePool) Acquire(size int) []byte {
-	data := C.multipool_mem_acquire(nsp.pool, C.uint32_t(size))
+// Write compresses data into the current output buffer, queueing it to be written as soon as it's full.
+// Returns the number of uncompressed bytes written and the first error that occurred writing previous buffers, if any
+func (pc *goPipelinedCompressor) Write(data []byte) (int, error) {
+	if pc.closed {
+		return 0, fmt.Errorf(wrapErrorFormat, TransformerCompressionError, C.Z_STREAM_ERROR)
+	}
 
-	var slice []byte
-	hdr := (*reflect.SliceHeader)(unsafe.Pointer(&slice))
+	if err := pc.error(); err != nil {
+		return 0, err
+	}
 
-	hdr.Data = uintptr(data)
-	hdr.Len = 0
-	hdr.Cap = int(size)
+	return pc.compress(data, C.Z_NO_FLUSH)
+}
 
-	return slice
+// Flush finishes the compressed stream and waits until all of it was written to the output.
+// It returns the first error that occurred compressing or writing, if any
+func (pc *goPipelinedCompressor) Flush() error {
+	return pc.FlushWith(FlushModeFinish)
 }
 
-// Return returns the slice to the pool.
-func (nsp *NativeSlicePool) Return(slice []byte) {
-	hdr := (*reflect.SliceHeader)(unsafe.Pointer(&slice))
+// FlushWith flushes the data compressed so far with the given mode, like the FlushWith of a compressor,
+// and waits until it was written to the output
+func (pc *goPipelinedCompressor) FlushWith(mode FlushMode) error {
+	if pc.closed {
+		return pc.error()
+	}
+	if !mode.valid() {
+		return fmt.Errorf(wrapErrorFormat, TransformerCompressionError, C.Z_STREAM_ERROR)
+	}
 
-	C.pool_mem_return(unsafe.Pointer(hdr.Data))
+	_, err := pc.compress(nil, C.int(mode))
+	if len(pc.current) > 0 {
+		pc.queueCurrent()
+	}
+	pc.pending.Wait()
+
+	if err != nil {
+		return err
+	}
+	return pc.error()
 }
 
-// Free releases the resources allocated by this pool
-// It must be invoked once the pool is not in use anymore to avoid resource leaks
-func (nsp *NativeSlicePool) Free() {
-	C.multipool_free(nsp.pool)
+// Close flushes the compressor, stops the writer goroutine and releases the compressor resources.
+// Not calling Close will result in a resource leak
+func (pc *goPipelinedCompressor) Close() error {
+	if pc.closed {
+		return pc.error()
+	}
+
+	err := pc.Flush()
+	pc.closed = true
+	close(pc.full)
+	<-pc.writerDone
+
+	C.release_compression_transformer(pc.transformer)
+	pc.transformer = nil
+	return err
+}
+
+// reset waits for the queued buffers to be written before the writer goroutine switches to the new output
+func (pc *goPipelinedCompressor) reset(output io.Writer) {
+	pc.pending.Wait()
+	if pc.current != nil {
+		pc.current = pc.current[:0]
+	}
+
+	pc.errLock.Lock()
+	pc.output = output
+	pc.err = nil
+	pc.errLock.Unlock()
+
+	C.reset_compression_transformer(pc.transformer)
+}
+
+func (pc *goPipelinedCompressor) compress(data []byte, flush C.int) (int, error) {
+	dataLen := len(data)
+	consumed := 0
+	for {
+		if pc.current == nil {
+			// blocks until the writer goroutine gives back a buffer
+			pc.current = <-pc.free
+		}
+
+		var uncompressed unsafe.Pointer = nil
+		if consumed < dataLen {
+			uncompressed = unsafe.Pointer(&data[consumed])
+		}
+
+		used := len(pc.current)
+		outputPtr := unsafe.Pointer(&pc.current[:used+1][used])
+		step := C.transformer_compress_step(pc.transformer, uncompressed, C.uInt(dataLen-consumed), outputPtr, C.uInt(cap(pc.current)-used), flush)
+		if step.status < C.Z_OK {
+			return 0, fmt.Errorf(wrapErrorFormat, TransformerCompressionError, step.status)
+		}
+		consumed += int(step.consumed)
+		pc.current = pc.current[:used+int(step.produced)]
+
+		if len(pc.current) == cap(pc.current) {
+			pc.queueCurrent()
+		}
+
+		if step.status != C.GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA {
+			return dataLen, nil
+		}
+	}
+}
+
+func (pc *goPipelinedCompressor) queueCurrent() {
+	pc.pending.Add(1)
+	pc.full <- pc.current
+	pc.current = nil
+}
+
+// writeBuffers writes the full buffers in order and gives them back, even after an error so that compression never blocks
+func (pc *goPipelinedCompressor) writeBuffers() {
+	defer close(pc.writerDone)
+
+	for buffer := range pc.full {
+		// the error is cleared when the compressor is reset
+		if pc.error() == nil {
+			if _, err := pc.output.Write(buffer); err != nil {
+				pc.setError(err)
+			}
+		}
+
+		pc.free <- buffer[:0]
+		pc.pending.Done()
+	}
+}
+
+func (pc *goPipelinedCompressor) setError(err error) {
+	pc.errLock.Lock()
+	defer pc.errLock.Unlock()
+
+	if pc.err == nil {
+		pc.err = err
+	}
+}
+
+func (pc *goPipelinedCompressor) error() error {
+	pc.errLock.Lock()
+	defer pc.errLock.Unlock()
+
+	return pc.err
+}
+
+// Flush coalescing
+
+// goCoalescingCompressor flushes the messages written to a compressor in batches, at most latency after the first
+// message of each batch, so that the stream stays open and each batch costs a single flush marker
+type goCoalescingCompressor struct {
+	lock       sync.Mutex
+	compressor *goGZipCompressor
+	mode       FlushMode
+	latency    time.Duration
+	timer      *time.Timer
+	// set while there is data written since the last flush
+	pending bool
+	closed  bool
+	err     error
+}
+
+// NewGoCoalescingCompressor creates a compressor for long lived streams, such as server-sent events or websocket messages,
+// where each message must reach the peer without ending the stream. Every write is flushed with mode, FlushModeSync,
+// FlushModePartial or FlushModeFull, at most latency after it was made. Writes made within the latency of the first one are
+// flushed together, keeping the output and the number of output writes small. With a zero latency each write is flushed
+// right away. Flushes triggered by the latency write to the output from another goroutine, never concurrently with the
+// compressor methods, and their errors are returned by the following Write, FlushWith or Close.
+// Close ends the stream and must be invoked to release its resources
+func NewGoCoalescingCompressor(output io.Writer, options CompressionOptions, bufferSize uint32, mode FlushMode, latency time.Duration) (io.WriteCloser, error) {
+	if !mode.valid() || mode == FlushModeFinish || latency < 0 {
+		return nil, InvalidCompressionOptionsError
+	}
+
+	compressor, err := NewGoCompressorWithOptions(output, options, bufferSize)
+	if err != nil {
+		return nil, err
+	}
+
+	return &goCoalescingCompressor{
+		compressor: compressor.(*goGZipCompressor),
+		mode:       mode,
+		latency:    latency,
+	}, nil
+}
+
+// Write compresses data, which is flushed along with any other data written within the latency of the current batch.
+// Writing no data does nothing
+func (cc *goCoalescingCompressor) Write(data []byte) (int, error) {
+	cc.lock.Lock()
+	defer cc.lock.Unlock()
+
+	if cc.closed {
+		return 0, fmt.Errorf(wrapErrorFormat, TransformerCompressionError, C.Z_STREAM_ERROR)
+	}
+	if cc.err != nil {
+		return 0, cc.err
+	}
+	if len(data) == 0 {
+		return 0, nil
+	}
+
+	written, err := cc.compressor.compress(data, C.Z_NO_FLUSH)
+	if err != nil {
+		cc.err = err
+		return 0, err
+	}
+
+	if cc.latency == 0 {
+		return written, cc.flush(cc.mode)
+	}
+
+	// the first write of a batch sets its deadline
+	if !cc.pending {
+		cc.pending = true
+		if cc.timer == nil {
+			cc.timer = time.AfterFunc(cc.latency, cc.flushBatch)
+		} else {
+			cc.timer.Reset(cc.latency)
+		}
+	}
+
+	return written, nil
+}
+
+// Flush ends the stream, writing any pending data. The compressor can't be written to after that
+func (cc *goCoalescingCompressor) Flush() error {
+	return cc.FlushWith(FlushModeFinish)
+}
+
+// FlushWith flushes the current batch right away with the given mode. FlushModeFinish ends the stream,
+// the compressor can't be written to after that
+func (cc *goCoalescingCompressor) FlushWith(mode FlushMode) error {
+	cc.lock.Lock()
+	defer cc.lock.Unlock()
+
+	if cc.closed {
+		return fmt.Errorf(wrapErrorFormat, TransformerCompressionError, C.Z_STREAM_ERROR)
+	}
+	if cc.err != nil {
+		return cc.err
+	}
+	if !mode.valid() {
+		return fmt.Errorf(wrapErrorFormat, TransformerCompressionError, C.Z_STREAM_ERROR)
+	}
+
+	err := cc.flush(mode)
+	if mode == FlushModeFinish && err == nil {
+		cc.closed = true
+		cc.compressor.release()
+	}
+	return err
+}
+
+// Close ends the stream, writing any pending data, and releases the compressor
+func (cc *goCoalescingCompressor) Close() error {
+	cc.lock.Lock()
+	defer cc.lock.Unlock()
+
+	if cc.closed {
+		return cc.err
+	}
+	cc.closed = true
+	if cc.timer != nil {
+		cc.timer.Stop()
+	}
+
+	err := cc.compressor.Close()
+	if cc.err == nil {
+		cc.err = err
+	}
+	return cc.err
+}
+
+func (cc *goCoalescingCompressor) reset(output io.Writer) {
+	cc.lock.Lock()
+	defer cc.lock.Unlock()
+
+	cc.pending = false
+	if cc.timer != nil {
+		cc.timer.Stop()
+	}
+	cc.err = nil
+	cc.compressor.reset(output)
+}
+
+func (cc *goCoalescingCompressor) zlibTransformer() *goZLibTransformer {
+	return &cc.compressor.goZLibTransformer
+}
+
+// flushBatch is invoked by the timer once the latency of the current batch expired
+func (cc *goCoalescingCompressor) flushBatch() {
+	cc.lock.Lock()
+	defer cc.lock.Unlock()
+
+	// the batch may have been flushed or the compressor closed while the timer fired
+	if cc.pending && !cc.closed && cc.err == nil {
+		_ = cc.flush(cc.mode)
+	}
+}
+
+func (cc *goCoalescingCompressor) flush(mode FlushMode) error {
+	cc.pending = false
+	if cc.timer != nil {
+		cc.timer.Stop()
+	}
+
+	_, err := cc.compressor.compress(nil, C.int(mode))
+	if err != nil {
+		cc.err = err
+	}
+	return err
+}
+
+// Parking
+
+// transformerStateSize is a rough upper bound of the deflate and inflate state structures, besides their window and hash tables
+const transformerStateSize = 8 * 1024
+
+// transformerFootprint estimates the native memory held by an active transformer from the memory usage documented for
+// deflateInit2 and inflateInit2, plus its work buffer
+func transformerFootprint(deflating bool, windowBits C.int, memLevel C.int, bufferSize uint32) int64 {
+	if windowBits < 0 {
+		windowBits = -windowBits
+	}
+	windowBits &= 15
+
+	footprint := int64(transformerStateSize) + int64(bufferSize)
+	if deflating {
+		return footprint + int64(1)<<(windowBits+2) + int64(1)<<(memLevel+9)
+	}
+	return footprint + int64(1)<<windowBits
+}
+
+// MemoryBudget caps the native memory held by the parking compressors and uncompressors sharing it.
+// Active transformers reserve their estimated footprint and parked ones only the history window they keep.
+// Creating or unparking a transformer blocks while it would exceed the limit, until other transformers are parked or closed.
+// A single transformer larger than the limit is let through once nothing else is reserved
+type MemoryBudget struct {
+	lock  sync.Mutex
+	freed *sync.Cond
+	limit int64
+	used  int64
+}
+
+// NewMemoryBudget creates a budget of limit bytes
+func NewMemoryBudget(limit int64) *MemoryBudget {
+	budget := &MemoryBudget{limit: limit}
+	budget.freed = sync.NewCond(&budget.lock)
+	return budget
+}
+
+// Used returns the number of bytes currently reserved
+func (budget *MemoryBudget) Used() int64 {
+	budget.lock.Lock()
+	defer budget.lock.Unlock()
+
+	return budget.used
+}
+
+// reserve grows a reservation of held bytes to size bytes. The held bytes only count towards the limit of others,
+// so a transformer never waits for memory it holds itself
+func (budget *MemoryBudget) reserve(size int64, held int64) {
+	if budget == nil || size <= held {
+		return
+	}
+
+	budget.lock.Lock()
+	defer budget.lock.Unlock()
+
+	for budget.used > held && budget.used-held+size > budget.limit {
+		budget.freed.Wait()
+	}
+	budget.used += size - held
+}
+
+func (budget *MemoryBudget) release(size int64) {
+	if budget == nil || size <= 0 {
+		return
+	}
+
+	budget.lock.Lock()
+	budget.used -= size
+	budget.lock.Unlock()
+	budget.freed.Broadcast()
+}
+
+// ParkingOptions configures when the transformers created by NewGoParkingCompressor and NewGoParkingUncompressor are parked
+type ParkingOptions struct {
+	// IdleTime is how long a transformer must go unused before it's parked. Zero parks it right after every call that leaves it parkable
+	IdleTime time.Duration
+	// Budget is the memory budget shared with other parking transformers, nil for no limit
+	Budget *MemoryBudget
+}
+
+// transformerParker parks the transformer of a parking compressor or uncompressor once it's idle and unparks it on use.
+// The compressor or uncompressor methods and the idle timer serialize on lock
+type transformerParker struct {
+	lock        sync.Mutex
+	options     ParkingOptions
+	transformer *goZLibTransformer
+	// the estimated footprint reserved while active and the memory currently reserved
+	footprint int64
+	reserved  int64
+	timer     *time.Timer
+	lastUse   time.Time
+}
+
+func (parker *transformerParker) init(transformer *goZLibTransformer, options ParkingOptions, footprint int64) {
+	parker.options = options
+	parker.transformer = transformer
+	parker.footprint = footprint
+}
+
+// unpark acquires a context for a parked transformer, waiting for the memory budget if needed
+func (parker *transformerParker) unpark() error {
+	transformer := parker.transformer.transformer
+	if !bool(transformer.parked) {
+		return nil
+	}
+
+	budget := parker.options.Budget
+	budget.reserve(parker.footprint, parker.reserved)
+	if code := C.unpark_transformer(transformer); code != C.Z_OK {
+		budget.release(parker.footprint - parker.reserved)
+		return fmt.Errorf(wrapErrorFormat, TransformerInitializationError, code)
+	}
+	parker.reserved = parker.footprint
+	return nil
+}
+
+// used parks the transformer or schedules it to be parked once it's been idle long enough
+func (parker *transformerParker) used() {
+	if parker.options.IdleTime == 0 {
+		parker.park()
+		return
+	}
+
+	parker.lastUse = time.Now()
+	if parker.timer == nil {
+		parker.timer = time.AfterFunc(parker.options.IdleTime, parker.parkIdle)
+	} else {
+		parker.timer.Reset(parker.options.IdleTime)
+	}
+}
+
+// park tries to park the transformer, which stays active if it's not at a point where it can be parked
+func (parker *transformerParker) park() {
+	if !bool(C.park_transformer(parker.transformer.transformer)) {
+		return
+	}
+
+	window := int64(parker.transformer.transformer.parked_window_len)
+	parker.options.Budget.release(parker.reserved - window)
+	parker.reserved = window
+}
+
+func (parker *transformerParker) parkIdle() {
+	parker.lock.Lock()
+	defer parker.lock.Unlock()
+
+	if parker.transformer.transformer == nil {
+		return
+	}
+	// used again since the timer fired
+	if idle := time.Since(parker.lastUse); idle < parker.options.IdleTime {
+		parker.timer.Reset(parker.options.IdleTime - idle)
+		return
+	}
+	parker.park()
+}
+
+// close returns the reserved memory, the transformer must be released by the caller
+func (parker *transformerParker) close() {
+	if parker.timer != nil {
+		parker.timer.Stop()
+	}
+	parker.options.Budget.release(parker.reserved)
+	parker.reserved = 0
+}
+
+// goParkingCompressor is a compressor whose transformer is parked while idle
+type goParkingCompressor struct {
+	goGZipCompressor
+	parker transformerParker
+	// set once Flush ended the stream, until data is written again
+	ended bool
+}
+
+// NewGoParkingCompressor creates a compressor like NewGoCompressorWithOptions for streams that are idle most of the time,
+// such as websocket connections. Once idle, its deflate state goes back to the native pools and its work buffer is freed,
+// so memory is only held by the streams in use. Parking happens when the stream can be resumed by a new deflate state:
+// before anything is written, after Flush and, for raw deflate streams, after FlushWith with FlushModeSync or
+// FlushModeFull, keeping the last window of data so that the following messages still reference it.
+// Flush ends the stream, the next write starts a new one, and Close must be invoked to release the compressor.
+// With a budget in parking, the compressor is created and unparked only when its estimated footprint fits in it
+func NewGoParkingCompressor(output io.Writer, options CompressionOptions, bufferSize uint32, parking ParkingOptions) (io.WriteCloser, error) {
+	if parking.IdleTime < 0 {
+		return nil, InvalidCompressionOptionsError
+	}
+	_, windowBits, memLevel, _, err := options.deflateParameters()
+	if err != nil {
+		return nil, err
+	}
+
+	footprint := transformerFootprint(true, windowBits, memLevel, bufferSize)
+	parking.Budget.reserve(footprint, 0)
+
+	pc := &goParkingCompressor{}
+	pc.output = output
+	if err := initCompressionTransformer(&pc.goZLibTransformer, &options, bufferSize); err != nil {
+		parking.Budget.release(footprint)
+		return nil, err
+	}
+
+	pc.parker.init(&pc.goZLibTransformer, parking, footprint)
+	pc.parker.reserved = footprint
+	pc.parker.used()
+	return pc, nil
+}
+
+// Write compresses data, unparking the compressor if needed. Writing no data does nothing
+func (pc *goParkingCompressor) Write(data []byte) (int, error) {
+	pc.parker.lock.Lock()
+	defer pc.parker.lock.Unlock()
+
+	if pc.transformer == nil {
+		return 0, fmt.Errorf(wrapErrorFormat, TransformerCompressionError, C.Z_STREAM_ERROR)
+	}
+	if len(data) == 0 {
+		return 0, nil
+	}
+	if err := pc.parker.unpark(); err != nil {
+		return 0, err
+	}
+	defer pc.parker.used()
+
+	pc.ended = false
+	return pc.compress(data, C.Z_NO_FLUSH)
+}
+
+// Flush ends the stream and resets the compressor, the next write starts a new stream
+func (pc *goParkingCompressor) Flush() error {
+	return pc.FlushWith(FlushModeFinish)
+}
+
+// FlushWith flushes the data written so far with the given mode, like the FlushWith of a compressor.
+// FlushModeFinish ends the stream like Flush
+func (pc *goParkingCompressor) FlushWith(mode FlushMode) error {
+	pc.parker.lock.Lock()
+	defer pc.parker.lock.Unlock()
+
+	if pc.transformer == nil || !mode.valid() {
+		return fmt.Errorf(wrapErrorFormat, TransformerCompressionError, C.Z_STREAM_ERROR)
+	}
+	if err := pc.parker.unpark(); err != nil {
+		return err
+	}
+	defer pc.parker.used()
+
+	if _, err := pc.compress(nil, C.int(mode)); err != nil {
+		return err
+	}
+	if mode == FlushModeFinish {
+		C.reset_compression_transformer(pc.transformer)
+		pc.ended = true
+	}
+	return nil
+}
+
+// Close ends the stream, unless Flush just did, and releases the compressor
+func (pc *goParkingCompressor) Close() error {
+	pc.parker.lock.Lock()
+	defer pc.parker.lock.Unlock()
+
+	if pc.transformer == nil {
+		return nil
+	}
+	defer pc.parker.close()
+
+	if pc.ended {
+		pc.release()
+		return nil
+	}
+	if err := pc.parker.unpark(); err != nil {
+		pc.release()
+		return err
+	}
+	return pc.goGZipCompressor.Close()
+}
+
+// reset drops the stream, a parked compressor also drops the window it kept
+func (pc *goParkingCompressor) reset(output io.Writer) {
+	pc.parker.lock.Lock()
+	defer pc.parker.lock.Unlock()
+
+	pc.ended = false
+	pc.goGZipCompressor.reset(output)
+}
+
+// goParkingUncompressor is an uncompressor whose transformer is parked while idle
+type goParkingUncompressor struct {
+	goUncompressor
+	parker transformerParker
+}
+
+// NewGoParkingUncompressor creates an uncompressor like NewGoUncompressorWithOptions whose inflate state goes back to the
+// native pools and whose work buffer is freed while idle, see NewGoParkingCompressor. It's parked before the first read and,
+// for raw deflate streams, when a read consumed all the input read so far at the end of a flushed block, as written by
+// FlushWith with FlushModeSync or FlushModeFull
+func NewGoParkingUncompressor(input io.Reader, options UncompressionOptions, bufferSize uint32, parking ParkingOptions) (io.ReadCloser, error) {
+	if parking.IdleTime < 0 {
+		return nil, InvalidCompressionOptionsError
+	}
+	windowBits, err := zlibWindowBits(options.Format, options.WindowBits, true)
+	if err != nil {
+		return nil, err
+	}
+
+	footprint := transformerFootprint(false, windowBits, 0, bufferSize)
+	parking.Budget.reserve(footprint, 0)
+
+	pu := &goParkingUncompressor{}
+	pu.input = input
+	if err := initUncompressionTransformer(&pu.goZLibTransformer, &options, bufferSize); err != nil {
+		parking.Budget.release(footprint)
+		return nil, err
+	}
+
+	pu.parker.init(&pu.goZLibTransformer, parking, footprint)
+	pu.parker.reserved = footprint
+	pu.parker.used()
+	return pu, nil
+}
+
+// Read uncompresses data like the Read of an uncompressor, unparking it if needed
+func (pu *goParkingUncompressor) Read(output []byte) (int, error) {
+	pu.parker.lock.Lock()
+	defer pu.parker.lock.Unlock()
+
+	if pu.transformer == nil {
+		return 0, fmt.Errorf(wrapErrorFormat, TransformerUncompressionError, C.Z_STREAM_ERROR)
+	}
+	if err := pu.parker.unpark(); err != nil {
+		return 0, err
+	}
+	defer pu.parker.used()
+
+	read, err := pu.goUncompressor.Read(output)
+	// a full output that ended a flushed block leaves nothing to uncompress until more input is read
+	if pu.hasMoreData && bool(pu.transformer.at_boundary) {
+		pu.hasMoreData = false
+	}
+	return read, err
+}
+
+// Close releases the uncompressor
+func (pu *goParkingUncompressor) Close() error {
+	pu.parker.lock.Lock()
+	defer pu.parker.lock.Unlock()
+
+	if pu.transformer == nil {
+		return nil
+	}
+	pu.parker.close()
+	return pu.goUncompressor.Close()
+}
+
+func (pu *goParkingUncompressor) reset(input io.Reader) {
+	pu.parker.lock.Lock()
+	defer pu.parker.lock.Unlock()
+
+	pu.goUncompressor.reset(input)
+}
+
+// Parallel gzip compression
+
+const (
+	// DefaultParallelBlockSize is the size of the blocks compressed independently by a parallel compressor, unless specified otherwise
+	DefaultParallelBlockSize = 128 * 1024
+
+	// maximum amount of data from the previous block used as dictionary, the size of the deflate window
+	parallelDictionarySize = 32 * 1024
+
+	gzipHeaderOSUnix = 3
+)
+
+// parallelBlock is a block of input compressed by one of the parallel compressor workers
+type parallelBlock struct {
+	input      []byte
+	dictionary []byte
+	output     []byte
+	last       bool
+	crc        uint32
+	err        error
+	done       chan struct{}
+}
+
+type goGZipParallelCompressor struct {
+	output    io.Writer
+	level     CompressionLevel
+	blockSize int
+
+	pending       []byte
+	previousInput []byte
+	closed        bool
+
+	jobs          chan *parallelBlock
+	ordered       chan *parallelBlock
+	inputBuffers  chan []byte
+	outputBuffers chan []byte
+	workersDone   sync.WaitGroup
+	writerDone    chan struct{}
+
+	errLock sync.Mutex
+	err     error
+}
+
+// NewGoGZipParallelCompressor creates a gzip compressor that splits its input in blocks of blockSize bytes, compressing them
+// concurrently on workers goroutines. Each block uses the end of the previous one as dictionary and the output is a single
+// gzip member, readable by any gzip decoder.
+// The level parameter specifies the compression level. It can be set to CompressionLevelBestCompression or CompressionLevelBestSpeed
+// If workers is zero or negative, runtime.NumCPU() workers are used. If blockSize is zero or negative, DefaultParallelBlockSize is used.
+// Returns an io.WriteCloser for writing compressed data and an error, if any. Close must be invoked to write the end of the gzip stream
+func NewGoGZipParallelCompressor(output io.Writer, level CompressionLevel, workers int, blockSize int) (io.WriteCloser, error) {
+	if level < C.Z_DEFAULT_COMPRESSION || level > C.Z_BEST_COMPRESSION {
+		return nil, fmt.Errorf(wrapErrorFormat, TransformerInitializationError, C.Z_STREAM_ERROR)
+	}
+
+	if workers <= 0 {
+		workers = runtime.NumCPU()
+	}
+
+	if blockSize <= 0 {
+		blockSize = DefaultParallelBlockSize
+	}
+
+	// enough blocks in flight to keep all workers busy while the output is written
+	inFlight := workers * 2
+	pc := &goGZipParallelCompressor{
+		output:        output,
+		level:         level,
+		blockSize:     blockSize,
+		jobs:          make(chan *parallelBlock, inFlight),
+		ordered:       make(chan *parallelBlock, inFlight),
+		inputBuffers:  make(chan []byte, inFlight+2),
+		outputBuffers: make(chan []byte, inFlight),
+		writerDone:    make(chan struct{}),
+	}
+	pc.pending = pc.acquireInputBuffer()
+
+	pc.workersDone.Add(workers)
+	for i := 0; i < workers; i++ {
+		go pc.compressBlocks()
+	}
+	go pc.writeBlocks()
+
+	return pc, nil
+}
+
+// Write buffers data in blocks, submitting full blocks to be compressed. Returns the number of uncompressed bytes written,
+// and the first error that occurred compressing or writing previous blocks, if any.
+func (pc *goGZipParallelCompressor) Write(data []byte) (int, error) {
+	if pc.closed {
+		return 0, fmt.Errorf(wrapErrorFormat, ParallelCompressionError, C.Z_STREAM_ERROR)
+	}
+
+	if err := pc.error(); err != nil {
+		return 0, err
+	}
+
+	written := 0
+	for len(data) > 0 {
+		// a full block is only submitted once more data arrives, the last block must be submitted by Close
+		if len(pc.pending) == pc.blockSize {
+			pc.submitBlock(false)
+		}
+
+		copied := copy(pc.pending[len(pc.pending):pc.blockSize], data)
+		pc.pending = pc.pending[:len(pc.pending)+copied]
+		data = data[copied:]
+		written += copied
+	}
+
+	return written, nil
+}
+
+// Close compresses the remaining data, writes the end of the gzip stream and stops the workers.
+// It returns the first error that occurred compressing or writing, if any.
+func (pc *goGZipParallelCompressor) Close() error {
+	if pc.closed {
+		return pc.error()
+	}
+	pc.closed = true
+
+	pc.submitBlock(true)
+	close(pc.jobs)
+	close(pc.ordered)
+
+	pc.workersDone.Wait()
+	<-pc.writerDone
+
+	return pc.error()
+}
+
+func (pc *goGZipParallelCompressor) submitBlock(last bool) {
+	block := &parallelBlock{
+		input: pc.pending,
+		last:  last,
+		done:  make(chan struct{}),
+	}
+
+	if pc.previousInput != nil {
+		dictionaryStart := len(pc.previousInput) - parallelDictionarySize
+		if dictionaryStart < 0 {
+			dictionaryStart = 0
+		}
+		block.dictionary = pc.previousInput[dictionaryStart:]
+	}
+
+	pc.previousInput = pc.pending
+	if !last {
+		pc.pending = pc.acquireInputBuffer()
+	}
+
+	// ordered bounds the number of blocks in flight
+	pc.ordered <- block
+	pc.jobs <- block
+}
+
+func (pc *goGZipParallelCompressor) compressBlocks() {
+	defer pc.workersDone.Done()
+
+	for block := range pc.jobs {
+		block.compress(pc.level, pc.acquireOutputBuffer())
+		close(block.done)
+	}
+}
+
+func (block *parallelBlock) compress(level CompressionLevel, output []byte) {
+	bound := int(C.deflate_raw_block_bound(C.uLong(len(block.input))))
+	if cap(output) < bound {
+		output = make([]byte, bound)
+	}
+	output = output[:bound]
+
+	var inputPtr unsafe.Pointer = nil
+	if len(block.input) > 0 {
+		inputPtr = unsafe.Pointer(&block.input[0])
+	}
+
+	var dictionaryPtr unsafe.Pointer = nil
+	if len(block.dictionary) > 0 {
+		dictionaryPtr = unsafe.Pointer(&block.dictionary[0])
+	}
+
+	var errorCode C.int = C.Z_OK
+	var crc C.uLong = 0
+	compLen := C.deflate_raw_block(C.int(level), dictionaryPtr, C.uInt(len(block.dictionary)), inputPtr, C.uInt(len(block.input)),
+		unsafe.Pointer(&output[0]), C.uInt(bound), C.bool(block.last), &crc, &errorCode)
+
+	if errorCode != C.Z_OK {
+		block.err = fmt.Errorf(wrapErrorFormat, ParallelCompressionError, errorCode)
+		return
+	}
+
+	block.output = output[:compLen]
+	block.crc = uint32(crc)
+}
+
+// writeBlocks writes compressed blocks in order, combining their checksums into the gzip trailer
+func (pc *goGZipParallelCompressor) writeBlocks() {
+	defer close(pc.writerDone)
+
+	var crc C.uLong = 0
+	var size uint32 = 0
+	var previous *parallelBlock = nil
+
+	err := pc.writeHeader()
+	for block := range pc.ordered {
+		<-block.done
+
+		if err == nil {
+			err = block.err
+		}
+
+		if err == nil {
+			_, err = pc.output.Write(block.output)
+			crc = C.crc32_combine(crc, C.uLong(block.crc), C.z_off_t(len(block.input)))
+			size += uint32(len(block.input))
+		}
+
+		if err != nil {
+			pc.setError(err)
+		}
+
+		// the previous block input was the dictionary of this one and it's not needed anymore
+		if previous != nil {
+			pc.releaseBuffers(previous)
+		}
+		previous = block
+	}
+
+	if err == nil {
+		var trailer [8]byte
+		binary.LittleEndian.PutUint32(trailer[0:4], uint32(crc))
+		binary.LittleEndian.PutUint32(trailer[4:8], size)
+		if _, err = pc.output.Write(trailer[:]); err != nil {
+			pc.setError(err)
+		}
+	}
+}
+
+func (pc *goGZipParallelCompressor) writeHeader() error {
+	var extraFlags byte = 0
+	switch pc.level {
+	case CompressionLevelBestCompression:
+		extraFlags = 2
+	case CompressionLevelBestSpeed:
+		extraFlags = 4
+	}
+
+	header := [10]byte{0x1f, 0x8b, 8, 0, 0, 0, 0, 0, extraFlags, gzipHeaderOSUnix}
+	_, err := pc.output.Write(header[:])
+	return err
+}
+
+func (pc *goGZipParallelCompressor) acquireInputBuffer() []byte {
+	select {
+	case buffer := <-pc.inputBuffers:
+		return buffer[:0]
+	default:
+		return make([]byte, 0, pc.blockSize)
+	}
+}
+
+func (pc *goGZipParallelCompressor) acquireOutputBuffer() []byte {
+	select {
+	case buffer := <-pc.outputBuffers:
+		return buffer
+	default:
+		return nil
+	}
+}
+
+func (pc *goGZipParallelCompressor) releaseBuffers(block *parallelBlock) {
+	select {
+	case pc.inputBuffers <- block.input:
+	default:
+	}
+
+	if block.output != nil {
+		select {
+		case pc.outputBuffers <- block.output:
+		default:
+		}
+	}
+}
+
+func (pc *goGZipParallelCompressor) setError(err error) {
+	pc.errLock.Lock()
+	defer pc.errLock.Unlock()
+
+	if pc.err == nil {
+		pc.err = err
+	}
+}
+
+func (pc *goGZipParallelCompressor) error() error {
+	pc.errLock.Lock()
+	defer pc.errLock.Unlock()
+
+	return pc.err
+}
+
+// Checksums
+
+// CRC32 updates crc with the IEEE CRC32 checksum of data, the same as hash/crc32 for an initial crc of zero.
+// It is hardware accelerated when built with the libdeflate tag or when running with zlib-ng
+func CRC32(crc uint32, data []byte) uint32 {
+	if len(data) == 0 {
+		return crc
+	}
+	return uint32(C.checksum_crc32(C.uLong(crc), unsafe.Pointer(&data[0]), C.size_t(len(data))))
+}
+
+// Adler32 updates adler with the Adler32 checksum of data, the same as hash/adler32 for an initial adler of one
+func Adler32(adler uint32, data []byte) uint32 {
+	if len(data) == 0 {
+		return adler
+	}
+	return uint32(C.checksum_adler32(C.uLong(adler), unsafe.Pointer(&data[0]), C.size_t(len(data))))
+}
+
+// CRC32Combine returns the CRC32 of two consecutive chunks of data given the checksum of each one and the length of the second one,
+// allowing chunks to be checksummed in parallel
+func CRC32Combine(crc1 uint32, crc2 uint32, len2 int64) uint32 {
+	return uint32(C.crc32_combine(C.uLong(crc1), C.uLong(crc2), C.z_off_t(len2)))
+}
+
+// Adler32Combine returns the Adler32 of two consecutive chunks of data like CRC32Combine
+func Adler32Combine(adler1 uint32, adler2 uint32, len2 int64) uint32 {
+	return uint32(C.adler32_combine(C.uLong(adler1), C.uLong(adler2), C.z_off_t(len2)))
+}
+
+type checksum32 struct {
+	initial uint32
+	value   uint32
+	update  func(uint32, []byte) uint32
+}
+
+// NewCRC32 returns a hash.Hash32 computing the IEEE CRC32 checksum with CRC32
+func NewCRC32() hash.Hash32 {
+	return &checksum32{initial: 0, value: 0, update: CRC32}
+}
+
+// NewAdler32 returns a hash.Hash32 computing the Adler32 checksum with Adler32
+func NewAdler32() hash.Hash32 {
+	return &checksum32{initial: 1, value: 1, update: Adler32}
+}
+
+func (checksum *checksum32) Write(data []byte) (int, error) {
+	checksum.value = checksum.update(checksum.value, data)
+	return len(data), nil
+}
+
+// Sum appends the checksum in big endian order, like the standard library checksums
+func (checksum *checksum32) Sum(data []byte) []byte {
+	return binary.BigEndian.AppendUint32(data, checksum.value)
+}
+
+func (checksum *checksum32) Reset() {
+	checksum.value = checksum.initial
+}
+
+func (checksum *checksum32) Size() int {
+	return 4
+}
+
+func (checksum *checksum32) BlockSize() int {
+	return 1
+}
+
+func (checksum *checksum32) Sum32() uint32 {
+	return checksum.value
+}
+
+// Stored gzip
+
+const (
+	storedBlockMaxLen    = 65535
+	storedBlockHeaderLen = 5
+)
+
+type goGZipStoredWriter struct {
+	output        io.Writer
+	crc           uint32
+	size          uint32
+	headerWritten bool
+	closed        bool
+	blockHeader   [storedBlockHeaderLen]byte
+}
+
+// NewGoGZipStoredWriter creates a writer producing a valid gzip stream of stored deflate blocks, for data known not to compress.
+// Nothing is deflated or copied: each write is sent to output as is, following a 5 byte block header, and only its CRC32 is computed.
+// Close must be invoked to write the end of the gzip stream
+func NewGoGZipStoredWriter(output io.Writer) io.WriteCloser {
+	return &goGZipStoredWriter{output: output}
+}
+
+// Write writes data as one or more non final stored blocks
+func (sw *goGZipStoredWriter) Write(data []byte) (int, error) {
+	if sw.closed {
+		return 0, fmt.Errorf(wrapErrorFormat, TransformerCompressionError, C.Z_STREAM_ERROR)
+	}
+	if err := sw.writeHeader(); err != nil {
+		return 0, err
+	}
+
+	written := 0
+	for len(data) > 0 {
+		block := data
+		if len(block) > storedBlockMaxLen {
+			block = block[:storedBlockMaxLen]
+		}
+
+		if err := sw.writeBlock(block, false); err != nil {
+			return written, err
+		}
+		sw.crc = CRC32(sw.crc, block)
+		sw.size += uint32(len(block))
+		written += len(block)
+		data = data[len(block):]
+	}
+
+	return written, nil
+}
+
+// Close writes an empty final stored block and the gzip trailer
+func (sw *goGZipStoredWriter) Close() error {
+	if sw.closed {
+		return nil
+	}
+	sw.closed = true
+
+	if err := sw.writeHeader(); err != nil {
+		return err
+	}
+	if err := sw.writeBlock(nil, true); err != nil {
+		return err
+	}
+
+	var trailer [8]byte
+	binary.LittleEndian.PutUint32(trailer[0:4], sw.crc)
+	binary.LittleEndian.PutUint32(trailer[4:8], sw.size)
+	_, err := sw.output.Write(trailer[:])
+	return err
+}
+
+func (sw *goGZipStoredWriter) writeHeader() error {
+	if sw.headerWritten {
+		return nil
+	}
+	sw.headerWritten = true
+
+	header := [10]byte{0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, gzipHeaderOSUnix}
+	_, err := sw.output.Write(header[:])
+	return err
+}
+
+func (sw *goGZipStoredWriter) writeBlock(block []byte, last bool) error {
+	sw.blockHeader[0] = 0
+	if last {
+		sw.blockHeader[0] = 1
+	}
+	binary.LittleEndian.PutUint16(sw.blockHeader[1:3], uint16(len(block)))
+	binary.LittleEndian.PutUint16(sw.blockHeader[3:5], ^uint16(len(block)))
+
+	if _, err := sw.output.Write(sw.blockHeader[:]); err != nil {
+		return err
+	}
+	if len(block) > 0 {
+		if _, err := sw.output.Write(block); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// Buffer to buffer operations
+
+// bufferPointers returns the C pointers and sizes for a pair of input and output buffers.
+// The whole input length is used while the output can be filled up to its capacity
+func bufferPointers(input []byte, output []byte) (unsafe.Pointer, C.uInt, unsafe.Pointer, C.uInt, error) {
+	inputLen := len(input)
+	outputCap := cap(output)
+	if outputCap == 0 {
+		return nil, 0, nil, 0, OutputBufferTooSmallError
+	}
+
+	var inputPtr unsafe.Pointer = nil
+	if inputLen > 0 {
+		inputPtr = unsafe.Pointer(&input[0])
+	}
+
+	outputHdr := (*reflect.SliceHeader)(unsafe.Pointer(&output))
+	outputPtr := unsafe.Pointer(outputHdr.Data)
+
+	return inputPtr, C.uInt(inputLen), outputPtr, C.uInt(outputCap), nil
+}
+
+// GoGZipCompressVector compresses the concatenation of the input segments into output in gzip format, like GoGZipCompressBuffer
+// without first copying the segments into a contiguous buffer: each segment is fed to zlib in turn within a single cgo call.
+// Returns the compressed length and an error if the output is too small
+func GoGZipCompressVector(level CompressionLevel, input [][]byte, output []byte) (uint64, error) {
+	outputs := [][]byte{output}
+	return GoCompressVectorWithOptions(CompressionOptions{Format: CompressionFormatGZip, Level: level}, input, outputs)
+}
+
+// GoCompressVectorWithOptions compresses the concatenation of the input segments into the chain of output buffers with the format,
+// level, window, memory level and strategy in options. Output buffers, for instance acquired from a NativeSlicePool, are filled up to their
+// capacity in order and the length of each one is set to the compressed bytes it holds, zero for the buffers left unused.
+// Vectors are always compressed with zlib, regardless of the buffer backend, and options.Adaptive is not supported.
+// Returns the total compressed length and an error if the output buffers are too small
+func GoCompressVectorWithOptions(options CompressionOptions, input [][]byte, output [][]byte) (uint64, error) {
+	if options.Adaptive {
+		return 0, InvalidCompressionOptionsError
+	}
+
+	level, windowBits, memLevel, strategy, err := options.deflateParameters()
+	if err != nil {
+		return 0, err
+	}
+
+	if len(output) == 0 {
+		return 0, OutputBufferTooSmallError
+	}
+
+	// buffer addresses are passed as integers, the buffers are kept alive until the call returns, see cgoEscape
+	cgoEscape(input)
+	cgoEscape(output)
+	segments := make([]C.GoZLibSegment, len(input)+len(output))
+	for i, data := range input {
+		if len(data) > 0 {
+			segments[i].data = C.uintptr_t(uintptr(unsafe.Pointer(&data[0])))
+			segments[i].len = C.uInt(len(data))
+		}
+	}
+
+	outputSegments := segments[len(input):]
+	for i, data := range output {
+		if cap(data) > 0 {
+			outputSegments[i].data = C.uintptr_t(uintptr(unsafe.Pointer(&data[:1][0])))
+			outputSegments[i].len = C.uInt(cap(data))
+		}
+	}
+
+	var inputSegments *C.GoZLibSegment = nil
+	if len(input) > 0 {
+		inputSegments = &segments[0]
+	}
+
+	result := C.go_deflate_compress_vector(level, windowBits, memLevel, strategy, inputSegments, C.uInt(len(input)), &outputSegments[0], C.uInt(len(output)))
+	runtime.KeepAlive(input)
+	runtime.KeepAlive(output)
+
+	if result.error_code != C.Z_OK {
+		return 0, fmt.Errorf(wrapErrorFormat, BufferCompressError, result.error_code)
+	}
+
+	for i := range output {
+		output[i] = output[i][:outputSegments[i].len]
+	}
+
+	return uint64(result.len), nil
+}
+
+// BufferBackend is the library used to compress one-shot buffers
+type BufferBackend int
+
+const (
+	// BufferBackendZLib compresses buffers with the zlib library gozlib is linked against, which may be zlib-ng in compatibility mode
+	BufferBackendZLib BufferBackend = C.GOZLIB_BUFFER_BACKEND_ZLIB
+	// BufferBackendLibDeflate compresses buffers with libdeflate, only available when built with the libdeflate tag
+	BufferBackendLibDeflate BufferBackend = C.GOZLIB_BUFFER_BACKEND_LIBDEFLATE
+)
+
+// SetBufferBackend selects the library used by GoGZipCompressBuffer, GoCompressBufferWithOptions and the batch compression functions.
+// libdeflate is the default when available and is only used with the default window size and strategy, other options
+// fall back to zlib. Streams, transformers, dictionaries and uncompression always use zlib.
+// An error is returned if the backend is not available in this build
+func SetBufferBackend(backend BufferBackend) error {
+	if !C.set_buffer_backend(C.int(backend)) {
+		return UnsupportedBufferBackendError
+	}
+	return nil
+}
+
+// GetBufferBackend returns the library currently used to compress one-shot buffers
+func GetBufferBackend() BufferBackend {
+	return BufferBackend(C.get_buffer_backend())
+}
+
+// ZLibVersion returns the version of the zlib library gozlib is running with, zlib-ng in compatibility mode reports its own version
+func ZLibVersion() string {
+	return C.GoString(C.zlibVersion())
+}
+
+// GoGZipCompressBuffer compresses data in gzip format, reading from input and
+// writing to a pre allocated output buffer. If the output is too small to contain the compressed data, an error is returned
+// Internally, compression contexts are pooled and reused across calls with the same level
+func GoGZipCompressBuffer(level CompressionLevel, input []byte, output []byte) (uint64, error) {
+	return GoCompressBufferWithOptions(CompressionOptions{Format: CompressionFormatGZip, Level: level}, input, output)
+}
+
+// GoCompressBufferWithOptions compresses data like GoGZipCompressBuffer with the format, level, window,
+// memory level and strategy in options. Contexts are pooled per distinct set of options
+func GoCompressBufferWithOptions(options CompressionOptions, input []byte, output []byte) (uint64, error) {
+	level, windowBits, memLevel, strategy, err := options.deflateParameters()
+	if err != nil {
+		return 0, err
+	}
+
+	inputPtr, inputCap, outputPtr, outputCap, err := bufferPointers(input, output)
+	if err != nil {
+		return 0, err
+	}
+
+	var result C.GoZLibBufferResult
+	if options.Adaptive {
+		result = C.go_adaptive_deflate_compress_buffer(level, windowBits, memLevel, strategy, inputPtr, inputCap, outputPtr, outputCap)
+	} else {
+		result = C.go_deflate_compress_buffer(level, windowBits, memLevel, strategy, inputPtr, inputCap, outputPtr, outputCap)
+	}
+
+	if result.error_code != C.Z_OK {
+		return 0, fmt.Errorf(wrapErrorFormat, BufferCompressError, result.error_code)
+	}
+
+	return uint64(result.len), nil
+}
+
+// GoUncompressBuffer uncompresses a gzip or standard zlib input buffer writing to a pre allocated output
+// if the output is too small to contain the compressed data, an error is returned
+func GoUncompressBuffer(input []byte, output []byte) (uint64, error) {
+	return GoUncompressBufferWithOptions(UncompressionOptions{}, input, output)
+}
+
+// GoUncompressBufferWithOptions uncompresses data like GoUncompressBuffer using the window and format in options.
+// It is required for raw deflate inputs
+func GoUncompressBufferWithOptions(options UncompressionOptions, input []byte, output []byte) (uint64, error) {
+	windowBits, err := zlibWindowBits(options.Format, options.WindowBits, true)
+	if err != nil {
+		return 0, err
+	}
+
+	inputPtr, inputCap, outputPtr, outputCap, err := bufferPointers(input, output)
+	if err != nil {
+		return 0, err
+	}
+
+	var errorCode C.int = C.Z_OK
+
+	uncompLen := C.inflate_uncompress_buffer(windowBits, inputPtr, inputCap, outputPtr, outputCap, &errorCode)
+
+	if errorCode != C.Z_OK {
+		return 0, fmt.Errorf(wrapErrorFormat, BufferUncompressError, errorCode)
+	}
+
+	return uint64(uncompLen), nil
+}
+
+// GZipStoreBound returns the size of the output of GoGZipStoreBuffer for an input of inputLen bytes
+func GZipStoreBound(inputLen int) int {
+	return int(C.gzip_store_bound(C.uLong(inputLen)))
+}
+
+// GoGZipStoreBuffer writes input to a pre allocated output buffer as a valid gzip stream without compressing it, for data known not to compress.
+// The output must have a capacity of at least GZipStoreBound(len(input)) bytes, otherwise an error is returned
+func GoGZipStoreBuffer(input []byte, output []byte) (uint64, error) {
+	inputPtr, inputCap, outputPtr, outputCap, err := bufferPointers(input, output)
+	if err != nil {
+		return 0, err
+	}
+
+	var errorCode C.int = C.Z_OK
+	storedLen := C.gzip_store_buffer(inputPtr, inputCap, outputPtr, outputCap, &errorCode)
+	if errorCode != C.Z_OK {
+		return 0, fmt.Errorf(wrapErrorFormat, BufferCompressError, errorCode)
+	}
+
+	return uint64(storedLen), nil
+}
+
+// CompressBound returns the maximum length of the output of GoCompressBufferWithOptions for an input of inputLen bytes, as given
+// by zlib deflateBound for the options and covering the libdeflate backend when it's selected, so that output buffers can be sized exactly.
+// An error is returned if the options are not valid
+func CompressBound(options CompressionOptions, inputLen int) (int, error) {
+	level, windowBits, memLevel, strategy, err := options.deflateParameters()
+	if err != nil {
+		return 0, err
+	}
+
+	var errorCode C.int = C.Z_OK
+	bound := C.deflate_compress_bound(level, windowBits, memLevel, strategy, C.uLong(inputLen), &errorCode)
+	if errorCode != C.Z_OK {
+		return 0, fmt.Errorf(wrapErrorFormat, BufferCompressError, errorCode)
+	}
+
+	return int(bound), nil
+}
+
+// GoCompressBufferPooled compresses input like GoCompressBufferWithOptions into an output buffer of CompressBound bytes acquired from pool,
+// in a single cgo call. The returned slice holds the compressed data and must be returned to the pool once it's not needed anymore
+func GoCompressBufferPooled(options CompressionOptions, input []byte, pool *NativeSlicePool) ([]byte, error) {
+	level, windowBits, memLevel, strategy, err := options.deflateParameters()
+	if err != nil {
+		return nil, err
+	}
+
+	var inputPtr unsafe.Pointer = nil
+	if len(input) > 0 {
+		inputPtr = unsafe.Pointer(&input[0])
+	}
+
+	result := C.go_deflate_compress_pooled(pool.pool, level, windowBits, memLevel, strategy, C.bool(options.Adaptive), inputPtr, C.uInt(len(input)))
+	if result.error_code != C.Z_OK {
+		return nil, fmt.Errorf(wrapErrorFormat, BufferCompressError, result.error_code)
+	}
+
+	return pooledSlice(uintptr(result.data), int(result.len)), nil
+}
+
+// GoUncompressBufferPooled uncompresses input like GoUncompressBufferWithOptions in a single pass, into an output buffer acquired from pool
+// that grows as needed instead of failing when it's too small. Gzip outputs start at the uncompressed size in the gzip trailer,
+// up to a multiple of the input size. Concatenated gzip members are uncompressed as a single stream, any other data after the
+// end of the stream is an error.
+// The returned slice holds the uncompressed data and must be returned to the pool once it's not needed anymore
+func GoUncompressBufferPooled(options UncompressionOptions, input []byte, pool *NativeSlicePool) ([]byte, error) {
+	windowBits, err := zlibWindowBits(options.Format, options.WindowBits, true)
+	if err != nil {
+		return nil, err
+	}
+
+	var inputPtr unsafe.Pointer = nil
+	if len(input) > 0 {
+		inputPtr = unsafe.Pointer(&input[0])
+	}
+
+	result := C.go_inflate_uncompress_pooled(pool.pool, windowBits, inputPtr, C.uInt(len(input)))
+	if result.error_code != C.Z_OK {
+		return nil, fmt.Errorf(wrapErrorFormat, BufferUncompressError, result.error_code)
+	}
+
+	return pooledSlice(uintptr(result.data), int(result.len)), nil
+}
+
+// pooledSlice returns a slice over length bytes of memory acquired from a native slice pool
+func pooledSlice(data uintptr, length int) []byte {
+	var slice []byte
+	hdr := (*reflect.SliceHeader)(unsafe.Pointer(&slice))
+
+	hdr.Data = data
+	hdr.Len = length
+	hdr.Cap = length
+
+	return slice
+}
+
+// set by nothing, they only make the buffers passed to cgoEscape escape to the heap
+var (
+	cgoAlwaysFalse bool
+	cgoEscapeSink  interface{}
+)
+
+// cgoEscape moves buffers whose addresses are passed to C as integers, in descriptors built in Go memory, to the heap.
+// Integers are not pointers to the compiler, so without it the buffers could be allocated in the caller stack, which is
+// copied to a new location when it grows, for instance while setting up the cgo call, leaving the addresses dangling.
+// Heap memory is never moved by the garbage collector, the buffers must still be kept alive with runtime.KeepAlive
+// until the call returns. runtime.Pinner would be the alternative but requires Go 1.21.
+// cgo makes the pointers passed directly to C functions escape the same way
+func cgoEscape(buffers [][]byte) {
+	if cgoAlwaysFalse {
+		cgoEscapeSink = buffers
+	}
+}
+
+// BatchResult is the outcome of compressing one item in a batch
+type BatchResult struct {
+	// CompressedLen is the length of the compressed data written to the item output
+	CompressedLen uint64
+	// Err is set if the item could not be compressed, for instance because its output is too small
+	Err error
+}
+
+// GoGZipCompressBatch compresses each inputs[i] into the pre allocated outputs[i] in gzip format with a single cgo call,
+// reusing one compression context for all items. Up to threads native threads compress contiguous ranges of items concurrently,
+// each one with its own context. Use 1 to compress all items in the calling thread, which is best for small batches.
+// The returned results hold the compressed length or error of each item. An error is returned if the number of inputs and outputs differ
+func GoGZipCompressBatch(level CompressionLevel, inputs [][]byte, outputs [][]byte, threads int) ([]BatchResult, error) {
+	if len(inputs) != len(outputs) {
+		return nil, BatchLengthMismatchError
+	}
+
+	results := make([]BatchResult, len(inputs))
+	if len(inputs) == 0 {
+		return results, nil
+	}
+
+	// buffer addresses are passed as integers, the buffers are kept alive until the call returns, see cgoEscape
+	cgoEscape(inputs)
+	cgoEscape(outputs)
+	items := make([]C.GoZLibBatchItem, len(inputs))
+	for i := range items {
+		if len(inputs[i]) > 0 {
+			items[i].input = C.uintptr_t(uintptr(unsafe.Pointer(&inputs[i][0])))
+			items[i].input_len = C.uInt(len(inputs[i]))
+		}
+
+		if cap(outputs[i]) > 0 {
+			items[i].output = C.uintptr_t(uintptr(unsafe.Pointer(&outputs[i][:1][0])))
+			items[i].output_len = C.uInt(cap(outputs[i]))
+		}
+	}
+
+	if threads < 1 {
+		threads = 1
+	}
+
+	C.gzip_compress_batch(C.int(level), &items[0], C.uInt(len(items)), C.uInt(threads))
+	runtime.KeepAlive(inputs)
+	runtime.KeepAlive(outputs)
+
+	for i := range items {
+		if items[i].error_code != C.Z_OK {
+			results[i].Err = fmt.Errorf(wrapErrorFormat, BufferCompressError, items[i].error_code)
+			continue
+		}
+		results[i].CompressedLen = uint64(items[i].result_len)
+	}
+
+	return results, nil
+}
+
+// UncompressBatchResult is the outcome of uncompressing one item in a batch
+type UncompressBatchResult struct {
+	// Output holds the uncompressed data in a buffer acquired from the batch pool, it's nil if the item could not be uncompressed
+	Output []byte
+	// Err is set if the item could not be uncompressed, for instance because it's truncated or its trailer checksum doesn't match
+	Err error
+}
+
+// GoUncompressBatchPooled uncompresses each inputs[i] like GoUncompressBufferPooled with a single cgo call, into output buffers acquired from pool.
+// Up to threads native threads uncompress contiguous ranges of items concurrently, each one reusing a single inflate context for its range.
+// An item is only uncompressed if the whole stream is consumed and its gzip or zlib trailer checksum and length match the output.
+// Concatenated gzip members are uncompressed as a single stream, any other data after the end of the stream fails the item.
+// Outputs of the returned results must be returned to the pool once they're not needed anymore
+func GoUncompressBatchPooled(options UncompressionOptions, inputs [][]byte, pool *NativeSlicePool, threads int) ([]UncompressBatchResult, error) {
+	windowBits, err := zlibWindowBits(options.Format, options.WindowBits, true)
+	if err != nil {
+		return nil, err
+	}
+
+	results := make([]UncompressBatchResult, len(inputs))
+	if len(inputs) == 0 {
+		return results, nil
+	}
+
+	// input addresses are passed as integers, the inputs are kept alive until the call returns, see cgoEscape
+	cgoEscape(inputs)
+	items := make([]C.GoZLibBatchItem, len(inputs))
+	for i := range items {
+		if len(inputs[i]) > 0 {
+			items[i].input = C.uintptr_t(uintptr(unsafe.Pointer(&inputs[i][0])))
+			items[i].input_len = C.uInt(len(inputs[i]))
+		}
+	}
+
+	if threads < 1 {
+		threads = 1
+	}
+
+	C.inflate_uncompress_batch(pool.pool, windowBits, &items[0], C.uInt(len(items)), C.uInt(threads))
+	runtime.KeepAlive(inputs)
+
+	for i := range items {
+		if items[i].error_code != C.Z_OK {
+			results[i].Err = fmt.Errorf(wrapErrorFormat, BufferUncompressError, items[i].error_code)
+			continue
+		}
+		results[i].Output = pooledSlice(uintptr(items[i].output), int(items[i].result_len))
+	}
+
+	return results, nil
+}
+
+// BufferCompressor holds a pre-initialized compression context so that repeated buffer to buffer
+// compressions skip the zlib stream setup entirely. A BufferCompressor is not safe for concurrent use
+// and Close must be invoked to return the context to the internal pool.
+type BufferCompressor struct {
+	context *C.GoZLibContext
+}
+
+// NewGoGZipBufferCompressor creates a buffer compressor that writes gzip format output
+// The level parameter specifies the compression level. It can be set to CompressionLevelBestCompression or CompressionLevelBestSpeed
+func NewGoGZipBufferCompressor(level CompressionLevel) (*BufferCompressor, error) {
+	return NewGoBufferCompressorWithOptions(CompressionOptions{Format: CompressionFormatGZip, Level: level})
+}
+
+// NewGoBufferCompressorWithOptions creates a buffer compressor for the format, level, window, memory level and strategy in options
+func NewGoBufferCompressorWithOptions(options CompressionOptions) (*BufferCompressor, error) {
+	level, windowBits, memLevel, strategy, err := options.deflateParameters()
+	if err != nil {
+		return nil, err
+	}
+
+	var errorCode C.int = C.Z_OK
+	context := C.acquire_deflate_context(level, windowBits, memLevel, strategy, &errorCode)
+
+	if context == nil {
+		return nil, fmt.Errorf(wrapErrorFormat, TransformerInitializationError, errorCode)
+	}
+	return &BufferCompressor{context: context}, nil
+}
+
+// Compress behaves like GoGZipCompressBuffer, using the context held by this compressor
+func (bc *BufferCompressor) Compress(input []byte, output []byte) (uint64, error) {
+	inputPtr, inputCap, outputPtr, outputCap, err := bufferPointers(input, output)
+	if err != nil {
+		return 0, err
+	}
+
+	var errorCode C.int = C.Z_OK
+
+	compLen := C.context_compress_buffer(bc.context, inputPtr, inputCap, outputPtr, outputCap, &errorCode)
+
+	if errorCode != C.Z_OK {
+		return 0, fmt.Errorf(wrapErrorFormat, BufferCompressError, errorCode)
+	}
+
+	return uint64(compLen), nil
+}
+
+// Close returns the compression context to the internal pool
+func (bc *BufferCompressor) Close() {
+	C.release_zlib_context(bc.context)
+	bc.context = nil
+}
+
+// BufferUncompressor holds a pre-initialized uncompression context for gzip or zlib inputs,
+// see BufferCompressor for details
+type BufferUncompressor struct {
+	context *C.GoZLibContext
+}
+
+// NewGoBufferUncompressor creates a buffer uncompressor that supports zlib or gzip inputs
+func NewGoBufferUncompressor() (*BufferUncompressor, error) {
+	return NewGoBufferUncompressorWithOptions(UncompressionOptions{})
+}
+
+// NewGoBufferUncompressorWithOptions creates a buffer uncompressor using the window and format in options
+func NewGoBufferUncompressorWithOptions(options UncompressionOptions) (*BufferUncompressor, error) {
+	windowBits, err := zlibWindowBits(options.Format, options.WindowBits, true)
+	if err != nil {
+		return nil, err
+	}
+
+	var errorCode C.int = C.Z_OK
+	context := C.acquire_inflate_context(windowBits, &errorCode)
+
+	if context == nil {
+		return nil, fmt.Errorf(wrapErrorFormat, TransformerInitializationError, errorCode)
+	}
+	return &BufferUncompressor{context: context}, nil
+}
+
+// Uncompress behaves like GoUncompressBuffer, using the context held by this uncompressor
+func (bu *BufferUncompressor) Uncompress(input []byte, output []byte) (uint64, error) {
+	inputPtr, inputCap, outputPtr, outputCap, err := bufferPointers(input, output)
+	if err != nil {
+		return 0, err
+	}
+
+	var errorCode C.int = C.Z_OK
+
+	uncompLen := C.context_uncompress_buffer(bu.context, inputPtr, inputCap, outputPtr, outputCap, &errorCode)
+
+	if errorCode != C.Z_OK {
+		return 0, fmt.Errorf(wrapErrorFormat, BufferUncompressError, errorCode)
+	}
+
+	return uint64(uncompLen), nil
+}
+
+// Close returns the uncompression context to the internal pool
+func (bu *BufferUncompressor) Close() {
+	C.release_zlib_context(bu.context)
+	bu.context = nil
+}
+
+// files
+
+// FileOptions controls how output files are written
+type FileOptions struct {
+	// DirectIO writes the output bypassing the page cache, when supported by the file system.
+	// Useful for large outputs that won't be read again soon
+	DirectIO bool
+}
+
+// CompressFile compresses the file src into dst, which is created or truncated, and returns the size of dst.
+// The whole compression loop runs in native code: src is mapped into memory and compressed without copies and
+// the output is written from large aligned buffers. dst may be left partially written on error
+func CompressFile(src string, dst string, options CompressionOptions, fileOptions FileOptions) (uint64, error) {
+	level, windowBits, memLevel, strategy, err := options.deflateParameters()
+	if err != nil {
+		return 0, err
+	}
+
+	return transformFile(src, dst, FileCompressError, func(input C.int, output C.int, errorCode *C.int) (C.uint64_t, error) {
+		written, errno := C.file_compress(input, output, level, windowBits, memLevel, strategy, C.bool(fileOptions.DirectIO), errorCode)
+		return written, errno
+	})
+}
+
+// UncompressFile uncompresses the file src into dst, which is created or truncated, and returns the size of dst. See CompressFile
+func UncompressFile(src string, dst string, options UncompressionOptions, fileOptions FileOptions) (uint64, error) {
+	windowBits, err := zlibWindowBits(options.Format, options.WindowBits, true)
+	if err != nil {
+		return 0, err
+	}
+
+	return transformFile(src, dst, FileUncompressError, func(input C.int, output C.int, errorCode *C.int) (C.uint64_t, error) {
+		written, errno := C.file_uncompress(input, output, windowBits, C.bool(fileOptions.DirectIO), errorCode)
+		return written, errno
+	})
+}
+
+type fileTransformFn func(input C.int, output C.int, errorCode *C.int) (C.uint64_t, error)
+
+func transformFile(src string, dst string, transformError error, transform fileTransformFn) (uint64, error) {
+	input, err := os.Open(src)
+	if err != nil {
+		return 0, err
+	}
+	defer input.Close()
+
+	output, err := os.OpenFile(dst, os.O_WRONLY|os.O_CREATE|os.O_TRUNC, 0644)
+	if err != nil {
+		return 0, err
+	}
+
+	var errorCode C.int = C.Z_OK
+	written, errno := transform(C.int(input.Fd()), C.int(output.Fd()), &errorCode)
+	closeErr := output.Close()
+
+	if errorCode == C.Z_ERRNO {
+		return uint64(written), fmt.Errorf("%w: %v", transformError, errno)
+	}
+	if errorCode != C.Z_OK {
+		return uint64(written), fmt.Errorf(wrapErrorFormat, transformError, errorCode)
+	}
+	return uint64(written), closeErr
+}
+
+type goFileUncompressor struct {
+	reader *C.GoZLibFileReader
+}
+
+// NewGoFileUncompressor opens a compressed file and returns a reader for its uncompressed content.
+// The file is mapped into memory and uncompressed straight into the buffers passed to Read, without intermediate copies
+func NewGoFileUncompressor(path string, options UncompressionOptions) (io.ReadCloser, error) {
+	windowBits, err := zlibWindowBits(options.Format, options.WindowBits, true)
+	if err != nil {
+		return nil, err
+	}
+
+	file, err := os.Open(path)
+	if err != nil {
+		return nil, err
+	}
+	// the mapping outlives the file descriptor
+	defer file.Close()
+
+	var errorCode C.int = C.Z_OK
+	reader, errno := C.open_file_reader(C.int(file.Fd()), windowBits, &errorCode)
+	if reader == nil {
+		if errorCode == C.Z_ERRNO {
+			return nil, fmt.Errorf("%w: %v", FileUncompressError, errno)
+		}
+		return nil, fmt.Errorf(wrapErrorFormat, FileUncompressError, errorCode)
+	}
+
+	return &goFileUncompressor{reader: reader}, nil
+}
+
+func (unc *goFileUncompressor) Read(output []byte) (int, error) {
+	if unc.reader == nil {
+		return 0, os.ErrClosed
+	}
+	if len(output) == 0 {
+		return 0, nil
+	}
+
+	outputLen := len(output)
+	if outputLen > math.MaxUint32 {
+		outputLen = math.MaxUint32
+	}
+
+	result := C.file_reader_read(unc.reader, unsafe.Pointer(&output[0]), C.uInt(outputLen))
+	switch result.status {
+	case C.Z_OK:
+		return int(result.produced), nil
+	case C.Z_STREAM_END:
+		return 0, io.EOF
+	default:
+		return int(result.produced), fmt.Errorf(wrapErrorFormat, FileUncompressError, result.status)
+	}
+}
+
+// Close unmaps the file and returns the uncompression context to the internal pool
+func (unc *goFileUncompressor) Close() error {
+	C.close_file_reader(unc.reader)
+	unc.reader = nil
+	return nil
+}
+
+// random access index
+
+const (
+	indexMagic   = "GZIX"
+	indexVersion = 1
+	// version, span, size and number of points
+	indexHeaderSize = 4 + 8 + 8 + 8
+	// in, out, bits and window length
+	indexPointHeaderSize = 8 + 8 + 1 + 4
+	indexMaxWindowSize   = 32 * 1024
+)
+
+// Index allows uncompressing a gzip or zlib stream from an arbitrary offset without inflating it from the start.
+// It holds access points about every span uncompressed bytes, each one with the last 32Kb of uncompressed data before it.
+// Indexes are built with BuildIndex and can be stored next to the compressed data with WriteTo and loaded with ReadIndex
+type Index struct {
+	span   uint64
+	size   uint64
+	points []indexAccessPoint
+}
+
+type indexAccessPoint struct {
+	in     uint64
+	out    uint64
+	bits   uint8
+	window []byte
+}
+
+// BuildIndex uncompresses the whole input, discarding the data, and returns an index with access points about every span uncompressed bytes.
+// Smaller spans make seeking faster at the expense of 32Kb per access point. All members of a multi member gzip input are indexed,
+// each one starting with an access point. bufferSize is the size of the reads from input and must be greater than zero
+func BuildIndex(input io.Reader, span uint64, bufferSize uint32) (*Index, error) {
+	// no input could ever be read
+	if bufferSize == 0 {
+		return nil, fmt.Errorf(wrapErrorFormat, IndexBuildError, C.Z_STREAM_ERROR)
+	}
+
+	var errorCode C.int = C.Z_OK
+	builder := C.create_index_builder(C.uint64_t(span), &errorCode)
+	if builder == nil {
+		return nil, fmt.Errorf(wrapErrorFormat, IndexBuildError, errorCode)
+	}
+	defer C.free_index_builder(builder)
+
+	buffer := make([]byte, bufferSize)
+	// the input may only end where a member ends
+	memberEnded := false
+	for {
+		readLen, readErr := input.Read(buffer)
+		if readLen > 0 {
+			step := C.index_builder_step(builder, unsafe.Pointer(&buffer[0]), C.uInt(readLen))
+			if step.status != C.Z_OK && step.status != C.Z_STREAM_END {
+				return nil, fmt.Errorf(wrapErrorFormat, IndexBuildError, step.status)
+			}
+			memberEnded = step.status == C.Z_STREAM_END
+		}
+
+		if readErr == io.EOF {
+			if memberEnded {
+				break
+			}
+			return nil, fmt.Errorf("%w: %v", IndexBuildError, io.ErrUnexpectedEOF)
+		}
+		if readErr != nil {
+			return nil, readErr
+		}
+	}
+
+	index := &Index{
+		span:   span,
+		size:   uint64(builder.context.zs.total_out),
+		points: make([]indexAccessPoint, builder.count),
+	}
+	cPoints := unsafe.Slice(builder.points, builder.count)
+	for i := range cPoints {
+		index.points[i] = indexAccessPoint{
+			in:     uint64(cPoints[i].in),
+			out:    uint64(cPoints[i].out),
+			bits:   uint8(cPoints[i].bits),
+			window: C.GoBytes(unsafe.Pointer(&cPoints[i].window[0]), C.int(cPoints[i].window_len)),
+		}
+	}
+	return index, nil
+}
+
+// UncompressedSize returns the size of the indexed uncompressed data
+func (index *Index) UncompressedSize() uint64 {
+	return index.size
+}
+
+// WriteTo writes the serialized index to output
+func (index *Index) WriteTo(output io.Writer) (int64, error) {
+	size := len(indexMagic) + indexHeaderSize
+	for i := range index.points {
+		size += indexPointHeaderSize + len(index.points[i].window)
+	}
+
+	data := make([]byte, 0, size)
+	data = append(data, indexMagic...)
+	data = binary.LittleEndian.AppendUint32(data, indexVersion)
+	data = binary.LittleEndian.AppendUint64(data, index.span)
+	data = binary.LittleEndian.AppendUint64(data, index.size)
+	data = binary.LittleEndian.AppendUint64(data, uint64(len(index.points)))
+	for i := range index.points {
+		point := &index.points[i]
+		data = binary.LittleEndian.AppendUint64(data, point.in)
+		data = binary.LittleEndian.AppendUint64(data, point.out)
+		data = append(data, point.bits)
+		data = binary.LittleEndian.AppendUint32(data, uint32(len(point.window)))
+		data = append(data, point.window...)
+	}
+
+	written, err := output.Write(data)
+	return int64(written), err
+}
+
+// ReadIndex reads an index serialized with Index.WriteTo
+func ReadIndex(input io.Reader) (*Index, error) {
+	header := make([]byte, len(indexMagic)+indexHeaderSize)
+	if _, err := io.ReadFull(input, header); err != nil {
+		return nil, fmt.Errorf("%w: %v", InvalidIndexError, err)
+	}
+	if string(header[:len(indexMagic)]) != indexMagic || binary.LittleEndian.Uint32(header[4:8]) != indexVersion {
+		return nil, InvalidIndexError
+	}
+
+	index := &Index{
+		span: binary.LittleEndian.Uint64(header[8:16]),
+		size: binary.LittleEndian.Uint64(header[16:24]),
+	}
+	count := binary.LittleEndian.Uint64(header[24:32])
+
+	pointHeader := make([]byte, indexPointHeaderSize)
+	for i := uint64(0); i < count; i++ {
+		if _, err := io.ReadFull(input, pointHeader); err != nil {
+			return nil, fmt.Errorf("%w: %v", InvalidIndexError, err)
+		}
+
+		point := indexAccessPoint{
+			in:   binary.LittleEndian.Uint64(pointHeader[0:8]),
+			out:  binary.LittleEndian.Uint64(pointHeader[8:16]),
+			bits: pointHeader[16],
+		}
+		windowLen := binary.LittleEndian.Uint32(pointHeader[17:21])
+		// access points must be valid and in order, with a bit count that can be primed
+		if windowLen > indexMaxWindowSize || point.bits > 7 || (point.bits > 0 && point.in == 0) || point.out > index.size ||
+			(len(index.points) > 0 && point.out < index.points[len(index.points)-1].out) {
+			return nil, InvalidIndexError
+		}
+
+		point.window = make([]byte, windowLen)
+		if _, err := io.ReadFull(input, point.window); err != nil {
+			return nil, fmt.Errorf("%w: %v", InvalidIndexError, err)
+		}
+		index.points = append(index.points, point)
+	}
+
+	if len(index.points) == 0 {
+		return nil, InvalidIndexError
+	}
+	return index, nil
+}
+
+// NewGoZLibUncompressorAt creates an uncompressor that returns the uncompressed data of input starting at offset.
+// Uncompressing resumes from the closest access point in the index before offset, so at most about the index span bytes are
+// uncompressed and discarded. The gzip or zlib trailer checksum is not verified.
+// The uncompressor can't be reset with ResetUncompressor
+func NewGoZLibUncompressorAt(input io.ReaderAt, index *Index, offset uint64, bufferSize uint32) (io.ReadCloser, error) {
+	if offset > index.size {
+		return nil, InvalidIndexOffsetError
+	}
+
+	// the last access point at or before offset
+	pointIndex := sort.Search(len(index.points), func(i int) bool { return index.points[i].out > offset }) - 1
+	if pointIndex < 0 {
+		return nil, InvalidIndexError
+	}
+
+	goUncomp := &goIndexedUncompressor{
+		input:    input,
+		index:    index,
+		position: index.points[pointIndex].out,
+	}
+
+	var errorCode C.int = 0
+	goUncomp.uncompressor.transformer = C.acquire_window_uncompression_transformer(-C.MAX_WBITS, C.uInt(bufferSize), &errorCode)
+	if errorCode != C.Z_OK {
+		C.release_uncompression_transformer(goUncomp.uncompressor.transformer)
+		return nil, fmt.Errorf(wrapErrorFormat, TransformerInitializationError, errorCode)
+	}
+
+	if err := goUncomp.uncompressor.primeAccessPoint(input, &index.points[pointIndex]); err != nil {
+		goUncomp.Close()
+		return nil, err
+	}
+
+	if _, err := io.CopyN(io.Discard, goUncomp, int64(offset-goUncomp.position)); err != nil {
+		goUncomp.Close()
+		return nil, err
+	}
+	return goUncomp, nil
+}
+
+// goIndexedUncompressor uncompresses the indexed data from an access point, moving to the access point at the start of
+// the next member each time a member ends
+type goIndexedUncompressor struct {
+	uncompressor goUncompressor
+	input        io.ReaderAt
+	index        *Index
+	position     uint64
+}
+
+// Read reads uncompressed data up to the end of the indexed data, returning io.EOF after it
+func (unc *goIndexedUncompressor) Read(output []byte) (int, error) {
+	readLen, err := unc.uncompressor.Read(output)
+	unc.position += uint64(readLen)
+	if err != io.EOF || unc.position >= unc.index.size {
+		return readLen, err
+	}
+
+	// the member ended, the next one starts at an access point with the same uncompressed offset
+	pointIndex := sort.Search(len(unc.index.points), func(i int) bool { return unc.index.points[i].out >= unc.position })
+	if pointIndex == len(unc.index.points) || unc.index.points[pointIndex].out != unc.position {
+		return readLen, fmt.Errorf("%w: %v", InvalidIndexError, io.ErrUnexpectedEOF)
+	}
+	return readLen, unc.uncompressor.primeAccessPoint(unc.input, &unc.index.points[pointIndex])
+}
+
+// Close returns the transformer to the internal pool
+func (unc *goIndexedUncompressor) Close() error {
+	return unc.uncompressor.Close()
+}
+
+// primeAccessPoint resets a raw uncompressor to uncompress input from the point
+func (unc *goUncompressor) primeAccessPoint(input io.ReaderAt, point *indexAccessPoint) error {
+	var primeByte [1]byte
+	if point.bits > 0 {
+		if _, err := input.ReadAt(primeByte[:], int64(point.in)-1); err != nil {
+			// the input is shorter than the indexed data
+			if err == io.EOF {
+				err = io.ErrUnexpectedEOF
+			}
+			return err
+		}
+	}
+
+	unc.reset(io.NewSectionReader(input, int64(point.in), math.MaxInt64-int64(point.in)))
+
+	var window unsafe.Pointer
+	if len(point.window) > 0 {
+		window = unsafe.Pointer(&point.window[0])
+	}
+	errorCode := C.transformer_prime_access_point(unc.transformer, C.uint64_t(point.in), C.uint64_t(point.out), C.int(point.bits),
+		C.int(primeByte[0]), window, C.uInt(len(point.window)))
+	if errorCode != C.Z_OK {
+		return fmt.Errorf(wrapErrorFormat, TransformerInitializationError, errorCode)
+	}
+	return nil
+}
+
+// Parallel indexed uncompression
+
+const (
+	// size of the compressed data read at once by the parallel uncompressor workers
+	parallelUncompressBufferSize = 64 * 1024
+)
+
+// parallelSegment is the uncompressed data between two consecutive access points, uncompressed by one of the parallel uncompressor workers
+type parallelSegment struct {
+	point  *indexAccessPoint
+	size   uint64
+	output []byte
+	err    error
+	done   chan struct{}
+}
+
+type goParallelUncompressor struct {
+	input io.ReaderAt
+	index *Index
+
+	current *parallelSegment
+	pending []byte
+	closed  bool
+
+	jobs          chan *parallelSegment
+	ordered       chan *parallelSegment
+	outputBuffers chan []byte
+	stop          chan struct{}
+	workersDone   sync.WaitGroup
+}
+
+// NewGoParallelUncompressor creates an uncompressor that returns the whole uncompressed data of input, uncompressing the segments
+// between consecutive index access points concurrently on workers goroutines. Segments are returned in order, with at most
+// two segments per worker uncompressed ahead of the reader, each one about the index span in size.
+// Members of a multi member gzip input are uncompressed the same way since each one starts with an access point.
+// If workers is zero or negative, runtime.NumCPU() workers are used. The gzip or zlib trailer checksums are not verified.
+// Close must be invoked to stop the workers
+func NewGoParallelUncompressor(input io.ReaderAt, index *Index, workers int) (io.ReadCloser, error) {
+	if len(index.points) == 0 {
+		return nil, InvalidIndexError
+	}
+
+	if workers <= 0 {
+		workers = runtime.NumCPU()
+	}
+
+	// enough segments in flight to keep all workers busy while the output is read
+	inFlight := workers * 2
+	pu := &goParallelUncompressor{
+		input:         input,
+		index:         index,
+		jobs:          make(chan *parallelSegment, inFlight),
+		ordered:       make(chan *parallelSegment, inFlight),
+		outputBuffers: make(chan []byte, inFlight+1),
+		stop:          make(chan struct{}),
+	}
+
+	pu.workersDone.Add(workers)
+	for i := 0; i < workers; i++ {
+		go pu.uncompressSegments()
+	}
+	go pu.submitSegments()
+
+	return pu, nil
+}
+
+// Read reads uncompressed data in order, returning io.EOF after the last segment or the error uncompressing a segment
+func (pu *goParallelUncompressor) Read(output []byte) (int, error) {
+	if pu.closed {
+		return 0, fmt.Errorf(wrapErrorFormat, ParallelUncompressionError, C.Z_STREAM_ERROR)
+	}
+
+	for len(pu.pending) == 0 {
+		if pu.current != nil {
+			if pu.current.err != nil {
+				return 0, pu.current.err
+			}
+			pu.releaseBuffer(pu.current)
+			pu.current = nil
+		}
+
+		segment, ok := <-pu.ordered
+		if !ok {
+			return 0, io.EOF
+		}
+		<-segment.done
+		pu.current = segment
+		pu.pending = segment.output
+	}
+
+	copied := copy(output, pu.pending)
+	pu.pending = pu.pending[copied:]
+	return copied, nil
+}
+
+// Close stops the workers, discarding the segments not read yet
+func (pu *goParallelUncompressor) Close() error {
+	if pu.closed {
+		return nil
+	}
+	pu.closed = true
+
+	close(pu.stop)
+	// submitSegments closes ordered once it stops
+	for segment := range pu.ordered {
+		<-segment.done
+	}
+	pu.workersDone.Wait()
+	return nil
+}
+
+func (pu *goParallelUncompressor) submitSegments() {
+	defer close(pu.ordered)
+	defer close(pu.jobs)
+
+	for i := range pu.index.points {
+		select {
+		case <-pu.stop:
+			return
+		default:
+		}
+
+		end := pu.index.size
+		if i+1 < len(pu.index.points) {
+			end = pu.index.points[i+1].out
+		}
+
+		segment := &parallelSegment{
+			point: &pu.index.points[i],
+			size:  end - pu.index.points[i].out,
+			done:  make(chan struct{}),
+		}
+
+		// ordered bounds the number of segments in flight
+		select {
+		case pu.ordered <- segment:
+		case <-pu.stop:
+			return
+		}
+		pu.jobs <- segment
+	}
+}
+
+func (pu *goParallelUncompressor) uncompressSegments() {
+	defer pu.workersDone.Done()
+
+	var errorCode C.int = 0
+	unc := &goUncompressor{}
+	unc.transformer = C.acquire_window_uncompression_transformer(-C.MAX_WBITS, C.uInt(parallelUncompressBufferSize), &errorCode)
+	defer unc.Close()
+
+	for segment := range pu.jobs {
+		select {
+		case <-pu.stop:
+			segment.err = fmt.Errorf(wrapErrorFormat, ParallelUncompressionError, C.Z_STREAM_ERROR)
+		default:
+			if errorCode != C.Z_OK {
+				segment.err = fmt.Errorf(wrapErrorFormat, TransformerInitializationError, errorCode)
+			} else {
+				segment.uncompress(unc, pu.input, pu.acquireOutputBuffer(segment.size))
+			}
+		}
+		close(segment.done)
+	}
+}
+
+func (segment *parallelSegment) uncompress(unc *goUncompressor, input io.ReaderAt, output []byte) {
+	if err := unc.primeAccessPoint(input, segment.point); err != nil {
+		segment.err = fmt.Errorf("%w: %v", ParallelUncompressionError, err)
+		return
+	}
+
+	// the segment ends at the next access point or at the end of its member
+	if _, err := io.ReadFull(unc, output); err != nil {
+		segment.err = fmt.Errorf("%w: %v", ParallelUncompressionError, err)
+		return
+	}
+	segment.output = output
+}
+
+func (pu *goParallelUncompressor) acquireOutputBuffer(size uint64) []byte {
+	select {
+	case buffer := <-pu.outputBuffers:
+		if uint64(cap(buffer)) >= size {
+			return buffer[:size]
+		}
+	default:
+	}
+	return make([]byte, size)
+}
+
+func (pu *goParallelUncompressor) releaseBuffer(segment *parallelSegment) {
+	if segment.output != nil {
+		select {
+		case pu.outputBuffers <- segment.output:
+		default:
+		}
+	}
+}
+
+// native slice pool
+
+// NativeSlicePool is a byte slice pool manager where memory allocated for each slice is allocated off-heap
+// The pool allows for slices of various types to be allocated and returned but given the way memory is internally tracked
+// slices of sizes that are power of 2 provide an optimal memory utilization.
+type NativeSlicePool struct {
+	pool *C.struct_MultiPool
+}
+
+// NewNativeSlicePool creates a new slice pool.
+// Manually call NewNativeSlicePool.Free() to release the resouces allocated by the returned NewNativeSlicePool.
+func NewNativeSlicePool() *NativeSlicePool {
+	return &NativeSlicePool{
+		pool: C.multipool_create(),
+	}
+}
+
+// Acquire acquires a new byte array. For optimal memory utilization use sizes that are power of 2
+// Slices larger than 4Mb are mapped directly, page aligned, and a few of them are cached for reuse once returned.
+// The returned slice cannot have its capacity changed.
+// The returned slice is not zeroed out and it has length zero but capacity equals to size
+func (nsp *NativeSlicePool) Acquire(size int) []byte {
+	data := C.multipool_mem_acquire(nsp.pool, C.uint32_t(size))
+
+	var slice []byte
+	hdr := (*reflect.SliceHeader)(unsafe.Pointer(&slice))
+
+	hdr.Data = uintptr(data)
+	hdr.Len = 0
+	hdr.Cap = int(size)
+
+	return slice
+}
+
+// Reserve pre-allocates memory for at least count slices of the given size so they can be acquired without further allocations.
+// Memory is allocated in slabs of multiple slices, one allocation per slab.
+// It returns false if size is larger than the maximum slice size or the memory cannot be allocated
+func (nsp *NativeSlicePool) Reserve(size int, count int) bool {
+	return bool(C.multipool_reserve(nsp.pool, C.uint32_t(size), C.uint32_t(count)))
+}
+
+// Return returns the slice to the pool.
+func (nsp *NativeSlicePool) Return(slice []byte) {
+	hdr := (*reflect.SliceHeader)(unsafe.Pointer(&slice))
+
+	C.pool_mem_return(unsafe.Pointer(hdr.Data))
+}
+
+// Free releases the resources allocated by this pool
+// It must be invoked once the pool is not in use anymore to avoid resource leaks.
+// All slices acquired from the pool must be returned first, since their memory is released with the pool.
+// If any slice is still acquired, the pool is not freed and NativeSlicePoolInUseError is returned
+func (nsp *NativeSlicePool) Free() error {
+	if C.multipool_in_use(nsp.pool) {
+		return NativeSlicePoolInUseError
+	}
+	C.multipool_free(nsp.pool)
+	return nil
+}
+
+// Trim releases the memory of the slices currently in the pool to the system, keeping up to keepBytes for each slice size.
+// Trimmed slices remain in the pool and their memory is zeroed when reused.
+// It returns the number of bytes released
+func (nsp *NativeSlicePool) Trim(keepBytes uint64) uint64 {
+	return uint64(C.multipool_trim(nsp.pool, C.size_t(keepBytes)))
+}
+
+// pool trimming
+
+// PoolTrimPolicy defines how the internal pool memory is trimmed in the background.
+// Watermarks apply to the unused memory held for each of the internal block sizes
+type PoolTrimPolicy struct {
+	// Interval is the time between trim passes
+	Interval time.Duration
+	// IdleAge is the minimum time a block must be unused before it can be trimmed
+	IdleAge time.Duration
+	// HighWatermark is the amount of unused memory in bytes that triggers trimming
+	HighWatermark uint64
+	// LowWatermark is the amount of unused memory in bytes kept after trimming
+	LowWatermark uint64
+}
+
+// TrimPools releases the unused memory held by gozlib internal pools to the system.
+// It returns the number of bytes released
+func TrimPools() uint64 {
+	return uint64(C.global_multipool_trim(0))
+}
+
+// StartPoolTrimmer starts a background thread trimming the internal pools according to policy.
+// If the trimmer is already running, the new policy replaces the current one
+func StartPoolTrimmer(policy PoolTrimPolicy) error {
+	if policy.Interval < time.Millisecond || policy.HighWatermark == 0 || policy.LowWatermark > policy.HighWatermark {
+		return InvalidPoolTrimPolicyError
+	}
+
+	C.multipool_set_all_trim_watermarks(C._global_multipool, C.size_t(policy.HighWatermark), C.size_t(policy.LowWatermark))
+
+	intervalMillis := policy.Interval.Milliseconds()
+	idleTicks := (policy.IdleAge.Milliseconds() + intervalMillis - 1) / intervalMillis
+	if !C.multipool_start_trimmer(C._global_multipool, C.uint32_t(intervalMillis), C.uint32_t(idleTicks)) {
+		return PoolTrimmerStartError
+	}
+	return nil
+}
+
+// StopPoolTrimmer stops the background trimming of the internal pools, if running
+func StopPoolTrimmer() {
+	C.multipool_stop_trimmer(C._global_multipool)
+}
+
+// pool statistics
+
+// PoolStats returns a snapshot of the usage statistics of gozlib internal pools, one entry per block size in increasing order
+func PoolStats() []PoolClassStats {
+	return multipoolStats(C._global_multipool)
+}
+
+// Stats returns a snapshot of the usage statistics of the pool, one entry per slice size in increasing order
+func (nsp *NativeSlicePool) Stats() []PoolClassStats {
+	return multipoolStats(nsp.pool)
+}
+
+func multipoolStats(multipool *C.struct_MultiPool) []PoolClassStats {
+	var cStats [C.MULTIPOOL_ENTRY_COUNT]C.struct_MemPoolStats
+	C.multipool_get_stats(multipool, &cStats[0])
+
+	stats := make([]PoolClassStats, C.MULTIPOOL_ENTRY_COUNT)
+	for i := range stats {
+		blockSize := uint64(multipool.pools[i].mem_size)
+		stats[i] = PoolClassStats{
+			BlockSize:      blockSize,
+			AllocatedBytes: uint64(cStats[i].allocated_blocks) * blockSize,
+			InUseBytes:     uint64(cStats[i].in_use_blocks) * blockSize,
+			HighWaterBytes: uint64(cStats[i].high_water_blocks) * blockSize,
+			Acquires:       uint64(cStats[i].acquires),
+			Misses:         uint64(cStats[i].misses),
+			ReleasedBytes:  uint64(cStats[i].released_bytes),
+		}
+	}
+	return stats
+}
+
+// instrumentation
+
+// Stats holds the instrumentation counters of the buffer, stream and transformer functions, collected while enabled with SetStatsEnabled
+type Stats struct {
+	// ZLibCalls is the number of deflate or inflate calls, which consumed BytesIn and produced BytesOut in ZLibTime
+	ZLibCalls uint64
+	BytesIn   uint64
+	BytesOut  uint64
+	ZLibTime  time.Duration
+	// HandlerCalls and HandlerTime measure the DataStreamEventHandler calls of the stream functions
+	HandlerCalls uint64
+	HandlerTime  time.Duration
+	// PoolMisses counts the contexts initialized because none was pooled for their parameters, only counted globally
+	PoolMisses uint64
+}
+
+// Ratio returns BytesOut divided by BytesIn, the compression ratio for compression stats, or zero without any input
+func (s Stats) Ratio() float64 {
+	if s.BytesIn == 0 {
+		return 0
+	}
+	return float64(s.BytesOut) / float64(s.BytesIn)
+}
+
+func statsFromC(stats *C.GoZLibStats) Stats {
+	return Stats{
+		ZLibCalls:    uint64(stats.zlib_calls),
+		BytesIn:      uint64(stats.bytes_in),
+		BytesOut:     uint64(stats.bytes_out),
+		ZLibTime:     time.Duration(stats.zlib_ns),
+		HandlerCalls: uint64(stats.handler_calls),
+		HandlerTime:  time.Duration(stats.handler_ns),
+		PoolMisses:   uint64(stats.pool_misses),
+	}
+}
+
+// SetStatsEnabled enables or disables the instrumentation counters. They're disabled by default and
+// while enabled each deflate, inflate and stream handler call is timed
+func SetStatsEnabled(enabled bool) {
+	C.set_stats_enabled(C.bool(enabled))
+}
+
+// StatsEnabled returns true if the instrumentation counters are enabled
+func StatsEnabled() bool {
+	return bool(C.get_stats_enabled())
+}
+
+// GlobalCompressionStats returns the counters of all buffers, streams and compressors since the process started
+func GlobalCompressionStats() Stats {
+	var stats C.GoZLibStats
+	C.get_global_stats(true, &stats)
+	return statsFromC(&stats)
+}
+
+// GlobalUncompressionStats returns the counters of all buffers, streams and uncompressors since the process started
+func GlobalUncompressionStats() Stats {
+	var stats C.GoZLibStats
+	C.get_global_stats(false, &stats)
+	return statsFromC(&stats)
+}
+
+// CompressorStats returns the counters of a compressor since it was created or last reset with ResetCompressor.
+// Compressors that aren't built on a single transformer, like the parallel compressor, have no counters and return zero values
+func CompressorStats(compressor io.WriteCloser) Stats {
+	holder, isHolder := compressor.(transformerHolder)
+	if !isHolder {
+		return Stats{}
+	}
+	return statsFromC(&holder.zlibTransformer().transformer.stats)
+}
+
+// UncompressorStats returns the counters of an uncompressor since it was created or last reset with ResetUncompressor.
+// Uncompressors that aren't built on a single transformer have no counters and return zero values
+func UncompressorStats(uncompressor io.ReadCloser) Stats {
+	holder, isHolder := uncompressor.(transformerHolder)
+	if !isHolder {
+		return Stats{}
+	}
+	return statsFromC(&holder.zlibTransformer().transformer.stats)
 }
@@ -3,8 +3,14 @@ package gozlib
 import (
 	"bytes"
 	"compress/gzip"
+	"encoding/binary"
+	"fmt"
 	"io"
+	"math/rand"
+	"sync"
 	"testing"
+	"time"
+	"unsafe"
 
 	"github.com/stretchr/testify/assert"
 )
@@ -35,6 +41,52 @@ func BenchmarkStdLibGZipCompressLarge(b *testing.B) {
 	benchmarkStdLibGZipCompress(b, largeTestData)
 }
 
+// BenchmarkStreamEventHandlerSlotTable measures the per stream callback handler lookup
+func BenchmarkStreamEventHandlerSlotTable(b *testing.B) {
+	id := registerStreamEventHandler(&streamEventHandlers{})
+	defer unregisterStreamEventHandler(id)
+
+	b.RunParallel(func(pb *testing.PB) {
+		for pb.Next() {
+			if findStreamEventHandler(id) == nil {
+				b.Fail()
+			}
+		}
+	})
+}
+
+// BenchmarkStreamEventHandlerSyncMap is the sync.Map lookup the slot table replaced, kept as baseline
+func BenchmarkStreamEventHandlerSyncMap(b *testing.B) {
+	tracker := sync.Map{}
+	handlers := &streamEventHandlers{}
+	tracker.Store(uintptr(unsafe.Pointer(handlers)), handlers)
+
+	b.RunParallel(func(pb *testing.PB) {
+		for pb.Next() {
+			value, exists := tracker.Load(uintptr(unsafe.Pointer(handlers)))
+			if !exists || value.(*streamEventHandlers) == nil {
+				b.Fail()
+			}
+		}
+	})
+}
+
+func BenchmarkStreamEventHandlerRegisterSlotTable(b *testing.B) {
+	handlers := &streamEventHandlers{}
+	for i := 0; i < b.N; i++ {
+		unregisterStreamEventHandler(registerStreamEventHandler(handlers))
+	}
+}
+
+func BenchmarkStreamEventHandlerRegisterSyncMap(b *testing.B) {
+	tracker := sync.Map{}
+	handlers := &streamEventHandlers{}
+	for i := 0; i < b.N; i++ {
+		tracker.Store(uintptr(i), handlers)
+		tracker.Delete(uintptr(i))
+	}
+}
+
 func benchmarkStdLibGZipCompress(b *testing.B, input []byte) {
 	for i := 0; i < b.N; i++ {
 		output := bytes.NewBuffer([]byte{})
@@ -57,3 +109,551 @@ func benchmarkgoGZipCompress(b *testing.B, input []byte) {
 		compressor.Close()
 	}
 }
+
+// benchmark suite across APIs, corpora, sizes and levels
+//
+// Sub-benchmarks are named <corpus>/<size>/level-<level> so a single combination can be selected, for instance
+// go test -run '^$' -bench 'BenchmarkCompressBuffer/json/64KB/level-6'
+// Inputs larger than 1MB are skipped with -short. All benchmarks report allocations, throughput against the
+// uncompressed size and, for compression, the ratio between compressed and original sizes.
+
+const (
+	benchWorkBufferSize  = 64 * 1024
+	benchParallelSize    = 64 * 1024
+	benchMaxShortSize    = 1024 * 1024
+	benchCorpusSeedValue = 42
+)
+
+type benchCorpusKind string
+
+const (
+	benchCorpusJSON           benchCorpusKind = "json"
+	benchCorpusLog            benchCorpusKind = "log"
+	benchCorpusBinary         benchCorpusKind = "binary"
+	benchCorpusIncompressible benchCorpusKind = "incompressible"
+)
+
+var (
+	benchCorpusKinds = []benchCorpusKind{benchCorpusJSON, benchCorpusLog, benchCorpusBinary, benchCorpusIncompressible}
+	benchInputSizes  = []int{128, 4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024, 64 * 1024 * 1024}
+	benchLevels      = []CompressionLevel{1, 2, 3, 4, 5, 6, 7, 8, 9}
+
+	benchCorpusCache     = map[string][]byte{}
+	benchCorpusCacheLock sync.Mutex
+)
+
+// benchCorpus returns deterministic data of the given kind and size, generated once and shared by all benchmarks
+func benchCorpus(kind benchCorpusKind, size int) []byte {
+	key := fmt.Sprintf("%s/%d", kind, size)
+	benchCorpusCacheLock.Lock()
+	defer benchCorpusCacheLock.Unlock()
+
+	if data, exists := benchCorpusCache[key]; exists {
+		return data
+	}
+
+	data := makeBenchCorpus(kind, size)
+	benchCorpusCache[key] = data
+	return data
+}
+
+func makeBenchCorpus(kind benchCorpusKind, size int) []byte {
+	random := rand.New(rand.NewSource(benchCorpusSeedValue))
+	logLevels := []string{"INFO", "WARN", "DEBUG", "ERROR"}
+	paths := []string{"/api/v1/users", "/api/v1/orders", "/healthz", "/static/app.js"}
+
+	data := bytes.NewBuffer(make([]byte, 0, size+256))
+	for data.Len() < size {
+		switch kind {
+		case benchCorpusJSON:
+			fmt.Fprintf(data, `{"id":%d,"name":"user%d","active":%t,"score":%.2f,"tags":["%s","%s"]},`+"\n",
+				random.Intn(100000), random.Intn(5000), random.Intn(2) == 0, random.Float64()*100, logLevels[random.Intn(4)], paths[random.Intn(4)])
+		case benchCorpusLog:
+			fmt.Fprintf(data, "2024-03-%02d 12:%02d:%02d.%03d %s [worker-%d] GET %s status=%d duration=%dms\n",
+				random.Intn(28)+1, random.Intn(60), random.Intn(60), random.Intn(1000), logLevels[random.Intn(4)], random.Intn(16),
+				paths[random.Intn(4)], []int{200, 200, 200, 404}[random.Intn(4)], random.Intn(500))
+		case benchCorpusBinary:
+			// fixed size records of small integers and a timestamp, the way serialized structs look
+			record := [8]uint32{uint32(random.Intn(256)), uint32(random.Intn(65536)), 0, 1700000000 + uint32(data.Len()), uint32(random.Intn(16)), 0, uint32(random.Intn(1024)), 0}
+			_ = binary.Write(data, binary.LittleEndian, record)
+		case benchCorpusIncompressible:
+			chunk := make([]byte, 4096)
+			random.Read(chunk)
+			data.Write(chunk)
+		}
+	}
+
+	return data.Bytes()[:size]
+}
+
+func benchSizeName(size int) string {
+	switch {
+	case size >= 1024*1024:
+		return fmt.Sprintf("%dMB", size/(1024*1024))
+	case size >= 1024:
+		return fmt.Sprintf("%dKB", size/1024)
+	default:
+		return fmt.Sprintf("%dB", size)
+	}
+}
+
+// runBenchMatrix runs the benchmark for every corpus and size, skipping large inputs with -short
+func runBenchMatrix(b *testing.B, bench func(b *testing.B, input []byte)) {
+	for _, kind := range benchCorpusKinds {
+		for _, size := range benchInputSizes {
+			kind, size := kind, size
+			b.Run(fmt.Sprintf("%s/%s", kind, benchSizeName(size)), func(b *testing.B) {
+				if testing.Short() && size > benchMaxShortSize {
+					b.Skip("large inputs are skipped in short mode")
+				}
+				bench(b, benchCorpus(kind, size))
+			})
+		}
+	}
+}
+
+// runCompressBenchMatrix is runBenchMatrix for every compression level as well
+func runCompressBenchMatrix(b *testing.B, bench func(b *testing.B, level CompressionLevel, input []byte) int) {
+	runBenchMatrix(b, func(b *testing.B, input []byte) {
+		for _, level := range benchLevels {
+			level := level
+			b.Run(fmt.Sprintf("level-%d", level), func(b *testing.B) {
+				b.SetBytes(int64(len(input)))
+				b.ReportAllocs()
+				b.ResetTimer()
+				compressedLen := bench(b, level, input)
+				b.ReportMetric(float64(compressedLen)/float64(len(input)), "ratio")
+			})
+		}
+	})
+}
+
+// runUncompressBenchMatrix uncompresses each corpus compressed at the default level
+func runUncompressBenchMatrix(b *testing.B, bench func(b *testing.B, compressed []byte, output []byte)) {
+	runBenchMatrix(b, func(b *testing.B, input []byte) {
+		compressed := benchGZipCompress(b, CompressionLevelDefault, input)
+		output := make([]byte, len(input))
+
+		b.SetBytes(int64(len(input)))
+		b.ReportAllocs()
+		b.ResetTimer()
+		bench(b, compressed, output)
+		b.StopTimer()
+
+		assert.Equal(b, input, output)
+	})
+}
+
+func benchGZipCompress(b *testing.B, level CompressionLevel, input []byte) []byte {
+	output := make([]byte, GZipStoreBound(len(input)))
+	written, err := GoGZipCompressBuffer(level, input, output)
+	if err != nil {
+		b.Fatal(err)
+	}
+	return output[:written]
+}
+
+// sliceStreamHandlers reads the stream input from a slice and writes its output to another one
+func sliceStreamHandlers(input []byte, output []byte) (DataStreamEventHandler, DataStreamEventHandler, *int) {
+	read := 0
+	written := 0
+
+	inputReader := func(data []byte) uint32 {
+		n := copy(data, input[read:])
+		read += n
+		return uint32(n)
+	}
+	outputWriter := func(data []byte) uint32 {
+		n := copy(output[written:], data)
+		written += n
+		return uint32(n)
+	}
+
+	return inputReader, outputWriter, &written
+}
+
+func BenchmarkCompressBuffer(b *testing.B) {
+	runCompressBenchMatrix(b, func(b *testing.B, level CompressionLevel, input []byte) int {
+		output := make([]byte, GZipStoreBound(len(input)))
+		var written uint64
+		for i := 0; i < b.N; i++ {
+			var err error
+			if written, err = GoGZipCompressBuffer(level, input, output); err != nil {
+				b.Fatal(err)
+			}
+		}
+		return int(written)
+	})
+}
+
+func BenchmarkCompressStream(b *testing.B) {
+	runCompressBenchMatrix(b, func(b *testing.B, level CompressionLevel, input []byte) int {
+		output := make([]byte, GZipStoreBound(len(input)))
+		written := 0
+		for i := 0; i < b.N; i++ {
+			inputReader, outputWriter, streamWritten := sliceStreamHandlers(input, output)
+			if _, err := GoGZipCompressStream(level, benchWorkBufferSize, benchWorkBufferSize, inputReader, outputWriter); err != nil {
+				b.Fatal(err)
+			}
+			written = *streamWritten
+		}
+		return written
+	})
+}
+
+func BenchmarkCompressTransformer(b *testing.B) {
+	runCompressBenchMatrix(b, func(b *testing.B, level CompressionLevel, input []byte) int {
+		output := bytes.NewBuffer(make([]byte, 0, GZipStoreBound(len(input))))
+		compressor, err := NewGoGZipCompressor(output, level, benchWorkBufferSize)
+		if err != nil {
+			b.Fatal(err)
+		}
+		defer compressor.Close()
+
+		for i := 0; i < b.N; i++ {
+			output.Reset()
+			ResetCompressor(output, compressor)
+			if _, err := compressor.Write(input); err != nil {
+				b.Fatal(err)
+			}
+			if err := Flush(compressor); err != nil {
+				b.Fatal(err)
+			}
+		}
+		return output.Len()
+	})
+}
+
+// BenchmarkCompressStdLib is the compress/gzip baseline for the gozlib compression benchmarks
+func BenchmarkCompressStdLib(b *testing.B) {
+	runCompressBenchMatrix(b, func(b *testing.B, level CompressionLevel, input []byte) int {
+		output := bytes.NewBuffer(make([]byte, 0, GZipStoreBound(len(input))))
+		compressor, err := gzip.NewWriterLevel(output, int(level))
+		if err != nil {
+			b.Fatal(err)
+		}
+
+		for i := 0; i < b.N; i++ {
+			output.Reset()
+			compressor.Reset(output)
+			if _, err := compressor.Write(input); err != nil {
+				b.Fatal(err)
+			}
+			if err := compressor.Close(); err != nil {
+				b.Fatal(err)
+			}
+		}
+		return output.Len()
+	})
+}
+
+func BenchmarkUncompressBuffer(b *testing.B) {
+	runUncompressBenchMatrix(b, func(b *testing.B, compressed []byte, output []byte) {
+		for i := 0; i < b.N; i++ {
+			if _, err := GoUncompressBuffer(compressed, output); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+}
+
+func BenchmarkUncompressStream(b *testing.B) {
+	runUncompressBenchMatrix(b, func(b *testing.B, compressed []byte, output []byte) {
+		for i := 0; i < b.N; i++ {
+			inputReader, outputWriter, _ := sliceStreamHandlers(compressed, output)
+			if _, err := GoUncompressStream(benchWorkBufferSize, benchWorkBufferSize, inputReader, outputWriter); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+}
+
+func BenchmarkUncompressTransformer(b *testing.B) {
+	runUncompressBenchMatrix(b, func(b *testing.B, compressed []byte, output []byte) {
+		input := bytes.NewReader(compressed)
+		uncompressor, err := NewGoZLibUncompressor(input, benchWorkBufferSize)
+		if err != nil {
+			b.Fatal(err)
+		}
+		defer uncompressor.Close()
+
+		for i := 0; i < b.N; i++ {
+			input.Reset(compressed)
+			ResetUncompressor(input, uncompressor)
+			if _, err := io.ReadFull(uncompressor, output); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+}
+
+// BenchmarkUncompressStdLib is the compress/gzip baseline for the gozlib uncompression benchmarks
+func BenchmarkUncompressStdLib(b *testing.B) {
+	runUncompressBenchMatrix(b, func(b *testing.B, compressed []byte, output []byte) {
+		input := bytes.NewReader(compressed)
+		uncompressor, err := gzip.NewReader(input)
+		if err != nil {
+			b.Fatal(err)
+		}
+
+		for i := 0; i < b.N; i++ {
+			input.Reset(compressed)
+			if err := uncompressor.Reset(input); err != nil {
+				b.Fatal(err)
+			}
+			if _, err := io.ReadFull(uncompressor, output); err != nil {
+				b.Fatal(err)
+			}
+		}
+	})
+}
+
+// contention benchmarks, where all goroutines share the native context and transformer pools
+
+func runParallelBench(b *testing.B, bench func(b *testing.B, input []byte)) {
+	for _, kind := range benchCorpusKinds {
+		kind := kind
+		b.Run(fmt.Sprintf("%s/%s", kind, benchSizeName(benchParallelSize)), func(b *testing.B) {
+			input := benchCorpus(kind, benchParallelSize)
+			b.SetBytes(int64(len(input)))
+			b.ReportAllocs()
+			b.ResetTimer()
+			bench(b, input)
+		})
+	}
+}
+
+func BenchmarkCompressBufferParallel(b *testing.B) {
+	runParallelBench(b, func(b *testing.B, input []byte) {
+		b.RunParallel(func(pb *testing.PB) {
+			output := make([]byte, GZipStoreBound(len(input)))
+			for pb.Next() {
+				if _, err := GoGZipCompressBuffer(CompressionLevelDefault, input, output); err != nil {
+					b.Error(err)
+					return
+				}
+			}
+		})
+	})
+}
+
+func BenchmarkCompressTransformerParallel(b *testing.B) {
+	runParallelBench(b, func(b *testing.B, input []byte) {
+		b.RunParallel(func(pb *testing.PB) {
+			output := bytes.NewBuffer(make([]byte, 0, GZipStoreBound(len(input))))
+			for pb.Next() {
+				// a new compressor per iteration measures acquiring the transformer from the shared pool
+				output.Reset()
+				compressor, err := NewGoGZipCompressor(output, CompressionLevelDefault, benchWorkBufferSize)
+				if err != nil {
+					b.Error(err)
+					return
+				}
+				_, werr := compressor.Write(input)
+				if cerr := compressor.Close(); werr != nil || cerr != nil {
+					b.Error(werr, cerr)
+					return
+				}
+			}
+		})
+	})
+}
+
+func BenchmarkUncompressBufferParallel(b *testing.B) {
+	runParallelBench(b, func(b *testing.B, input []byte) {
+		compressed := benchGZipCompress(b, CompressionLevelDefault, input)
+		b.ResetTimer()
+		b.RunParallel(func(pb *testing.PB) {
+			output := make([]byte, len(input))
+			for pb.Next() {
+				if _, err := GoUncompressBuffer(compressed, output); err != nil {
+					b.Error(err)
+					return
+				}
+			}
+		})
+	})
+}
+
+func BenchmarkCompressStdLibParallel(b *testing.B) {
+	runParallelBench(b, func(b *testing.B, input []byte) {
+		b.RunParallel(func(pb *testing.PB) {
+			output := bytes.NewBuffer(make([]byte, 0, GZipStoreBound(len(input))))
+			compressor, _ := gzip.NewWriterLevel(output, gzip.DefaultCompression)
+			for pb.Next() {
+				output.Reset()
+				compressor.Reset(output)
+				_, werr := compressor.Write(input)
+				if cerr := compressor.Close(); werr != nil || cerr != nil {
+					b.Error(werr, cerr)
+					return
+				}
+			}
+		})
+	})
+}
+
+// BenchmarkNativeSlicePool measures acquiring and returning off-heap slices, compared with BenchmarkMakeSlice
+func BenchmarkNativeSlicePool(b *testing.B) {
+	pool := NewNativeSlicePool()
+	defer pool.Free()
+
+	for _, size := range []int{128, 4 * 1024, 64 * 1024, 1024 * 1024} {
+		size := size
+		b.Run(benchSizeName(size), func(b *testing.B) {
+			b.ReportAllocs()
+			b.RunParallel(func(pb *testing.PB) {
+				for pb.Next() {
+					slice := pool.Acquire(size)
+					pool.Return(slice)
+				}
+			})
+		})
+	}
+}
+
+var benchSliceSink []byte
+
+func BenchmarkMakeSlice(b *testing.B) {
+	for _, size := range []int{128, 4 * 1024, 64 * 1024, 1024 * 1024} {
+		size := size
+		b.Run(benchSizeName(size), func(b *testing.B) {
+			b.ReportAllocs()
+			b.RunParallel(func(pb *testing.PB) {
+				var slice []byte
+				for pb.Next() {
+					slice = make([]byte, 0, size)
+				}
+				benchSliceSink = slice
+			})
+		})
+	}
+}
+
+// transformer reuse, the pooled transformers are compared to creating and closing a new one each time
+
+func BenchmarkTransformerPoolAcquireRelease(b *testing.B) {
+	pool, err := NewTransformerPool(TransformModeGZip, CompressionLevelDefault, 16*1024, DefaultTransformerPoolCapacity)
+	if err != nil {
+		b.Fatal(err)
+	}
+	defer pool.Close()
+
+	b.ReportAllocs()
+	b.RunParallel(func(pb *testing.PB) {
+		for pb.Next() {
+			compressor, err := pool.AcquireCompressor(io.Discard)
+			if err != nil {
+				b.Fatal(err)
+			}
+			pool.ReleaseCompressor(compressor)
+		}
+	})
+}
+
+func BenchmarkTransformerNewClose(b *testing.B) {
+	b.ReportAllocs()
+	b.RunParallel(func(pb *testing.PB) {
+		for pb.Next() {
+			compressor, err := NewGoGZipCompressor(io.Discard, CompressionLevelDefault, 16*1024)
+			if err != nil {
+				b.Fatal(err)
+			}
+			_ = compressor.Close()
+		}
+	})
+}
+
+// vectored input, compressing fragments in place compared to concatenating them first
+
+func benchFragments(size int) [][]byte {
+	data := benchCorpus("json", size)
+	fragments := [][]byte{}
+	for len(data) > 0 {
+		fragment := len(data)
+		if fragment > size/8+1 {
+			fragment = size/8 + 1
+		}
+		fragments = append(fragments, data[:fragment])
+		data = data[fragment:]
+	}
+	return fragments
+}
+
+func BenchmarkCompressVector(b *testing.B) {
+	for _, size := range []int{4 * 1024, 64 * 1024} {
+		fragments := benchFragments(size)
+		output := make([]byte, 0, GZipStoreBound(size))
+		b.Run(benchSizeName(size), func(b *testing.B) {
+			b.SetBytes(int64(size))
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				if _, err := GoGZipCompressVector(CompressionLevelDefault, fragments, output); err != nil {
+					b.Fatal(err)
+				}
+			}
+		})
+	}
+}
+
+func BenchmarkCompressConcatenated(b *testing.B) {
+	for _, size := range []int{4 * 1024, 64 * 1024} {
+		fragments := benchFragments(size)
+		output := make([]byte, 0, GZipStoreBound(size))
+		concatenated := make([]byte, 0, size)
+		b.Run(benchSizeName(size), func(b *testing.B) {
+			b.SetBytes(int64(size))
+			b.ReportAllocs()
+			for i := 0; i < b.N; i++ {
+				concatenated = concatenated[:0]
+				for _, fragment := range fragments {
+					concatenated = append(concatenated, fragment...)
+				}
+				if _, err := GoGZipCompressBuffer(CompressionLevelDefault, concatenated, output); err != nil {
+					b.Fatal(err)
+				}
+			}
+		})
+	}
+}
+
+// benchSlowWriter discards its input after a fixed delay per write, like a socket whose peer reads slowly
+type benchSlowWriter struct {
+	delay time.Duration
+}
+
+func (sw *benchSlowWriter) Write(data []byte) (int, error) {
+	time.Sleep(sw.delay)
+	return len(data), nil
+}
+
+func benchSlowOutputCompress(b *testing.B, newCompressor func(output io.Writer) (io.WriteCloser, error)) {
+	const size = 1024 * 1024
+	input := benchCorpus(benchCorpusLog, size)
+	output := &benchSlowWriter{delay: 100 * time.Microsecond}
+
+	b.SetBytes(size)
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		compressor, err := newCompressor(output)
+		if err != nil {
+			b.Fatal(err)
+		}
+		_, werr := compressor.Write(input)
+		if cerr := compressor.Close(); werr != nil || cerr != nil {
+			b.Fatal(werr, cerr)
+		}
+	}
+}
+
+func BenchmarkCompressSlowOutputSync(b *testing.B) {
+	benchSlowOutputCompress(b, func(output io.Writer) (io.WriteCloser, error) {
+		return NewGoGZipCompressor(output, CompressionLevelDefault, 16*1024)
+	})
+}
+
+func BenchmarkCompressSlowOutputPipelined(b *testing.B) {
+	benchSlowOutputCompress(b, func(output io.Writer) (io.WriteCloser, error) {
+		return NewGoGZipPipelinedCompressor(output, CompressionLevelDefault, 16*1024, DefaultPipelineDepth)
+	})
+}
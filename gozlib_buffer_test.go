@@ -2,6 +2,7 @@ package gozlib
 
 import (
 	"bytes"
+	"encoding/binary"
 	"testing"
 
 	"github.com/stretchr/testify/assert"
@@ -115,3 +116,425 @@ func TestGoCompressUncompressBuffer(t *testing.T) {
 	assert.Equal(t, uint64(inputSize), uncompLen)
 	assert.Equal(t, input, uncompressed[:uncompLen])
 }
+
+func TestBufferCompressorUncompressorReuse(t *testing.T) {
+	const inputSize = 2113
+	const outputSize = inputSize + 64
+	const maxRuns = 17
+
+	compressor, compInitErr := NewGoGZipBufferCompressor(CompressionLevelBestSpeed)
+	assert.NoError(t, compInitErr)
+	defer compressor.Close()
+
+	uncompressor, uncompInitErr := NewGoBufferUncompressor()
+	assert.NoError(t, uncompInitErr)
+	defer uncompressor.Close()
+
+	// the same contexts should be usable for many independent buffers
+	for runCount := 0; runCount < maxRuns; runCount++ {
+		input := makeTestData(inputSize)
+		output := make([]byte, 0, outputSize)
+
+		compLen, compErr := compressor.Compress(input, output)
+		assert.NoError(t, compErr)
+
+		stdUncompressed, stdErr := stdLibGZipUncompress(bytes.NewBuffer(output[:compLen]), int64(inputSize))
+		assert.NoError(t, stdErr)
+		assert.Equal(t, input, stdUncompressed)
+
+		uncompressed := make([]byte, 0, inputSize)
+		uncompLen, uncompErr := uncompressor.Uncompress(output[:compLen], uncompressed)
+		assert.NoError(t, uncompErr)
+		assert.Equal(t, input, uncompressed[:uncompLen])
+	}
+}
+
+func TestBufferCompressorFailOutputSizeTooSmall(t *testing.T) {
+	compressor, initErr := NewGoGZipBufferCompressor(CompressionLevelBestCompression)
+	assert.NoError(t, initErr)
+	defer compressor.Close()
+
+	output := make([]byte, 0, 32)
+	compLen, err := compressor.Compress(makeTestData(1024), output)
+	assert.ErrorIs(t, err, BufferCompressError)
+	assert.Equal(t, uint64(0), compLen)
+
+	// the compressor must still be usable after a failure
+	output = make([]byte, 0, 2048)
+	_, err = compressor.Compress(makeTestData(1024), output)
+	assert.NoError(t, err)
+}
+
+func TestCompressBatch(t *testing.T) {
+	for _, threads := range []int{0, 1, 3, 100} {
+		const itemCount = 17
+		inputs := make([][]byte, itemCount)
+		outputs := make([][]byte, itemCount)
+		for i := range inputs {
+			inputs[i] = makeTestData(uint32(i * 100))
+			outputs[i] = make([]byte, len(inputs[i])+100)
+		}
+
+		results, err := GoGZipCompressBatch(CompressionLevelBestSpeed, inputs, outputs, threads)
+		assert.NoError(t, err)
+		assert.Len(t, results, itemCount)
+
+		for i, result := range results {
+			assert.NoError(t, result.Err)
+			uncompressed, uerr := stdLibGZipUncompress(bytes.NewBuffer(outputs[i][:result.CompressedLen]), int64(len(inputs[i])))
+			assert.NoError(t, uerr)
+			assert.Equal(t, inputs[i], uncompressed)
+		}
+	}
+}
+
+func TestCompressBatchItemErrors(t *testing.T) {
+	inputs := [][]byte{makeTestData(1000), makeTestData(1000), makeTestData(1000)}
+	outputs := [][]byte{make([]byte, 2000), make([]byte, 10), nil}
+
+	results, err := GoGZipCompressBatch(CompressionLevelBestCompression, inputs, outputs, 1)
+	assert.NoError(t, err)
+
+	assert.NoError(t, results[0].Err)
+	assert.ErrorIs(t, results[1].Err, BufferCompressError)
+	assert.ErrorIs(t, results[2].Err, BufferCompressError)
+
+	// a failed item should not affect the following ones reusing the same context
+	uncompressed, uerr := stdLibGZipUncompress(bytes.NewBuffer(outputs[0][:results[0].CompressedLen]), 1000)
+	assert.NoError(t, uerr)
+	assert.Equal(t, inputs[0], uncompressed)
+
+	reordered, err := GoGZipCompressBatch(CompressionLevelBestCompression, [][]byte{inputs[1], inputs[0]}, [][]byte{outputs[1], outputs[0]}, 1)
+	assert.NoError(t, err)
+	assert.Error(t, reordered[0].Err)
+	assert.NoError(t, reordered[1].Err)
+	uncompressed, uerr = stdLibGZipUncompress(bytes.NewBuffer(outputs[0][:reordered[1].CompressedLen]), 1000)
+	assert.NoError(t, uerr)
+	assert.Equal(t, inputs[0], uncompressed)
+}
+
+func TestCompressBatchFailLengthMismatch(t *testing.T) {
+	_, err := GoGZipCompressBatch(CompressionLevelBestSpeed, [][]byte{{1}}, [][]byte{}, 1)
+	assert.ErrorIs(t, err, BatchLengthMismatchError)
+
+	results, err := GoGZipCompressBatch(CompressionLevelBestSpeed, nil, nil, 1)
+	assert.NoError(t, err)
+	assert.Len(t, results, 0)
+}
+
+func verifyBufferBackendCompressUncompress(t *testing.T, options CompressionOptions) {
+	input := makeTestData(100 * 1024)
+	compressed := make([]byte, 0, len(input)+1024)
+	compLen, err := GoCompressBufferWithOptions(options, input, compressed)
+	if !assert.NoError(t, err) {
+		return
+	}
+
+	uncompressed := make([]byte, 0, len(input))
+	uncompLen, err := GoUncompressBufferWithOptions(UncompressionOptions{Format: options.Format}, compressed[:compLen], uncompressed)
+	assert.NoError(t, err)
+	assert.Equal(t, input, uncompressed[:uncompLen])
+}
+
+func TestBufferBackends(t *testing.T) {
+	initial := GetBufferBackend()
+	defer SetBufferBackend(initial)
+
+	backends := []BufferBackend{BufferBackendZLib}
+	if err := SetBufferBackend(BufferBackendLibDeflate); err == nil {
+		backends = append(backends, BufferBackendLibDeflate)
+	} else {
+		assert.ErrorIs(t, err, UnsupportedBufferBackendError)
+	}
+	assert.ErrorIs(t, SetBufferBackend(BufferBackend(-1)), UnsupportedBufferBackendError)
+
+	for _, backend := range backends {
+		assert.NoError(t, SetBufferBackend(backend))
+		assert.Equal(t, backend, GetBufferBackend())
+
+		for _, format := range []CompressionFormat{CompressionFormatGZip, CompressionFormatZLib, CompressionFormatRaw} {
+			verifyBufferBackendCompressUncompress(t, CompressionOptions{Format: format, Level: CompressionLevelBestSpeed})
+			// a window the backend doesn't support falls back to zlib
+			verifyBufferBackendCompressUncompress(t, CompressionOptions{Format: format, Level: CompressionLevelBestCompression, WindowBits: 10})
+		}
+	}
+	assert.NotEmpty(t, ZLibVersion())
+}
+
+func TestGoGZipCompressVector(t *testing.T) {
+	original := makeTestData(40 * 1024)
+	// unevenly sized segments, with an empty one, as assembled from several fragments
+	input := [][]byte{original[:17], original[17:1000], {}, original[1000:30000], original[30000:]}
+
+	output := make([]byte, 0, len(original)+1024)
+	compLen, err := GoGZipCompressVector(CompressionLevelBestSpeed, input, output)
+	assert.NoError(t, err)
+
+	uncompressed, err := stdLibGZipUncompress(bytes.NewBuffer(output[:compLen]), int64(len(original)))
+	assert.NoError(t, err)
+	assert.Equal(t, original, uncompressed)
+
+	// no input is still a valid, empty gzip stream
+	compLen, err = GoGZipCompressVector(CompressionLevelBestSpeed, nil, output)
+	assert.NoError(t, err)
+	uncompressed, err = stdLibGZipUncompress(bytes.NewBuffer(output[:compLen]), 0)
+	assert.NoError(t, err)
+	assert.Empty(t, uncompressed)
+}
+
+func TestCompressVectorToBufferChain(t *testing.T) {
+	const bufferSize = 4096
+
+	pool := NewNativeSlicePool()
+	defer pool.Free()
+
+	original := makeTestData(64 * 1024)
+	input := [][]byte{original[:20000], original[20000:]}
+
+	output := make([][]byte, 32)
+	for i := range output {
+		output[i] = pool.Acquire(bufferSize)
+	}
+
+	options := CompressionOptions{Format: CompressionFormatZLib, Level: CompressionLevelDefault}
+	compLen, err := GoCompressVectorWithOptions(options, input, output)
+	assert.NoError(t, err)
+
+	compressed := []byte{}
+	for i, buffer := range output {
+		// buffers are filled in order, only the last one used can be partially filled
+		if len(buffer) < bufferSize {
+			for _, unused := range output[i+1:] {
+				assert.Empty(t, unused)
+			}
+		}
+		compressed = append(compressed, buffer...)
+		pool.Return(buffer)
+	}
+	assert.Equal(t, int(compLen), len(compressed))
+	assert.Greater(t, compLen, uint64(bufferSize))
+
+	uncompressed := make([]byte, 0, len(original))
+	uncompLen, err := GoUncompressBufferWithOptions(UncompressionOptions{Format: CompressionFormatZLib}, compressed, uncompressed)
+	assert.NoError(t, err)
+	assert.Equal(t, original, uncompressed[:uncompLen])
+}
+
+func TestCompressVectorFailOutputTooSmall(t *testing.T) {
+	input := [][]byte{makeTestData(8192), makeTestData(8192)}
+
+	_, err := GoGZipCompressVector(CompressionLevelBestSpeed, input, make([]byte, 0, 64))
+	assert.ErrorIs(t, err, BufferCompressError)
+
+	_, err = GoCompressVectorWithOptions(CompressionOptions{Level: CompressionLevelBestSpeed}, input, nil)
+	assert.ErrorIs(t, err, OutputBufferTooSmallError)
+
+	_, err = GoCompressVectorWithOptions(CompressionOptions{Level: CompressionLevelBestSpeed, Adaptive: true}, input, [][]byte{make([]byte, 0, 32*1024)})
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+}
+
+func TestCompressBound(t *testing.T) {
+	for _, format := range []CompressionFormat{CompressionFormatGZip, CompressionFormatZLib, CompressionFormatRaw} {
+		options := CompressionOptions{Format: format, Level: CompressionLevelBestCompression}
+		input := makeTestData(50000)
+		bound, err := CompressBound(options, len(input))
+		assert.NoError(t, err)
+		assert.Greater(t, bound, len(input))
+
+		// a buffer of exactly the bound is never too small
+		compressed := make([]byte, 0, bound)
+		_, err = GoCompressBufferWithOptions(options, input, compressed)
+		assert.NoError(t, err)
+	}
+
+	_, err := CompressBound(CompressionOptions{Level: CompressionLevel(42)}, 10)
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+}
+
+func TestCompressUncompressBufferPooled(t *testing.T) {
+	pool := NewNativeSlicePool()
+	defer pool.Free()
+
+	for _, size := range []uint32{0, 100, 70000, 1024 * 1024} {
+		original := makeTestData(size)
+
+		compressed, err := GoCompressBufferPooled(CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelBestSpeed}, original, pool)
+		if !assert.NoError(t, err) {
+			continue
+		}
+
+		stdUncompressed, err := stdLibGZipUncompress(bytes.NewBuffer(compressed), int64(size))
+		assert.NoError(t, err)
+		assert.Equal(t, original, stdUncompressed)
+
+		uncompressed, err := GoUncompressBufferPooled(UncompressionOptions{}, compressed, pool)
+		assert.NoError(t, err)
+		assert.Equal(t, len(original), len(uncompressed))
+		assert.True(t, bytes.Equal(original, uncompressed))
+
+		pool.Return(uncompressed)
+		pool.Return(compressed)
+	}
+}
+
+func TestUncompressBufferPooledGrowsOutput(t *testing.T) {
+	pool := NewNativeSlicePool()
+	defer pool.Free()
+
+	// highly compressible zlib data has no size hint, the output is grown until the stream ends
+	original := bytes.Repeat([]byte("gozlib"), 200000)
+	options := CompressionOptions{Format: CompressionFormatZLib, Level: CompressionLevelBestCompression}
+	compressed, err := GoCompressBufferPooled(options, original, pool)
+	assert.NoError(t, err)
+	defer pool.Return(compressed)
+
+	uncompressed, err := GoUncompressBufferPooled(UncompressionOptions{Format: CompressionFormatZLib}, compressed, pool)
+	assert.NoError(t, err)
+	assert.True(t, bytes.Equal(original, uncompressed))
+	pool.Return(uncompressed)
+
+	_, err = GoUncompressBufferPooled(UncompressionOptions{}, compressed[:len(compressed)/2], pool)
+	assert.ErrorIs(t, err, BufferUncompressError)
+}
+
+func TestUncompressBufferPooledConsumesWholeInput(t *testing.T) {
+	pool := NewNativeSlicePool()
+	defer pool.Free()
+
+	members, original, err := stdLibGZipCompressMembers(3000, 1, 70000)
+	assert.NoError(t, err)
+	uncompressed, err := GoUncompressBufferPooled(UncompressionOptions{}, members, pool)
+	assert.NoError(t, err)
+	assert.True(t, bytes.Equal(original, uncompressed))
+	pool.Return(uncompressed)
+
+	garbage := append(append([]byte{}, members...), bytes.Repeat([]byte("X"), 100)...)
+	_, err = GoUncompressBufferPooled(UncompressionOptions{}, garbage, pool)
+	assert.ErrorIs(t, err, BufferUncompressError)
+
+	// raw streams have no members to follow them
+	options := CompressionOptions{Format: CompressionFormatRaw, Level: CompressionLevelDefault}
+	raw, err := GoCompressBufferPooled(options, original, pool)
+	assert.NoError(t, err)
+	defer pool.Return(raw)
+	_, err = GoUncompressBufferPooled(UncompressionOptions{Format: CompressionFormatRaw}, append(append([]byte{}, raw...), members...), pool)
+	assert.ErrorIs(t, err, BufferUncompressError)
+}
+
+func TestUncompressBufferPooledDistrustsTrailerSize(t *testing.T) {
+	pool := NewNativeSlicePool()
+	defer pool.Free()
+
+	original := makeTestData(1000)
+	compressed, err := stdLibGZipCompressSlice(original)
+	assert.NoError(t, err)
+	// claims 1000 times the input, within the deflate ratio, the stream still fails on its trailer
+	binary.LittleEndian.PutUint32(compressed[len(compressed)-4:], uint32(len(compressed)*1000))
+
+	_, err = GoUncompressBufferPooled(UncompressionOptions{}, compressed, pool)
+	assert.ErrorIs(t, err, BufferUncompressError)
+	for _, stats := range pool.Stats() {
+		assert.Less(t, stats.HighWaterBytes, uint64(len(compressed)*128), stats.BlockSize)
+	}
+}
+
+func TestUncompressBatchPooled(t *testing.T) {
+	pool := NewNativeSlicePool()
+	defer pool.Free()
+
+	originals := make([][]byte, 12)
+	inputs := make([][]byte, len(originals))
+	for i := range originals {
+		originals[i] = makeTestData(uint32(1000 + i*3000))
+		compressed, err := stdLibGZipCompressSlice(originals[i])
+		assert.NoError(t, err)
+		inputs[i] = compressed
+	}
+	inputs[3] = []byte{}
+
+	for _, threads := range []int{0, 1, 4, 32} {
+		results, err := GoUncompressBatchPooled(UncompressionOptions{}, inputs, pool, threads)
+		assert.NoError(t, err)
+		assert.Equal(t, len(inputs), len(results))
+
+		for i, result := range results {
+			if i == 3 {
+				assert.ErrorIs(t, result.Err, BufferUncompressError)
+				assert.Nil(t, result.Output)
+				continue
+			}
+			assert.NoError(t, result.Err)
+			assert.True(t, bytes.Equal(originals[i], result.Output))
+			pool.Return(result.Output)
+		}
+	}
+
+	results, err := GoUncompressBatchPooled(UncompressionOptions{}, nil, pool, 4)
+	assert.NoError(t, err)
+	assert.Empty(t, results)
+
+	_, err = GoUncompressBatchPooled(UncompressionOptions{Format: CompressionFormat(9)}, inputs, pool, 1)
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+}
+
+func TestUncompressBatchPooledConsumesWholeInput(t *testing.T) {
+	pool := NewNativeSlicePool()
+	defer pool.Free()
+
+	members, original, err := stdLibGZipCompressMembers(3000, 1, 70000)
+	assert.NoError(t, err)
+	garbage := append(append([]byte{}, members...), bytes.Repeat([]byte("X"), 100)...)
+	zlibOriginal := makeTestData(5000)
+	zlibCompressed, err := GoCompressBufferPooled(CompressionOptions{Format: CompressionFormatZLib, Level: CompressionLevelDefault}, zlibOriginal, pool)
+	assert.NoError(t, err)
+	defer pool.Return(zlibCompressed)
+	zlibTrailing := append(append([]byte{}, zlibCompressed...), zlibCompressed...)
+
+	inputs := [][]byte{members, garbage, zlibCompressed, zlibTrailing}
+	results, err := GoUncompressBatchPooled(UncompressionOptions{}, inputs, pool, 2)
+	assert.NoError(t, err)
+
+	assert.NoError(t, results[0].Err)
+	assert.True(t, bytes.Equal(original, results[0].Output))
+	pool.Return(results[0].Output)
+	assert.NoError(t, results[2].Err)
+	assert.True(t, bytes.Equal(zlibOriginal, results[2].Output))
+	pool.Return(results[2].Output)
+
+	// only gzip members can follow the end of a stream
+	for _, i := range []int{1, 3} {
+		assert.ErrorIs(t, results[i].Err, BufferUncompressError)
+		assert.Nil(t, results[i].Output)
+	}
+}
+
+func TestUncompressBatchPooledVerifiesTrailers(t *testing.T) {
+	pool := NewNativeSlicePool()
+	defer pool.Free()
+
+	original := makeTestData(20000)
+	compressed, err := stdLibGZipCompressSlice(original)
+	assert.NoError(t, err)
+
+	badCRC := append([]byte{}, compressed...)
+	badCRC[len(badCRC)-8] ^= 0xff
+	badSize := append([]byte{}, compressed...)
+	badSize[len(badSize)-4] ^= 0x01
+	truncated := compressed[:len(compressed)-4]
+
+	inputs := [][]byte{compressed, badCRC, compressed, badSize, truncated, compressed}
+	results, err := GoUncompressBatchPooled(UncompressionOptions{}, inputs, pool, 2)
+	assert.NoError(t, err)
+
+	for i, result := range results {
+		if i == 1 || i == 3 || i == 4 {
+			assert.ErrorIs(t, result.Err, BufferUncompressError)
+			assert.Nil(t, result.Output)
+			continue
+		}
+		// a failed item leaves the context of its range ready for the next one
+		assert.NoError(t, result.Err)
+		assert.True(t, bytes.Equal(original, result.Output))
+		pool.Return(result.Output)
+	}
+}
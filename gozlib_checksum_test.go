@@ -0,0 +1,95 @@
+package gozlib
+
+import (
+	"bytes"
+	"hash/adler32"
+	"hash/crc32"
+	"io"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestChecksumsMatchStandardLibrary(t *testing.T) {
+	data := makeTestData(1024*1024 + 7)
+
+	assert.Equal(t, crc32.ChecksumIEEE(data), CRC32(0, data))
+	assert.Equal(t, adler32.Checksum(data), Adler32(1, data))
+	assert.Equal(t, uint32(0), CRC32(0, nil))
+	assert.Equal(t, uint32(1), Adler32(1, []byte{}))
+}
+
+func TestChecksumsCombine(t *testing.T) {
+	data := makeTestData(300000)
+	first, second := data[:123457], data[123457:]
+
+	assert.Equal(t, CRC32(0, data), CRC32Combine(CRC32(0, first), CRC32(0, second), int64(len(second))))
+	assert.Equal(t, Adler32(1, data), Adler32Combine(Adler32(1, first), Adler32(1, second), int64(len(second))))
+}
+
+func TestChecksumHash(t *testing.T) {
+	data := makeTestData(10000)
+
+	crc := NewCRC32()
+	crc.Write(data[:5000])
+	crc.Write(data[5000:])
+	assert.Equal(t, crc32.ChecksumIEEE(data), crc.Sum32())
+	assert.Equal(t, crc32.NewIEEE().Sum(data[:0:0]), NewCRC32().Sum(nil))
+
+	adler := NewAdler32()
+	adler.Write(data)
+	stdAdler := adler32.New()
+	stdAdler.Write(data)
+	assert.Equal(t, stdAdler.Sum([]byte{1}), adler.Sum([]byte{1}))
+
+	adler.Reset()
+	assert.Equal(t, uint32(1), adler.Sum32())
+}
+
+func TestGZipStoreBuffer(t *testing.T) {
+	for _, size := range []uint32{0, 100, storedBlockMaxLen, storedBlockMaxLen*2 + 1} {
+		original := makeTestData(size)
+		output := make([]byte, 0, GZipStoreBound(len(original)))
+
+		storedLen, err := GoGZipStoreBuffer(original, output)
+		assert.NoError(t, err)
+		assert.Equal(t, uint64(cap(output)), storedLen)
+
+		// the standard library reader validates the crc and size in the trailer
+		uncompressed, err := stdLibGZipUncompress(bytes.NewBuffer(output[:storedLen]), int64(size))
+		assert.NoError(t, err)
+		assert.Equal(t, original, uncompressed)
+	}
+
+	_, err := GoGZipStoreBuffer(makeTestData(100), make([]byte, 0, 100))
+	assert.ErrorIs(t, err, BufferCompressError)
+}
+
+func TestGZipStoredWriter(t *testing.T) {
+	original := makeTestData(3*storedBlockMaxLen + 1000)
+	output := bytes.NewBuffer([]byte{})
+
+	writer := NewGoGZipStoredWriter(output)
+	written, err := io.CopyBuffer(writer, bytes.NewReader(original), make([]byte, 50000))
+	assert.NoError(t, err)
+	assert.Equal(t, int64(len(original)), written)
+	assert.NoError(t, writer.Close())
+
+	uncompressed, err := stdLibGZipUncompress(output, int64(len(original)))
+	assert.NoError(t, err)
+	assert.Equal(t, original, uncompressed)
+
+	_, err = writer.Write(original)
+	assert.ErrorIs(t, err, TransformerCompressionError)
+}
+
+func TestGZipStoredWriterEmptyInput(t *testing.T) {
+	output := bytes.NewBuffer([]byte{})
+
+	writer := NewGoGZipStoredWriter(output)
+	assert.NoError(t, writer.Close())
+
+	uncompressed, err := stdLibGZipUncompress(output, 0)
+	assert.NoError(t, err)
+	assert.Empty(t, uncompressed)
+}
@@ -0,0 +1,151 @@
+package gozlib
+
+import (
+	"bytes"
+	"compress/flate"
+	"compress/zlib"
+	"fmt"
+	"io"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+var testDictionaryData = []byte(`{"request_id":"","user_name":"","email":"","created_at":"","updated_at":"","status":"active","roles":["reader","writer"]}`)
+
+func makeTestJSONPayload(i int) []byte {
+	return []byte(fmt.Sprintf(`{"request_id":"%d","user_name":"user%d","email":"user%d@example.com","created_at":"2024-01-%02d","updated_at":"2024-02-%02d","status":"active","roles":["reader"]}`,
+		i, i, i, i%28+1, i%28+1))
+}
+
+func TestDictionaryCompressBufferImprovesRatio(t *testing.T) {
+	for _, format := range []CompressionFormat{CompressionFormatZLib, CompressionFormatRaw} {
+		options := CompressionOptions{Format: format, Level: CompressionLevelBestCompression}
+		dictionary, err := NewDictionary(testDictionaryData, options)
+		assert.NoError(t, err)
+
+		output := make([]byte, 512)
+		for i := 0; i < 50; i++ {
+			payload := makeTestJSONPayload(i)
+
+			plainLen, perr := GoCompressBufferWithOptions(options, payload, output)
+			assert.NoError(t, perr)
+
+			compLen, cerr := GoCompressBufferWithDictionary(dictionary, payload, output)
+			assert.NoError(t, cerr)
+			assert.Less(t, compLen, plainLen)
+
+			// the standard library validates the output format and dictionary use
+			var reader io.Reader
+			if format == CompressionFormatRaw {
+				reader = flate.NewReaderDict(bytes.NewReader(output[:compLen]), testDictionaryData)
+			} else {
+				zreader, zerr := zlib.NewReaderDict(bytes.NewReader(output[:compLen]), testDictionaryData)
+				assert.NoError(t, zerr)
+				reader = zreader
+			}
+			stdUncompressed, rerr := io.ReadAll(reader)
+			assert.NoError(t, rerr)
+			assert.Equal(t, payload, stdUncompressed)
+
+			uncompressed := make([]byte, len(payload))
+			uncompLen, uerr := GoUncompressBufferWithDictionary(dictionary, output[:compLen], uncompressed)
+			assert.NoError(t, uerr)
+			assert.Equal(t, uint64(len(payload)), uncompLen)
+			assert.Equal(t, payload, uncompressed)
+		}
+
+		dictionary.Close()
+	}
+}
+
+func TestDictionaryTransformers(t *testing.T) {
+	dictionary, err := NewDictionary(testDictionaryData, CompressionOptions{Format: CompressionFormatZLib, Level: CompressionLevelDefault})
+	assert.NoError(t, err)
+	defer dictionary.Close()
+
+	payload := makeTestJSONPayload(7)
+	compressor, cerr := NewGoCompressorWithDictionary(bytes.NewBuffer([]byte{}), dictionary, 64)
+	assert.NoError(t, cerr)
+	uncompressor, uerr := NewGoUncompressorWithDictionary(bytes.NewBuffer([]byte{}), dictionary, 64)
+	assert.NoError(t, uerr)
+
+	// reset transformers start from the dictionary again
+	for run := 0; run < 3; run++ {
+		compressed := bytes.NewBuffer([]byte{})
+		ResetCompressor(compressed, compressor)
+		_, werr := compressor.Write(payload)
+		assert.NoError(t, werr)
+		assert.NoError(t, Flush(compressor))
+
+		ResetUncompressor(compressed, uncompressor)
+		uncompressed := bytes.NewBuffer([]byte{})
+		_, rerr := io.Copy(uncompressed, uncompressor)
+		assert.NoError(t, rerr)
+		assert.Equal(t, payload, uncompressed.Bytes())
+	}
+
+	assert.NoError(t, compressor.Close())
+	assert.NoError(t, uncompressor.Close())
+}
+
+func TestDictionaryStream(t *testing.T) {
+	dictionary, err := NewDictionary(testDictionaryData, CompressionOptions{Format: CompressionFormatRaw, Level: CompressionLevelBestSpeed})
+	assert.NoError(t, err)
+	defer dictionary.Close()
+
+	payload := makeTestJSONPayload(3)
+	input := bytes.NewBuffer(payload)
+	compressed := bytes.NewBuffer([]byte{})
+	_, cerr := GoCompressStreamWithDictionary(dictionary, 32, 32, func(data []byte) uint32 {
+		read, _ := input.Read(data)
+		return uint32(read)
+	}, func(data []byte) uint32 {
+		written, _ := compressed.Write(data)
+		return uint32(written)
+	})
+	assert.NoError(t, cerr)
+
+	uncompressed := bytes.NewBuffer([]byte{})
+	uncompLen, uerr := GoUncompressStreamWithDictionary(dictionary, 32, 32, func(data []byte) uint32 {
+		read, _ := compressed.Read(data)
+		return uint32(read)
+	}, func(data []byte) uint32 {
+		written, _ := uncompressed.Write(data)
+		return uint32(written)
+	})
+	assert.NoError(t, uerr)
+	assert.Equal(t, uint64(len(payload)), uncompLen)
+	assert.Equal(t, payload, uncompressed.Bytes())
+}
+
+func TestFailDictionaryMismatch(t *testing.T) {
+	options := CompressionOptions{Format: CompressionFormatZLib, Level: CompressionLevelDefault}
+	dictionary, _ := NewDictionary(testDictionaryData, options)
+	defer dictionary.Close()
+	other, _ := NewDictionary([]byte("some other dictionary"), options)
+	defer other.Close()
+
+	payload := makeTestJSONPayload(1)
+	output := make([]byte, 512)
+	compLen, err := GoCompressBufferWithDictionary(dictionary, payload, output)
+	assert.NoError(t, err)
+
+	uncompressed := make([]byte, len(payload))
+	_, err = GoUncompressBufferWithDictionary(other, output[:compLen], uncompressed)
+	assert.ErrorIs(t, err, BufferUncompressError)
+
+	_, err = GoUncompressBuffer(output[:compLen], uncompressed)
+	assert.ErrorIs(t, err, BufferUncompressError)
+}
+
+func TestFailInvalidDictionary(t *testing.T) {
+	_, err := NewDictionary(testDictionaryData, CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelDefault})
+	assert.ErrorIs(t, err, InvalidDictionaryError)
+
+	_, err = NewDictionary(nil, CompressionOptions{Format: CompressionFormatZLib, Level: CompressionLevelDefault})
+	assert.ErrorIs(t, err, InvalidDictionaryError)
+
+	_, err = NewDictionary(testDictionaryData, CompressionOptions{Format: CompressionFormatZLib, Level: CompressionLevelDefault, MemLevel: 20})
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+}
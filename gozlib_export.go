@@ -3,6 +3,7 @@ package gozlib
 import (
 	"reflect"
 	"sync"
+	"sync/atomic"
 	"unsafe"
 )
 import "C"
@@ -13,35 +14,97 @@ type streamEventHandlers struct {
 	onWrite DataStreamEventHandler
 }
 
-var dataStreamEventHandlersTracker = sync.Map{}
+// Stream event handlers are kept in a sharded slot table and identified by a small integer stored in ZStreamState.data_handler.
+// Registering and unregistering take the lock of a single shard, chosen round robin, while lookups from the stream
+// callbacks are lock free: slot pages are never moved or released once published
+const (
+	handlerShardBits = 4
+	handlerShardMask = 1<<handlerShardBits - 1
+	handlerPageBits  = 8
+	handlerPageSize  = 1 << handlerPageBits
+	handlerPageMask  = handlerPageSize - 1
+	handlerMaxPages  = 1024
+)
+
+type streamEventHandlersPage [handlerPageSize]*streamEventHandlers
 
-func registerStreamEventHandler(id unsafe.Pointer, shandler *streamEventHandlers) {
-	dataStreamEventHandlersTracker.Store(uintptr(id), shandler)
+type streamEventHandlersShard struct {
+	lock     sync.Mutex
+	free     []uint32
+	nextSlot uint32
+	pages    [handlerMaxPages]unsafe.Pointer
 }
 
-func unregisterStreamEventHandler(id unsafe.Pointer) {
-	dataStreamEventHandlersTracker.Delete(uintptr(id))
+var (
+	dataStreamEventHandlersShards    [handlerShardMask + 1]streamEventHandlersShard
+	dataStreamEventHandlersNextShard uint32
+)
+
+// registerStreamEventHandler stores shandler in a free slot and returns the non zero slot ID to be used as data handler
+func registerStreamEventHandler(shandler *streamEventHandlers) uintptr {
+	shardIndex := uintptr(atomic.AddUint32(&dataStreamEventHandlersNextShard, 1) & handlerShardMask)
+	shard := &dataStreamEventHandlersShards[shardIndex]
+
+	shard.lock.Lock()
+	var slot uint32
+	if freeCount := len(shard.free); freeCount > 0 {
+		slot = shard.free[freeCount-1]
+		shard.free = shard.free[:freeCount-1]
+	} else {
+		slot = shard.nextSlot
+		if slot >= handlerMaxPages*handlerPageSize {
+			shard.lock.Unlock()
+			panic("too many stream event handlers")
+		}
+
+		if slot&handlerPageMask == 0 {
+			atomic.StorePointer(&shard.pages[slot>>handlerPageBits], unsafe.Pointer(new(streamEventHandlersPage)))
+		}
+		shard.nextSlot++
+	}
+
+	page := (*streamEventHandlersPage)(atomic.LoadPointer(&shard.pages[slot>>handlerPageBits]))
+	page[slot&handlerPageMask] = shandler
+	shard.lock.Unlock()
+
+	return (uintptr(slot)<<handlerShardBits | shardIndex) + 1
 }
 
-const uintptrSize = C.ulong(unsafe.Sizeof(uintptr(0)))
+func unregisterStreamEventHandler(id uintptr) {
+	id--
+	shard := &dataStreamEventHandlersShards[id&handlerShardMask]
+	slot := uint32(id >> handlerShardBits)
+
+	shard.lock.Lock()
+	page := (*streamEventHandlersPage)(atomic.LoadPointer(&shard.pages[slot>>handlerPageBits]))
+	page[slot&handlerPageMask] = nil
+	shard.free = append(shard.free, slot)
+	shard.lock.Unlock()
+}
 
-func findStreamEventHandler(ptr unsafe.Pointer) *streamEventHandlers {
-	dsEventHandlerId := uintptr(ptr)
+func findStreamEventHandler(dsEventHandlerId uintptr) *streamEventHandlers {
 	if dsEventHandlerId == 0 {
 		panic("event handler id cannot be nil")
 	}
 
-	shandlerValue, exists := dataStreamEventHandlersTracker.Load(dsEventHandlerId)
-	if !exists {
+	dsEventHandlerId--
+	slot := dsEventHandlerId >> handlerShardBits
+	if slot >= handlerMaxPages*handlerPageSize {
+		panic("event handler not found")
+	}
+
+	shard := &dataStreamEventHandlersShards[dsEventHandlerId&handlerShardMask]
+	page := (*streamEventHandlersPage)(atomic.LoadPointer(&shard.pages[slot>>handlerPageBits]))
+	if page == nil || page[slot&handlerPageMask] == nil {
 		panic("event handler not found")
 	}
 
-	return shandlerValue.(*streamEventHandlers)
+	return page[slot&handlerPageMask]
 }
 
 //export GoStreamDataInputHandler
 func GoStreamDataInputHandler(ptr unsafe.Pointer, buffer unsafe.Pointer, bufferLength uint32) uint32 {
-	shandler := findStreamEventHandler(ptr)
+	shandler := findStreamEventHandler(uintptr(ptr))
 
 	var bufferSlice []byte
 	hdr := (*reflect.SliceHeader)(unsafe.Pointer(&bufferSlice))
@@ -55,7 +118,7 @@ func GoStreamDataInputHandler(ptr unsafe.Pointer, buffer unsafe.Pointer, bufferL
 
 //export GoStreamDataOutputHandler
 func GoStreamDataOutputHandler(ptr unsafe.Pointer, buffer unsafe.Pointer, bufferLength uint32) uint32 {
-	shandler := findStreamEventHandler(ptr)
+	shandler := findStreamEventHandler(uintptr(ptr))
 
 	var bufferSlice []byte
 	hdr := (*reflect.SliceHeader)(unsafe.Pointer(&bufferSlice))
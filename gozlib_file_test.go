@@ -0,0 +1,112 @@
+package gozlib
+
+import (
+	"bytes"
+	"io"
+	"os"
+	"path/filepath"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func writeTestFile(t *testing.T, name string, data []byte) string {
+	path := filepath.Join(t.TempDir(), name)
+	assert.NoError(t, os.WriteFile(path, data, 0644))
+	return path
+}
+
+func verifyCompressUncompressFile(t *testing.T, fileOptions FileOptions) {
+	// larger than the native output buffer so the output files are written in more than one step
+	original := makeTestData(12 * 1024 * 1024)
+	src := writeTestFile(t, "original", original)
+	compressedPath := filepath.Join(t.TempDir(), "compressed.gz")
+	uncompressedPath := filepath.Join(t.TempDir(), "uncompressed")
+
+	compressedLen, err := CompressFile(src, compressedPath, CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelBestSpeed}, fileOptions)
+	assert.NoError(t, err)
+
+	// the standard library validates the compressed file
+	compressed, err := os.ReadFile(compressedPath)
+	assert.NoError(t, err)
+	assert.Equal(t, int(compressedLen), len(compressed))
+	uncompressed, err := stdLibGZipUncompress(bytes.NewBuffer(compressed), int64(len(original)))
+	assert.NoError(t, err)
+	assert.Equal(t, original, uncompressed)
+
+	uncompressedLen, err := UncompressFile(compressedPath, uncompressedPath, UncompressionOptions{}, fileOptions)
+	assert.NoError(t, err)
+	assert.Equal(t, uint64(len(original)), uncompressedLen)
+	uncompressed, err = os.ReadFile(uncompressedPath)
+	assert.NoError(t, err)
+	assert.Equal(t, original, uncompressed)
+}
+
+func TestCompressUncompressFile(t *testing.T) {
+	verifyCompressUncompressFile(t, FileOptions{})
+}
+
+func TestCompressUncompressFileDirectIO(t *testing.T) {
+	verifyCompressUncompressFile(t, FileOptions{DirectIO: true})
+}
+
+func TestCompressUncompressEmptyFile(t *testing.T) {
+	src := writeTestFile(t, "empty", []byte{})
+	compressedPath := filepath.Join(t.TempDir(), "compressed")
+
+	compressedLen, err := CompressFile(src, compressedPath, CompressionOptions{Format: CompressionFormatZLib}, FileOptions{})
+	assert.NoError(t, err)
+	assert.Greater(t, compressedLen, uint64(0))
+
+	uncompressedLen, err := UncompressFile(compressedPath, filepath.Join(t.TempDir(), "uncompressed"), UncompressionOptions{}, FileOptions{})
+	assert.NoError(t, err)
+	assert.Equal(t, uint64(0), uncompressedLen)
+
+	uncompressedLen, err = UncompressFile(src, filepath.Join(t.TempDir(), "uncompressed"), UncompressionOptions{}, FileOptions{})
+	assert.NoError(t, err)
+	assert.Equal(t, uint64(0), uncompressedLen)
+}
+
+func TestFileUncompressor(t *testing.T) {
+	original := makeTestData(256 * 1024)
+	compressed, err := stdLibGZipCompressSlice(original)
+	assert.NoError(t, err)
+
+	uncompressor, err := NewGoFileUncompressor(writeTestFile(t, "compressed.gz", compressed), UncompressionOptions{})
+	assert.NoError(t, err)
+
+	uncompressed := bytes.NewBuffer([]byte{})
+	uncompressedLen, err := io.Copy(uncompressed, uncompressor)
+	assert.NoError(t, err)
+	assert.Equal(t, int64(len(original)), uncompressedLen)
+	assert.Equal(t, original, uncompressed.Bytes())
+
+	assert.NoError(t, uncompressor.Close())
+	_, err = uncompressor.Read(make([]byte, 1))
+	assert.ErrorIs(t, err, os.ErrClosed)
+}
+
+func TestFailUncompressTruncatedFile(t *testing.T) {
+	compressed, err := stdLibGZipCompressSlice(makeTestData(64 * 1024))
+	assert.NoError(t, err)
+	truncated := writeTestFile(t, "truncated.gz", compressed[:len(compressed)/2])
+
+	_, err = UncompressFile(truncated, filepath.Join(t.TempDir(), "uncompressed"), UncompressionOptions{}, FileOptions{})
+	assert.ErrorIs(t, err, FileUncompressError)
+
+	uncompressor, err := NewGoFileUncompressor(truncated, UncompressionOptions{})
+	assert.NoError(t, err)
+	_, err = io.Copy(io.Discard, uncompressor)
+	assert.ErrorIs(t, err, FileUncompressError)
+	assert.NoError(t, uncompressor.Close())
+}
+
+func TestFailCompressMissingFile(t *testing.T) {
+	missing := filepath.Join(t.TempDir(), "missing")
+
+	_, err := CompressFile(missing, filepath.Join(t.TempDir(), "compressed"), CompressionOptions{}, FileOptions{})
+	assert.ErrorIs(t, err, os.ErrNotExist)
+
+	_, err = NewGoFileUncompressor(missing, UncompressionOptions{})
+	assert.ErrorIs(t, err, os.ErrNotExist)
+}
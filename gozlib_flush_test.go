@@ -0,0 +1,258 @@
+package gozlib
+
+import (
+	"bytes"
+	"compress/flate"
+	"compress/gzip"
+	"io"
+	"strings"
+	"sync"
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/assert"
+)
+
+var syncFlushMarker = []byte{0, 0, 0xff, 0xff}
+
+func makeTestMessages(count int) [][]byte {
+	messages := make([][]byte, count)
+	for i := range messages {
+		messages[i] = []byte(strings.Repeat("message ", i%7+3) + string(rune('a'+i%26)) + "\n")
+	}
+	return messages
+}
+
+// readFlushed uncompresses length bytes from a gzip stream that may not be finished yet
+func readFlushed(t *testing.T, compressed []byte, length int) []byte {
+	reader, err := gzip.NewReader(bytes.NewReader(compressed))
+	assert.NoError(t, err)
+	uncompressed := make([]byte, length)
+	_, err = io.ReadFull(reader, uncompressed)
+	assert.NoError(t, err)
+	return uncompressed
+}
+
+func TestCompressorFlushWithKeepsStreamOpen(t *testing.T) {
+	for _, mode := range []FlushMode{FlushModeSync, FlushModePartial, FlushModeFull} {
+		output := bytes.NewBuffer([]byte{})
+		compressor, err := NewGoGZipCompressor(output, CompressionLevelDefault, 1024)
+		assert.NoError(t, err)
+
+		sent := []byte{}
+		for _, message := range makeTestMessages(20) {
+			_, err = compressor.Write(message)
+			assert.NoError(t, err)
+			assert.NoError(t, FlushWith(compressor, mode))
+			sent = append(sent, message...)
+
+			assert.Equal(t, sent, readFlushed(t, output.Bytes(), len(sent)))
+		}
+		if mode == FlushModeSync || mode == FlushModeFull {
+			assert.True(t, bytes.HasSuffix(output.Bytes(), syncFlushMarker))
+		}
+
+		assert.NoError(t, compressor.Close())
+		uncompressed, uerr := stdLibGZipUncompress(output, int64(len(sent)))
+		assert.NoError(t, uerr)
+		assert.Equal(t, sent, uncompressed)
+	}
+}
+
+func TestCompressorFlushWithRawFormat(t *testing.T) {
+	output := bytes.NewBuffer([]byte{})
+	compressor, err := NewGoCompressorWithOptions(output, CompressionOptions{Format: CompressionFormatRaw, Level: CompressionLevelDefault}, 4096)
+	assert.NoError(t, err)
+	defer compressor.Close()
+
+	message := makeTestData(3000)
+	_, err = compressor.Write(message)
+	assert.NoError(t, err)
+	assert.NoError(t, FlushWith(compressor, FlushModeSync))
+	first := output.Len()
+
+	// the second message is compressed with the history of the first one
+	_, err = compressor.Write(message)
+	assert.NoError(t, err)
+	assert.NoError(t, FlushWith(compressor, FlushModeSync))
+	assert.Less(t, output.Len()-first, first/4)
+	assert.True(t, bytes.HasSuffix(output.Bytes(), syncFlushMarker))
+
+	uncompressed := make([]byte, 2*len(message))
+	_, err = io.ReadFull(flate.NewReader(bytes.NewReader(output.Bytes())), uncompressed)
+	assert.NoError(t, err)
+	assert.Equal(t, append(append([]byte{}, message...), message...), uncompressed)
+}
+
+func TestCompressorFlushWithInvalidMode(t *testing.T) {
+	compressor, err := NewGoGZipCompressor(io.Discard, CompressionLevelDefault, 1024)
+	assert.NoError(t, err)
+	defer compressor.Close()
+
+	assert.ErrorIs(t, FlushWith(compressor, FlushMode(42)), TransformerCompressionError)
+}
+
+func TestPipelinedCompressorFlushWith(t *testing.T) {
+	output := bytes.NewBuffer([]byte{})
+	compressor, err := NewGoGZipPipelinedCompressor(output, CompressionLevelBestSpeed, 512, 2)
+	assert.NoError(t, err)
+
+	sent := []byte{}
+	for _, message := range makeTestMessages(10) {
+		_, err = compressor.Write(message)
+		assert.NoError(t, err)
+		// FlushWith waits until the flushed data was written
+		assert.NoError(t, FlushWith(compressor, FlushModeSync))
+		sent = append(sent, message...)
+		assert.Equal(t, sent, readFlushed(t, output.Bytes(), len(sent)))
+	}
+
+	assert.NoError(t, compressor.Close())
+	uncompressed, uerr := stdLibGZipUncompress(output, int64(len(sent)))
+	assert.NoError(t, uerr)
+	assert.Equal(t, sent, uncompressed)
+}
+
+// lockedBuffer is an output that can be written by the coalescing timer while the test reads it
+type lockedBuffer struct {
+	lock   sync.Mutex
+	buffer bytes.Buffer
+}
+
+func (lb *lockedBuffer) Write(data []byte) (int, error) {
+	lb.lock.Lock()
+	defer lb.lock.Unlock()
+	return lb.buffer.Write(data)
+}
+
+func (lb *lockedBuffer) snapshot() []byte {
+	lb.lock.Lock()
+	defer lb.lock.Unlock()
+	return append([]byte{}, lb.buffer.Bytes()...)
+}
+
+func coalescedLen(t *testing.T, messages [][]byte, latency time.Duration) int {
+	output := &lockedBuffer{}
+	compressor, err := NewGoCoalescingCompressor(output, CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelDefault}, 4096, FlushModeSync, latency)
+	assert.NoError(t, err)
+
+	sent := []byte{}
+	for _, message := range messages {
+		_, err = compressor.Write(message)
+		assert.NoError(t, err)
+		sent = append(sent, message...)
+	}
+	assert.NoError(t, FlushWith(compressor, FlushModeSync))
+	compressed := output.snapshot()
+	assert.Equal(t, sent, readFlushed(t, compressed, len(sent)))
+
+	assert.NoError(t, compressor.Close())
+	compressed = output.snapshot()
+	uncompressed, uerr := stdLibGZipUncompress(bytes.NewBuffer(compressed), int64(len(sent)))
+	assert.NoError(t, uerr)
+	assert.Equal(t, sent, uncompressed)
+	return len(compressed)
+}
+
+func TestCoalescingCompressorBatchesFlushes(t *testing.T) {
+	messages := makeTestMessages(100)
+
+	// every message flushed on its own pays for a flush marker, a batch pays for one
+	perMessage := coalescedLen(t, messages, 0)
+	batched := coalescedLen(t, messages, time.Hour)
+	assert.Less(t, batched+len(messages)*len(syncFlushMarker), perMessage)
+}
+
+func TestCoalescingCompressorFlushesWithinLatency(t *testing.T) {
+	output := &lockedBuffer{}
+	compressor, err := NewGoCoalescingCompressor(output, CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelBestSpeed}, 1024, FlushModeSync, 5*time.Millisecond)
+	assert.NoError(t, err)
+
+	sent := []byte{}
+	for _, message := range makeTestMessages(3) {
+		_, err = compressor.Write(message)
+		assert.NoError(t, err)
+		sent = append(sent, message...)
+	}
+
+	// nothing but the gzip header is written until the timer flushes the batch
+	deadline := time.Now().Add(5 * time.Second)
+	compressed := output.snapshot()
+	for !bytes.HasSuffix(compressed, syncFlushMarker) && time.Now().Before(deadline) {
+		time.Sleep(time.Millisecond)
+		compressed = output.snapshot()
+	}
+	assert.Equal(t, sent, readFlushed(t, compressed, len(sent)))
+
+	assert.NoError(t, compressor.Close())
+	_, err = compressor.Write(sent)
+	assert.ErrorIs(t, err, TransformerCompressionError)
+	assert.NoError(t, compressor.Close())
+}
+
+func TestCoalescingCompressorFlushEndsStream(t *testing.T) {
+	output := &lockedBuffer{}
+	compressor, err := NewGoCoalescingCompressor(output, CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelDefault}, 1024, FlushModeSync, time.Hour)
+	assert.NoError(t, err)
+
+	message := makeTestData(1000)
+	_, err = compressor.Write(message)
+	assert.NoError(t, err)
+	assert.NoError(t, Flush(compressor))
+
+	uncompressed, err := stdLibGZipUncompress(bytes.NewBuffer(output.snapshot()), int64(len(message)))
+	assert.NoError(t, err)
+	assert.Equal(t, message, uncompressed)
+
+	assert.ErrorIs(t, FlushWith(compressor, FlushModeSync), TransformerCompressionError)
+	assert.NoError(t, compressor.Close())
+	assert.ErrorIs(t, FlushWith(compressor, FlushModeSync), TransformerCompressionError)
+}
+
+func TestCoalescingCompressorStatsAndReset(t *testing.T) {
+	SetStatsEnabled(true)
+	defer SetStatsEnabled(false)
+
+	original := makeTestData(10000)
+	compressor, err := NewGoCoalescingCompressor(io.Discard, CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelDefault}, 1024, FlushModeSync, time.Hour)
+	assert.NoError(t, err)
+	_, err = compressor.Write(original)
+	assert.NoError(t, err)
+	assert.Equal(t, uint64(len(original)), CompressorStats(compressor).BytesIn)
+
+	// the reset compressor drops the pending batch and starts a new stream on the new output
+	compressed := bytes.NewBuffer([]byte{})
+	ResetCompressor(compressed, compressor)
+	assert.Equal(t, Stats{}, CompressorStats(compressor))
+	_, err = compressor.Write(original)
+	assert.NoError(t, err)
+	assert.NoError(t, compressor.Close())
+
+	uncompressed, err := stdLibGZipUncompress(compressed, int64(len(original)))
+	assert.NoError(t, err)
+	assert.Equal(t, original, uncompressed)
+}
+
+func TestCoalescingCompressorFailWrite(t *testing.T) {
+	compressor, err := NewGoCoalescingCompressor(&failingWriter{}, CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelDefault}, 1024, FlushModeSync, 0)
+	assert.NoError(t, err)
+
+	_, err = compressor.Write(makeTestData(100))
+	assert.ErrorIs(t, err, TransformerCompressionError)
+	// the error is kept and returned by the following calls
+	_, err = compressor.Write(makeTestData(100))
+	assert.ErrorIs(t, err, TransformerCompressionError)
+	assert.ErrorIs(t, compressor.Close(), TransformerCompressionError)
+}
+
+func TestCoalescingCompressorRejectsInvalidParameters(t *testing.T) {
+	options := CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelDefault}
+	_, err := NewGoCoalescingCompressor(io.Discard, options, 1024, FlushModeFinish, 0)
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+
+	_, err = NewGoCoalescingCompressor(io.Discard, options, 1024, FlushModeSync, -time.Second)
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+
+	_, err = NewGoCoalescingCompressor(io.Discard, CompressionOptions{Level: CompressionLevel(12)}, 1024, FlushModeSync, 0)
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+}
@@ -0,0 +1,116 @@
+package gozlib
+
+import (
+	"bytes"
+	"io"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+const testIndexSpan = 128 * 1024
+
+func verifyUncompressAt(t *testing.T, compressed []byte, index *Index, original []byte, offset uint64) {
+	uncompressor, err := NewGoZLibUncompressorAt(bytes.NewReader(compressed), index, offset, 4096)
+	if !assert.NoError(t, err) {
+		return
+	}
+
+	const readLen = 1000
+	expected := original[offset:]
+	if len(expected) > readLen {
+		expected = expected[:readLen]
+	}
+
+	uncompressed := bytes.NewBuffer([]byte{})
+	_, err = io.CopyN(uncompressed, uncompressor, int64(len(expected)))
+	assert.NoError(t, err)
+	assert.Equal(t, expected, uncompressed.Bytes(), "data at offset %d", offset)
+	assert.NoError(t, uncompressor.Close())
+}
+
+func verifyIndexedUncompress(t *testing.T, compressed []byte, original []byte) *Index {
+	index, err := BuildIndex(bytes.NewReader(compressed), testIndexSpan, 1024*16)
+	assert.NoError(t, err)
+	assert.Equal(t, uint64(len(original)), index.UncompressedSize())
+	assert.Greater(t, len(index.points), 4)
+
+	size := uint64(len(original))
+	for _, offset := range []uint64{0, 1, testIndexSpan - 1, testIndexSpan + 123, size / 2, size - 10, size} {
+		verifyUncompressAt(t, compressed, index, original, offset)
+	}
+	return index
+}
+
+func TestIndexUncompressAtGZip(t *testing.T) {
+	original := makeTestData(2 * 1024 * 1024)
+	compressed, err := stdLibGZipCompressSlice(original)
+	assert.NoError(t, err)
+
+	verifyIndexedUncompress(t, compressed, original)
+}
+
+func TestIndexUncompressAtZLib(t *testing.T) {
+	original := makeTestData(2 * 1024 * 1024)
+	compressed := make([]byte, len(original)+1024)
+	compressedLen, err := GoCompressBufferWithOptions(CompressionOptions{Format: CompressionFormatZLib, Level: CompressionLevelBestSpeed}, original, compressed)
+	assert.NoError(t, err)
+
+	verifyIndexedUncompress(t, compressed[:compressedLen], original)
+}
+
+func TestIndexSerialization(t *testing.T) {
+	original := makeTestData(1024 * 1024)
+	compressed, err := stdLibGZipCompressSlice(original)
+	assert.NoError(t, err)
+	index, err := BuildIndex(bytes.NewReader(compressed), testIndexSpan, 1024*16)
+	assert.NoError(t, err)
+
+	serialized := bytes.NewBuffer([]byte{})
+	written, err := index.WriteTo(serialized)
+	assert.NoError(t, err)
+	assert.Equal(t, int64(serialized.Len()), written)
+
+	loaded, err := ReadIndex(bytes.NewReader(serialized.Bytes()))
+	assert.NoError(t, err)
+	assert.Equal(t, index, loaded)
+	verifyUncompressAt(t, compressed, loaded, original, uint64(len(original))-testIndexSpan/3)
+
+	_, err = ReadIndex(bytes.NewReader(serialized.Bytes()[:serialized.Len()/2]))
+	assert.ErrorIs(t, err, InvalidIndexError)
+
+	corrupted := append([]byte{}, serialized.Bytes()...)
+	corrupted[0] = 'X'
+	_, err = ReadIndex(bytes.NewReader(corrupted))
+	assert.ErrorIs(t, err, InvalidIndexError)
+}
+
+func TestFailIndexInvalidInput(t *testing.T) {
+	original := makeTestData(64 * 1024)
+	compressed, err := stdLibGZipCompressSlice(original)
+	assert.NoError(t, err)
+
+	_, err = BuildIndex(bytes.NewReader(compressed[:len(compressed)/2]), testIndexSpan, 1024)
+	assert.ErrorIs(t, err, IndexBuildError)
+
+	_, err = BuildIndex(bytes.NewReader(original), testIndexSpan, 1024)
+	assert.ErrorIs(t, err, IndexBuildError)
+
+	_, err = BuildIndex(bytes.NewReader(compressed), testIndexSpan, 0)
+	assert.ErrorIs(t, err, IndexBuildError)
+
+	index, err := BuildIndex(bytes.NewReader(compressed), testIndexSpan, 1024)
+	assert.NoError(t, err)
+	_, err = NewGoZLibUncompressorAt(bytes.NewReader(compressed), index, uint64(len(original))+1, 1024)
+	assert.ErrorIs(t, err, InvalidIndexOffsetError)
+}
+
+func TestIndexUncompressAtMultiMember(t *testing.T) {
+	compressed, original, err := stdLibGZipCompressMembers(300*1024, 1000, 500*1024)
+	assert.NoError(t, err)
+
+	index := verifyIndexedUncompress(t, compressed, original)
+	// reads crossing the end of the first and second members
+	verifyUncompressAt(t, compressed, index, original, 300*1024-10)
+	verifyUncompressAt(t, compressed, index, original, 300*1024+500)
+}
@@ -0,0 +1,12 @@
+//go:build libdeflate
+
+package gozlib
+
+// Building with the libdeflate tag compresses one-shot buffers with libdeflate, see SetBufferBackend.
+// It requires the libdeflate headers and library, which can be located with CGO_CFLAGS and CGO_LDFLAGS
+
+/*
+#cgo CFLAGS: -DGOZLIB_LIBDEFLATE
+#cgo LDFLAGS: -ldeflate
+*/
+import "C"
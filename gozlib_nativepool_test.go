@@ -1,7 +1,9 @@
 package gozlib
 
 import (
+	"io"
 	"testing"
+	"time"
 
 	"github.com/stretchr/testify/assert"
 )
@@ -40,4 +42,113 @@ func TestNativePoolAllocAndReuse(t *testing.T) {
 	dataAfterReturned := pool.Acquire(desiredBufferSize)
 	actual := dataAfterReturned[:len(tag)]
 	assert.Equal(t, tag, actual)
+	pool.Return(dataAfterReturned)
+}
+
+func TestNativePoolFreeRequiresReturnedSlices(t *testing.T) {
+	pool := NewNativeSlicePool()
+
+	data := pool.Acquire(1024)
+	large := pool.Acquire(8 << 20)
+	assert.Equal(t, NativeSlicePoolInUseError, pool.Free())
+
+	// the pool is still usable after a refused free
+	pool.Return(data)
+	assert.Equal(t, NativeSlicePoolInUseError, pool.Free())
+	pool.Return(large)
+	assert.Nil(t, pool.Free())
+}
+
+func TestNativePoolReserve(t *testing.T) {
+	const desiredBufferSize = 4096
+	pool := NewNativeSlicePool()
+	defer pool.Free()
+
+	assert.True(t, pool.Reserve(desiredBufferSize, 8))
+	assert.False(t, pool.Reserve(1<<30, 1))
+
+	data := pool.Acquire(desiredBufferSize)
+	assert.Equal(t, desiredBufferSize, cap(data))
+	pool.Return(data)
+}
+
+func TestNativePoolTrim(t *testing.T) {
+	const desiredBufferSize = 64 * 1024
+	pool := NewNativeSlicePool()
+	defer pool.Free()
+
+	data := pool.Acquire(desiredBufferSize)
+	data = data[:desiredBufferSize]
+	data[desiredBufferSize-1] = 1
+	pool.Return(data)
+
+	assert.Greater(t, pool.Trim(0), uint64(0))
+	assert.Equal(t, uint64(0), pool.Trim(0))
+
+	// trimmed slices can still be reused
+	data = pool.Acquire(desiredBufferSize)
+	assert.Equal(t, desiredBufferSize, cap(data))
+	pool.Return(data)
+}
+
+func TestTrimPools(t *testing.T) {
+	compressed, compErr := stdLibGZipCompressSlice(makeTestData(64 * 1024))
+	assert.NoError(t, compErr)
+	output := make([]byte, 1024*1024)
+	_, err := GoUncompressBuffer(compressed, output)
+	assert.NoError(t, err)
+
+	TrimPools()
+	// pools should still be usable after trimming
+	_, err = GoUncompressBuffer(compressed, output)
+	assert.NoError(t, err)
+}
+
+func TestStartPoolTrimmer(t *testing.T) {
+	assert.ErrorIs(t, StartPoolTrimmer(PoolTrimPolicy{}), InvalidPoolTrimPolicyError)
+	assert.ErrorIs(t, StartPoolTrimmer(PoolTrimPolicy{Interval: time.Second, HighWatermark: 1, LowWatermark: 2}), InvalidPoolTrimPolicyError)
+
+	policy := PoolTrimPolicy{
+		Interval:      time.Millisecond,
+		IdleAge:       time.Millisecond,
+		HighWatermark: 1,
+		LowWatermark:  0,
+	}
+	assert.NoError(t, StartPoolTrimmer(policy))
+	defer StopPoolTrimmer()
+
+	compressed, compErr := stdLibGZipCompressSlice(makeTestData(64 * 1024))
+	assert.NoError(t, compErr)
+	output := make([]byte, 1024*1024)
+	for i := 0; i < 10; i++ {
+		_, err := GoUncompressBuffer(compressed, output)
+		assert.NoError(t, err)
+		time.Sleep(time.Millisecond)
+	}
+}
+
+func TestNativePoolLargeSlices(t *testing.T) {
+	const desiredBufferSize = 16 * 1024 * 1024
+	pool := NewNativeSlicePool()
+	defer pool.Free()
+
+	data := pool.Acquire(desiredBufferSize)
+	assert.Equal(t, desiredBufferSize, cap(data))
+	data = data[:desiredBufferSize]
+	data[0] = 'a'
+	data[desiredBufferSize-1] = 'z'
+	pool.Return(data)
+
+	// the returned large slice is cached and handed out again
+	reused := pool.Acquire(desiredBufferSize)[:desiredBufferSize]
+	assert.Equal(t, byte('a'), reused[0])
+	assert.Equal(t, byte('z'), reused[desiredBufferSize-1])
+	pool.Return(reused)
+
+	assert.GreaterOrEqual(t, pool.Trim(0), uint64(desiredBufferSize))
+}
+
+func TestTransformerLargeWorkBuffer(t *testing.T) {
+	const bufferSize = 8 * 1024 * 1024
+	verifyTransformerUncompress(t, io.Copy, bufferSize, 64*1024)
 }
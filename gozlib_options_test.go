@@ -0,0 +1,246 @@
+package gozlib
+
+import (
+	"bytes"
+	"compress/flate"
+	"compress/zlib"
+	"io"
+	"math/rand"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func stdLibUncompress(format CompressionFormat, compressed []byte) ([]byte, error) {
+	var reader io.Reader
+	switch format {
+	case CompressionFormatRaw:
+		reader = flate.NewReader(bytes.NewReader(compressed))
+	case CompressionFormatZLib:
+		zreader, err := zlib.NewReader(bytes.NewReader(compressed))
+		if err != nil {
+			return nil, err
+		}
+		reader = zreader
+	default:
+		return stdLibGZipUncompress(bytes.NewBuffer(compressed), int64(len(compressed)))
+	}
+
+	return io.ReadAll(reader)
+}
+
+func TestCompressBufferWithOptionsAllFormatsAndLevels(t *testing.T) {
+	const originalLen = 4000
+	original := makeTestData(originalLen)
+	output := make([]byte, originalLen+128)
+
+	for _, format := range []CompressionFormat{CompressionFormatGZip, CompressionFormatZLib, CompressionFormatRaw} {
+		for level := CompressionLevelDefault; level <= CompressionLevelBestCompression; level++ {
+			options := CompressionOptions{Format: format, Level: level}
+			compLen, err := GoCompressBufferWithOptions(options, original, output)
+			assert.NoError(t, err)
+
+			uncompressed, uerr := stdLibUncompress(format, output[:compLen])
+			assert.NoError(t, uerr)
+			assert.Equal(t, original, uncompressed)
+		}
+	}
+}
+
+func TestCompressBufferWithOptionsStrategies(t *testing.T) {
+	const originalLen = 4000
+	original := makeTestData(originalLen)
+	output := make([]byte, originalLen*2)
+	uncompressed := make([]byte, originalLen)
+
+	strategies := []CompressionStrategy{CompressionStrategyDefault, CompressionStrategyFiltered, CompressionStrategyHuffmanOnly, CompressionStrategyRLE, CompressionStrategyFixed}
+	for _, strategy := range strategies {
+		options := CompressionOptions{Format: CompressionFormatRaw, Level: CompressionLevelBestSpeed, Strategy: strategy}
+		compLen, err := GoCompressBufferWithOptions(options, original, output)
+		assert.NoError(t, err)
+
+		uncompLen, uerr := GoUncompressBufferWithOptions(UncompressionOptions{Format: CompressionFormatRaw}, output[:compLen], uncompressed)
+		assert.NoError(t, uerr)
+		assert.Equal(t, uint64(originalLen), uncompLen)
+		assert.Equal(t, original, uncompressed)
+	}
+}
+
+func TestCompressorWithOptionsSmallWindowRawDeflate(t *testing.T) {
+	const originalLen = 20000
+	original := makeTestData(originalLen)
+
+	compressed := bytes.NewBuffer([]byte{})
+	options := CompressionOptions{Format: CompressionFormatRaw, Level: CompressionLevelDefault, WindowBits: 9, MemLevel: 1}
+	compressor, err := NewGoCompressorWithOptions(compressed, options, 1024)
+	assert.NoError(t, err)
+
+	_, werr := io.Copy(compressor, bytes.NewBuffer(original))
+	assert.NoError(t, werr)
+	assert.NoError(t, compressor.Close())
+
+	stdUncompressed, uerr := stdLibUncompress(CompressionFormatRaw, compressed.Bytes())
+	assert.NoError(t, uerr)
+	assert.Equal(t, original, stdUncompressed)
+
+	uncompressor, uerr := NewGoUncompressorWithOptions(bytes.NewBuffer(compressed.Bytes()), UncompressionOptions{Format: CompressionFormatRaw, WindowBits: 9}, 1024)
+	assert.NoError(t, uerr)
+	uncompressed := bytes.NewBuffer([]byte{})
+	_, rerr := io.Copy(uncompressed, uncompressor)
+	assert.NoError(t, rerr)
+	assert.NoError(t, uncompressor.Close())
+	assert.Equal(t, original, uncompressed.Bytes())
+}
+
+func TestBufferCompressorWithOptionsZLib(t *testing.T) {
+	const originalLen = 3000
+	original := makeTestData(originalLen)
+	output := make([]byte, originalLen+128)
+
+	compressor, err := NewGoBufferCompressorWithOptions(CompressionOptions{Format: CompressionFormatZLib, Level: CompressionLevelBestSpeed, WindowBits: 12})
+	assert.NoError(t, err)
+	defer compressor.Close()
+
+	compLen, cerr := compressor.Compress(original, output)
+	assert.NoError(t, cerr)
+
+	uncompressor, uerr := NewGoBufferUncompressorWithOptions(UncompressionOptions{WindowBits: 12})
+	assert.NoError(t, uerr)
+	defer uncompressor.Close()
+
+	uncompressed := make([]byte, originalLen)
+	uncompLen, uerr := uncompressor.Uncompress(output[:compLen], uncompressed)
+	assert.NoError(t, uerr)
+	assert.Equal(t, uint64(originalLen), uncompLen)
+	assert.Equal(t, original, uncompressed)
+}
+
+func TestFailInvalidCompressionOptions(t *testing.T) {
+	invalid := []CompressionOptions{
+		{Format: CompressionFormatGZip, Level: CompressionLevelBestCompression + 1},
+		{Format: CompressionFormatGZip, Level: CompressionLevelDefault - 1},
+		{Format: CompressionFormatZLib, Level: CompressionLevelDefault, WindowBits: 8},
+		{Format: CompressionFormatZLib, Level: CompressionLevelDefault, WindowBits: 16},
+		{Format: CompressionFormatRaw, Level: CompressionLevelDefault, MemLevel: 10},
+		{Format: CompressionFormatRaw, Level: CompressionLevelDefault, Strategy: CompressionStrategyFixed + 1},
+		{Format: CompressionFormatRaw + 1, Level: CompressionLevelDefault},
+	}
+
+	output := make([]byte, 128)
+	for _, options := range invalid {
+		_, err := GoCompressBufferWithOptions(options, []byte{1, 2, 3}, output)
+		assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+
+		_, err = NewGoCompressorWithOptions(bytes.NewBuffer([]byte{}), options, 64)
+		assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+
+		_, err = NewGoBufferCompressorWithOptions(options)
+		assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+	}
+
+	_, err := NewGoUncompressorWithOptions(bytes.NewBuffer([]byte{}), UncompressionOptions{WindowBits: 20}, 64)
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+
+	_, err = GoUncompressBufferWithOptions(UncompressionOptions{Format: CompressionFormatRaw + 1}, []byte{1}, output)
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+}
+
+// makeTestDataRange returns data with bytes uniformly distributed over [0, symbols)
+func makeTestDataRange(length int, symbols int) []byte {
+	data := make([]byte, length)
+	for i := range data {
+		data[i] = byte(rand.Intn(symbols))
+	}
+	return data
+}
+
+func TestAdaptiveCompressBuffer(t *testing.T) {
+	inputs := map[string][]byte{
+		"incompressible": makeTestDataRange(64*1024, 256),
+		"huffman only":   makeTestDataRange(64*1024, 160),
+		"compressible":   bytes.Repeat([]byte("adaptive compression "), 4000),
+	}
+	expected := map[string]AdaptiveStats{
+		"incompressible": {Samples: 1, Stored: 1},
+		"huffman only":   {Samples: 1, HuffmanOnly: 1},
+		"compressible":   {Samples: 1},
+	}
+
+	for name, original := range inputs {
+		before := BufferAdaptiveStats()
+		output := make([]byte, GZipStoreBound(len(original)))
+		options := CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelBestCompression, Adaptive: true}
+		compLen, err := GoCompressBufferWithOptions(options, original, output)
+		assert.NoError(t, err, name)
+
+		uncompressed, uerr := stdLibUncompress(CompressionFormatGZip, output[:compLen])
+		assert.NoError(t, uerr, name)
+		assert.Equal(t, original, uncompressed, name)
+
+		after := BufferAdaptiveStats()
+		delta := AdaptiveStats{Samples: after.Samples - before.Samples, Stored: after.Stored - before.Stored, HuffmanOnly: after.HuffmanOnly - before.HuffmanOnly}
+		assert.Equal(t, expected[name], delta, name)
+	}
+}
+
+func TestAdaptiveCompressor(t *testing.T) {
+	compressible := bytes.Repeat([]byte("adaptive compression "), 3000)
+	original := []byte{}
+	compressed := bytes.NewBuffer([]byte{})
+	options := CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelBestCompression, Adaptive: true}
+	compressor, err := NewGoCompressorWithOptions(compressed, options, 16*1024)
+	assert.NoError(t, err)
+
+	// alternate between incompressible and compressible writes, switching parameters back and forth
+	for i := 0; i < 3; i++ {
+		for _, chunk := range [][]byte{makeTestDataRange(50000, 256), compressible} {
+			_, werr := compressor.Write(chunk)
+			assert.NoError(t, werr)
+			original = append(original, chunk...)
+		}
+	}
+	assert.NoError(t, Flush(compressor))
+	assert.Equal(t, AdaptiveStats{Samples: 6, Stored: 3}, CompressorAdaptiveStats(compressor))
+
+	uncompressed, uerr := stdLibUncompress(CompressionFormatGZip, compressed.Bytes())
+	assert.NoError(t, uerr)
+	assert.Equal(t, original, uncompressed)
+	// the compressible chunks are still deflated
+	assert.Less(t, compressed.Len(), 3*50000+3*len(compressible)/10)
+
+	ResetCompressor(bytes.NewBuffer([]byte{}), compressor)
+	assert.Equal(t, AdaptiveStats{}, CompressorAdaptiveStats(compressor))
+	assert.NoError(t, compressor.Close())
+
+	// the pooled context got its parameters back
+	plainOutput := make([]byte, len(compressible))
+	compLen, err := GoCompressBufferWithOptions(CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelBestCompression}, compressible, plainOutput)
+	assert.NoError(t, err)
+	assert.Less(t, compLen, uint64(len(compressible)/10))
+
+	plainCompressed := bytes.NewBuffer([]byte{})
+	plain, err := NewGoCompressorWithOptions(plainCompressed, CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelBestCompression}, 16*1024)
+	assert.NoError(t, err)
+	_, err = plain.Write(compressible)
+	assert.NoError(t, err)
+	assert.NoError(t, plain.Close())
+	assert.Less(t, plainCompressed.Len(), len(compressible)/10)
+}
+
+func TestAdaptivePipelinedCompressor(t *testing.T) {
+	options := CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelBestCompression, Adaptive: true}
+	compressor, err := NewGoPipelinedCompressorWithOptions(io.Discard, options, 16*1024, 0)
+	assert.NoError(t, err)
+
+	_, err = compressor.Write(makeTestDataRange(50000, 256))
+	assert.NoError(t, err)
+	assert.NoError(t, Flush(compressor))
+	assert.Equal(t, AdaptiveStats{Samples: 1, Stored: 1}, CompressorAdaptiveStats(compressor))
+	assert.NoError(t, compressor.Close())
+
+	// the parallel compressor doesn't compress adaptively
+	parallel, err := NewGoGZipParallelCompressor(io.Discard, CompressionLevelBestSpeed, 2, 0)
+	assert.NoError(t, err)
+	assert.Equal(t, AdaptiveStats{}, CompressorAdaptiveStats(parallel))
+	assert.NoError(t, parallel.Close())
+}
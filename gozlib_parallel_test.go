@@ -0,0 +1,168 @@
+package gozlib
+
+import (
+	"bytes"
+	"errors"
+	"io"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func verifyParallelCompressUncompress(t *testing.T, original []byte, workers int, blockSize int, writeSize int) {
+	compressed := bytes.NewBuffer([]byte{})
+	compressor, err := NewGoGZipParallelCompressor(compressed, CompressionLevelBestSpeed, workers, blockSize)
+	assert.NoError(t, err)
+
+	for remaining := original; len(remaining) > 0; {
+		chunk := remaining
+		if len(chunk) > writeSize {
+			chunk = chunk[:writeSize]
+		}
+		written, werr := compressor.Write(chunk)
+		assert.NoError(t, werr)
+		assert.Equal(t, len(chunk), written)
+		remaining = remaining[len(chunk):]
+	}
+	assert.NoError(t, compressor.Close())
+
+	// the standard library reader validates the crc and size in the trailer
+	uncompressed, uerr := stdLibGZipUncompress(compressed, int64(len(original)))
+	assert.NoError(t, uerr)
+	assert.Equal(t, original, uncompressed)
+}
+
+func TestParallelCompressorMultipleBlocks(t *testing.T) {
+	original := makeTestData(1024*1024 + 123)
+	verifyParallelCompressUncompress(t, original, 4, 64*1024, 10000)
+}
+
+func TestParallelCompressorSingleBlock(t *testing.T) {
+	original := makeTestData(1000)
+	verifyParallelCompressUncompress(t, original, 2, 0, len(original))
+}
+
+func TestParallelCompressorExactBlockMultiple(t *testing.T) {
+	original := makeTestData(4 * 8192)
+	verifyParallelCompressUncompress(t, original, 3, 8192, 8192)
+}
+
+func TestParallelCompressorEmptyInput(t *testing.T) {
+	compressed := bytes.NewBuffer([]byte{})
+	compressor, err := NewGoGZipParallelCompressor(compressed, CompressionLevelBestCompression, 0, 0)
+	assert.NoError(t, err)
+	assert.NoError(t, compressor.Close())
+
+	uncompressed, uerr := stdLibGZipUncompress(compressed, 0)
+	assert.NoError(t, uerr)
+	assert.Len(t, uncompressed, 0)
+}
+
+func TestParallelCompressorUsesPreviousBlockAsDictionary(t *testing.T) {
+	pattern := makeTestData(16 * 1024)
+	original := bytes.Repeat(pattern, 16)
+
+	compressed := bytes.NewBuffer([]byte{})
+	compressor, err := NewGoGZipParallelCompressor(compressed, CompressionLevelBestCompression, 4, len(pattern))
+	assert.NoError(t, err)
+	_, err = compressor.Write(original)
+	assert.NoError(t, err)
+	assert.NoError(t, compressor.Close())
+
+	// without the dictionary every block would compress the pattern from scratch
+	assert.Less(t, compressed.Len(), 2*len(pattern))
+
+	uncompressed, uerr := stdLibGZipUncompress(compressed, int64(len(original)))
+	assert.NoError(t, uerr)
+	assert.Equal(t, original, uncompressed)
+}
+
+type failingWriter struct{}
+
+var errFailingWriter = errors.New("failing writer")
+
+func (fw *failingWriter) Write(data []byte) (int, error) {
+	return 0, errFailingWriter
+}
+
+func TestParallelCompressorFailWrite(t *testing.T) {
+	compressor, err := NewGoGZipParallelCompressor(&failingWriter{}, CompressionLevelBestSpeed, 2, 1024)
+	assert.NoError(t, err)
+
+	data := makeTestData(64 * 1024)
+	// write errors are reported asynchronously, by a later Write or by Close
+	compressor.Write(data)
+	assert.ErrorIs(t, compressor.Close(), errFailingWriter)
+
+	_, werr := compressor.Write(data)
+	assert.ErrorIs(t, werr, ParallelCompressionError)
+}
+
+func TestParallelCompressorFailInvalidLevel(t *testing.T) {
+	_, err := NewGoGZipParallelCompressor(bytes.NewBuffer([]byte{}), CompressionLevel(42), 1, 1024)
+	assert.ErrorIs(t, err, TransformerInitializationError)
+}
+
+func verifyParallelUncompress(t *testing.T, compressed []byte, original []byte, span uint64, workers int) {
+	index, err := BuildIndex(bytes.NewReader(compressed), span, 1024*16)
+	assert.NoError(t, err)
+
+	uncompressor, err := NewGoParallelUncompressor(bytes.NewReader(compressed), index, workers)
+	assert.NoError(t, err)
+
+	uncompressed := bytes.NewBuffer([]byte{})
+	uncompLen, uncompErr := io.Copy(uncompressed, uncompressor)
+	assert.NoError(t, uncompErr)
+	assert.NoError(t, uncompressor.Close())
+	assert.Equal(t, int64(len(original)), uncompLen)
+	assert.Equal(t, original, uncompressed.Bytes())
+}
+
+func TestParallelUncompressorSingleMember(t *testing.T) {
+	original := makeTestData(3*1024*1024 + 17)
+	compressed, err := stdLibGZipCompressSlice(original)
+	assert.NoError(t, err)
+
+	verifyParallelUncompress(t, compressed, original, 64*1024, 4)
+	verifyParallelUncompress(t, compressed, original, 1024*1024, 1)
+}
+
+func TestParallelUncompressorMultiMember(t *testing.T) {
+	compressed, original, err := stdLibGZipCompressMembers(200*1024, 0, 5, 900*1024, 64*1024)
+	assert.NoError(t, err)
+
+	verifyParallelUncompress(t, compressed, original, 32*1024, 3)
+}
+
+func TestParallelUncompressorCloseBeforeEnd(t *testing.T) {
+	original := makeTestData(2 * 1024 * 1024)
+	compressed, err := stdLibGZipCompressSlice(original)
+	assert.NoError(t, err)
+	index, err := BuildIndex(bytes.NewReader(compressed), 32*1024, 1024*16)
+	assert.NoError(t, err)
+
+	uncompressor, err := NewGoParallelUncompressor(bytes.NewReader(compressed), index, 2)
+	assert.NoError(t, err)
+
+	partial := make([]byte, 100*1024)
+	_, err = io.ReadFull(uncompressor, partial)
+	assert.NoError(t, err)
+	assert.Equal(t, original[:len(partial)], partial)
+	assert.NoError(t, uncompressor.Close())
+}
+
+func TestFailParallelUncompressorCorruptedInput(t *testing.T) {
+	original := makeTestData(512 * 1024)
+	compressed, err := stdLibGZipCompressSlice(original)
+	assert.NoError(t, err)
+	index, err := BuildIndex(bytes.NewReader(compressed), 32*1024, 1024*16)
+	assert.NoError(t, err)
+
+	// the index no longer matches the truncated input
+	uncompressor, err := NewGoParallelUncompressor(bytes.NewReader(compressed[:len(compressed)/2]), index, 2)
+	assert.NoError(t, err)
+
+	_, err = io.Copy(io.Discard, uncompressor)
+	assert.ErrorIs(t, err, ParallelUncompressionError)
+	assert.NoError(t, uncompressor.Close())
+}
@@ -0,0 +1,292 @@
+package gozlib
+
+import (
+	"bytes"
+	"compress/flate"
+	"io"
+	"runtime"
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/assert"
+)
+
+var rawParkingOptions = CompressionOptions{Format: CompressionFormatRaw, Level: CompressionLevelDefault}
+
+func isParked(transformer *goZLibTransformer, parker *transformerParker) bool {
+	parker.lock.Lock()
+	defer parker.lock.Unlock()
+	return bool(transformer.transformer.parked)
+}
+
+func compressorParked(compressor io.WriteCloser) bool {
+	pc := compressor.(*goParkingCompressor)
+	return isParked(&pc.goZLibTransformer, &pc.parker)
+}
+
+func uncompressorParked(uncompressor io.ReadCloser) bool {
+	pu := uncompressor.(*goParkingUncompressor)
+	return isParked(&pu.goZLibTransformer, &pu.parker)
+}
+
+// chunkReader returns a single chunk per Read, like messages received one at a time
+type chunkReader struct {
+	chunks [][]byte
+}
+
+func (cr *chunkReader) Read(data []byte) (int, error) {
+	if len(cr.chunks) == 0 {
+		return 0, io.EOF
+	}
+	read := copy(data, cr.chunks[0])
+	cr.chunks[0] = cr.chunks[0][read:]
+	if len(cr.chunks[0]) == 0 {
+		cr.chunks = cr.chunks[1:]
+	}
+	return read, nil
+}
+
+func TestParkingCompressorRawMessages(t *testing.T) {
+	output := bytes.NewBuffer([]byte{})
+	compressor, err := NewGoParkingCompressor(output, rawParkingOptions, 4096, ParkingOptions{})
+	assert.NoError(t, err)
+	assert.True(t, compressorParked(compressor))
+
+	message := makeTestData(3000)
+	chunks := [][]byte{}
+	for i := 0; i < 3; i++ {
+		start := output.Len()
+		_, err = compressor.Write(message)
+		assert.NoError(t, err)
+		// not parkable until the message is flushed
+		assert.False(t, compressorParked(compressor))
+		assert.NoError(t, FlushWith(compressor, FlushModeSync))
+		assert.True(t, compressorParked(compressor))
+		chunks = append(chunks, append([]byte{}, output.Bytes()[start:]...))
+	}
+	// the window was kept while parked, the following messages reference the first one
+	assert.Less(t, len(chunks[1]), len(chunks[0])/4)
+	assert.Less(t, len(chunks[2]), len(chunks[0])/4)
+
+	uncompressor, err := NewGoParkingUncompressor(&chunkReader{chunks: chunks}, UncompressionOptions{Format: CompressionFormatRaw}, 4096, ParkingOptions{})
+	assert.NoError(t, err)
+	assert.True(t, uncompressorParked(uncompressor))
+	for range chunks {
+		received := make([]byte, len(message))
+		_, err = io.ReadFull(uncompressor, received)
+		assert.NoError(t, err)
+		assert.Equal(t, message, received)
+		assert.True(t, uncompressorParked(uncompressor))
+	}
+	assert.NoError(t, uncompressor.Close())
+
+	// closing writes the end of the stream
+	assert.NoError(t, compressor.Close())
+	uncompressed, err := io.ReadAll(flate.NewReader(bytes.NewReader(output.Bytes())))
+	assert.NoError(t, err)
+	assert.Equal(t, bytes.Repeat(message, 3), uncompressed)
+}
+
+func TestParkingCompressorGZipStreams(t *testing.T) {
+	output := bytes.NewBuffer([]byte{})
+	options := CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelBestSpeed}
+	compressor, err := NewGoParkingCompressor(output, options, 1024, ParkingOptions{})
+	assert.NoError(t, err)
+
+	sent := []byte{}
+	for _, message := range makeTestMessages(5) {
+		_, err = compressor.Write(message)
+		assert.NoError(t, err)
+		// gzip streams can't be resumed in the middle
+		assert.NoError(t, FlushWith(compressor, FlushModeSync))
+		assert.False(t, compressorParked(compressor))
+
+		// each message is a gzip member, parked once it ends
+		assert.NoError(t, Flush(compressor))
+		assert.True(t, compressorParked(compressor))
+		sent = append(sent, message...)
+	}
+	assert.NoError(t, compressor.Close())
+
+	uncompressed, err := stdLibGZipUncompress(output, int64(len(sent)))
+	assert.NoError(t, err)
+	assert.Equal(t, sent, uncompressed)
+}
+
+func TestParkingCompressorIdleTime(t *testing.T) {
+	compressor, err := NewGoParkingCompressor(io.Discard, rawParkingOptions, 1024, ParkingOptions{IdleTime: 10 * time.Millisecond})
+	assert.NoError(t, err)
+	defer compressor.Close()
+
+	_, err = compressor.Write(makeTestData(1000))
+	assert.NoError(t, err)
+	assert.NoError(t, FlushWith(compressor, FlushModeSync))
+	assert.False(t, compressorParked(compressor))
+
+	deadline := time.Now().Add(5 * time.Second)
+	for !compressorParked(compressor) && time.Now().Before(deadline) {
+		time.Sleep(time.Millisecond)
+	}
+	assert.True(t, compressorParked(compressor))
+}
+
+func TestParkingUncompressorClearsUnusedWindow(t *testing.T) {
+	// keeps the released context out of other threads caches
+	runtime.LockOSThread()
+	defer runtime.UnlockOSThread()
+
+	output := bytes.NewBuffer([]byte{})
+	compressor, err := NewGoParkingCompressor(output, rawParkingOptions, 4096, ParkingOptions{})
+	assert.NoError(t, err)
+	message := makeTestData(3000)
+	chunks := [][]byte{}
+	for i := 0; i < 2; i++ {
+		start := output.Len()
+		_, err = compressor.Write(message)
+		assert.NoError(t, err)
+		assert.NoError(t, FlushWith(compressor, FlushModeSync))
+		chunks = append(chunks, append([]byte{}, output.Bytes()[start:]...))
+	}
+	assert.NoError(t, compressor.Close())
+
+	uncompressor, err := NewGoParkingUncompressor(&chunkReader{chunks: chunks[:1]}, UncompressionOptions{Format: CompressionFormatRaw}, 4096, ParkingOptions{})
+	assert.NoError(t, err)
+	received := make([]byte, len(message))
+	_, err = io.ReadFull(uncompressor, received)
+	assert.NoError(t, err)
+	// unparks with the window of the first message and releases the context without inflating anything
+	_, err = uncompressor.Read(received)
+	assert.ErrorIs(t, err, io.EOF)
+	assert.NoError(t, uncompressor.Close())
+
+	// the second message references the first one, a clean context can't uncompress it
+	uncompressor, err = NewGoUncompressorWithOptions(bytes.NewReader(chunks[1]), UncompressionOptions{Format: CompressionFormatRaw}, 4096)
+	assert.NoError(t, err)
+	_, err = io.ReadAll(uncompressor)
+	assert.Error(t, err)
+	assert.NoError(t, uncompressor.Close())
+}
+
+func TestParkingReset(t *testing.T) {
+	output := bytes.NewBuffer([]byte{})
+	compressor, err := NewGoParkingCompressor(output, rawParkingOptions, 4096, ParkingOptions{})
+	assert.NoError(t, err)
+	message := makeTestData(3000)
+	_, err = compressor.Write(message)
+	assert.NoError(t, err)
+	assert.NoError(t, FlushWith(compressor, FlushModeSync))
+	assert.True(t, compressorParked(compressor))
+
+	// the reset compressor drops the window it kept, its stream doesn't reference the previous one
+	restarted := bytes.NewBuffer([]byte{})
+	ResetCompressor(restarted, compressor)
+	_, err = compressor.Write(message)
+	assert.NoError(t, err)
+	assert.NoError(t, compressor.Close())
+	uncompressed, err := io.ReadAll(flate.NewReader(bytes.NewReader(restarted.Bytes())))
+	assert.NoError(t, err)
+	assert.Equal(t, message, uncompressed)
+
+	uncompressor, err := NewGoParkingUncompressor(bytes.NewReader(output.Bytes()), UncompressionOptions{Format: CompressionFormatRaw}, 4096, ParkingOptions{})
+	assert.NoError(t, err)
+	received := make([]byte, len(message))
+	_, err = io.ReadFull(uncompressor, received)
+	assert.NoError(t, err)
+	ResetUncompressor(bytes.NewReader(restarted.Bytes()), uncompressor)
+	_, err = io.ReadFull(uncompressor, received)
+	assert.NoError(t, err)
+	assert.Equal(t, message, received)
+	assert.NoError(t, uncompressor.Close())
+}
+
+func TestParkingMemoryBudget(t *testing.T) {
+	const bufferSize = 1024
+	footprint := transformerFootprint(true, -defaultWindowBits, defaultMemLevel, bufferSize)
+	budget := NewMemoryBudget(2 * footprint)
+	parking := ParkingOptions{IdleTime: time.Hour, Budget: budget}
+
+	first, err := NewGoParkingCompressor(io.Discard, rawParkingOptions, bufferSize, parking)
+	assert.NoError(t, err)
+	second, err := NewGoParkingCompressor(io.Discard, rawParkingOptions, bufferSize, parking)
+	assert.NoError(t, err)
+	assert.Equal(t, 2*footprint, budget.Used())
+
+	created := make(chan io.WriteCloser)
+	go func() {
+		third, terr := NewGoParkingCompressor(io.Discard, rawParkingOptions, bufferSize, parking)
+		assert.NoError(t, terr)
+		created <- third
+	}()
+
+	select {
+	case <-created:
+		t.Fatal("compressor created over the memory budget")
+	case <-time.After(20 * time.Millisecond):
+	}
+
+	assert.NoError(t, first.Close())
+	third := <-created
+	assert.NoError(t, second.Close())
+	assert.NoError(t, third.Close())
+	assert.Equal(t, int64(0), budget.Used())
+}
+
+func TestParkingUnparksWithinOwnReservation(t *testing.T) {
+	const bufferSize = 4096
+	// only fits a single active transformer, which keeps its window reserved while parked
+	budget := NewMemoryBudget(transformerFootprint(true, -defaultWindowBits, defaultMemLevel, bufferSize))
+	compressor, err := NewGoParkingCompressor(io.Discard, rawParkingOptions, bufferSize, ParkingOptions{Budget: budget})
+	assert.NoError(t, err)
+
+	_, err = compressor.Write(makeTestData(100000))
+	assert.NoError(t, err)
+	assert.NoError(t, FlushWith(compressor, FlushModeSync))
+	assert.True(t, compressorParked(compressor))
+
+	written := make(chan error)
+	go func() {
+		_, werr := compressor.Write(makeTestData(100000))
+		written <- werr
+	}()
+
+	select {
+	case err = <-written:
+		assert.NoError(t, err)
+	case <-time.After(5 * time.Second):
+		t.Fatal("unparking waited for its own reservation")
+	}
+
+	assert.NoError(t, compressor.Close())
+	assert.Equal(t, int64(0), budget.Used())
+}
+
+func TestParkingReleasesBudget(t *testing.T) {
+	budget := NewMemoryBudget(1 << 30)
+	compressor, err := NewGoParkingCompressor(io.Discard, rawParkingOptions, 4096, ParkingOptions{Budget: budget})
+	assert.NoError(t, err)
+	// parked right away, nothing was written
+	assert.Equal(t, int64(0), budget.Used())
+
+	_, err = compressor.Write(makeTestData(100000))
+	assert.NoError(t, err)
+	active := budget.Used()
+	assert.Greater(t, active, int64(64*1024))
+
+	// parked with its window only
+	assert.NoError(t, FlushWith(compressor, FlushModeSync))
+	assert.LessOrEqual(t, budget.Used(), int64(32*1024))
+
+	assert.NoError(t, compressor.Close())
+	assert.Equal(t, int64(0), budget.Used())
+}
+
+func TestParkingRejectsInvalidParameters(t *testing.T) {
+	_, err := NewGoParkingCompressor(io.Discard, CompressionOptions{Level: CompressionLevel(12)}, 1024, ParkingOptions{})
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+
+	_, err = NewGoParkingCompressor(io.Discard, rawParkingOptions, 1024, ParkingOptions{IdleTime: -time.Second})
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+
+	_, err = NewGoParkingUncompressor(bytes.NewReader(nil), UncompressionOptions{WindowBits: 42}, 1024, ParkingOptions{})
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+}
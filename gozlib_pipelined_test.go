@@ -0,0 +1,164 @@
+package gozlib
+
+import (
+	"bytes"
+	"sync"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func verifyPipelinedCompressUncompress(t *testing.T, original []byte, bufferSize uint32, depth int, writeSize int) {
+	compressed := bytes.NewBuffer([]byte{})
+	compressor, err := NewGoGZipPipelinedCompressor(compressed, CompressionLevelBestSpeed, bufferSize, depth)
+	assert.NoError(t, err)
+
+	for remaining := original; len(remaining) > 0; {
+		chunk := remaining
+		if len(chunk) > writeSize {
+			chunk = chunk[:writeSize]
+		}
+		written, werr := compressor.Write(chunk)
+		assert.NoError(t, werr)
+		assert.Equal(t, len(chunk), written)
+		remaining = remaining[len(chunk):]
+	}
+	assert.NoError(t, compressor.Close())
+
+	uncompressed, uerr := stdLibGZipUncompress(compressed, int64(len(original)))
+	assert.NoError(t, uerr)
+	assert.Equal(t, original, uncompressed)
+}
+
+func TestPipelinedCompressorMultipleBuffers(t *testing.T) {
+	original := makeTestData(1024*1024 + 123)
+	verifyPipelinedCompressUncompress(t, original, 1024, 2, 10000)
+	verifyPipelinedCompressUncompress(t, original, 16*1024, 4, 100*1024)
+}
+
+func TestPipelinedCompressorSingleBuffer(t *testing.T) {
+	original := makeTestData(1000)
+	verifyPipelinedCompressUncompress(t, original, 64*1024, 1, len(original))
+	verifyPipelinedCompressUncompress(t, original, 512, 0, 7)
+}
+
+func TestPipelinedCompressorEmptyInput(t *testing.T) {
+	compressed := bytes.NewBuffer([]byte{})
+	compressor, err := NewGoGZipPipelinedCompressor(compressed, CompressionLevelDefault, 1024, 0)
+	assert.NoError(t, err)
+	assert.NoError(t, compressor.Close())
+	// closing again does nothing
+	assert.NoError(t, compressor.Close())
+
+	uncompressed, uerr := stdLibGZipUncompress(compressed, 0)
+	assert.NoError(t, uerr)
+	assert.Len(t, uncompressed, 0)
+}
+
+func TestPipelinedCompressorFlush(t *testing.T) {
+	const originalLen = 50000
+
+	compressed := bytes.NewBuffer([]byte{})
+	compressor, err := NewGoGZipPipelinedCompressor(compressed, CompressionLevelBestSpeed, 2048, 2)
+	assert.NoError(t, err)
+	defer compressor.Close()
+
+	original := makeTestData(originalLen)
+	_, err = compressor.Write(original)
+	assert.NoError(t, err)
+	// once Flush returns the whole stream was written
+	assert.NoError(t, Flush(compressor))
+
+	uncompressed, uerr := stdLibGZipUncompress(compressed, originalLen)
+	assert.NoError(t, uerr)
+	assert.Equal(t, original, uncompressed)
+}
+
+func TestPipelinedCompressorReset(t *testing.T) {
+	original := makeTestData(50000)
+	compressor, err := NewGoGZipPipelinedCompressor(&failingWriter{}, CompressionLevelBestSpeed, 1024, 2)
+	assert.NoError(t, err)
+	compressor.Write(original)
+	assert.ErrorIs(t, Flush(compressor), errFailingWriter)
+
+	// the reset compressor forgets the output error and starts a new stream on the new output
+	compressed := bytes.NewBuffer([]byte{})
+	ResetCompressor(compressed, compressor)
+	_, err = compressor.Write(original)
+	assert.NoError(t, err)
+	assert.NoError(t, compressor.Close())
+
+	uncompressed, err := stdLibGZipUncompress(compressed, int64(len(original)))
+	assert.NoError(t, err)
+	assert.Equal(t, original, uncompressed)
+}
+
+func TestPipelinedCompressorFailWrite(t *testing.T) {
+	compressor, err := NewGoGZipPipelinedCompressor(&failingWriter{}, CompressionLevelBestSpeed, 1024, 2)
+	assert.NoError(t, err)
+
+	data := makeTestData(64 * 1024)
+	// write errors are reported asynchronously, by a later Write, Flush or Close
+	compressor.Write(data)
+	assert.ErrorIs(t, compressor.Close(), errFailingWriter)
+
+	_, werr := compressor.Write(data)
+	assert.ErrorIs(t, werr, TransformerCompressionError)
+}
+
+func TestPipelinedCompressorFailInvalidLevel(t *testing.T) {
+	_, err := NewGoGZipPipelinedCompressor(bytes.NewBuffer([]byte{}), CompressionLevel(42), 1024, 1)
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+}
+
+// blockingWriter holds every write until it receives from release, or until release is closed
+type blockingWriter struct {
+	lock    sync.Mutex
+	writes  int
+	release chan struct{}
+	output  bytes.Buffer
+}
+
+func (bw *blockingWriter) Write(data []byte) (int, error) {
+	<-bw.release
+	bw.lock.Lock()
+	defer bw.lock.Unlock()
+	bw.writes++
+	return bw.output.Write(data)
+}
+
+func TestPipelinedCompressorBackpressure(t *testing.T) {
+	const bufferSize = 1024
+	const depth = 2
+
+	output := &blockingWriter{release: make(chan struct{})}
+	compressor, err := NewGoGZipPipelinedCompressor(output, CompressionLevelNoCompression, bufferSize, depth)
+	assert.NoError(t, err)
+
+	// stored, the data fills many more buffers than the pipeline can hold without writing
+	original := makeTestData(1024 * bufferSize)
+	done := make(chan struct{})
+	go func() {
+		defer close(done)
+		_, werr := compressor.Write(original)
+		assert.NoError(t, werr)
+	}()
+
+	// with a single write allowed, the queue fills up and Write must wait for the writer
+	output.release <- struct{}{}
+	select {
+	case <-done:
+		t.Fatal("Write returned while the output was blocked")
+	default:
+	}
+
+	// unblocks all the following writes
+	close(output.release)
+	<-done
+	assert.NoError(t, compressor.Close())
+	assert.Greater(t, output.writes, depth+1)
+
+	uncompressed, uerr := stdLibGZipUncompress(&output.output, int64(len(original)))
+	assert.NoError(t, uerr)
+	assert.Equal(t, original, uncompressed)
+}
@@ -0,0 +1,57 @@
+package gozlib
+
+import (
+	"fmt"
+	"io"
+	"strings"
+)
+
+// PoolClassStats contains the usage statistics of a pool for a single block size
+type PoolClassStats struct {
+	// BlockSize is the size in bytes of each block in the pool
+	BlockSize uint64
+	// AllocatedBytes is the memory allocated by the pool, in use or not
+	AllocatedBytes uint64
+	// InUseBytes is the memory of blocks currently acquired from the pool
+	InUseBytes uint64
+	// HighWaterBytes is the maximum memory in use at the same time
+	HighWaterBytes uint64
+	// Acquires is the number of blocks handed out by the pool
+	Acquires uint64
+	// Misses is the number of acquires that needed new memory to be allocated because the pool was empty
+	Misses uint64
+	// ReleasedBytes is the total memory released to the system by trimming
+	ReleasedBytes uint64
+}
+
+type poolStatsMetric struct {
+	name        string
+	metricType  string
+	help        string
+	metricValue func(stats *PoolClassStats) uint64
+}
+
+var poolStatsMetrics = []poolStatsMetric{
+	{"gozlib_pool_allocated_bytes", "gauge", "Memory allocated by the pool, in use or not.", func(s *PoolClassStats) uint64 { return s.AllocatedBytes }},
+	{"gozlib_pool_in_use_bytes", "gauge", "Memory of blocks currently acquired from the pool.", func(s *PoolClassStats) uint64 { return s.InUseBytes }},
+	{"gozlib_pool_high_water_bytes", "gauge", "Maximum memory in use at the same time.", func(s *PoolClassStats) uint64 { return s.HighWaterBytes }},
+	{"gozlib_pool_acquires_total", "counter", "Number of blocks handed out by the pool.", func(s *PoolClassStats) uint64 { return s.Acquires }},
+	{"gozlib_pool_misses_total", "counter", "Number of acquires that allocated new memory.", func(s *PoolClassStats) uint64 { return s.Misses }},
+	{"gozlib_pool_released_bytes_total", "counter", "Memory released to the system by trimming.", func(s *PoolClassStats) uint64 { return s.ReleasedBytes }},
+}
+
+// WritePoolStatsPrometheus writes pool statistics, as returned by PoolStats, in the Prometheus text exposition format.
+// Each metric has a block_size label identifying the pool
+func WritePoolStatsPrometheus(output io.Writer, stats []PoolClassStats) error {
+	var text strings.Builder
+
+	for _, metric := range poolStatsMetrics {
+		fmt.Fprintf(&text, "# HELP %s %s\n# TYPE %s %s\n", metric.name, metric.help, metric.name, metric.metricType)
+		for i := range stats {
+			fmt.Fprintf(&text, "%s{block_size=\"%d\"} %d\n", metric.name, stats[i].BlockSize, metric.metricValue(&stats[i]))
+		}
+	}
+
+	_, err := io.WriteString(output, text.String())
+	return err
+}
@@ -0,0 +1,211 @@
+package gozlib
+
+import (
+	"bytes"
+	"io"
+	"strings"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestNativePoolStats(t *testing.T) {
+	const desiredBufferSize = 4096
+	pool := NewNativeSlicePool()
+	defer pool.Free()
+
+	first := pool.Acquire(desiredBufferSize)
+	second := pool.Acquire(desiredBufferSize)
+	pool.Return(first)
+
+	stats := pool.Stats()
+	assert.Len(t, stats, 14)
+
+	var classStats *PoolClassStats
+	for i := range stats {
+		if stats[i].BlockSize == desiredBufferSize {
+			classStats = &stats[i]
+		}
+	}
+	assert.NotNil(t, classStats)
+	assert.Equal(t, uint64(2), classStats.Acquires)
+	assert.Equal(t, uint64(1), classStats.Misses)
+	assert.Equal(t, uint64(desiredBufferSize), classStats.InUseBytes)
+	assert.Equal(t, uint64(2*desiredBufferSize), classStats.HighWaterBytes)
+	assert.True(t, classStats.AllocatedBytes >= 2*desiredBufferSize)
+
+	pool.Return(second)
+}
+
+func TestPoolStatsTrackInternalPools(t *testing.T) {
+	compressed, err := stdLibGZipCompressSlice(makeTestData(4096))
+	assert.NoError(t, err)
+	output := make([]byte, 8192)
+	_, err = GoUncompressBuffer(compressed, output)
+	assert.NoError(t, err)
+
+	var acquires uint64
+	for _, stats := range PoolStats() {
+		acquires += stats.Acquires
+	}
+	assert.Greater(t, acquires, uint64(0))
+}
+
+func TestWritePoolStatsPrometheus(t *testing.T) {
+	stats := []PoolClassStats{
+		{BlockSize: 512, AllocatedBytes: 1024, InUseBytes: 512, HighWaterBytes: 1024, Acquires: 3, Misses: 1},
+		{BlockSize: 1024},
+	}
+
+	output := bytes.NewBuffer([]byte{})
+	assert.NoError(t, WritePoolStatsPrometheus(output, stats))
+
+	text := output.String()
+	assert.Contains(t, text, "# TYPE gozlib_pool_allocated_bytes gauge\n")
+	assert.Contains(t, text, "# TYPE gozlib_pool_misses_total counter\n")
+	assert.Contains(t, text, "gozlib_pool_allocated_bytes{block_size=\"512\"} 1024\n")
+	assert.Contains(t, text, "gozlib_pool_acquires_total{block_size=\"512\"} 3\n")
+	assert.Contains(t, text, "gozlib_pool_in_use_bytes{block_size=\"1024\"} 0\n")
+	assert.Equal(t, 6*2+6*len(stats), strings.Count(text, "\n"))
+}
+
+func TestInstrumentationBufferStats(t *testing.T) {
+	const originalLen = 1024 * 16
+	original := makeTestData(originalLen)
+	SetStatsEnabled(true)
+	defer SetStatsEnabled(false)
+	assert.True(t, StatsEnabled())
+
+	before := GlobalCompressionStats()
+	compressed := make([]byte, GZipStoreBound(originalLen))
+	compressedLen, err := GoGZipCompressBuffer(CompressionLevelBestSpeed, original, compressed)
+	assert.NoError(t, err)
+	after := GlobalCompressionStats()
+
+	assert.Equal(t, uint64(1), after.ZLibCalls-before.ZLibCalls)
+	assert.Equal(t, uint64(originalLen), after.BytesIn-before.BytesIn)
+	assert.Equal(t, compressedLen, after.BytesOut-before.BytesOut)
+	assert.Greater(t, after.ZLibTime, before.ZLibTime)
+
+	before = GlobalUncompressionStats()
+	uncompressed := make([]byte, originalLen)
+	_, err = GoUncompressBuffer(compressed[:compressedLen], uncompressed)
+	assert.NoError(t, err)
+	after = GlobalUncompressionStats()
+
+	assert.Equal(t, compressedLen, after.BytesIn-before.BytesIn)
+	assert.Equal(t, uint64(originalLen), after.BytesOut-before.BytesOut)
+}
+
+func TestInstrumentationTransformerStats(t *testing.T) {
+	const originalLen = 1024 * 64
+	const bufferSize = 1024
+	original := makeTestData(originalLen)
+	SetStatsEnabled(true)
+	defer SetStatsEnabled(false)
+
+	compressed := bytes.NewBuffer([]byte{})
+	compressor, err := NewGoGZipCompressor(compressed, CompressionLevelBestSpeed, bufferSize)
+	assert.NoError(t, err)
+	_, err = compressor.Write(original)
+	assert.NoError(t, err)
+	assert.NoError(t, Flush(compressor))
+
+	stats := CompressorStats(compressor)
+	assert.Greater(t, stats.ZLibCalls, uint64(1))
+	assert.Equal(t, uint64(originalLen), stats.BytesIn)
+	assert.Equal(t, uint64(compressed.Len()), stats.BytesOut)
+	assert.Less(t, stats.Ratio(), 1.0)
+
+	ResetCompressor(bytes.NewBuffer([]byte{}), compressor)
+	assert.Equal(t, Stats{}, CompressorStats(compressor))
+	assert.NoError(t, compressor.Close())
+
+	uncompressor, err := NewGoZLibUncompressor(bytes.NewReader(compressed.Bytes()), bufferSize)
+	assert.NoError(t, err)
+	defer uncompressor.Close()
+	uncompressed, err := io.ReadAll(uncompressor)
+	assert.NoError(t, err)
+	assert.Equal(t, original, uncompressed)
+
+	stats = UncompressorStats(uncompressor)
+	assert.Equal(t, uint64(compressed.Len()), stats.BytesIn)
+	assert.Equal(t, uint64(originalLen), stats.BytesOut)
+}
+
+func TestInstrumentationWrappedTransformerStats(t *testing.T) {
+	const originalLen = 1024 * 16
+	original := makeTestData(originalLen)
+	options := CompressionOptions{Format: CompressionFormatGZip, Level: CompressionLevelBestSpeed}
+	SetStatsEnabled(true)
+	defer SetStatsEnabled(false)
+
+	pipelined, err := NewGoPipelinedCompressorWithOptions(io.Discard, options, 1024, 0)
+	assert.NoError(t, err)
+	parking, err := NewGoParkingCompressor(io.Discard, options, 1024, ParkingOptions{})
+	assert.NoError(t, err)
+	for _, compressor := range []io.WriteCloser{pipelined, parking} {
+		_, err = compressor.Write(original)
+		assert.NoError(t, err)
+		assert.NoError(t, FlushWith(compressor, FlushModeSync))
+		assert.Equal(t, uint64(originalLen), CompressorStats(compressor).BytesIn)
+		assert.NoError(t, compressor.Close())
+	}
+
+	compressed, err := stdLibGZipCompress(original)
+	assert.NoError(t, err)
+	uncompressor, err := NewGoParkingUncompressor(compressed, UncompressionOptions{}, 1024, ParkingOptions{})
+	assert.NoError(t, err)
+	_, err = io.ReadAll(uncompressor)
+	assert.NoError(t, err)
+	assert.Equal(t, uint64(originalLen), UncompressorStats(uncompressor).BytesOut)
+	assert.NoError(t, uncompressor.Close())
+
+	// the parallel compressor has no transformer to count with
+	parallel, err := NewGoGZipParallelCompressor(io.Discard, CompressionLevelBestSpeed, 2, 0)
+	assert.NoError(t, err)
+	assert.Equal(t, Stats{}, CompressorStats(parallel))
+	assert.NoError(t, parallel.Close())
+}
+
+func TestInstrumentationStreamHandlerStats(t *testing.T) {
+	const originalLen = 1024 * 16
+	const bufferSize = 1024
+	original := bytes.NewBuffer(makeTestData(originalLen))
+	SetStatsEnabled(true)
+	defer SetStatsEnabled(false)
+
+	compressed := bytes.NewBuffer([]byte{})
+	inputReader := func(data []byte) uint32 {
+		read, _ := original.Read(data)
+		return uint32(read)
+	}
+	outputWriter := func(data []byte) uint32 {
+		written, _ := compressed.Write(data)
+		return uint32(written)
+	}
+
+	before := GlobalCompressionStats()
+	_, err := GoGZipCompressStream(CompressionLevelBestSpeed, bufferSize, bufferSize, inputReader, outputWriter)
+	assert.NoError(t, err)
+	after := GlobalCompressionStats()
+
+	assert.Equal(t, uint64(originalLen), after.BytesIn-before.BytesIn)
+	assert.Equal(t, uint64(compressed.Len()), after.BytesOut-before.BytesOut)
+	// the input handler is called once per work buffer and once more to find the end of the input
+	assert.Greater(t, after.HandlerCalls-before.HandlerCalls, uint64(originalLen/bufferSize))
+	assert.Greater(t, after.HandlerTime, before.HandlerTime)
+}
+
+func TestInstrumentationDisabled(t *testing.T) {
+	const originalLen = 1024
+	original := makeTestData(originalLen)
+	assert.False(t, StatsEnabled())
+
+	before := GlobalCompressionStats()
+	compressed := make([]byte, GZipStoreBound(originalLen))
+	_, err := GoGZipCompressBuffer(CompressionLevelBestSpeed, original, compressed)
+	assert.NoError(t, err)
+
+	assert.Equal(t, before, GlobalCompressionStats())
+}
@@ -2,6 +2,7 @@ package gozlib
 
 import (
 	"bytes"
+	"sync"
 	"testing"
 
 	"github.com/stretchr/testify/assert"
@@ -161,6 +162,38 @@ func TestCompressUncompressStream(t *testing.T) {
 	assert.Equal(t, original, uncompressed.Bytes())
 }
 
+func TestUncompressStreamMultiMember(t *testing.T) {
+	compressed, original, err := stdLibGZipCompressMembers(5000, 12000, 700)
+	assert.NoError(t, err)
+	input := bytes.NewBuffer(compressed)
+
+	inputReader := func(data []byte) uint32 {
+		read, err := input.Read(data)
+
+		if err != nil {
+			return 0
+		}
+		return uint32(read)
+	}
+
+	uncompressed := bytes.NewBuffer([]byte{})
+	outputWriter := func(data []byte) uint32 {
+		written, err := uncompressed.Write(data)
+
+		if err != nil {
+			return 0
+		}
+
+		return uint32(written)
+	}
+
+	total, err := GoUncompressStream(1024, 512, inputReader, outputWriter)
+
+	assert.NoError(t, err)
+	assert.Equal(t, uint64(len(original)), total)
+	assert.Equal(t, original, uncompressed.Bytes())
+}
+
 func verifyUncompressStream(originalLen uint32, inputBufferSize uint32, outputBufferSize uint32, t *testing.T) {
 	original := makeTestData(originalLen)
 	compressed, stdCompErr := stdLibGZipCompress(original)
@@ -227,3 +260,45 @@ func verifyCompressStream(originalLen uint32, inputBufferSize uint32, outputBuff
 	assert.NoError(t, uncompErr)
 	assert.Equal(t, stdUncompressed, original)
 }
+
+func TestStreamEventHandlerSlotsAreReused(t *testing.T) {
+	handlers := &streamEventHandlers{}
+	ids := make(map[uintptr]bool)
+	for i := 0; i < handlerPageSize*3; i++ {
+		id := registerStreamEventHandler(handlers)
+		assert.NotZero(t, id)
+		assert.False(t, ids[id], "handler IDs should be unique while registered")
+		assert.True(t, handlers == findStreamEventHandler(id))
+		ids[id] = true
+	}
+
+	for id := range ids {
+		unregisterStreamEventHandler(id)
+		assert.Panics(t, func() { findStreamEventHandler(id) })
+	}
+
+	// slots freed above are handed out again
+	id := registerStreamEventHandler(handlers)
+	defer unregisterStreamEventHandler(id)
+	assert.True(t, ids[id])
+}
+
+func TestStreamEventHandlerConcurrentRegistration(t *testing.T) {
+	const goroutines = 8
+	const iterations = 1000
+
+	var wg sync.WaitGroup
+	for g := 0; g < goroutines; g++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for i := 0; i < iterations; i++ {
+				handlers := &streamEventHandlers{}
+				id := registerStreamEventHandler(handlers)
+				assert.True(t, handlers == findStreamEventHandler(id))
+				unregisterStreamEventHandler(id)
+			}
+		}()
+	}
+	wg.Wait()
+}
@@ -56,3 +56,21 @@ func stdLibGZipCompress(data []byte) (*bytes.Buffer, error) {
 
 	return bytes.NewBuffer(compressed), nil
 }
+
+// stdLibGZipCompressMembers compresses each of the given sizes of test data as a separate gzip member,
+// returning the concatenated members and the concatenated original data
+func stdLibGZipCompressMembers(sizes ...uint32) ([]byte, []byte, error) {
+	original := []byte{}
+	compressed := []byte{}
+	for _, size := range sizes {
+		data := makeTestData(size)
+		member, err := stdLibGZipCompressSlice(data)
+		if err != nil {
+			return nil, nil, err
+		}
+		original = append(original, data...)
+		compressed = append(compressed, member...)
+	}
+
+	return compressed, original, nil
+}
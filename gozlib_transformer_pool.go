@@ -0,0 +1,250 @@
+package gozlib
+
+import (
+	"io"
+	"runtime"
+	"sync"
+	"sync/atomic"
+	_ "unsafe" // go:linkname
+)
+
+// DefaultTransformerPoolCapacity is the number of idle transformers kept by the pools returned by SharedTransformerPool
+const DefaultTransformerPoolCapacity = 256
+
+// runtime.procPin and runtime.procUnpin pin the goroutine to its P and return the P id, the same way sync.Pool picks its
+// per P shard. They are internal runtime functions: these declarations are verified against go1.21.6, the toolchain the
+// package is built and tested with, and the signatures are unchanged since the go1.19 minimum in go.mod.
+// Check them again when moving to a newer Go release, starting with go1.23 the linker only allows pulling runtime
+// functions that the runtime explicitly marks as linkname targets
+//
+//go:linkname runtimeProcPin runtime.procPin
+func runtimeProcPin() int
+
+//go:linkname runtimeProcUnpin runtime.procUnpin
+func runtimeProcUnpin()
+
+// transformerPoolShard is the free list of a single P, padded so that shards used by different Ps don't share a cache line
+type transformerPoolShard struct {
+	lock sync.Mutex
+	free []io.Closer
+	_    [64]byte
+}
+
+// TransformerPool keeps idle compressors or uncompressors of a single mode, level and buffer size so they can be reused
+// without initializing zlib again. Unlike a sync.Pool, idle transformers are never dropped by the GC: they're kept in one
+// shard per P, up to the pool capacity, and the surplus is released as soon as it's returned to a full shard.
+// Acquire takes a transformer from the shard of the current P, or from another shard if it's empty, and only creates
+// a new one when all shards are empty.
+// Close releases all idle transformers, it must be invoked once the pool is not in use anymore to avoid resource leaks
+type TransformerPool struct {
+	mode       TransformMode
+	level      CompressionLevel
+	bufferSize uint32
+	shardCap   int
+	shards     []transformerPoolShard
+	closed     uint32
+}
+
+// NewTransformerPool creates a pool of transformers for the mode, compression level and work buffer size.
+// The level is ignored for TransformModeUncompress, whose uncompressors accept zlib or gzip inputs.
+// capacity is the maximum number of idle transformers kept, spread evenly across GOMAXPROCS shards.
+// An error is returned if the mode or level are not valid
+func NewTransformerPool(mode TransformMode, level CompressionLevel, bufferSize uint32, capacity int) (*TransformerPool, error) {
+	if mode < TransformModeZLib || mode > TransformModeUncompress || capacity < 0 {
+		return nil, InvalidCompressionOptionsError
+	}
+	if mode != TransformModeUncompress {
+		options := CompressionOptions{Format: compressionFormat(mode), Level: level}
+		if _, _, _, _, err := options.deflateParameters(); err != nil {
+			return nil, err
+		}
+	}
+
+	shardCount := runtime.GOMAXPROCS(0)
+	shardCap := (capacity + shardCount - 1) / shardCount
+	shards := make([]transformerPoolShard, shardCount)
+	for i := range shards {
+		shards[i].free = make([]io.Closer, 0, shardCap)
+	}
+
+	return &TransformerPool{
+		mode:       mode,
+		level:      level,
+		bufferSize: bufferSize,
+		shardCap:   shardCap,
+		shards:     shards,
+	}, nil
+}
+
+func compressionFormat(mode TransformMode) CompressionFormat {
+	if mode == TransformModeZLib {
+		return CompressionFormatZLib
+	}
+	return CompressionFormatGZip
+}
+
+type transformerPoolKey struct {
+	mode       TransformMode
+	level      CompressionLevel
+	bufferSize uint32
+}
+
+var (
+	sharedTransformerPoolsLock sync.Mutex
+	sharedTransformerPools     = map[transformerPoolKey]*TransformerPool{}
+)
+
+// SharedTransformerPool returns the process wide pool of transformers for the mode, level and work buffer size,
+// creating it with DefaultTransformerPoolCapacity on first use. Shared pools must not be closed
+func SharedTransformerPool(mode TransformMode, level CompressionLevel, bufferSize uint32) (*TransformerPool, error) {
+	key := transformerPoolKey{mode: mode, level: level, bufferSize: bufferSize}
+
+	sharedTransformerPoolsLock.Lock()
+	defer sharedTransformerPoolsLock.Unlock()
+
+	if pool, exists := sharedTransformerPools[key]; exists {
+		return pool, nil
+	}
+
+	pool, err := NewTransformerPool(mode, level, bufferSize, DefaultTransformerPoolCapacity)
+	if err != nil {
+		return nil, err
+	}
+	sharedTransformerPools[key] = pool
+	return pool, nil
+}
+
+// AcquireCompressor returns an idle compressor writing to output, or a new one if there is none.
+// The compressor must be returned with ReleaseCompressor once its stream is finished with Flush.
+// It panics if the pool is an uncompression pool
+func (pool *TransformerPool) AcquireCompressor(output io.Writer) (io.WriteCloser, error) {
+	if pool.mode == TransformModeUncompress {
+		panic("gozlib: compressor acquired from an uncompression pool")
+	}
+
+	if idle := pool.acquire(); idle != nil {
+		goComp := idle.(*goGZipCompressor)
+		goComp.output = output
+		return goComp, nil
+	}
+
+	return NewGoCompressorWithOptions(output, CompressionOptions{Format: compressionFormat(pool.mode), Level: pool.level}, pool.bufferSize)
+}
+
+// ReleaseCompressor resets the compressor and keeps it for reuse, or releases it if the pool is full.
+// Compressors that were closed are ignored
+func (pool *TransformerPool) ReleaseCompressor(compressor io.WriteCloser) {
+	goComp := compressor.(*goGZipCompressor)
+	if goComp.transformer == nil {
+		return
+	}
+
+	ResetCompressor(nil, goComp)
+	if !pool.release(goComp) {
+		goComp.release()
+	}
+}
+
+// AcquireUncompressor returns an idle uncompressor reading from input, or a new one if there is none.
+// The uncompressor must be returned with ReleaseUncompressor.
+// It panics if the pool is a compression pool
+func (pool *TransformerPool) AcquireUncompressor(input io.Reader) (io.ReadCloser, error) {
+	if pool.mode != TransformModeUncompress {
+		panic("gozlib: uncompressor acquired from a compression pool")
+	}
+
+	if idle := pool.acquire(); idle != nil {
+		goUncomp := idle.(*goUncompressor)
+		goUncomp.input = input
+		return goUncomp, nil
+	}
+
+	return NewGoZLibUncompressor(input, pool.bufferSize)
+}
+
+// ReleaseUncompressor resets the uncompressor and keeps it for reuse, or releases it if the pool is full.
+// Uncompressors that were closed are ignored
+func (pool *TransformerPool) ReleaseUncompressor(uncompressor io.ReadCloser) {
+	goUncomp := uncompressor.(*goUncompressor)
+	if goUncomp.transformer == nil {
+		return
+	}
+
+	goUncomp.reset(nil)
+	if !pool.release(goUncomp) {
+		_ = goUncomp.Close()
+	}
+}
+
+// Idle returns the number of idle transformers kept by the pool
+func (pool *TransformerPool) Idle() int {
+	idle := 0
+	for i := range pool.shards {
+		shard := &pool.shards[i]
+		shard.lock.Lock()
+		idle += len(shard.free)
+		shard.lock.Unlock()
+	}
+	return idle
+}
+
+// Close releases all idle transformers. Transformers released to the pool after Close are released right away
+func (pool *TransformerPool) Close() {
+	atomic.StoreUint32(&pool.closed, 1)
+	for i := range pool.shards {
+		shard := &pool.shards[i]
+		shard.lock.Lock()
+		for _, idle := range shard.free {
+			pool.releaseIdle(idle)
+		}
+		shard.free = shard.free[:0]
+		shard.lock.Unlock()
+	}
+}
+
+func (pool *TransformerPool) releaseIdle(idle io.Closer) {
+	if goComp, isCompressor := idle.(*goGZipCompressor); isCompressor {
+		goComp.release()
+		return
+	}
+	_ = idle.Close()
+}
+
+// homeShard returns the index of the shard of the P running the calling goroutine.
+// The goroutine may be moved to another P right after, which only costs locking a shard owned by another P
+func (pool *TransformerPool) homeShard() int {
+	pid := runtimeProcPin()
+	runtimeProcUnpin()
+	return pid % len(pool.shards)
+}
+
+func (pool *TransformerPool) acquire() io.Closer {
+	home := pool.homeShard()
+	for i := 0; i < len(pool.shards); i++ {
+		shard := &pool.shards[(home+i)%len(pool.shards)]
+		shard.lock.Lock()
+		if last := len(shard.free) - 1; last >= 0 {
+			idle := shard.free[last]
+			shard.free[last] = nil
+			shard.free = shard.free[:last]
+			shard.lock.Unlock()
+			return idle
+		}
+		shard.lock.Unlock()
+	}
+	return nil
+}
+
+// release keeps the transformer in the shard of the current P and returns false if the shard is full
+func (pool *TransformerPool) release(idle io.Closer) bool {
+	shard := &pool.shards[pool.homeShard()]
+	shard.lock.Lock()
+	defer shard.lock.Unlock()
+
+	// checked under the lock so that Close can't miss a transformer kept while it drains the shard
+	if atomic.LoadUint32(&pool.closed) != 0 || len(shard.free) >= pool.shardCap {
+		return false
+	}
+	shard.free = append(shard.free, idle)
+	return true
+}
@@ -0,0 +1,203 @@
+package gozlib
+
+import (
+	"bytes"
+	"compress/zlib"
+	"io"
+	"runtime"
+	"sync"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestTransformerPoolReusesCompressors(t *testing.T) {
+	const originalLen = 20000
+
+	pool, err := NewTransformerPool(TransformModeGZip, CompressionLevelBestSpeed, 4096, 4)
+	assert.NoError(t, err)
+	defer pool.Close()
+
+	original := makeTestData(originalLen)
+	var previous io.WriteCloser
+	for i := 0; i < 3; i++ {
+		output := bytes.NewBuffer([]byte{})
+		compressor, err := pool.AcquireCompressor(output)
+		assert.NoError(t, err)
+		if previous != nil {
+			assert.True(t, previous == compressor, "compressor not reused")
+		}
+
+		_, err = compressor.Write(original)
+		assert.NoError(t, err)
+		assert.NoError(t, Flush(compressor))
+
+		uncompressed, err := stdLibGZipUncompress(output, originalLen)
+		assert.NoError(t, err)
+		assert.Equal(t, original, uncompressed)
+
+		pool.ReleaseCompressor(compressor)
+		previous = compressor
+
+		// idle compressors are kept through garbage collections
+		runtime.GC()
+		assert.Equal(t, 1, pool.Idle())
+	}
+}
+
+func TestTransformerPoolZLibCompressor(t *testing.T) {
+	pool, err := NewTransformerPool(TransformModeZLib, CompressionLevelDefault, 1024, 1)
+	assert.NoError(t, err)
+	defer pool.Close()
+
+	original := makeTestData(5000)
+	output := bytes.NewBuffer([]byte{})
+	compressor, err := pool.AcquireCompressor(output)
+	assert.NoError(t, err)
+
+	_, err = compressor.Write(original)
+	assert.NoError(t, err)
+	assert.NoError(t, Flush(compressor))
+	pool.ReleaseCompressor(compressor)
+
+	reader, err := zlib.NewReader(output)
+	assert.NoError(t, err)
+	uncompressed, err := io.ReadAll(reader)
+	assert.NoError(t, err)
+	assert.Equal(t, original, uncompressed)
+}
+
+func TestTransformerPoolReleasesUnfinishedCompressors(t *testing.T) {
+	const originalLen = 3000
+
+	pool, err := NewTransformerPool(TransformModeGZip, CompressionLevelDefault, 1024, 1)
+	assert.NoError(t, err)
+	defer pool.Close()
+
+	compressor, err := pool.AcquireCompressor(io.Discard)
+	assert.NoError(t, err)
+	_, err = compressor.Write(makeTestData(originalLen))
+	assert.NoError(t, err)
+	// released in the middle of a stream, the compressor must start a new one when reused
+	pool.ReleaseCompressor(compressor)
+
+	original := makeTestData(originalLen)
+	output := bytes.NewBuffer([]byte{})
+	compressor, err = pool.AcquireCompressor(output)
+	assert.NoError(t, err)
+	_, err = compressor.Write(original)
+	assert.NoError(t, err)
+	assert.NoError(t, Flush(compressor))
+	pool.ReleaseCompressor(compressor)
+
+	uncompressed, err := stdLibGZipUncompress(output, originalLen)
+	assert.NoError(t, err)
+	assert.Equal(t, original, uncompressed)
+}
+
+func TestTransformerPoolReusesUncompressors(t *testing.T) {
+	const originalLen = 12000
+
+	pool, err := NewTransformerPool(TransformModeUncompress, CompressionLevelDefault, 2048, 2)
+	assert.NoError(t, err)
+	defer pool.Close()
+
+	original := makeTestData(originalLen)
+	compressed, err := stdLibGZipCompressSlice(original)
+	assert.NoError(t, err)
+
+	for i := 0; i < 3; i++ {
+		uncompressor, err := pool.AcquireUncompressor(bytes.NewReader(compressed))
+		assert.NoError(t, err)
+
+		uncompressed, err := io.ReadAll(uncompressor)
+		assert.NoError(t, err)
+		assert.Equal(t, original, uncompressed)
+
+		pool.ReleaseUncompressor(uncompressor)
+		assert.Equal(t, 1, pool.Idle())
+	}
+}
+
+func TestTransformerPoolIsBounded(t *testing.T) {
+	pool, err := NewTransformerPool(TransformModeGZip, CompressionLevelDefault, 1024, 0)
+	assert.NoError(t, err)
+
+	compressor, err := pool.AcquireCompressor(io.Discard)
+	assert.NoError(t, err)
+	// the surplus is released right away
+	pool.ReleaseCompressor(compressor)
+	assert.Equal(t, 0, pool.Idle())
+
+	pool.Close()
+
+	// closed transformers aren't taken back and releasing to a closed pool releases the transformer
+	closed, err := pool.AcquireCompressor(io.Discard)
+	assert.NoError(t, err)
+	assert.NoError(t, closed.Close())
+	pool.ReleaseCompressor(closed)
+
+	released, err := pool.AcquireCompressor(io.Discard)
+	assert.NoError(t, err)
+	pool.ReleaseCompressor(released)
+	assert.Equal(t, 0, pool.Idle())
+}
+
+func TestTransformerPoolRejectsInvalidParameters(t *testing.T) {
+	_, err := NewTransformerPool(TransformModeGZip, CompressionLevel(12), 1024, 1)
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+
+	_, err = NewTransformerPool(TransformMode(7), CompressionLevelDefault, 1024, 1)
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+
+	_, err = NewTransformerPool(TransformModeUncompress, CompressionLevelDefault, 1024, -1)
+	assert.ErrorIs(t, err, InvalidCompressionOptionsError)
+}
+
+func TestSharedTransformerPool(t *testing.T) {
+	pool, err := SharedTransformerPool(TransformModeGZip, CompressionLevelBestSpeed, 8192)
+	assert.NoError(t, err)
+
+	same, err := SharedTransformerPool(TransformModeGZip, CompressionLevelBestSpeed, 8192)
+	assert.NoError(t, err)
+	assert.True(t, pool == same)
+
+	other, err := SharedTransformerPool(TransformModeGZip, CompressionLevelBestSpeed, 4096)
+	assert.NoError(t, err)
+	assert.True(t, pool != other)
+}
+
+func TestTransformerPoolConcurrentUse(t *testing.T) {
+	const originalLen = 8000
+	const workers = 8
+
+	pool, err := NewTransformerPool(TransformModeGZip, CompressionLevelBestSpeed, 2048, workers/2)
+	assert.NoError(t, err)
+	defer pool.Close()
+
+	original := makeTestData(originalLen)
+
+	var wg sync.WaitGroup
+	for w := 0; w < workers; w++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for i := 0; i < 50; i++ {
+				output := bytes.NewBuffer([]byte{})
+				compressor, err := pool.AcquireCompressor(output)
+				assert.NoError(t, err)
+				_, err = compressor.Write(original)
+				assert.NoError(t, err)
+				assert.NoError(t, Flush(compressor))
+				pool.ReleaseCompressor(compressor)
+
+				uncompressed, err := stdLibGZipUncompress(output, originalLen)
+				assert.NoError(t, err)
+				assert.Equal(t, original, uncompressed)
+			}
+		}()
+	}
+	wg.Wait()
+
+	assert.LessOrEqual(t, pool.Idle(), workers)
+}
@@ -147,6 +147,39 @@ func TestTransformerUncompressEmptyInput(t *testing.T) {
 	assert.Equal(t, int64(0), uncompLen)
 }
 
+func TestTransformerUncompressTruncatedInput(t *testing.T) {
+	original := makeTestData(10000)
+	compressed, err := stdLibGZipCompress(original)
+	assert.NoError(t, err)
+
+	// cut in the deflate data and in the trailer
+	for _, cut := range []int{compressed.Len() / 2, compressed.Len() - 4} {
+		uncompressor, initErr := NewGoZLibUncompressor(bytes.NewReader(compressed.Bytes()[:cut]), 1024)
+		assert.NoError(t, initErr)
+		_, uncompErr := io.Copy(io.Discard, uncompressor)
+		assert.ErrorIs(t, uncompErr, io.ErrUnexpectedEOF)
+		assert.NoError(t, uncompressor.Close())
+	}
+}
+
+func TestTransformerUncompressMultiMemberGZip(t *testing.T) {
+	compressed, original, err := stdLibGZipCompressMembers(3000, 1, 0, 70000)
+	assert.NoError(t, err)
+
+	// small work buffers make members end and start in the middle of the input chunks
+	for _, bufferSize := range []uint32{64, 1000, 256 * 1024} {
+		uncompressor, initErr := NewGoZLibUncompressor(bytes.NewBuffer(compressed), bufferSize)
+		assert.NoError(t, initErr)
+
+		uncompressed := bytes.NewBuffer([]byte{})
+		uncompLen, uncompErr := io.Copy(uncompressed, uncompressor)
+		assert.NoError(t, uncompErr)
+		assert.NoError(t, uncompressor.Close())
+		assert.Equal(t, int64(len(original)), uncompLen)
+		assert.Equal(t, original, uncompressed.Bytes())
+	}
+}
+
 type eofAwareReader struct {
 	data *bytes.Buffer
 }
@@ -337,3 +370,13 @@ func verifyTransformerUncompress(t *testing.T, copyFn copyDataFn, workBufferSize
 		}
 	}
 }
+
+func TestTransformerFailCompressOutputWrite(t *testing.T) {
+	compressor, err := NewGoGZipCompressor(&failingWriter{}, CompressionLevelBestSpeed, 64)
+	assert.NoError(t, err)
+
+	// the small work buffer gets filled and written before the input is consumed
+	_, werr := compressor.Write(makeTestData(4096))
+	assert.ErrorIs(t, werr, TransformerCompressionError)
+	assert.ErrorIs(t, compressor.Close(), TransformerCompressionError)
+}
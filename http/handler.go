@@ -0,0 +1,261 @@
+// Package http provides net/http response compression and a transport uncompressing responses, built on gozlib
+// pooled compressors, uncompressors and native buffers.
+//
+// Responses are buffered up to Config.BufferThreshold bytes. Bodies that end within the threshold are compressed
+// with a single GoGZipCompressBuffer call, or sent uncompressed when smaller than Config.MinSize, and larger bodies
+// are streamed through a pooled compressor with a work buffer sized for their content type.
+// Compressors and buffers are reused across requests so serving a response doesn't allocate on the heap once the
+// pools are warm.
+package http
+
+import (
+	"errors"
+	"mime"
+	nethttp "net/http"
+	"strings"
+	"sync"
+
+	"github.com/bignacio/gozlib"
+)
+
+const (
+	// DefaultMinSize is the smallest body compressed by default, below it the gzip header and trailer outweigh the savings
+	DefaultMinSize = 256
+	// DefaultBufferThreshold is the largest body compressed as a single buffer by default
+	DefaultBufferThreshold = 64 * 1024
+	// DefaultBufferSize is the default work buffer size of the pooled compressors
+	DefaultBufferSize = 16 * 1024
+	// DefaultMaxIdleCompressors is the default number of idle compressors kept for each work buffer size
+	DefaultMaxIdleCompressors = 64
+)
+
+// InvalidConfigError is returned by NewHandler when the configuration sizes or level are not valid
+var InvalidConfigError = errors.New("invalid compression handler configuration")
+
+// Config holds the response compression parameters. Use DefaultConfig for sensible defaults
+type Config struct {
+	// Level is the gzip compression level
+	Level gozlib.CompressionLevel
+	// MinSize is the smallest body that is compressed, smaller ones are sent as they are
+	MinSize int
+	// BufferThreshold is the number of bytes buffered before streaming the response through a compressor.
+	// Bodies that fit are compressed with a single GoGZipCompressBuffer call
+	BufferThreshold int
+	// BufferSize is the work buffer size of the compressors used for content types not in ContentTypeBufferSizes
+	BufferSize uint32
+	// ContentTypeBufferSizes overrides BufferSize for media types, like "application/json", whose responses are usually larger or smaller
+	ContentTypeBufferSizes map[string]uint32
+	// ContentTypes lists the media type prefixes that are compressed, like "text/" or "application/json".
+	// Empty means compressing all content types except the ones that are usually compressed already
+	ContentTypes []string
+	// MaxIdleCompressors is the number of idle compressors kept for each distinct work buffer size, the rest are closed
+	MaxIdleCompressors int
+}
+
+// DefaultConfig returns a configuration compressing at the default level with the Default* sizes
+func DefaultConfig() Config {
+	return Config{
+		Level:              gozlib.CompressionLevelDefault,
+		MinSize:            DefaultMinSize,
+		BufferThreshold:    DefaultBufferThreshold,
+		BufferSize:         DefaultBufferSize,
+		MaxIdleCompressors: DefaultMaxIdleCompressors,
+	}
+}
+
+// content types that are compressed already and gain nothing from gzip
+var incompressibleContentTypes = []string{"image/", "video/", "audio/", "application/gzip", "application/zip", "application/x-gzip",
+	"application/zstd", "application/octet-stream", "font/woff"}
+
+// header values shared by all responses, assigning them directly avoids allocating a new slice per request
+var (
+	gzipEncodingValue         = []string{"gzip"}
+	acceptEncodingVaryValue   = []string{"Accept-Encoding"}
+	acceptEncodingHeaderName  = "Accept-Encoding"
+	contentEncodingHeaderName = "Content-Encoding"
+	contentLengthHeaderName   = "Content-Length"
+	contentTypeHeaderName     = "Content-Type"
+	varyHeaderName            = "Vary"
+)
+
+// Handler compresses the responses of the wrapped handler for clients accepting gzip
+type Handler struct {
+	next        nethttp.Handler
+	config      Config
+	defaultPool *gozlib.TransformerPool
+	pools       map[string]*gozlib.TransformerPool
+	buffers     *gozlib.NativeSlicePool
+	outputSize  int
+	writers     sync.Pool
+}
+
+// NewHandler returns a handler compressing the responses of next according to config.
+// Close must be called once the handler is not used anymore to release its pooled compressors and buffers
+func NewHandler(next nethttp.Handler, config Config) (*Handler, error) {
+	if config.MinSize < 0 || config.BufferThreshold < config.MinSize || config.BufferThreshold <= 0 || config.BufferSize == 0 || config.MaxIdleCompressors < 0 {
+		return nil, InvalidConfigError
+	}
+	if config.Level < gozlib.CompressionLevelDefault || config.Level > gozlib.CompressionLevelBestCompression {
+		return nil, InvalidConfigError
+	}
+
+	handler := &Handler{
+		next:       next,
+		config:     config,
+		pools:      map[string]*gozlib.TransformerPool{},
+		buffers:    gozlib.NewNativeSlicePool(),
+		outputSize: gozlib.GZipStoreBound(config.BufferThreshold),
+	}
+	defaultPool, err := handler.newPool(config.BufferSize)
+	if err != nil {
+		handler.buffers.Free()
+		return nil, InvalidConfigError
+	}
+	handler.defaultPool = defaultPool
+
+	// media types sharing a work buffer size share their compressors too
+	poolsBySize := map[uint32]*gozlib.TransformerPool{config.BufferSize: handler.defaultPool}
+	for contentType, bufferSize := range config.ContentTypeBufferSizes {
+		if bufferSize == 0 {
+			handler.Close()
+			return nil, InvalidConfigError
+		}
+		pool, exists := poolsBySize[bufferSize]
+		if !exists {
+			pool, err = handler.newPool(bufferSize)
+			if err != nil {
+				handler.Close()
+				return nil, InvalidConfigError
+			}
+			poolsBySize[bufferSize] = pool
+		}
+		handler.pools[strings.ToLower(contentType)] = pool
+	}
+
+	handler.writers.New = func() interface{} {
+		return &responseWriter{handler: handler}
+	}
+	return handler, nil
+}
+
+// newPool returns a pool of compressors with the work buffer size, which never drops its idle compressors
+// without releasing them like a sync.Pool would
+func (h *Handler) newPool(bufferSize uint32) (*gozlib.TransformerPool, error) {
+	return gozlib.NewTransformerPool(gozlib.TransformModeGZip, h.config.Level, bufferSize, h.config.MaxIdleCompressors)
+}
+
+// Close releases the idle compressors and the buffer pool. The handler must not serve requests after it's closed
+func (h *Handler) Close() {
+	h.defaultPool.Close()
+	for _, pool := range h.pools {
+		pool.Close()
+	}
+	h.buffers.Free()
+}
+
+// ServeHTTP serves the request with the wrapped handler, compressing its response if the client accepts gzip
+func (h *Handler) ServeHTTP(w nethttp.ResponseWriter, r *nethttp.Request) {
+	if r.Method == nethttp.MethodHead || !AcceptsGZip(r.Header.Get(acceptEncodingHeaderName)) {
+		h.next.ServeHTTP(w, r)
+		return
+	}
+
+	rw := h.writers.Get().(*responseWriter)
+	rw.reset(w)
+	// the pooled resources are released even if the wrapped handler panics
+	defer h.release(rw)
+
+	h.next.ServeHTTP(rw, r)
+	rw.finish()
+}
+
+func (h *Handler) release(rw *responseWriter) {
+	rw.releaseBuffer()
+	if rw.compressor != nil {
+		rw.pool.ReleaseCompressor(rw.compressor)
+	}
+	rw.reset(nil)
+	h.writers.Put(rw)
+}
+
+// compressible returns true if responses of the content type are compressed
+func (h *Handler) compressible(contentType string) bool {
+	if len(h.config.ContentTypes) > 0 {
+		return hasAnyPrefix(contentType, h.config.ContentTypes)
+	}
+	return !hasAnyPrefix(contentType, incompressibleContentTypes)
+}
+
+// compressorPool returns the pool of compressors with the work buffer size of the content type
+func (h *Handler) compressorPool(contentType string) *gozlib.TransformerPool {
+	if len(h.pools) > 0 {
+		if pool, exists := h.pools[mediaType(contentType)]; exists {
+			return pool
+		}
+	}
+	return h.defaultPool
+}
+
+func hasAnyPrefix(value string, prefixes []string) bool {
+	for _, prefix := range prefixes {
+		if len(value) >= len(prefix) && strings.EqualFold(value[:len(prefix)], prefix) {
+			return true
+		}
+	}
+	return false
+}
+
+// mediaType returns the content type without parameters, only allocating when it isn't already lower case
+func mediaType(contentType string) string {
+	if separator := strings.IndexByte(contentType, ';'); separator >= 0 {
+		contentType = contentType[:separator]
+	}
+	contentType = strings.TrimSpace(contentType)
+	for i := 0; i < len(contentType); i++ {
+		if contentType[i] >= 'A' && contentType[i] <= 'Z' {
+			if parsed, _, err := mime.ParseMediaType(contentType); err == nil {
+				return parsed
+			}
+			return strings.ToLower(contentType)
+		}
+	}
+	return contentType
+}
+
+// AcceptsGZip returns true if an Accept-Encoding header value allows gzip, either by name or with the * wildcard,
+// with a non zero quality value
+func AcceptsGZip(acceptEncoding string) bool {
+	for len(acceptEncoding) > 0 {
+		coding := acceptEncoding
+		if comma := strings.IndexByte(acceptEncoding, ','); comma >= 0 {
+			coding, acceptEncoding = acceptEncoding[:comma], acceptEncoding[comma+1:]
+		} else {
+			acceptEncoding = ""
+		}
+
+		name, params := coding, ""
+		if semicolon := strings.IndexByte(coding, ';'); semicolon >= 0 {
+			name, params = coding[:semicolon], coding[semicolon+1:]
+		}
+		name = strings.TrimSpace(name)
+		if strings.EqualFold(name, "gzip") || strings.EqualFold(name, "x-gzip") || name == "*" {
+			return !zeroQuality(params)
+		}
+	}
+	return false
+}
+
+// zeroQuality returns true for a q=0 parameter, which refuses the coding
+func zeroQuality(params string) bool {
+	params = strings.TrimSpace(params)
+	if len(params) < 2 || (params[0] != 'q' && params[0] != 'Q') || params[1] != '=' {
+		return false
+	}
+	quality := strings.TrimSpace(params[2:])
+	for i := 0; i < len(quality); i++ {
+		if quality[i] != '0' && quality[i] != '.' {
+			return false
+		}
+	}
+	return true
+}
@@ -0,0 +1,307 @@
+package http
+
+import (
+	"bytes"
+	"compress/gzip"
+	"io"
+	"math/rand"
+	nethttp "net/http"
+	"net/http/httptest"
+	"strings"
+	"testing"
+
+	"github.com/bignacio/gozlib"
+	"github.com/stretchr/testify/assert"
+)
+
+func makeTestData(size int) []byte {
+	data := make([]byte, size)
+	for i := range data {
+		data[i] = byte(rand.Intn(16) + 'a')
+	}
+	return data
+}
+
+func gunzip(t *testing.T, data []byte) []byte {
+	reader, err := gzip.NewReader(bytes.NewReader(data))
+	assert.NoError(t, err)
+	uncompressed, err := io.ReadAll(reader)
+	assert.NoError(t, err)
+	return uncompressed
+}
+
+func newTestHandler(t *testing.T, config Config, next nethttp.HandlerFunc) *Handler {
+	handler, err := NewHandler(next, config)
+	assert.NoError(t, err)
+	t.Cleanup(handler.Close)
+	return handler
+}
+
+func serve(handler nethttp.Handler, acceptEncoding string) *httptest.ResponseRecorder {
+	req := httptest.NewRequest(nethttp.MethodGet, "/", nil)
+	if acceptEncoding != "" {
+		req.Header.Set("Accept-Encoding", acceptEncoding)
+	}
+	recorder := httptest.NewRecorder()
+	handler.ServeHTTP(recorder, req)
+	return recorder
+}
+
+// writeInChunks returns a handler writing body in chunks of chunkSize bytes with the given content type
+func writeInChunks(body []byte, chunkSize int, contentType string) nethttp.HandlerFunc {
+	return func(w nethttp.ResponseWriter, r *nethttp.Request) {
+		if contentType != "" {
+			w.Header().Set("Content-Type", contentType)
+		}
+		for start := 0; start < len(body); start += chunkSize {
+			end := start + chunkSize
+			if end > len(body) {
+				end = len(body)
+			}
+			_, err := w.Write(body[start:end])
+			if err != nil {
+				panic(err)
+			}
+		}
+	}
+}
+
+func TestAcceptsGZip(t *testing.T) {
+	accepted := []string{"gzip", "GZIP", "deflate, gzip", "gzip;q=0.5", "br;q=1.0, gzip; q=0.8", "*", "x-gzip", "identity, *;q=0.1"}
+	for _, acceptEncoding := range accepted {
+		assert.True(t, AcceptsGZip(acceptEncoding), acceptEncoding)
+	}
+
+	refused := []string{"", "identity", "deflate, br", "gzip;q=0", "gzip; q=0.000", "*;q=0", "gzipx"}
+	for _, acceptEncoding := range refused {
+		assert.False(t, AcceptsGZip(acceptEncoding), acceptEncoding)
+	}
+}
+
+func TestHandlerRejectsInvalidConfig(t *testing.T) {
+	next := nethttp.NotFoundHandler()
+	invalid := []func(config *Config){
+		func(config *Config) { config.BufferThreshold = 0 },
+		func(config *Config) { config.MinSize = config.BufferThreshold + 1 },
+		func(config *Config) { config.BufferSize = 0 },
+		func(config *Config) { config.Level = gozlib.CompressionLevelBestCompression + 1 },
+		func(config *Config) { config.ContentTypeBufferSizes = map[string]uint32{"text/html": 0} },
+	}
+
+	for _, change := range invalid {
+		config := DefaultConfig()
+		change(&config)
+		handler, err := NewHandler(next, config)
+		assert.ErrorIs(t, err, InvalidConfigError)
+		assert.Nil(t, handler)
+	}
+}
+
+func TestHandlerCompressesBufferedBody(t *testing.T) {
+	body := makeTestData(DefaultBufferThreshold / 2)
+	handler := newTestHandler(t, DefaultConfig(), writeInChunks(body, 1000, "text/plain"))
+
+	recorder := serve(handler, "gzip, deflate")
+
+	assert.Equal(t, nethttp.StatusOK, recorder.Code)
+	assert.Equal(t, "gzip", recorder.Header().Get("Content-Encoding"))
+	assert.Equal(t, "Accept-Encoding", recorder.Header().Get("Vary"))
+	assert.Empty(t, recorder.Header().Get("Content-Length"))
+	assert.Less(t, recorder.Body.Len(), len(body))
+	assert.Equal(t, body, gunzip(t, recorder.Body.Bytes()))
+}
+
+func TestHandlerStreamsLargeBody(t *testing.T) {
+	body := makeTestData(DefaultBufferThreshold*4 + 123)
+	config := DefaultConfig()
+	config.ContentTypeBufferSizes = map[string]uint32{"application/json": 4096}
+	handler := newTestHandler(t, config, writeInChunks(body, 7000, "application/json; charset=utf-8"))
+
+	// the second request reuses the compressor returned by the first one
+	for i := 0; i < 2; i++ {
+		recorder := serve(handler, "gzip")
+
+		assert.Equal(t, "gzip", recorder.Header().Get("Content-Encoding"))
+		assert.Equal(t, "application/json; charset=utf-8", recorder.Header().Get("Content-Type"))
+		assert.Equal(t, body, gunzip(t, recorder.Body.Bytes()))
+	}
+
+	assert.Equal(t, 1, handler.pools["application/json"].Idle())
+	assert.Equal(t, 0, handler.defaultPool.Idle())
+}
+
+func TestHandlerFlushKeepsStreamOpen(t *testing.T) {
+	events := [][]byte{[]byte("data: " + strings.Repeat("first ", 20) + "\n\n"), []byte("data: " + strings.Repeat("second ", 20) + "\n\n")}
+	recorder := httptest.NewRecorder()
+
+	handler := newTestHandler(t, DefaultConfig(), func(w nethttp.ResponseWriter, r *nethttp.Request) {
+		w.Header().Set("Content-Type", "text/plain")
+		flusher, canFlush := w.(nethttp.Flusher)
+		assert.True(t, canFlush)
+
+		sent := []byte{}
+		for _, event := range events {
+			_, err := w.Write(event)
+			assert.NoError(t, err)
+			flusher.Flush()
+			sent = append(sent, event...)
+
+			// every flushed event can be read before the stream ends
+			assert.True(t, recorder.Flushed)
+			reader, err := gzip.NewReader(bytes.NewReader(recorder.Body.Bytes()))
+			assert.NoError(t, err)
+			received := make([]byte, len(sent))
+			_, err = io.ReadFull(reader, received)
+			assert.NoError(t, err)
+			assert.Equal(t, sent, received)
+		}
+	})
+
+	req := httptest.NewRequest(nethttp.MethodGet, "/", nil)
+	req.Header.Set("Accept-Encoding", "gzip")
+	handler.ServeHTTP(recorder, req)
+
+	assert.Equal(t, "gzip", recorder.Header().Get("Content-Encoding"))
+	assert.Equal(t, append(append([]byte{}, events[0]...), events[1]...), gunzip(t, recorder.Body.Bytes()))
+}
+
+func TestHandlerIgnoresEmptyWrites(t *testing.T) {
+	first := makeTestData(DefaultBufferThreshold * 2)
+	second := makeTestData(DefaultBufferThreshold * 2)
+	handler := newTestHandler(t, DefaultConfig(), func(w nethttp.ResponseWriter, r *nethttp.Request) {
+		w.Header().Set("Content-Type", "text/plain")
+		_, err := w.Write(first)
+		assert.NoError(t, err)
+		_, err = w.Write(nil)
+		assert.NoError(t, err)
+		_, err = w.Write(second)
+		assert.NoError(t, err)
+	})
+
+	recorder := serve(handler, "gzip")
+
+	assert.Equal(t, "gzip", recorder.Header().Get("Content-Encoding"))
+	assert.Equal(t, append(append([]byte{}, first...), second...), gunzip(t, recorder.Body.Bytes()))
+}
+
+func TestHandlerSniffsContentType(t *testing.T) {
+	body := []byte("<html><body>" + strings.Repeat("hello gozlib ", 100) + "</body></html>")
+	handler := newTestHandler(t, DefaultConfig(), writeInChunks(body, len(body), ""))
+
+	recorder := serve(handler, "gzip")
+
+	assert.Equal(t, "gzip", recorder.Header().Get("Content-Encoding"))
+	assert.Equal(t, "text/html; charset=utf-8", recorder.Header().Get("Content-Type"))
+	assert.Equal(t, body, gunzip(t, recorder.Body.Bytes()))
+}
+
+func TestHandlerFlushBeforeWriteDoesNotSniff(t *testing.T) {
+	body := []byte("<html><body>" + strings.Repeat("hello gozlib ", 100) + "</body></html>")
+	handler := newTestHandler(t, DefaultConfig(), func(w nethttp.ResponseWriter, r *nethttp.Request) {
+		w.(nethttp.Flusher).Flush()
+		_, err := w.Write(body)
+		assert.NoError(t, err)
+	})
+
+	recorder := serve(handler, "gzip")
+
+	assert.Equal(t, "gzip", recorder.Header().Get("Content-Encoding"))
+	// the empty body flushed first isn't taken for plain text
+	assert.Empty(t, recorder.Header().Get("Content-Type"))
+	assert.Equal(t, body, gunzip(t, recorder.Body.Bytes()))
+}
+
+func TestHandlerSkipsCompression(t *testing.T) {
+	small := makeTestData(DefaultMinSize - 1)
+	large := makeTestData(DefaultBufferThreshold * 2)
+	alreadyEncoded := func(w nethttp.ResponseWriter, r *nethttp.Request) {
+		w.Header().Set("Content-Encoding", "br")
+		_, _ = w.Write(large)
+	}
+
+	cases := []struct {
+		name           string
+		handler        nethttp.HandlerFunc
+		acceptEncoding string
+		expected       []byte
+	}{
+		{"not accepted", writeInChunks(large, 1024, "text/plain"), "br", large},
+		{"refused", writeInChunks(large, 1024, "text/plain"), "gzip;q=0", large},
+		{"small body", writeInChunks(small, 1024, "text/plain"), "gzip", small},
+		{"buffered incompressible type", writeInChunks(small, 1024, "image/png"), "gzip", small},
+		{"streamed incompressible type", writeInChunks(large, 1024, "video/mp4"), "gzip", large},
+		{"already encoded", alreadyEncoded, "gzip", large},
+	}
+
+	for _, c := range cases {
+		handler := newTestHandler(t, DefaultConfig(), c.handler)
+		recorder := serve(handler, c.acceptEncoding)
+
+		assert.NotEqual(t, "gzip", recorder.Header().Get("Content-Encoding"), c.name)
+		assert.Equal(t, c.expected, recorder.Body.Bytes(), c.name)
+	}
+}
+
+func TestHandlerKeepsStatus(t *testing.T) {
+	body := makeTestData(DefaultMinSize * 2)
+	handler := newTestHandler(t, DefaultConfig(), func(w nethttp.ResponseWriter, r *nethttp.Request) {
+		w.WriteHeader(nethttp.StatusCreated)
+		_, _ = w.Write(body)
+	})
+	recorder := serve(handler, "gzip")
+	assert.Equal(t, nethttp.StatusCreated, recorder.Code)
+	assert.Equal(t, body, gunzip(t, recorder.Body.Bytes()))
+
+	noContent := newTestHandler(t, DefaultConfig(), func(w nethttp.ResponseWriter, r *nethttp.Request) {
+		w.WriteHeader(nethttp.StatusNoContent)
+	})
+	recorder = serve(noContent, "gzip")
+	assert.Equal(t, nethttp.StatusNoContent, recorder.Code)
+	assert.Empty(t, recorder.Header().Get("Content-Encoding"))
+	assert.Equal(t, 0, recorder.Body.Len())
+}
+
+// discardResponseWriter is a response writer that doesn't allocate, reusing its header map across requests
+type discardResponseWriter struct {
+	header  nethttp.Header
+	written int
+}
+
+func (w *discardResponseWriter) Header() nethttp.Header {
+	return w.header
+}
+
+func (w *discardResponseWriter) Write(data []byte) (int, error) {
+	w.written += len(data)
+	return len(data), nil
+}
+
+func (w *discardResponseWriter) WriteHeader(int) {
+}
+
+func TestHandlerDoesNotAllocate(t *testing.T) {
+	contentType := []string{"text/plain"}
+	for _, size := range []int{DefaultBufferThreshold / 2, DefaultBufferThreshold * 3} {
+		body := makeTestData(size)
+		handler := newTestHandler(t, DefaultConfig(), func(w nethttp.ResponseWriter, r *nethttp.Request) {
+			w.Header()["Content-Type"] = contentType
+			_, _ = w.Write(body)
+		})
+
+		req := httptest.NewRequest(nethttp.MethodGet, "/", nil)
+		req.Header.Set("Accept-Encoding", "gzip")
+		w := &discardResponseWriter{header: nethttp.Header{}}
+
+		allocs := testing.AllocsPerRun(100, func() {
+			for key := range w.header {
+				delete(w.header, key)
+			}
+			w.written = 0
+			handler.ServeHTTP(w, req)
+		})
+
+		assert.Equal(t, float64(0), allocs, "allocations serving %d bytes", size)
+		assert.Greater(t, w.written, 0)
+		assert.Less(t, w.written, size)
+	}
+}
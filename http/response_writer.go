@@ -0,0 +1,305 @@
+package http
+
+import (
+	"io"
+	nethttp "net/http"
+	"strings"
+
+	"github.com/bignacio/gozlib"
+)
+
+type writerMode int
+
+const (
+	// the body is buffered until it ends or exceeds the buffer threshold
+	modeBuffering writerMode = iota
+	// the body is sent as written, compression was ruled out
+	modeIdentity
+	// the body is written to a compressor
+	modeStreaming
+)
+
+// responseWriter compresses the response of a single request, it's pooled and reused by the handler
+type responseWriter struct {
+	handler    *Handler
+	writer     nethttp.ResponseWriter
+	status     int
+	headerSent bool
+	mode       writerMode
+	buffer     []byte
+	pool       *gozlib.TransformerPool
+	compressor io.WriteCloser
+}
+
+func (rw *responseWriter) reset(w nethttp.ResponseWriter) {
+	rw.writer = w
+	rw.status = 0
+	rw.headerSent = false
+	rw.mode = modeBuffering
+	rw.buffer = nil
+	rw.pool = nil
+	rw.compressor = nil
+}
+
+// Header returns the header map of the underlying response writer
+func (rw *responseWriter) Header() nethttp.Header {
+	return rw.writer.Header()
+}
+
+// Unwrap returns the underlying response writer, used by http.ResponseController
+func (rw *responseWriter) Unwrap() nethttp.ResponseWriter {
+	return rw.writer
+}
+
+// Flush sends the body written so far to the client, as server-sent events need. A buffered body starts being compressed
+// and the compressor is flushed with gozlib.FlushModeSync, so the client can uncompress everything written so far while
+// the stream stays open. The underlying response writer is flushed after that
+func (rw *responseWriter) Flush() {
+	if rw.mode == modeBuffering {
+		if rw.compressibleHeaders() {
+			_ = rw.startStreaming(nil)
+		} else {
+			rw.startIdentity()
+		}
+	}
+
+	rw.sendHeader()
+	if rw.mode == modeStreaming {
+		// an error here means the client went away, there's nothing left to write it to
+		_ = gozlib.FlushWith(rw.compressor, gozlib.FlushModeSync)
+	}
+	if flusher, canFlush := rw.writer.(nethttp.Flusher); canFlush {
+		flusher.Flush()
+	}
+}
+
+// WriteHeader records the status code, which is only sent once it's known whether the body is compressed
+func (rw *responseWriter) WriteHeader(status int) {
+	if rw.status != 0 || rw.headerSent {
+		return
+	}
+	// informational responses are sent right away and don't end the headers
+	if status >= 100 && status < 200 && status != nethttp.StatusSwitchingProtocols {
+		rw.writer.WriteHeader(status)
+		return
+	}
+
+	rw.status = status
+	if !bodyAllowed(status) || rw.writer.Header().Get(contentEncodingHeaderName) != "" {
+		rw.startIdentity()
+		rw.sendHeader()
+	}
+}
+
+// Write buffers or compresses data, depending on how much of the body was written so far
+func (rw *responseWriter) Write(data []byte) (int, error) {
+	// an empty write would end the gzip stream of a compressor
+	if len(data) == 0 {
+		return 0, nil
+	}
+
+	switch rw.mode {
+	case modeIdentity:
+		return rw.writeIdentity(data)
+	case modeStreaming:
+		return rw.compressor.Write(data)
+	}
+
+	if rw.buffer == nil {
+		if !rw.compressibleHeaders() {
+			rw.startIdentity()
+			return rw.writeIdentity(data)
+		}
+		rw.buffer = rw.handler.buffers.Acquire(rw.handler.config.BufferThreshold)
+	}
+
+	if len(rw.buffer)+len(data) <= cap(rw.buffer) {
+		rw.buffer = append(rw.buffer, data...)
+		return len(data), nil
+	}
+
+	if err := rw.startStreaming(data); err != nil {
+		return 0, err
+	}
+	if rw.mode == modeIdentity {
+		return rw.writeIdentity(data)
+	}
+	return rw.compressor.Write(data)
+}
+
+// compressibleHeaders returns false if the headers set by the handler rule out compression
+func (rw *responseWriter) compressibleHeaders() bool {
+	header := rw.writer.Header()
+	if header.Get(contentEncodingHeaderName) != "" {
+		return false
+	}
+	contentType := header.Get(contentTypeHeaderName)
+	return contentType == "" || rw.handler.compressible(contentType)
+}
+
+// detectContentType sets the content type from the start of the body if the handler didn't, the way net/http would
+// for the uncompressed body, and returns it
+func (rw *responseWriter) detectContentType(data []byte) string {
+	header := rw.writer.Header()
+	if contentType := header.Get(contentTypeHeaderName); contentType != "" {
+		return contentType
+	}
+	if _, exists := header[contentTypeHeaderName]; exists {
+		// an empty value disables sniffing
+		return ""
+	}
+	contentType := nethttp.DetectContentType(data)
+	header.Set(contentTypeHeaderName, contentType)
+	return contentType
+}
+
+func (rw *responseWriter) sendHeader() {
+	if rw.headerSent {
+		return
+	}
+	rw.headerSent = true
+	if rw.status == 0 {
+		rw.status = nethttp.StatusOK
+	}
+	rw.writer.WriteHeader(rw.status)
+}
+
+func (rw *responseWriter) setEncodingHeaders() {
+	header := rw.writer.Header()
+	header[contentEncodingHeaderName] = gzipEncodingValue
+	delete(header, contentLengthHeaderName)
+	addVaryAcceptEncoding(header)
+}
+
+func addVaryAcceptEncoding(header nethttp.Header) {
+	vary := header[varyHeaderName]
+	if len(vary) == 0 {
+		header[varyHeaderName] = acceptEncodingVaryValue
+		return
+	}
+	for _, value := range vary {
+		if containsFold(value, acceptEncodingHeaderName) || strings.TrimSpace(value) == "*" {
+			return
+		}
+	}
+	header[varyHeaderName] = append(vary, acceptEncodingVaryValue[0])
+}
+
+// containsFold is a case insensitive strings.Contains that doesn't allocate the lower case copy
+func containsFold(value string, substr string) bool {
+	for i := 0; i+len(substr) <= len(value); i++ {
+		if strings.EqualFold(value[i:i+len(substr)], substr) {
+			return true
+		}
+	}
+	return false
+}
+
+func (rw *responseWriter) startIdentity() {
+	rw.mode = modeIdentity
+}
+
+func (rw *responseWriter) writeIdentity(data []byte) (int, error) {
+	rw.sendHeader()
+	return rw.writer.Write(data)
+}
+
+// writeBuffered sends the buffered body uncompressed
+func (rw *responseWriter) writeBuffered() error {
+	rw.startIdentity()
+	if len(rw.buffer) == 0 {
+		rw.sendHeader()
+		return nil
+	}
+	_, err := rw.writeIdentity(rw.buffer)
+	return err
+}
+
+// startStreaming moves the buffered body to a compressor, once data doesn't fit the buffer anymore or it's flushed
+func (rw *responseWriter) startStreaming(data []byte) error {
+	defer rw.releaseBuffer()
+
+	sniffed := rw.buffer
+	if len(sniffed) == 0 {
+		sniffed = data
+	}
+	// a body flushed before anything was written has nothing to sniff, its content type is left to the handler
+	contentType := rw.writer.Header().Get(contentTypeHeaderName)
+	if len(sniffed) > 0 {
+		contentType = rw.detectContentType(sniffed)
+	}
+	if !rw.handler.compressible(contentType) {
+		return rw.writeBuffered()
+	}
+
+	rw.pool = rw.handler.compressorPool(contentType)
+	compressor, err := rw.pool.AcquireCompressor(rw.writer)
+	if err != nil {
+		// the body is still correct uncompressed
+		return rw.writeBuffered()
+	}
+
+	rw.setEncodingHeaders()
+	rw.sendHeader()
+	rw.compressor = compressor
+	rw.mode = modeStreaming
+	if len(rw.buffer) > 0 {
+		_, err = rw.compressor.Write(rw.buffer)
+	}
+	return err
+}
+
+// finish completes the response once the wrapped handler returns
+func (rw *responseWriter) finish() {
+	switch rw.mode {
+	case modeStreaming:
+		// an error here means the client went away, there's nothing left to write it to
+		_ = gozlib.Flush(rw.compressor)
+		return
+	case modeIdentity:
+		return
+	}
+
+	defer rw.releaseBuffer()
+	if len(rw.buffer) == 0 {
+		// a handler that wrote nothing sends the status it set, if any
+		if rw.status != 0 {
+			rw.sendHeader()
+		}
+		return
+	}
+
+	contentType := rw.detectContentType(rw.buffer)
+	compressible := rw.handler.compressible(contentType)
+	if compressible {
+		addVaryAcceptEncoding(rw.writer.Header())
+	}
+	if !compressible || len(rw.buffer) < rw.handler.config.MinSize {
+		_ = rw.writeBuffered()
+		return
+	}
+
+	output := rw.handler.buffers.Acquire(rw.handler.outputSize)
+	defer rw.handler.buffers.Return(output)
+
+	written, err := gozlib.GoGZipCompressBuffer(rw.handler.config.Level, rw.buffer, output[:cap(output)])
+	if err != nil || int(written) >= len(rw.buffer) {
+		_ = rw.writeBuffered()
+		return
+	}
+
+	rw.setEncodingHeaders()
+	rw.sendHeader()
+	_, _ = rw.writer.Write(output[:written])
+}
+
+func (rw *responseWriter) releaseBuffer() {
+	if rw.buffer != nil {
+		rw.handler.buffers.Return(rw.buffer)
+		rw.buffer = nil
+	}
+}
+
+func bodyAllowed(status int) bool {
+	return status != nethttp.StatusNoContent && status != nethttp.StatusNotModified && (status < 100 || status >= 200)
+}
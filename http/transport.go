@@ -0,0 +1,100 @@
+package http
+
+import (
+	"io"
+	nethttp "net/http"
+
+	"github.com/bignacio/gozlib"
+)
+
+// DefaultMaxIdleUncompressors is the default number of idle uncompressors kept by a Transport
+const DefaultMaxIdleUncompressors = 64
+
+// Transport is an http.RoundTripper asking for gzip responses and uncompressing them with pooled gozlib uncompressors.
+// Like the net/http transport, it only uncompresses responses when it added the Accept-Encoding header itself,
+// requests setting their own Accept-Encoding get the response body as it was sent.
+type Transport struct {
+	base          nethttp.RoundTripper
+	uncompressors *gozlib.TransformerPool
+}
+
+// NewTransport returns a transport sending requests with base, or http.DefaultTransport if nil.
+// bufferSize is the work buffer size of the uncompressors. Close releases the idle uncompressors
+func NewTransport(base nethttp.RoundTripper, bufferSize uint32) *Transport {
+	if base == nil {
+		base = nethttp.DefaultTransport
+	}
+	if bufferSize == 0 {
+		bufferSize = DefaultBufferSize
+	}
+	// creating an uncompression pool only fails for a negative capacity
+	uncompressors, _ := gozlib.NewTransformerPool(gozlib.TransformModeUncompress, gozlib.CompressionLevelDefault, bufferSize, DefaultMaxIdleUncompressors)
+	return &Transport{
+		base:          base,
+		uncompressors: uncompressors,
+	}
+}
+
+// RoundTrip sends the request accepting gzip and returns the response with an uncompressed body
+func (t *Transport) RoundTrip(req *nethttp.Request) (*nethttp.Response, error) {
+	if req.Header.Get(acceptEncodingHeaderName) != "" || req.Header.Get("Range") != "" || req.Method == nethttp.MethodHead {
+		return t.base.RoundTrip(req)
+	}
+
+	// a round tripper must not modify the request it was given
+	gzipReq := req.Clone(req.Context())
+	gzipReq.Header[acceptEncodingHeaderName] = gzipEncodingValue
+
+	resp, err := t.base.RoundTrip(gzipReq)
+	if err != nil || !isGZipEncoded(resp) {
+		return resp, err
+	}
+
+	uncompressor, err := t.uncompressors.AcquireUncompressor(resp.Body)
+	if err != nil {
+		resp.Body.Close()
+		return nil, err
+	}
+
+	resp.Body = &uncompressedBody{body: resp.Body, uncompressor: uncompressor, transport: t}
+	resp.Header.Del(contentEncodingHeaderName)
+	resp.Header.Del(contentLengthHeaderName)
+	resp.ContentLength = -1
+	resp.Uncompressed = true
+	return resp, nil
+}
+
+// Close releases the idle uncompressors, responses still being read release theirs on close
+func (t *Transport) Close() {
+	t.uncompressors.Close()
+}
+
+func isGZipEncoded(resp *nethttp.Response) bool {
+	if resp.StatusCode == nethttp.StatusNoContent || resp.StatusCode == nethttp.StatusNotModified {
+		return false
+	}
+	encoding := resp.Header.Get(contentEncodingHeaderName)
+	return encoding == "gzip" || encoding == "x-gzip"
+}
+
+// uncompressedBody reads the uncompressed response body and returns its uncompressor to the transport when closed
+type uncompressedBody struct {
+	body         io.ReadCloser
+	uncompressor io.ReadCloser
+	transport    *Transport
+}
+
+func (ub *uncompressedBody) Read(data []byte) (int, error) {
+	if ub.uncompressor == nil {
+		return 0, nethttp.ErrBodyReadAfterClose
+	}
+	return ub.uncompressor.Read(data)
+}
+
+func (ub *uncompressedBody) Close() error {
+	if ub.uncompressor != nil {
+		ub.transport.uncompressors.ReleaseUncompressor(ub.uncompressor)
+		ub.uncompressor = nil
+	}
+	return ub.body.Close()
+}
@@ -0,0 +1,118 @@
+package http
+
+import (
+	"bytes"
+	"compress/gzip"
+	"io"
+	nethttp "net/http"
+	"net/http/httptest"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func newTestServer(t *testing.T, body []byte) *httptest.Server {
+	handler := newTestHandler(t, DefaultConfig(), func(w nethttp.ResponseWriter, r *nethttp.Request) {
+		w.Header().Set("Content-Type", "text/plain")
+		_, _ = w.Write(body)
+	})
+	server := httptest.NewServer(handler)
+	t.Cleanup(server.Close)
+	return server
+}
+
+func TestTransportUncompressesResponses(t *testing.T) {
+	body := makeTestData(DefaultBufferThreshold * 2)
+	server := newTestServer(t, body)
+
+	transport := NewTransport(nil, 0)
+	defer transport.Close()
+	client := &nethttp.Client{Transport: transport}
+
+	for i := 0; i < 3; i++ {
+		resp, err := client.Get(server.URL)
+		assert.NoError(t, err)
+
+		received, err := io.ReadAll(resp.Body)
+		assert.NoError(t, err)
+		assert.NoError(t, resp.Body.Close())
+
+		assert.Equal(t, body, received)
+		assert.True(t, resp.Uncompressed)
+		assert.Empty(t, resp.Header.Get("Content-Encoding"))
+		assert.Equal(t, int64(-1), resp.ContentLength)
+
+		_, err = resp.Body.Read(make([]byte, 1))
+		assert.ErrorIs(t, err, nethttp.ErrBodyReadAfterClose)
+	}
+
+	// the uncompressor is returned on close and reused by the following requests
+	assert.Equal(t, 1, transport.uncompressors.Idle())
+}
+
+func TestTransportKeepsRequestEncoding(t *testing.T) {
+	body := makeTestData(DefaultBufferThreshold / 2)
+	server := newTestServer(t, body)
+
+	transport := NewTransport(nil, 0)
+	defer transport.Close()
+	client := &nethttp.Client{Transport: transport}
+
+	req, err := nethttp.NewRequest(nethttp.MethodGet, server.URL, nil)
+	assert.NoError(t, err)
+	req.Header.Set("Accept-Encoding", "gzip")
+
+	resp, err := client.Do(req)
+	assert.NoError(t, err)
+	received, err := io.ReadAll(resp.Body)
+	assert.NoError(t, err)
+	assert.NoError(t, resp.Body.Close())
+
+	assert.False(t, resp.Uncompressed)
+	assert.Equal(t, "gzip", resp.Header.Get("Content-Encoding"))
+	assert.Equal(t, body, gunzip(t, received))
+	assert.Equal(t, 0, transport.uncompressors.Idle())
+}
+
+func TestTransportPassesIdentityResponses(t *testing.T) {
+	body := makeTestData(DefaultMinSize / 2)
+	server := newTestServer(t, body)
+
+	transport := NewTransport(nil, 0)
+	defer transport.Close()
+	client := &nethttp.Client{Transport: transport}
+
+	resp, err := client.Get(server.URL)
+	assert.NoError(t, err)
+	received, err := io.ReadAll(resp.Body)
+	assert.NoError(t, err)
+	assert.NoError(t, resp.Body.Close())
+
+	assert.False(t, resp.Uncompressed)
+	assert.Equal(t, body, received)
+}
+
+func TestTransportReportsTruncatedResponses(t *testing.T) {
+	compressed := bytes.NewBuffer([]byte{})
+	gzipWriter := gzip.NewWriter(compressed)
+	_, err := gzipWriter.Write(makeTestData(DefaultBufferThreshold * 2))
+	assert.NoError(t, err)
+	assert.NoError(t, gzipWriter.Close())
+	truncated := compressed.Bytes()[:compressed.Len()/2]
+
+	server := httptest.NewServer(nethttp.HandlerFunc(func(w nethttp.ResponseWriter, r *nethttp.Request) {
+		w.Header().Set("Content-Encoding", "gzip")
+		_, _ = w.Write(truncated)
+	}))
+	defer server.Close()
+
+	transport := NewTransport(nil, 0)
+	defer transport.Close()
+	client := &nethttp.Client{Transport: transport}
+
+	resp, err := client.Get(server.URL)
+	assert.NoError(t, err)
+	_, err = io.ReadAll(resp.Body)
+	assert.ErrorIs(t, err, io.ErrUnexpectedEOF)
+	assert.NoError(t, resp.Body.Close())
+}
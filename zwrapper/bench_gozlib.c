@@ -0,0 +1,376 @@
+/*
+  Native throughput benchmark for the buffer, stream and transformer APIs, without the cgo call overhead.
+  Each corpus (json, log, binary and incompressible data) is compressed at every level with the buffer API
+  and at the default level with the stream and transformer APIs, then uncompressed with each of them.
+  The buffer API is also run from multiple threads at once to measure contention on the context pools.
+  Uncompressed results are checked against the input so the benchmark fails if any API produces wrong output.
+
+  usage: zwrapper_bench_gozlib [max input size] [thread count]
+*/
+#include "gozlib.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum {
+  BENCH_MIN_INPUT_SIZE = 128,
+  BENCH_DEFAULT_MAX_INPUT_SIZE = 1024 * 1024,
+  BENCH_DEFAULT_THREADS = 8,
+  BENCH_BYTES_PER_RUN = 16 * 1024 * 1024,
+  BENCH_CONCURRENT_INPUT_SIZE = 64 * 1024,
+  BENCH_WORK_BUFFER_SIZE = 64 * 1024,
+  BENCH_DEFAULT_LEVEL = 6
+};
+
+typedef enum { CORPUS_JSON, CORPUS_LOG, CORPUS_BINARY, CORPUS_RANDOM, CORPUS_COUNT } BenchCorpus;
+
+static const char *corpus_names[CORPUS_COUNT] = {"json", "log", "binary", "random"};
+
+static const uInt input_sizes[] = {BENCH_MIN_INPUT_SIZE, 4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024, 64 * 1024 * 1024};
+
+typedef struct {
+  char *data;
+  uInt len;
+  uInt offset;
+} BenchSource;
+
+typedef struct {
+  char *data;
+  uInt cap;
+  uInt len;
+} BenchSink;
+
+typedef struct {
+  BenchSource source;
+  BenchSink sink;
+} BenchStream;
+
+typedef struct {
+  char *input;
+  uInt input_len;
+  uint64_t iterations;
+  bool failed;
+} BenchWorker;
+
+typedef uLong (*BenchRunFn)(char *input, uInt input_len, char *output, uInt output_cap, int level, int *error_code);
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t bench_rand(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (uint32_t)(rng_state >> 32);
+}
+
+static uInt corpus_record(BenchCorpus corpus, char *record, size_t cap, uInt position) {
+  static const char *log_levels[] = {"INFO", "WARN", "DEBUG", "ERROR"};
+  static const char *paths[] = {"/api/v1/users", "/api/v1/orders", "/healthz", "/static/app.js"};
+
+  int len = 0;
+  switch (corpus) {
+  case CORPUS_JSON:
+    len = snprintf(record, cap, "{\"id\":%u,\"name\":\"user%u\",\"active\":%s,\"score\":%u.%02u},\n", bench_rand() % 100000, bench_rand() % 5000,
+                   (bench_rand() & 1) ? "true" : "false", bench_rand() % 100, bench_rand() % 100);
+    break;
+  case CORPUS_LOG:
+    len = snprintf(record, cap, "2024-03-%02u 12:%02u:%02u.%03u %s [worker-%u] GET %s status=%u duration=%ums\n", bench_rand() % 28 + 1,
+                   bench_rand() % 60, bench_rand() % 60, bench_rand() % 1000, log_levels[bench_rand() % 4], bench_rand() % 16,
+                   paths[bench_rand() % 4], (bench_rand() % 4 == 0) ? 404u : 200u, bench_rand() % 500);
+    break;
+  case CORPUS_BINARY: {
+    // fixed size records of small integers and a timestamp, the way serialized structs look
+    const uint32_t fields[8] = {bench_rand() % 256, bench_rand() % 65536, 0, 1700000000u + position, bench_rand() % 16, 0, bench_rand() % 1024, 0};
+    memcpy(record, fields, sizeof(fields));
+    len = (int)sizeof(fields);
+    break;
+  }
+  case CORPUS_RANDOM:
+    for (size_t i = 0; i + sizeof(uint32_t) <= cap; i += sizeof(uint32_t)) {
+      const uint32_t value = bench_rand();
+      memcpy(record + i, &value, sizeof(value));
+    }
+    len = (int)(cap - cap % sizeof(uint32_t));
+    break;
+  case CORPUS_COUNT:
+    break;
+  }
+  return (uInt)len;
+}
+
+static void fill_corpus(BenchCorpus corpus, char *buf, uInt len) {
+  char record[256];
+  uInt written = 0;
+  while (written < len) {
+    uInt record_len = corpus_record(corpus, record, sizeof(record), written);
+    if (record_len > len - written) {
+      record_len = len - written;
+    }
+    memcpy(buf + written, record, record_len);
+    written += record_len;
+  }
+}
+
+static double elapsed_seconds(struct timespec start, struct timespec end) {
+  return (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static uint64_t iterations_for(uInt input_len) {
+  const uint64_t iterations = BENCH_BYTES_PER_RUN / input_len;
+  return iterations == 0 ? 1 : iterations;
+}
+
+/* stream handlers */
+
+static uInt bench_in_handler(ZStreamState *state, void *restrict buffer, uInt length) {
+  BenchSource *source = &((BenchStream *)state->data_handler)->source;
+  uInt len = source->len - source->offset;
+  if (len > length) {
+    len = length;
+  }
+  memcpy(buffer, source->data + source->offset, len);
+  source->offset += len;
+  return len;
+}
+
+static uInt bench_out_handler(ZStreamState *state, void *restrict buffer, uInt length) {
+  BenchSink *sink = &((BenchStream *)state->data_handler)->sink;
+  if (length > sink->cap - sink->len) {
+    return 0;
+  }
+  memcpy(sink->data + sink->len, buffer, length);
+  sink->len += length;
+  return length;
+}
+
+/* single call runners, each one compresses or uncompresses input into output */
+
+static uLong run_buffer_compress(char *input, uInt input_len, char *output, uInt output_cap, int level, int *error_code) {
+  return gzip_compress_buffer(level, input, input_len, output, output_cap, error_code);
+}
+
+static uLong run_buffer_uncompress(char *input, uInt input_len, char *output, uInt output_cap, int level, int *error_code) {
+  (void)level;
+  return uncompress_buffer_any(input, input_len, output, output_cap, error_code);
+}
+
+static uLong run_stream_compress(char *input, uInt input_len, char *output, uInt output_cap, int level, int *error_code) {
+  BenchStream stream = {.source = {input, input_len, 0}, .sink = {output, output_cap, 0}};
+  ZStreamState state = {.data_handler = &stream};
+  return gzip_compress_stream(&state, level, bench_in_handler, bench_out_handler, BENCH_WORK_BUFFER_SIZE, BENCH_WORK_BUFFER_SIZE, error_code);
+}
+
+static uLong run_stream_uncompress(char *input, uInt input_len, char *output, uInt output_cap, int level, int *error_code) {
+  (void)level;
+  BenchStream stream = {.source = {input, input_len, 0}, .sink = {output, output_cap, 0}};
+  ZStreamState state = {.data_handler = &stream};
+  return uncompress_stream_any(&state, bench_in_handler, bench_out_handler, BENCH_WORK_BUFFER_SIZE, BENCH_WORK_BUFFER_SIZE, error_code);
+}
+
+static uLong run_transformer_compress(char *input, uInt input_len, char *output, uInt output_cap, int level, int *error_code) {
+  GoZLibTransformer *transformer = acquire_gzip_compression_transformer(level, BENCH_WORK_BUFFER_SIZE, error_code);
+  if (*error_code != Z_OK) {
+    return 0;
+  }
+
+  uInt consumed = 0;
+  uLong produced = 0;
+  GoZLibStepResult step;
+  do {
+    step = transformer_compress_step(transformer, input + consumed, input_len - consumed, output + produced, (uInt)(output_cap - produced), Z_FINISH);
+    consumed += step.consumed;
+    produced += step.produced;
+  } while (step.status == GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA && produced < output_cap);
+  release_compression_transformer(transformer);
+
+  if (step.status != Z_STREAM_END) {
+    *error_code = step.status == GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA ? Z_MEM_ERROR : step.status;
+  }
+  return produced;
+}
+
+static uLong run_transformer_uncompress(char *input, uInt input_len, char *output, uInt output_cap, int level, int *error_code) {
+  (void)level;
+  GoZLibTransformer *transformer = acquire_uncompression_transformer(BENCH_WORK_BUFFER_SIZE, error_code);
+  if (*error_code != Z_OK) {
+    return 0;
+  }
+  transformer->zs->next_in = (Bytef *)input;
+  transformer->zs->avail_in = input_len;
+
+  uLong produced = 0;
+  GoZLibStepResult step;
+  do {
+    step = transformer_uncompress_step(transformer, output + produced, (uInt)(output_cap - produced));
+    produced += step.produced;
+  } while (step.status == GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA && produced < output_cap);
+  release_uncompression_transformer(transformer);
+
+  if (step.status != Z_STREAM_END) {
+    *error_code = step.status == GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA ? Z_MEM_ERROR : step.status;
+  }
+  return produced;
+}
+
+/* measurement */
+
+static bool bench_run(BenchRunFn run, const char *api, const char *corpus, char *input, uInt input_len, char *output, uInt output_cap,
+                      int level, uInt original_len, uLong *output_len) {
+  const uint64_t iterations = iterations_for(original_len);
+
+  struct timespec start;
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint64_t i = 0; i < iterations; i++) {
+    int ec = Z_OK;
+    *output_len = run(input, input_len, output, output_cap, level, &ec);
+    if (ec != Z_OK) {
+      fprintf(stderr, "%s %s %u failed with error %d\n", api, corpus, original_len, ec);
+      return false;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  // throughput is always measured against the uncompressed size so compression and uncompression compare
+  const double seconds = elapsed_seconds(start, end);
+  const double bytes = (double)original_len * (double)iterations;
+  const uLong compressed_len = input_len == original_len ? *output_len : input_len;
+  printf("%-6s %9u %-22s level %2d: %9.1f MB/s %12.0f ns/op ratio %.3f\n", corpus, original_len, api, level, bytes / seconds / 1e6,
+         seconds * 1e9 / (double)iterations, (double)compressed_len / (double)original_len);
+  return true;
+}
+
+static bool bench_corpus(BenchCorpus corpus, uInt input_len) {
+  const char *name = corpus_names[corpus];
+  const uInt compressed_cap = (uInt)gzip_store_bound(input_len);
+  char *input = malloc(input_len);
+  char *compressed = malloc(compressed_cap);
+  char *uncompressed = malloc(input_len);
+  fill_corpus(corpus, input, input_len);
+
+  bool ok = true;
+  uLong compressed_len = 0;
+  uLong uncompressed_len = 0;
+  for (int level = Z_BEST_SPEED; level <= Z_BEST_COMPRESSION && ok; level++) {
+    ok = bench_run(run_buffer_compress, "buffer compress", name, input, input_len, compressed, compressed_cap, level, input_len, &compressed_len);
+  }
+  ok = ok && bench_run(run_stream_compress, "stream compress", name, input, input_len, compressed, compressed_cap, BENCH_DEFAULT_LEVEL, input_len,
+                       &compressed_len);
+  ok = ok && bench_run(run_transformer_compress, "transformer compress", name, input, input_len, compressed, compressed_cap, BENCH_DEFAULT_LEVEL,
+                       input_len, &compressed_len);
+
+  // the transformer output was produced at the default level, the one all uncompression runs read
+  const uInt compressed_input_len = (uInt)compressed_len;
+  BenchRunFn uncompress_runs[] = {run_buffer_uncompress, run_stream_uncompress, run_transformer_uncompress};
+  const char *uncompress_apis[] = {"buffer uncompress", "stream uncompress", "transformer uncompress"};
+  for (size_t i = 0; i < sizeof(uncompress_runs) / sizeof(uncompress_runs[0]) && ok; i++) {
+    memset(uncompressed, 0, input_len);
+    ok = bench_run(uncompress_runs[i], uncompress_apis[i], name, compressed, compressed_input_len, uncompressed, input_len, BENCH_DEFAULT_LEVEL,
+                   input_len, &uncompressed_len);
+    if (ok && (uncompressed_len != input_len || memcmp(input, uncompressed, input_len) != 0)) {
+      fprintf(stderr, "%s %s %u output differs from the input\n", uncompress_apis[i], name, input_len);
+      ok = false;
+    }
+  }
+
+  free(uncompressed);
+  free(compressed);
+  free(input);
+  return ok;
+}
+
+/* concurrency */
+
+static void *bench_worker_run(void *arg) {
+  BenchWorker *worker = arg;
+  const uInt compressed_cap = (uInt)gzip_store_bound(worker->input_len);
+  char *compressed = malloc(compressed_cap);
+
+  for (uint64_t i = 0; i < worker->iterations; i++) {
+    int ec = Z_OK;
+    gzip_compress_buffer(BENCH_DEFAULT_LEVEL, worker->input, worker->input_len, compressed, compressed_cap, &ec);
+    if (ec != Z_OK) {
+      worker->failed = true;
+      break;
+    }
+  }
+
+  free(compressed);
+  return NULL;
+}
+
+static bool bench_concurrent_buffer_compress(BenchCorpus corpus, uint64_t thread_count) {
+  const uInt input_len = BENCH_CONCURRENT_INPUT_SIZE;
+  char *input = malloc(input_len);
+  fill_corpus(corpus, input, input_len);
+
+  pthread_t *threads = malloc(sizeof(pthread_t) * thread_count);
+  BenchWorker *workers = malloc(sizeof(BenchWorker) * thread_count);
+  const uint64_t iterations = iterations_for(input_len);
+
+  struct timespec start;
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (uint64_t i = 0; i < thread_count; i++) {
+    workers[i].input = input;
+    workers[i].input_len = input_len;
+    workers[i].iterations = iterations;
+    workers[i].failed = false;
+    pthread_create(&threads[i], NULL, bench_worker_run, &workers[i]);
+  }
+
+  bool failed = false;
+  for (uint64_t i = 0; i < thread_count; i++) {
+    pthread_join(threads[i], NULL);
+    failed = failed || workers[i].failed;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  const double seconds = elapsed_seconds(start, end);
+  const double operations = (double)(thread_count * iterations);
+  printf("%-6s %9u buffer compress x%-3lu    level %2d: %9.1f MB/s %12.0f ns/op\n", corpus_names[corpus], input_len, (unsigned long)thread_count,
+         BENCH_DEFAULT_LEVEL, operations * input_len / seconds / 1e6, seconds * 1e9 / operations);
+
+  free(workers);
+  free(threads);
+  free(input);
+
+  if (failed) {
+    fprintf(stderr, "concurrent buffer compression failed\n");
+  }
+  return !failed;
+}
+
+int main(int argc, char **argv) {
+  uint64_t max_input_len = BENCH_DEFAULT_MAX_INPUT_SIZE;
+  uint64_t thread_count = BENCH_DEFAULT_THREADS;
+  if (argc > 1) {
+    max_input_len = strtoull(argv[1], NULL, 10);
+  }
+  if (argc > 2) {
+    thread_count = strtoull(argv[2], NULL, 10);
+  }
+  if (max_input_len < BENCH_MIN_INPUT_SIZE || max_input_len > UINT32_MAX / 2 || thread_count == 0) {
+    fprintf(stderr, "usage: %s [max input size] [thread count]\n", argv[0]);
+    return 1;
+  }
+
+  for (int corpus = CORPUS_JSON; corpus < CORPUS_COUNT; corpus++) {
+    for (size_t i = 0; i < sizeof(input_sizes) / sizeof(input_sizes[0]) && input_sizes[i] <= max_input_len; i++) {
+      if (!bench_corpus((BenchCorpus)corpus, input_sizes[i])) {
+        return 1;
+      }
+    }
+  }
+
+  for (int corpus = CORPUS_JSON; corpus < CORPUS_COUNT; corpus++) {
+    if (!bench_concurrent_buffer_compress((BenchCorpus)corpus, thread_count)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
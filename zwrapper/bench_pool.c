@@ -0,0 +1,145 @@
+/*
+  Contention stress benchmark for the pool free list.
+  Each thread repeatedly acquires two blocks and returns them in a different order, the access pattern that
+  exposes ABA corruption in an untagged lock-free stack. Block ownership and the final free list are validated
+  so the benchmark fails if the pool is corrupted.
+
+  usage: zwrapper_bench_pool [thread count] [iterations per thread]
+*/
+#define TRACK_POOL_USAGE
+#include "dyn_mem_pool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+enum {
+  BENCH_BLOCK_SIZE = 64,
+  BENCH_DEFAULT_THREADS = 16,
+  BENCH_DEFAULT_ITERATIONS = 1000000
+};
+
+typedef struct {
+  struct MemPool *pool;
+  uint64_t iterations;
+  uint64_t tag;
+  bool corrupted;
+} BenchWorker;
+
+static bool claim_block(void *block, uint64_t tag) {
+  uint64_t *owner = block;
+  if (__atomic_exchange_n(owner, tag, __ATOMIC_ACQ_REL) != 0) {
+    return false;
+  }
+  return true;
+}
+
+static bool release_block(void *block, uint64_t tag) {
+  uint64_t *owner = block;
+  return __atomic_exchange_n(owner, 0, __ATOMIC_ACQ_REL) == tag;
+}
+
+static void *bench_worker_run(void *arg) {
+  BenchWorker *worker = arg;
+
+  for (uint64_t i = 0; i < worker->iterations; i++) {
+    void *first = pool_mem_acquire(worker->pool);
+    void *second = pool_mem_acquire(worker->pool);
+
+    // a block handed out to two threads at the same time means the free list is corrupted
+    if (first == NULL || second == NULL || !claim_block(first, worker->tag) || !claim_block(second, worker->tag)) {
+      worker->corrupted = true;
+      return NULL;
+    }
+
+    if (!release_block(first, worker->tag)) {
+      worker->corrupted = true;
+      return NULL;
+    }
+    pool_mem_return(first);
+
+    if (!release_block(second, worker->tag)) {
+      worker->corrupted = true;
+      return NULL;
+    }
+    pool_mem_return(second);
+  }
+
+  return NULL;
+}
+
+static bool validate_free_list(struct MemPool *pool) {
+  uint32_t count = 0;
+  for (struct MemNode *node = pool_free_list_first(pool); node != NULL; node = node->next) {
+    count++;
+    // a cycle in the list would make the walk go beyond the number of allocated blocks
+    if (count > pool->num_allocs) {
+      return false;
+    }
+  }
+  return count == pool->num_allocs;
+}
+
+static double elapsed_seconds(struct timespec start, struct timespec end) {
+  return (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv) {
+  uint64_t thread_count = BENCH_DEFAULT_THREADS;
+  uint64_t iterations = BENCH_DEFAULT_ITERATIONS;
+  if (argc > 1) {
+    thread_count = strtoull(argv[1], NULL, 10);
+  }
+  if (argc > 2) {
+    iterations = strtoull(argv[2], NULL, 10);
+  }
+  if (thread_count == 0 || iterations == 0) {
+    fprintf(stderr, "usage: %s [thread count] [iterations per thread]\n", argv[0]);
+    return 1;
+  }
+
+  struct MemPool *pool = alloc_mem_pool(BENCH_BLOCK_SIZE);
+  pool_enable_thread_cache(pool);
+
+  pthread_t *threads = malloc(sizeof(pthread_t) * thread_count);
+  BenchWorker *workers = malloc(sizeof(BenchWorker) * thread_count);
+
+  struct timespec start;
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (uint64_t i = 0; i < thread_count; i++) {
+    workers[i].pool = pool;
+    workers[i].iterations = iterations;
+    workers[i].tag = i + 1;
+    workers[i].corrupted = false;
+    pthread_create(&threads[i], NULL, bench_worker_run, &workers[i]);
+  }
+
+  for (uint64_t i = 0; i < thread_count; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  bool corrupted = !validate_free_list(pool);
+  for (uint64_t i = 0; i < thread_count; i++) {
+    corrupted = corrupted || workers[i].corrupted;
+  }
+
+  const double seconds = elapsed_seconds(start, end);
+  const double operations = (double)(thread_count * iterations * 4);
+  printf("threads: %lu, iterations: %lu, blocks allocated: %u\n", (unsigned long)thread_count, (unsigned long)iterations, pool->num_allocs);
+  printf("%.3f s, %.2f Mops/s, %.1f ns/op\n", seconds, operations / seconds / 1e6, seconds * 1e9 / operations);
+
+  free(workers);
+  free(threads);
+
+  if (corrupted) {
+    fprintf(stderr, "pool free list is corrupted\n");
+    return 1;
+  }
+
+  free_mem_pool(pool);
+  return 0;
+}
@@ -13,26 +13,103 @@
 #include <string.h>
 #include <limits.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
 
 
 /**
- * @brief Pool linked list node containing a pointer to the allocated memory and the next available item in the pool, if any
+ * @brief Pool linked list node containing a pointer to the allocated memory and the next available item in the pool, if any.
+ * While the node is in the pool, epoch is the pool epoch when it was returned and trimmed indicates its memory was released to the system
  *
  */
 struct MemNode {
     struct MemNode* next;
     void *data;
     struct MemPool* pool;
+    uint32_t epoch;
+    bool trimmed;
 } ;
 
 
+/*
+    The pool free list head is a version tagged pointer. Every successful update of the head increments the tag, so a CAS
+    based on a stale read fails even if the same node is back at the head (ABA problem).
+    When available, a double width CAS updates a full pointer and a 64 bit tag. Otherwise the tag is packed
+    with the pointer into a single 64 bit word: on 64 bit platforms the pointer uses the lower 48 bits and the tag
+    the upper 16 bits, on 32 bit platforms pointer and tag have 32 bits each.
+    Defining POOL_NO_DOUBLE_WIDTH_CAS forces the packed representation, for CPUs without a double width CAS.
+*/
+#if defined(POOL_NO_DOUBLE_WIDTH_CAS)
+// packed tagged pointer
+#elif defined(__x86_64__) && defined(__GNUC__)
+// cmpxchg16b is used directly so that builds don't depend on -mcx16
+#define POOL_DOUBLE_WIDTH_CAS
+#define POOL_DOUBLE_WIDTH_CAS_ASM
+#elif defined(__SIZEOF_INT128__) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+#define POOL_DOUBLE_WIDTH_CAS
+#endif
+
+#ifdef POOL_DOUBLE_WIDTH_CAS
+
+typedef struct {
+    struct MemNode* node;
+    uint64_t tag;
+} __attribute__((aligned(16))) TaggedNodePtr;
+
+#else
+
+typedef struct {
+    uint64_t word;
+} TaggedNodePtr;
+
+#if UINTPTR_MAX > UINT32_MAX
+static const unsigned TaggedNodePtrTagShift = 48;
+#else
+static const unsigned TaggedNodePtrTagShift = 32;
+#endif
+
+#endif // POOL_DOUBLE_WIDTH_CAS
+
+/**
+ * @brief Pool usage statistics. Counters are always collected, using relaxed atomic operations
+ *
+ */
+struct MemPoolStats {
+    // number of blocks handed out by the pool
+    uint64_t acquires;
+    // number of acquires that needed new memory to be allocated because the pool was empty
+    uint64_t misses;
+    // number of blocks allocated by the pool, in use or not
+    uint64_t allocated_blocks;
+    // number of blocks currently acquired and not yet returned
+    uint64_t in_use_blocks;
+    // maximum number of blocks in use at the same time
+    uint64_t high_water_blocks;
+    // total amount of memory released to the system by trimming
+    uint64_t released_bytes;
+};
+
 /**
  * @brief Memory pool entry point. All entries in the pool have the same allocated memory size
  *
  */
 struct MemPool {
-    struct MemNode* head;
+    TaggedNodePtr head;
     uint32_t mem_size;
+    uint32_t blocks_per_slab;
+    size_t block_stride;
+    struct MemSlab* slabs;
+    uint32_t epoch;
+    // number of trims in progress, acquires finding the free list empty wait for them instead of allocating
+    uint32_t trimming;
+    struct MemPoolStats stats;
+#ifdef POOL_THREAD_CACHE
+    // nodes moved at once between a thread magazine and the free list, zero if thread caching is disabled
+    uint32_t thread_cache_batch;
+#endif
 #ifdef TRACK_POOL_USAGE
     uint32_t num_allocs;
     uint32_t num_available;
@@ -43,157 +120,1082 @@ struct MemPool {
 
 // MemNode operations
 
-void track_pool_usage_allocs(__attribute__((unused)) struct MemPool* pool) {
-#ifdef TRACK_POOL_USAGE
-    __atomic_add_fetch(&pool->num_allocs, 1, __ATOMIC_RELEASE);
-#endif
-}
+void track_pool_usage_allocs(__attribute__((unused)) struct MemPool* pool, __attribute__((unused)) uint32_t count) {
+#ifdef TRACK_POOL_USAGE
+    __atomic_add_fetch(&pool->num_allocs, count, __ATOMIC_RELEASE);
+#endif
+}
+
+void track_pool_usage_returned(__attribute__((unused)) struct MemPool* pool, __attribute__((unused)) uint32_t count) {
+#ifdef TRACK_POOL_USAGE
+    __atomic_add_fetch(&pool->num_available, count, __ATOMIC_RELEASE);
+#endif
+}
+
+void track_pool_usage_memnode_unavailable(__attribute__((unused)) struct MemPool* pool) {
+#ifdef TRACK_POOL_USAGE
+    __atomic_sub_fetch(&pool->num_available, 1, __ATOMIC_RELEASE);
+#endif
+}
+
+// MemPool statistics
+
+static inline void pool_stats_acquired(struct MemPool* pool) {
+    __atomic_add_fetch(&pool->stats.acquires, 1, __ATOMIC_RELAXED);
+    uint64_t in_use = __atomic_add_fetch(&pool->stats.in_use_blocks, 1, __ATOMIC_RELAXED);
+
+    uint64_t high_water = __atomic_load_n(&pool->stats.high_water_blocks, __ATOMIC_RELAXED);
+    while (in_use > high_water) {
+        if (__atomic_compare_exchange_n(&pool->stats.high_water_blocks, &high_water, in_use, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+
+static inline void pool_stats_released(struct MemPool* pool) {
+    __atomic_sub_fetch(&pool->stats.in_use_blocks, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Takes a snapshot of the pool usage statistics. Counters are read independently so the snapshot is not atomic
+ *
+ * @param pool the memory pool
+ * @param stats set to the current statistics
+ */
+void pool_get_stats(struct MemPool* pool, struct MemPoolStats* stats) {
+    assert(pool != NULL);
+    assert(stats != NULL);
+
+    stats->acquires = __atomic_load_n(&pool->stats.acquires, __ATOMIC_RELAXED);
+    stats->misses = __atomic_load_n(&pool->stats.misses, __ATOMIC_RELAXED);
+    stats->allocated_blocks = __atomic_load_n(&pool->stats.allocated_blocks, __ATOMIC_RELAXED);
+    stats->in_use_blocks = __atomic_load_n(&pool->stats.in_use_blocks, __ATOMIC_RELAXED);
+    stats->high_water_blocks = __atomic_load_n(&pool->stats.high_water_blocks, __ATOMIC_RELAXED);
+    stats->released_bytes = __atomic_load_n(&pool->stats.released_bytes, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Returns a pointer to the MemNode struct associated with a given data pointer.
+ * The MemNode struct is assumed to be located directly before the data pointer in memory. The function returns a pointer to the MemNode struct.
+ *
+ * @param data Pointer to the memory block for which to retrieve the associated MemNode struct.
+ * @return A pointer to the MemNode struct associated with the given data pointer.
+ */
+static inline struct MemNode* get_memnode_in_data(void* data) {
+    assert(data != NULL);
+
+    ptrdiff_t *node_mem_val = ((ptrdiff_t *)data) - 1;
+    struct MemNode *node = (struct MemNode *)(node_mem_val[0]); // NOLINT(performance-no-int-to-ptr)
+    return node;
+}
+
+/*
+    Slab backing
+    Pool blocks are carved from larger contiguous slabs instead of being allocated one at a time. Each block in a slab is
+    laid out as [MemNode][owning node address][data] and all blocks in a pool have the same stride.
+    A slab holds as many blocks as fit in POOL_SLAB_SIZE bytes, with a minimum of one and a maximum of POOL_SLAB_MAX_BLOCKS. Slabs of POOL_SLAB_MMAP_THRESHOLD
+    bytes or more are mapped directly and, when supported, advised to be backed by transparent hugepages.
+    The memory of a new slab is zero filled, so blocks that were never acquired before can be told apart from
+    returned ones by their content. Slabs are only released when the pool is freed.
+*/
+#ifndef POOL_SLAB_SIZE
+#define POOL_SLAB_SIZE (256 * 1024)
+#endif
+
+#ifndef POOL_SLAB_MAX_BLOCKS
+#define POOL_SLAB_MAX_BLOCKS 64
+#endif
+
+#ifndef POOL_SLAB_MMAP_THRESHOLD
+#define POOL_SLAB_MMAP_THRESHOLD (1024 * 1024)
+#endif
+
+#if defined(MAP_ANONYMOUS) && !defined(POOL_NO_SLAB_MMAP)
+#define POOL_SLAB_MMAP
+#endif
+
+// alignment of slabs, blocks and the data in each block
+static const size_t PoolBlockAlignment = 16;
+
+/**
+ * @brief Header of a contiguous memory region holding pool blocks
+ *
+ */
+struct MemSlab {
+    struct MemSlab* next;
+    size_t size;
+    bool mapped;
+};
+
+static inline size_t pool_align_size(size_t size) {
+    return (size + PoolBlockAlignment - 1) & ~(PoolBlockAlignment - 1);
+}
+
+static inline size_t pool_slab_header_size(void) {
+    return pool_align_size(sizeof(struct MemSlab));
+}
+
+static inline size_t pool_block_header_size(void) {
+    return pool_align_size(sizeof(struct MemNode) + sizeof(ptrdiff_t));
+}
+
+/**
+ * @brief Allocates the zero filled memory for a slab, mapping it directly if it's large enough
+ *
+ * @param size of the slab in bytes
+ * @return the slab or NULL if the memory cannot be allocated
+ */
+__attribute__((warn_unused_result))
+static struct MemSlab* alloc_mem_slab(size_t size) {
+    struct MemSlab* slab = NULL;
+    bool mapped = false;
+
+#ifdef POOL_SLAB_MMAP
+    if (size >= POOL_SLAB_MMAP_THRESHOLD) {
+        void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        // best effort, the mapping is still usable if transparent hugepages are not available
+        madvise(mem, size, MADV_HUGEPAGE);
+#endif
+        slab = mem;
+        mapped = true;
+    }
+#endif
+
+    if (slab == NULL) {
+        slab = calloc(1, size);
+        if (slab == NULL) {
+            return NULL;
+        }
+    }
+
+    slab->next = NULL;
+    slab->size = size;
+    slab->mapped = mapped;
+    return slab;
+}
+
+/**
+ * @brief Releases the memory of a slab and all blocks in it
+ *
+ * @param slab the slab to be released
+ */
+static void free_mem_slab(struct MemSlab* slab) {
+    assert(slab != NULL);
+
+#ifdef POOL_SLAB_MMAP
+    if (slab->mapped) {
+        munmap((void*)slab, slab->size);
+        return;
+    }
+#endif
+    free(slab);
+}
+
+// Lock-free stack operations
+
+/**
+ * @brief Returns the node referenced by a tagged pointer
+ *
+ * @param tagged the tagged pointer
+ * @return the node, which can be NULL
+ */
+static inline struct MemNode* tagged_node(TaggedNodePtr tagged) {
+#ifdef POOL_DOUBLE_WIDTH_CAS
+    return tagged.node;
+#else
+    return (struct MemNode*)(uintptr_t)(tagged.word & ((UINT64_C(1) << TaggedNodePtrTagShift) - 1)); // NOLINT(performance-no-int-to-ptr)
+#endif
+}
+
+/**
+ * @brief Makes a tagged pointer to a node with the tag following the one in previous
+ *
+ * @param node the node, which can be NULL
+ * @param previous the tagged pointer being replaced
+ * @return the new tagged pointer
+ */
+static inline TaggedNodePtr tagged_node_next(struct MemNode* node, TaggedNodePtr previous) {
+    TaggedNodePtr tagged;
+#ifdef POOL_DOUBLE_WIDTH_CAS
+    tagged.node = node;
+    tagged.tag = previous.tag + 1;
+#else
+    assert(((uintptr_t)node >> (TaggedNodePtrTagShift - 1) >> 1) == 0);
+    uint64_t tag = (previous.word >> TaggedNodePtrTagShift) + 1;
+    tagged.word = (tag << TaggedNodePtrTagShift) | (uint64_t)(uintptr_t)node;
+#endif
+    return tagged;
+}
+
+/**
+ * @brief Reads the pool free list head. With a double width head, pointer and tag are read independently,
+ * a torn read can only make the following CAS fail
+ *
+ * @param pool the memory pool
+ * @return the tagged pointer to the first node in the free list
+ */
+static inline TaggedNodePtr pool_head_load(struct MemPool* pool) {
+    TaggedNodePtr head;
+#ifdef POOL_DOUBLE_WIDTH_CAS
+    head.tag = __atomic_load_n(&pool->head.tag, __ATOMIC_ACQUIRE);
+    head.node = __atomic_load_n(&pool->head.node, __ATOMIC_ACQUIRE);
+#else
+    head.word = __atomic_load_n(&pool->head.word, __ATOMIC_ACQUIRE);
+#endif
+    return head;
+}
+
+/**
+ * @brief Replaces the pool free list head if it's still equal to expected, pointer and tag
+ *
+ * @param pool the memory pool
+ * @param expected the value previously read from the head
+ * @param desired the new head
+ * @return true if the head was replaced
+ */
+static inline bool pool_head_compare_exchange(struct MemPool* pool, TaggedNodePtr expected, TaggedNodePtr desired) {
+#if defined(POOL_DOUBLE_WIDTH_CAS_ASM)
+    bool exchanged = false;
+    uint64_t expected_node = (uint64_t)(uintptr_t)expected.node;
+    uint64_t expected_tag = expected.tag;
+    __asm__ __volatile__("lock cmpxchg16b %1"
+                         : "=@ccz"(exchanged), "+m"(pool->head), "+a"(expected_node), "+d"(expected_tag)
+                         : "b"((uint64_t)(uintptr_t)desired.node), "c"(desired.tag)
+                         : "memory");
+    return exchanged;
+#elif defined(POOL_DOUBLE_WIDTH_CAS)
+    __extension__ typedef unsigned __int128 TaggedNodeWord;
+    TaggedNodeWord expected_word;
+    TaggedNodeWord desired_word;
+    memcpy(&expected_word, &expected, sizeof(TaggedNodeWord));
+    memcpy(&desired_word, &desired, sizeof(TaggedNodeWord));
+    return __sync_bool_compare_and_swap((TaggedNodeWord*)&pool->head, expected_word, desired_word);
+#else
+    return __atomic_compare_exchange_n(&pool->head.word, &expected.word, desired.word, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * @brief Returns the first node in the pool free list. Not safe to use while other threads modify the pool
+ *
+ * @param pool the memory pool
+ * @return the first node or NULL if the free list is empty
+ */
+static inline struct MemNode* pool_free_list_first(struct MemPool* pool) {
+    return tagged_node(pool_head_load(pool));
+}
+
+/**
+ * @brief Pops the head node from the pool free list
+ *
+ * @param pool the memory pool
+ * @return the removed node or NULL if the free list is empty
+ */
+static inline struct MemNode* pool_stack_pop(struct MemPool* pool) {
+    while (true) {
+        TaggedNodePtr previous_head = pool_head_load(pool);
+        struct MemNode* node = tagged_node(previous_head);
+        if (node == NULL) {
+            return NULL;
+        }
+
+        // nodes are never released while the pool is in use so reading next is safe even if node was popped
+        // by another thread after the head was read, in which case the tag has changed and the CAS fails
+        struct MemNode* new_head = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+        if (pool_head_compare_exchange(pool, previous_head, tagged_node_next(new_head, previous_head))) {
+            return node;
+        }
+    }
+}
+
+/**
+ * @brief Pops up to max_count nodes from the pool free list with a single successful CAS
+ *
+ * @param pool the memory pool
+ * @param max_count maximum number of nodes to remove, must be greater than zero
+ * @param count set to the number of nodes removed
+ * @return the first removed node, the following count - 1 nodes are reachable through next. NULL if the free list is empty
+ */
+static inline struct MemNode* pool_stack_pop_batch(struct MemPool* pool, uint32_t max_count, uint32_t* count) {
+    assert(max_count > 0);
+
+    while (true) {
+        TaggedNodePtr previous_head = pool_head_load(pool);
+        struct MemNode* first = tagged_node(previous_head);
+        if (first == NULL) {
+            *count = 0;
+            return NULL;
+        }
+
+        // the walk may read nodes being modified by other threads but if the head tag is still
+        // the same when the CAS is performed, none of the walked nodes left the list
+        struct MemNode* last = first;
+        uint32_t batch_count = 1;
+        struct MemNode* new_head = __atomic_load_n(&last->next, __ATOMIC_ACQUIRE);
+        while (batch_count < max_count && new_head != NULL) {
+            last = new_head;
+            batch_count++;
+            new_head = __atomic_load_n(&last->next, __ATOMIC_ACQUIRE);
+        }
+
+        if (pool_head_compare_exchange(pool, previous_head, tagged_node_next(new_head, previous_head))) {
+            *count = batch_count;
+            return first;
+        }
+    }
+}
+
+/**
+ * @brief Pushes a chain of nodes linked through next onto the pool free list with a single successful CAS
+ *
+ * @param pool the memory pool
+ * @param first first node in the chain
+ * @param last last node in the chain, it can be the same as first
+ */
+static inline void pool_stack_push(struct MemPool* pool, struct MemNode* first, struct MemNode* last) {
+    while (true) {
+        TaggedNodePtr previous_head = pool_head_load(pool);
+        __atomic_store_n(&last->next, tagged_node(previous_head), __ATOMIC_RELEASE);
+        if (pool_head_compare_exchange(pool, previous_head, tagged_node_next(first, previous_head))) {
+            return;
+        }
+    }
+}
+
+/*
+    Thread local magazines
+    When POOL_THREAD_CACHE is defined, pools with thread caching enabled keep a small per thread stack (magazine) of free nodes
+    in front of the shared free list. Acquire and return operations only touch the shared list to refill or spill
+    a batch of nodes at a time, avoiding the contention on the pool head.
+    Batches have up to POOL_THREAD_CACHE_BATCH nodes and a magazine holds at most two batches. Batches are smaller for pools
+    with large blocks, so that a magazine never caches more than POOL_THREAD_CACHE_MAX_BYTES, and pools whose blocks don't fit
+    that budget are not cached at all.
+    The magazines of every thread are registered, so the nodes cached by all threads for a pool can be returned to the shared
+    list with pool_flush_thread_caches. Each thread holds a lock on its own magazines while it uses them, the lock is only
+    contended while another thread is flushing. Nodes cached by a thread are also returned to the shared list when the thread exits.
+*/
+#ifdef POOL_THREAD_CACHE
+
+#ifndef POOL_THREAD_CACHE_BATCH
+#define POOL_THREAD_CACHE_BATCH 16
+#endif
+
+#ifndef POOL_THREAD_CACHE_MAX_BYTES
+#define POOL_THREAD_CACHE_MAX_BYTES (512 * 1024)
+#endif
+
+#ifndef POOL_THREAD_CACHE_SLOTS
+#define POOL_THREAD_CACHE_SLOTS 32
+#endif
+
+/**
+ * @brief Per thread cache of free nodes for a single pool. It holds at most two batches of nodes
+ *
+ */
+struct PoolMagazine {
+    struct MemPool* pool;
+    uint32_t count;
+    struct MemNode* nodes[POOL_THREAD_CACHE_BATCH * 2];
+};
+
+/**
+ * @brief All magazines of a thread, linked with the magazines of the other threads
+ *
+ */
+struct PoolThreadMagazines {
+    uint32_t lock;
+    bool registered;
+    struct PoolThreadMagazines* prev;
+    struct PoolThreadMagazines* next;
+    struct PoolMagazine magazines[POOL_THREAD_CACHE_SLOTS];
+};
+
+static __thread struct PoolThreadMagazines _pool_thread_magazines; //NOLINT(bugprone-reserved-identifier, cppcoreguidelines-avoid-non-const-global-variables)
+static struct PoolThreadMagazines* _pool_registered_magazines = NULL; //NOLINT(bugprone-reserved-identifier, cppcoreguidelines-avoid-non-const-global-variables)
+static pthread_mutex_t _pool_registered_magazines_lock = PTHREAD_MUTEX_INITIALIZER; //NOLINT(bugprone-reserved-identifier, cppcoreguidelines-avoid-non-const-global-variables)
+static pthread_key_t _pool_thread_magazines_key; //NOLINT(bugprone-reserved-identifier, cppcoreguidelines-avoid-non-const-global-variables)
+static pthread_once_t _pool_thread_magazines_key_once = PTHREAD_ONCE_INIT; //NOLINT(bugprone-reserved-identifier, cppcoreguidelines-avoid-non-const-global-variables)
+
+static inline void pool_thread_magazines_lock(struct PoolThreadMagazines* thread_magazines) {
+    while (__atomic_exchange_n(&thread_magazines->lock, 1, __ATOMIC_ACQUIRE) != 0) {
+        sched_yield();
+    }
+}
+
+static inline void pool_thread_magazines_unlock(struct PoolThreadMagazines* thread_magazines) {
+    __atomic_store_n(&thread_magazines->lock, 0, __ATOMIC_RELEASE);
+}
+
+static inline struct PoolMagazine* pool_magazine_in_slot(struct PoolThreadMagazines* thread_magazines, struct MemPool* pool) {
+    return &thread_magazines->magazines[((uintptr_t)pool / sizeof(struct MemPool)) % POOL_THREAD_CACHE_SLOTS];
+}
+
+/**
+ * @brief Returns the first count nodes in a magazine to the pool shared free list, keeping the remaining ones
+ *
+ * @param magazine the magazine to spill from
+ * @param count number of nodes to spill
+ */
+static inline void pool_magazine_spill(struct PoolMagazine* magazine, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    for (uint32_t i = 0; i + 1 < count; i++) {
+        magazine->nodes[i]->next = magazine->nodes[i + 1];
+    }
+    pool_stack_push(magazine->pool, magazine->nodes[0], magazine->nodes[count - 1]);
+
+    magazine->count -= count;
+    memmove((void*)magazine->nodes, (void*)(magazine->nodes + count), magazine->count * sizeof(struct MemNode*));
+}
+
+static void pool_thread_magazines_unregister(void* magazines) {
+    struct PoolThreadMagazines* thread_magazines = magazines;
+
+    pthread_mutex_lock(&_pool_registered_magazines_lock);
+    if (thread_magazines->prev != NULL) {
+        thread_magazines->prev->next = thread_magazines->next;
+    } else {
+        _pool_registered_magazines = thread_magazines->next;
+    }
+    if (thread_magazines->next != NULL) {
+        thread_magazines->next->prev = thread_magazines->prev;
+    }
+
+    pool_thread_magazines_lock(thread_magazines);
+    for (uint32_t i = 0; i < POOL_THREAD_CACHE_SLOTS; i++) {
+        if (thread_magazines->magazines[i].pool != NULL) {
+            pool_magazine_spill(&thread_magazines->magazines[i], thread_magazines->magazines[i].count);
+            thread_magazines->magazines[i].pool = NULL;
+        }
+    }
+    pool_thread_magazines_unlock(thread_magazines);
+    pthread_mutex_unlock(&_pool_registered_magazines_lock);
+}
+
+static void pool_thread_magazines_create_key(void) {
+    pthread_key_create(&_pool_thread_magazines_key, pool_thread_magazines_unregister);
+}
+
+/**
+ * @brief Registers the current thread magazines the first time the thread uses a thread cached pool
+ *
+ * @return the current thread magazines
+ */
+static inline struct PoolThreadMagazines* pool_thread_magazines(void) {
+    struct PoolThreadMagazines* thread_magazines = &_pool_thread_magazines;
+    if (__builtin_expect(thread_magazines->registered, 1)) {
+        return thread_magazines;
+    }
+
+    // the key destructor returns cached nodes to their pools when the thread exits
+    pthread_once(&_pool_thread_magazines_key_once, pool_thread_magazines_create_key);
+    pthread_setspecific(_pool_thread_magazines_key, thread_magazines);
+
+    pthread_mutex_lock(&_pool_registered_magazines_lock);
+    thread_magazines->prev = NULL;
+    thread_magazines->next = _pool_registered_magazines;
+    if (_pool_registered_magazines != NULL) {
+        _pool_registered_magazines->prev = thread_magazines;
+    }
+    _pool_registered_magazines = thread_magazines;
+    pthread_mutex_unlock(&_pool_registered_magazines_lock);
+
+    thread_magazines->registered = true;
+    return thread_magazines;
+}
+
+/**
+ * @brief Finds the thread magazine for a pool, claiming the magazine slot if it's in use by another pool.
+ * The thread magazines must be locked
+ *
+ * @param thread_magazines the current thread magazines
+ * @param pool the memory pool
+ * @return the magazine for the pool
+ */
+static inline struct PoolMagazine* pool_thread_magazine(struct PoolThreadMagazines* thread_magazines, struct MemPool* pool) {
+    struct PoolMagazine* magazine = pool_magazine_in_slot(thread_magazines, pool);
+
+    if (__builtin_expect(magazine->pool == pool, 1)) {
+        return magazine;
+    }
+
+    if (magazine->pool != NULL) {
+        pool_magazine_spill(magazine, magazine->count);
+    }
+    magazine->pool = pool;
+    magazine->count = 0;
+
+    return magazine;
+}
+
+/**
+ * @brief Takes a node from the current thread magazine, refilling it from the shared free list if empty
+ *
+ * @param pool the memory pool
+ * @return a free node or NULL if both the magazine and the shared free list are empty
+ */
+static inline struct MemNode* pool_thread_cache_pop(struct MemPool* pool) {
+    struct PoolThreadMagazines* thread_magazines = pool_thread_magazines();
+    pool_thread_magazines_lock(thread_magazines);
+    struct PoolMagazine* magazine = pool_thread_magazine(thread_magazines, pool);
+
+    if (magazine->count == 0) {
+        uint32_t count = 0;
+        struct MemNode* node = pool_stack_pop_batch(pool, pool->thread_cache_batch, &count);
+        for (uint32_t i = 0; i < count; i++) {
+            // keep the list order so the most recently returned node is handed out first
+            magazine->nodes[count - i - 1] = node;
+            node = node->next;
+        }
+        magazine->count = count;
+
+        if (count == 0) {
+            pool_thread_magazines_unlock(thread_magazines);
+            return NULL;
+        }
+    }
+
+    magazine->count--;
+    struct MemNode* node = magazine->nodes[magazine->count];
+    pool_thread_magazines_unlock(thread_magazines);
+    return node;
+}
+
+/**
+ * @brief Stores a node in the current thread magazine, spilling the oldest batch to the shared free list if full
+ *
+ * @param pool the memory pool owning the node
+ * @param node the node being returned
+ */
+static inline void pool_thread_cache_push(struct MemPool* pool, struct MemNode* node) {
+    struct PoolThreadMagazines* thread_magazines = pool_thread_magazines();
+    pool_thread_magazines_lock(thread_magazines);
+    struct PoolMagazine* magazine = pool_thread_magazine(thread_magazines, pool);
+
+    if (magazine->count == pool->thread_cache_batch * 2) {
+        pool_magazine_spill(magazine, pool->thread_cache_batch);
+    }
+
+    magazine->nodes[magazine->count] = node;
+    magazine->count++;
+    pool_thread_magazines_unlock(thread_magazines);
+}
+
+#endif // POOL_THREAD_CACHE
+
+/**
+ * @brief Enables the per thread magazine cache for a pool when compiled with POOL_THREAD_CACHE, otherwise it has no effect.
+ * Pools whose blocks are too large for the thread cache budget are not cached.
+ * The pool must not be freed while other threads are still using it
+ *
+ * @param pool the memory pool
+ */
+void pool_enable_thread_cache(__attribute__((unused)) struct MemPool* pool) {
+#ifdef POOL_THREAD_CACHE
+    size_t batch = POOL_THREAD_CACHE_MAX_BYTES / 2 / pool->mem_size;
+    pool->thread_cache_batch = batch < POOL_THREAD_CACHE_BATCH ? (uint32_t)batch : POOL_THREAD_CACHE_BATCH;
+#endif
+}
+
+/**
+ * @brief Returns the free blocks cached by all threads for a pool to its shared free list when compiled with POOL_THREAD_CACHE,
+ * otherwise it has no effect. Threads can keep using the pool, caching blocks again
+ *
+ * @param pool the memory pool
+ */
+void pool_flush_thread_caches(__attribute__((unused)) struct MemPool* pool) {
+#ifdef POOL_THREAD_CACHE
+    if (pool->thread_cache_batch == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&_pool_registered_magazines_lock);
+    for (struct PoolThreadMagazines* thread_magazines = _pool_registered_magazines; thread_magazines != NULL; thread_magazines = thread_magazines->next) {
+        pool_thread_magazines_lock(thread_magazines);
+        struct PoolMagazine* magazine = pool_magazine_in_slot(thread_magazines, pool);
+        if (magazine->pool == pool) {
+            pool_magazine_spill(magazine, magazine->count);
+            magazine->pool = NULL;
+        }
+        pool_thread_magazines_unlock(thread_magazines);
+    }
+    pthread_mutex_unlock(&_pool_registered_magazines_lock);
+#endif
+}
+
+// MemPool operations
+/**
+ * @brief Creates a new memory pool for a given memory size.
+ * The pool will return an memory block of the indicated size
+ * Changing the size of the memory block after creation leads to undefined behaviour.
+ *
+ * @param size of each memory block
+ * @return a new memory pool or NULL if the memory for it cannot be allocated
+ */
+__attribute__((malloc,warn_unused_result))
+struct MemPool* alloc_mem_pool(uint32_t size) {
+    struct MemPool* pool = malloc(sizeof(struct MemPool));
+    if(pool == NULL) {
+        return NULL;
+    }
+    memset((void*)pool, 0, sizeof(struct MemPool));
+    pool->mem_size = size;
+    pool->block_stride = pool_align_size(pool_block_header_size() + size);
+
+    size_t slab_capacity = POOL_SLAB_SIZE - pool_slab_header_size();
+    size_t blocks_per_slab = pool->block_stride < slab_capacity ? slab_capacity / pool->block_stride : 1;
+    pool->blocks_per_slab = blocks_per_slab < POOL_SLAB_MAX_BLOCKS ? (uint32_t)blocks_per_slab : POOL_SLAB_MAX_BLOCKS;
+
+    return pool;
+}
+
+/**
+ * @brief Allocates a new slab for the pool and links all of its blocks in a chain
+ *
+ * @param pool owning the slab
+ * @param last set to the last node in the chain
+ * @return the first node in the chain or NULL if the slab memory cannot be allocated
+ */
+__attribute__((warn_unused_result))
+static struct MemNode* alloc_pool_slab(struct MemPool* pool, struct MemNode** last) {
+    assert(pool != NULL);
+    assert(pool->mem_size != 0);
+
+    struct MemSlab* slab = alloc_mem_slab(pool_slab_header_size() + pool->block_stride * pool->blocks_per_slab);
+    if (slab == NULL) {
+        return NULL;
+    }
+
+    char* block = (char*)slab + pool_slab_header_size();
+    struct MemNode* first = (struct MemNode*)(void*)block;
+    struct MemNode* previous = NULL;
+    for (uint32_t i = 0; i < pool->blocks_per_slab; i++, block += pool->block_stride) {
+        struct MemNode* node = (struct MemNode*)(void*)block;
+        ptrdiff_t* ptr_data = (ptrdiff_t*)(void*)(block + pool_block_header_size()) - 1;
+
+        // store the address of the owning node right before the data
+        ptr_data[0] = (ptrdiff_t) node;
+        node->data = ptr_data + 1;
+        node->pool = pool;
+        node->next = NULL;
+        node->epoch = pool->epoch;
+        node->trimmed = false;
+
+        if (previous != NULL) {
+            previous->next = node;
+        }
+        previous = node;
+    }
+    *last = previous;
+
+    // slabs are only removed when the pool is freed so a plain CAS push is safe here
+    slab->next = __atomic_load_n(&pool->slabs, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&pool->slabs, &slab->next, slab, true, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+    }
+
+    track_pool_usage_allocs(pool, pool->blocks_per_slab);
+    __atomic_add_fetch(&pool->stats.allocated_blocks, pool->blocks_per_slab, __ATOMIC_RELAXED);
+    return first;
+}
+
+/**
+ * @brief Free the memory used by all items in the pool and empties the pool.
+ * All blocks acquired from the pool must be returned first: the slabs backing blocks still acquired are released as well,
+ * so using or returning those blocks afterwards is undefined behaviour. The in_use_blocks statistic tells whether any block is still acquired.
+ * This function is not thread safe and should be only invoked when the pool is destroyed
+ *
+ * @param pool containing the memory to be released
+ */
+void pool_mem_free_all(struct MemPool* pool) {
+    assert(pool != NULL);
+
+    pool_flush_thread_caches(pool);
+
+    struct MemSlab* slab = pool->slabs;
+    while(slab != NULL) {
+        struct MemSlab* next = slab->next;
+        free_mem_slab(slab);
+        slab = next;
+    }
+    pool->slabs = NULL;
+    memset((void*)&pool->head, 0, sizeof(TaggedNodePtr));
+    memset((void*)&pool->stats, 0, sizeof(struct MemPoolStats));
+
+#ifdef TRACK_POOL_USAGE
+    pool->num_allocs = 0;
+    pool->num_available = 0;
+#endif
+}
+
+/**
+ * @brief Frees a memory pool and all of its associated memory nodes.
+ *
+ * @param pool Pointer to the memory pool to be freed.
+ */
+void free_mem_pool(struct MemPool* pool) {
+    assert(pool != NULL);
+
+    pool_mem_free_all(pool);
+    free(pool);
+}
+
+/*
+    Large blocks
+    Sizes above the largest multipool entry are served by a large block tier. Each large block is its own mapping
+    laid out as [MemLargeBlock header][owning node address][data], with the data starting at a page boundary and the
+    mapping advised to be backed by transparent hugepages when supported. Large block nodes have no pool, which is how
+    pool_mem_return tells them apart.
+    Returned large blocks are kept in a small cache, bounded by POOL_LARGE_CACHE_MAX_BLOCKS and POOL_LARGE_CACHE_MAX_BYTES,
+    and reused for requests of up to twice their capacity. Blocks that don't fit the cache are unmapped right away.
+*/
+#ifndef POOL_LARGE_CACHE_MAX_BLOCKS
+#define POOL_LARGE_CACHE_MAX_BLOCKS 8
+#endif
+
+#ifndef POOL_LARGE_CACHE_MAX_BYTES
+#define POOL_LARGE_CACHE_MAX_BYTES (256 * 1024 * 1024)
+#endif
+
+#if defined(MAP_ANONYMOUS) && !defined(POOL_NO_SLAB_MMAP)
+#define POOL_LARGE_MMAP
+#endif
+
+struct MemLargeCache;
+
+/**
+ * @brief Header of a large block mapping. The block node is kept in the header, right before the data
+ *
+ */
+struct MemLargeBlock {
+    struct MemLargeBlock* next;
+    struct MemLargeCache* cache;
+    size_t map_size;
+    size_t capacity;
+    struct MemNode node;
+};
+
+/**
+ * @brief Cache of returned large blocks, most recently returned first
+ *
+ */
+struct MemLargeCache {
+    pthread_mutex_t lock;
+    struct MemLargeBlock* free_blocks;
+    uint32_t free_count;
+    size_t free_bytes;
+    struct MemPoolStats stats;
+};
+
+static inline size_t pool_page_size(void) {
+    static size_t page_size = 0;
+    if (page_size == 0) {
+        page_size = (size_t)sysconf(_SC_PAGESIZE);
+    }
+    return page_size;
+}
+
+static inline struct MemLargeBlock* get_large_block_in_node(struct MemNode* node) {
+    return (struct MemLargeBlock*)(void*)((char*)node - offsetof(struct MemLargeBlock, node));
+}
+
+static void large_cache_init(struct MemLargeCache* cache) {
+    memset((void*)cache, 0, sizeof(struct MemLargeCache));
+    pthread_mutex_init(&cache->lock, NULL);
+}
+
+/**
+ * @brief Maps a new large block with at least size bytes of data
+ *
+ * @param cache owning the block
+ * @param size of the block data
+ * @return the block or NULL if the memory cannot be allocated
+ */
+__attribute__((warn_unused_result))
+static struct MemLargeBlock* alloc_large_block(struct MemLargeCache* cache, size_t size) {
+    const size_t page_size = pool_page_size();
+    // the header takes whole pages so the data is page aligned
+    const size_t header_size = (sizeof(struct MemLargeBlock) + sizeof(ptrdiff_t) + page_size - 1) & ~(page_size - 1);
+    const size_t map_size = (header_size + size + page_size - 1) & ~(page_size - 1);
+
+    struct MemLargeBlock* block = NULL;
+#ifdef POOL_LARGE_MMAP
+    void* mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    // best effort, the mapping is still usable if transparent hugepages are not available
+    madvise(mem, map_size, MADV_HUGEPAGE);
+#endif
+    block = mem;
+#else
+    void* mem = NULL;
+    if (posix_memalign(&mem, page_size, map_size) != 0) {
+        return NULL;
+    }
+    block = mem;
+#endif
+
+    char* data = (char*)block + header_size;
+    ptrdiff_t* ptr_data = (ptrdiff_t*)(void*)data - 1;
+    ptr_data[0] = (ptrdiff_t)&block->node;
+
+    block->next = NULL;
+    block->cache = cache;
+    block->map_size = map_size;
+    block->capacity = map_size - header_size;
+    block->node.next = NULL;
+    block->node.data = data;
+    block->node.pool = NULL;
+    block->node.epoch = 0;
+    block->node.trimmed = false;
+
+    __atomic_add_fetch(&cache->stats.allocated_blocks, 1, __ATOMIC_RELAXED);
+    return block;
+}
+
+static void free_large_block(struct MemLargeBlock* block) {
+    __atomic_sub_fetch(&block->cache->stats.allocated_blocks, 1, __ATOMIC_RELAXED);
+#ifdef POOL_LARGE_MMAP
+    munmap((void*)block, block->map_size);
+#else
+    free(block);
+#endif
+}
+
+/**
+ * @brief Acquires a large block, reusing the smallest cached block that fits if there's one
+ *
+ * @param cache the large block cache
+ * @param size of the block data
+ * @return void* pointer to the block data or NULL if the memory cannot be allocated
+ */
+__attribute__((warn_unused_result))
+void* large_mem_acquire(struct MemLargeCache* cache, size_t size) {
+    assert(cache != NULL);
+
+    pthread_mutex_lock(&cache->lock);
+    struct MemLargeBlock** best = NULL;
+    for (struct MemLargeBlock** entry = &cache->free_blocks; *entry != NULL; entry = &(*entry)->next) {
+        const size_t capacity = (*entry)->capacity;
+        // don't hold on to a much larger block for a small request
+        if (capacity >= size && capacity / 2 <= size && (best == NULL || capacity < (*best)->capacity)) {
+            best = entry;
+        }
+    }
+
+    struct MemLargeBlock* block = NULL;
+    if (best != NULL) {
+        block = *best;
+        *best = block->next;
+        cache->free_count--;
+        cache->free_bytes -= block->map_size;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (block == NULL) {
+        block = alloc_large_block(cache, size);
+        if (block == NULL) {
+            return NULL;
+        }
+        __atomic_add_fetch(&cache->stats.misses, 1, __ATOMIC_RELAXED);
+    }
 
-void track_pool_usage_returned(__attribute__((unused)) struct MemPool* pool) {
-#ifdef TRACK_POOL_USAGE
-    __atomic_add_fetch(&pool->num_available, 1, __ATOMIC_RELEASE);
-#endif
-}
+    __atomic_add_fetch(&cache->stats.acquires, 1, __ATOMIC_RELAXED);
+    uint64_t in_use = __atomic_add_fetch(&cache->stats.in_use_blocks, 1, __ATOMIC_RELAXED);
+    uint64_t high_water = __atomic_load_n(&cache->stats.high_water_blocks, __ATOMIC_RELAXED);
+    while (in_use > high_water) {
+        if (__atomic_compare_exchange_n(&cache->stats.high_water_blocks, &high_water, in_use, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
 
-void track_pool_usage_memnode_unavailable(__attribute__((unused)) struct MemPool* pool) {
-#ifdef TRACK_POOL_USAGE
-    __atomic_sub_fetch(&pool->num_available, 1, __ATOMIC_RELEASE);
-#endif
+    block->next = NULL;
+    return block->node.data;
 }
 
 /**
- * @brief Returns a pointer to the MemNode struct associated with a given data pointer.
- * The MemNode struct is assumed to be located directly before the data pointer in memory. The function returns a pointer to the MemNode struct.
+ * @brief Returns a large block to its cache or unmaps it if the cache is full
  *
- * @param data Pointer to the memory block for which to retrieve the associated MemNode struct.
- * @return A pointer to the MemNode struct associated with the given data pointer.
+ * @param node of the large block
  */
-static inline struct MemNode* get_memnode_in_data(void* data) {
-    assert(data != NULL);
+static void large_mem_return(struct MemNode* node) {
+    struct MemLargeBlock* block = get_large_block_in_node(node);
+    struct MemLargeCache* cache = block->cache;
+    __atomic_sub_fetch(&cache->stats.in_use_blocks, 1, __ATOMIC_RELAXED);
 
-    ptrdiff_t *node_mem_val = ((ptrdiff_t *)data) - 1;
-    struct MemNode *node = (struct MemNode *)(node_mem_val[0]); // NOLINT(performance-no-int-to-ptr)
-    return node;
+    pthread_mutex_lock(&cache->lock);
+    bool cached = cache->free_count < POOL_LARGE_CACHE_MAX_BLOCKS && cache->free_bytes + block->map_size <= POOL_LARGE_CACHE_MAX_BYTES;
+    if (cached) {
+        block->next = cache->free_blocks;
+        cache->free_blocks = block;
+        cache->free_count++;
+        cache->free_bytes += block->map_size;
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    if (!cached) {
+        __atomic_add_fetch(&cache->stats.released_bytes, block->map_size, __ATOMIC_RELAXED);
+        free_large_block(block);
+    }
 }
 
 /**
- * @brief Allocates a new pool entry and the memory block it holds
+ * @brief Unmaps the cached large blocks, keeping the most recently returned ones up to keep_bytes
  *
- * @param pool to store the newly allocated entry
- * @return node with the allocated memory
+ * @param cache the large block cache
+ * @param keep_bytes amount of cached memory to keep
+ * @return number of bytes released to the system
  */
-__attribute__((malloc,warn_unused_result))
-struct MemNode* alloc_poolable_mem(struct MemPool* pool) {
-    assert(pool != NULL);
-    assert(pool->mem_size != 0);
+size_t large_cache_trim(struct MemLargeCache* cache, size_t keep_bytes) {
+    assert(cache != NULL);
 
-    struct MemNode* node = malloc(sizeof(struct MemNode));
-    if (node == NULL) {
-        return NULL;
+    pthread_mutex_lock(&cache->lock);
+    struct MemLargeBlock** entry = &cache->free_blocks;
+    size_t kept_bytes = 0;
+    while (*entry != NULL && kept_bytes + (*entry)->map_size <= keep_bytes) {
+        kept_bytes += (*entry)->map_size;
+        entry = &(*entry)->next;
     }
 
-    node->next = NULL;
-    ptrdiff_t* ptr_data = malloc(pool->mem_size + sizeof(ptrdiff_t));
+    struct MemLargeBlock* released = *entry;
+    *entry = NULL;
+    for (struct MemLargeBlock* block = released; block != NULL; block = block->next) {
+        cache->free_count--;
+        cache->free_bytes -= block->map_size;
+    }
+    pthread_mutex_unlock(&cache->lock);
 
-    if(ptr_data == NULL) {
-        free(node);
-        return NULL;
+    size_t released_bytes = 0;
+    while (released != NULL) {
+        struct MemLargeBlock* next = released->next;
+        released_bytes += released->map_size;
+        free_large_block(released);
+        released = next;
     }
 
-    // store the address of the owning node in the first sizeof(ptrdiff_t) byes
-    ptr_data[0] = (ptrdiff_t) node;
-    node->data = ptr_data+1;
-    node->pool = pool;
-    return node;
+    __atomic_add_fetch(&cache->stats.released_bytes, released_bytes, __ATOMIC_RELAXED);
+    return released_bytes;
 }
 
 /**
- * @brief Frees a poolable memory node and all of its allocated memory.
+ * @brief Takes a snapshot of the large block usage statistics, see pool_get_stats
  *
- * @param node The memory node to free.
- *
- * @pre `node` must not be `NULL`.
+ * @param cache the large block cache
+ * @param stats set to the current statistics
  */
-void free_poolable_mem(struct MemNode* node) {
-    assert(node != NULL);
-
-    // we need to restore all the allocated memory
-    ptrdiff_t* ptr_data = node->data;
-    void* node_data = ptr_data-1;
+void large_cache_get_stats(struct MemLargeCache* cache, struct MemPoolStats* stats) {
+    assert(cache != NULL);
+    assert(stats != NULL);
 
-    free(node_data);
-    free(node);
+    stats->acquires = __atomic_load_n(&cache->stats.acquires, __ATOMIC_RELAXED);
+    stats->misses = __atomic_load_n(&cache->stats.misses, __ATOMIC_RELAXED);
+    stats->allocated_blocks = __atomic_load_n(&cache->stats.allocated_blocks, __ATOMIC_RELAXED);
+    stats->in_use_blocks = __atomic_load_n(&cache->stats.in_use_blocks, __ATOMIC_RELAXED);
+    stats->high_water_blocks = __atomic_load_n(&cache->stats.high_water_blocks, __ATOMIC_RELAXED);
+    stats->released_bytes = __atomic_load_n(&cache->stats.released_bytes, __ATOMIC_RELAXED);
 }
 
-// MemPool operations
 /**
- * @brief Creates a new memory pool for a given memory size.
- * The pool will return an memory block of the indicated size
- * Changing the size of the memory block after creation leads to undefined behaviour.
+ * @brief Releases all cached large blocks. Blocks still acquired must not be returned afterwards
  *
- * @param size of each memory block
- * @return a new memory pool or NULL if the memory for it cannot be allocated
+ * @param cache the large block cache
  */
-__attribute__((malloc,warn_unused_result))
-struct MemPool* alloc_mem_pool(uint32_t size) {
-    struct MemPool* pool = malloc(sizeof(struct MemPool));
-    if(pool == NULL) {
-        return NULL;
-    }
-    memset((void*)pool, 0, sizeof(struct MemPool));
-    pool->mem_size = size;
-
-    return pool;
+static void large_cache_free(struct MemLargeCache* cache) {
+    large_cache_trim(cache, 0);
+    pthread_mutex_destroy(&cache->lock);
 }
 
+// MemPool acquire and return operations
 /**
- * @brief Free the memory used by all items in the pool and empties the pool.
- * This function is not thread safe and should be only invoked when the pool is destroyed
+ * @brief Try allocate a new memory block. The size of the memory block is the one set in the pool
+ * A new slab is allocated, one block is returned and the remaining ones are added to the pool.
+ * The function will return NULL if the slab memory cannot be allocated
  *
- * @param pool containing the memory to be released
+ * @param pool containing the newly allocated entry and memory block
+ * @return void* pointer to the allocated memory block or NULL if the allocation fails
  */
-void pool_mem_free_all(struct MemPool* pool) {
+__attribute__((warn_unused_result))
+void* pool_mem_try_alloc_data(struct MemPool* pool)  {
     assert(pool != NULL);
 
-    struct MemNode* node = pool->head;
-    while(node != NULL) {
-        pool->head = node->next;
-        free_poolable_mem(node);
-        track_pool_usage_memnode_unavailable(pool);
-        node = pool->head;
+    struct MemNode* last = NULL;
+    struct MemNode* node = alloc_pool_slab(pool, &last);
+    if(node == NULL) {
+        return NULL;
+    }
+
+    if (node != last) {
+        pool_stack_push(pool, node->next, last);
+        track_pool_usage_returned(pool, pool->blocks_per_slab - 1);
     }
+
+    __atomic_add_fetch(&pool->stats.misses, 1, __ATOMIC_RELAXED);
+    pool_stats_acquired(pool);
+    return node->data;
 }
 
 /**
- * @brief Frees a memory pool and all of its associated memory nodes.
+ * @brief Pre-allocates slabs until the pool has allocated at least count free memory blocks.
+ * This is useful for warming up a pool before use, with a single allocation per slab
  *
- * @param pool Pointer to the memory pool to be freed.
+ * @param pool the memory pool
+ * @param count minimum number of blocks to add to the pool
+ * @return true if all blocks were allocated, false if the memory cannot be allocated
  */
-void free_mem_pool(struct MemPool* pool) {
+bool pool_mem_reserve(struct MemPool* pool, uint32_t count) {
     assert(pool != NULL);
 
-    pool_mem_free_all(pool);
-    free(pool);
+    uint32_t reserved = 0;
+    while (reserved < count) {
+        struct MemNode* last = NULL;
+        struct MemNode* first = alloc_pool_slab(pool, &last);
+        if (first == NULL) {
+            return false;
+        }
+
+        pool_stack_push(pool, first, last);
+        track_pool_usage_returned(pool, pool->blocks_per_slab);
+        reserved += pool->blocks_per_slab;
+    }
+    return true;
 }
 
-// MemPool acquire and return operations
 /**
- * @brief Try allocate a new pool node and memory block. The size of the memory block is the one set in the pool
- * The function will return NULL if malloc fails
+ * @brief Acquire a block of memory from the pool only if one is available. No new memory is allocated
+ * Useful when blocks carry state that must be initialized the first time they are used. Blocks that were never
+ * acquired before are zero filled
  *
- * @param pool containing the newly allocated entry and memory block
- * @return void* pointer to the allocated memory block or NULL if malloc fails
+ * @param pool the memory pool
+ * @return void* pointer to a previously returned memory block or NULL if the pool is empty
  */
 __attribute__((warn_unused_result))
-void* pool_mem_try_alloc_data(struct MemPool* pool)  {
+void* pool_mem_try_acquire(struct MemPool* pool) {
     assert(pool != NULL);
 
-    struct MemNode* node = alloc_poolable_mem(pool);
-    if(node == NULL) {
+    struct MemNode* node = NULL;
+#ifdef POOL_THREAD_CACHE
+    if (pool->thread_cache_batch > 0) {
+        node = pool_thread_cache_pop(pool);
+    } else {
+        node = pool_stack_pop(pool);
+    }
+#else
+    node = pool_stack_pop(pool);
+#endif
+
+    if (node == NULL) {
         return NULL;
     }
 
-    track_pool_usage_allocs(pool);
+    track_pool_usage_memnode_unavailable(pool);
+    pool_stats_acquired(pool);
     return node->data;
 }
 
@@ -207,18 +1209,16 @@ __attribute__((warn_unused_result))
 void* pool_mem_acquire(struct MemPool* pool) {
     assert(pool != NULL);
 
-    while (true) {
-        struct MemNode* previous_head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
-        if (previous_head == NULL) {
-            return pool_mem_try_alloc_data(pool);
-        }
-
-        struct MemNode* new_head = __atomic_load_n(&previous_head->next,__ATOMIC_ACQUIRE);
-        if (__atomic_compare_exchange_n(&pool->head, &previous_head, new_head, true, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
-            track_pool_usage_memnode_unavailable(pool);
-            return previous_head->data;
-        }
+    void* data = pool_mem_try_acquire(pool);
+    while (data == NULL && __atomic_load_n(&pool->trimming, __ATOMIC_SEQ_CST) > 0) {
+        // free blocks detached by a trim are pushed back within a batch
+        sched_yield();
+        data = pool_mem_try_acquire(pool);
     }
+    if (data == NULL) {
+        return pool_mem_try_alloc_data(pool);
+    }
+    return data;
 }
 
 /**
@@ -229,17 +1229,166 @@ void* pool_mem_acquire(struct MemPool* pool) {
 void pool_mem_return(void* data) {
     assert(data != NULL);
 
-    struct MemNode* new_head = get_memnode_in_data(data);
-    struct MemPool* pool = new_head->pool;
+    struct MemNode* node = get_memnode_in_data(data);
+    struct MemPool* pool = node->pool;
+    if (__builtin_expect(pool == NULL, 0)) {
+        large_mem_return(node);
+        return;
+    }
 
-    while (true) {
-        struct MemNode* previous_head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
-        __atomic_store_n(&new_head->next, previous_head, __ATOMIC_RELEASE);
-        if (__atomic_compare_exchange_n(&pool->head, &previous_head, new_head, true, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
-            track_pool_usage_returned(pool);
-            return;
+    node->epoch = __atomic_load_n(&pool->epoch, __ATOMIC_RELAXED);
+    node->trimmed = false;
+    pool_stats_released(pool);
+
+#ifdef POOL_THREAD_CACHE
+    if (pool->thread_cache_batch > 0) {
+        pool_thread_cache_push(pool, node);
+        track_pool_usage_returned(pool, 1);
+        return;
+    }
+#endif
+
+    pool_stack_push(pool, node, node);
+    track_pool_usage_returned(pool, 1);
+}
+
+/*
+    Trimming
+    Blocks in the pool free list can have their memory released to the system with madvise(MADV_DONTNEED). Node headers
+    are kept, so trimmed blocks stay in the free list and their memory is faulted back in, zero filled, when reused.
+    Only the pages fully covered by a block data are released, blocks smaller than a page are never trimmed.
+    Each pool has an epoch, advanced by pool_advance_epoch, and returned blocks record the epoch they were returned in.
+    Blocks held in thread caches are not trimmed.
+    Blocks are trimmed POOL_TRIM_BATCH at a time, each batch is pushed back to the free list as soon as it's trimmed.
+*/
+#ifndef POOL_TRIM_BATCH
+#define POOL_TRIM_BATCH 32
+#endif
+
+/**
+ * @brief Releases the pages fully covered by a block data to the system
+ *
+ * @param node the node owning the block, it must not be in use
+ * @param mem_size size of the block data
+ * @return number of bytes released
+ */
+static inline size_t pool_trim_block(struct MemNode* node, size_t mem_size) {
+#ifdef MADV_DONTNEED
+    const size_t page_size = pool_page_size();
+
+    uintptr_t start = ((uintptr_t)node->data + page_size - 1) & ~(uintptr_t)(page_size - 1);
+    uintptr_t end = ((uintptr_t)node->data + mem_size) & ~(uintptr_t)(page_size - 1);
+    if (end <= start) {
+        return 0;
+    }
+
+    if (madvise((void*)start, end - start, MADV_DONTNEED) != 0) { // NOLINT(performance-no-int-to-ptr)
+        return 0;
+    }
+    node->trimmed = true;
+    return end - start;
+#else
+    (void)node;
+    (void)mem_size;
+    return 0;
+#endif
+}
+
+/**
+ * @brief Advances the pool epoch, used to measure for how long blocks have been idle in the pool
+ *
+ * @param pool the memory pool
+ */
+void pool_advance_epoch(struct MemPool* pool) {
+    assert(pool != NULL);
+    __atomic_add_fetch(&pool->epoch, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Trims the pool free list, see pool_mem_trim
+ *
+ * @return number of bytes released to the system
+ */
+static size_t pool_trim_free_list(struct MemPool* pool, size_t trigger_bytes, size_t keep_bytes, uint32_t min_idle_epochs) {
+    uint32_t count = 0;
+    struct MemNode* first = pool_stack_pop_batch(pool, UINT32_MAX, &count);
+    if (first == NULL) {
+        return 0;
+    }
+
+    size_t untrimmed_bytes = 0;
+    struct MemNode* last = first;
+    for (struct MemNode* node = first; node != NULL; node = node->next) {
+        if (!node->trimmed) {
+            untrimmed_bytes += pool->mem_size;
+        }
+        last = node;
+    }
+
+    if (untrimmed_bytes <= trigger_bytes) {
+        pool_stack_push(pool, first, last);
+        return 0;
+    }
+
+    // blocks at the head of the list were returned most recently, keep those
+    struct MemNode* kept_last = NULL;
+    struct MemNode* node = first;
+    size_t kept_bytes = 0;
+    while (node != NULL && (node->trimmed || kept_bytes + pool->mem_size <= keep_bytes)) {
+        if (!node->trimmed) {
+            kept_bytes += pool->mem_size;
+        }
+        kept_last = node;
+        node = node->next;
+    }
+
+    if (kept_last != NULL) {
+        kept_last->next = NULL;
+        pool_stack_push(pool, first, kept_last);
+    }
+
+    if (node == NULL) {
+        return 0;
+    }
+
+    size_t released_bytes = 0;
+    uint32_t epoch = __atomic_load_n(&pool->epoch, __ATOMIC_RELAXED);
+    while (node != NULL) {
+        struct MemNode* batch_first = node;
+        struct MemNode* batch_last = node;
+        for (uint32_t i = 0; i < POOL_TRIM_BATCH && node != NULL; i++) {
+            if (!node->trimmed && epoch - node->epoch >= min_idle_epochs) {
+                released_bytes += pool_trim_block(node, pool->mem_size);
+            }
+            batch_last = node;
+            node = node->next;
         }
+        pool_stack_push(pool, batch_first, batch_last);
     }
+    return released_bytes;
+}
+
+/**
+ * @brief Releases the memory of idle blocks in the pool free list to the system.
+ * The free list is detached while it's measured, the most recently returned blocks, up to keep_bytes, are made available
+ * again right away and the remaining blocks are returned in batches as they are trimmed. Concurrent acquires finding
+ * the free list empty wait for the trim instead of allocating new memory.
+ *
+ * @param pool the memory pool
+ * @param trigger_bytes the pool is only trimmed if the untrimmed memory in the free list exceeds this amount
+ * @param keep_bytes amount of untrimmed memory to keep in the free list
+ * @param min_idle_epochs only blocks returned at least this many epochs ago are trimmed
+ * @return number of bytes released to the system
+ */
+size_t pool_mem_trim(struct MemPool* pool, size_t trigger_bytes, size_t keep_bytes, uint32_t min_idle_epochs) {
+    assert(pool != NULL);
+
+    __atomic_add_fetch(&pool->trimming, 1, __ATOMIC_SEQ_CST);
+    size_t released_bytes = pool_trim_free_list(pool, trigger_bytes, keep_bytes, min_idle_epochs);
+    __atomic_sub_fetch(&pool->trimming, 1, __ATOMIC_SEQ_CST);
+
+    __atomic_add_fetch(&pool->stats.released_bytes, released_bytes, __ATOMIC_RELAXED);
+    return released_bytes;
 }
 
 /*
@@ -267,6 +1416,17 @@ enum {
  */
 struct MultiPool {
     struct MemPool* pools[MULTIPOOL_ENTRY_COUNT];
+    // blocks larger than the largest pool
+    struct MemLargeCache large;
+    // background trim policy for each pool, disabled when the high watermark is zero
+    size_t trim_high_watermarks[MULTIPOOL_ENTRY_COUNT];
+    size_t trim_low_watermarks[MULTIPOOL_ENTRY_COUNT];
+    uint32_t trim_min_idle_epochs;
+    uint32_t trim_interval_ms;
+    bool trimmer_running;
+    pthread_t trimmer;
+    pthread_mutex_t trimmer_lock;
+    pthread_cond_t trimmer_stop;
 };
 
 
@@ -280,6 +1440,10 @@ struct MultiPool* multipool_create(void) {
     struct MultiPool* multipool = malloc(sizeof(struct MultiPool));
 
     if(multipool != NULL) {
+        memset((void*)multipool, 0, sizeof(struct MultiPool));
+        pthread_mutex_init(&multipool->trimmer_lock, NULL);
+        pthread_cond_init(&multipool->trimmer_stop, NULL);
+        large_cache_init(&multipool->large);
         for(uint32_t i = 0 ; i < MULTIPOOL_ENTRY_COUNT ; i++) {
             uint32_t size = 1 << ((uint32_t)DynPoolMinMultiPoolMemNodeSizeBits+i);
             struct MemPool* pool = alloc_mem_pool(size);
@@ -291,16 +1455,40 @@ struct MultiPool* multipool_create(void) {
 }
 
 /**
- * @brief Releases all memory owned by a multi pool, including individual pool items
+ * @brief Checks whether any block acquired from a multi pool, large blocks included, was not returned yet
+ *
+ * @param multipool the multipool
+ * @return true if at least one block is still acquired
+ */
+bool multipool_in_use(struct MultiPool* multipool) {
+    assert(multipool != NULL);
+
+    for(uint32_t i = 0 ; i < MULTIPOOL_ENTRY_COUNT ; i++) {
+        if (__atomic_load_n(&multipool->pools[i]->stats.in_use_blocks, __ATOMIC_RELAXED) > 0) {
+            return true;
+        }
+    }
+    return __atomic_load_n(&multipool->large.stats.in_use_blocks, __ATOMIC_RELAXED) > 0;
+}
+
+/**
+ * @brief Releases all memory owned by a multi pool, including individual pool items.
+ * All blocks acquired from the multipool must be returned first, see pool_mem_free_all and multipool_in_use
  *
  * @param multipool to be released
  */
+void multipool_stop_trimmer(struct MultiPool* multipool);
+
 void multipool_free(struct MultiPool* multipool) {
     assert(multipool != NULL);
 
+    multipool_stop_trimmer(multipool);
     for(int i = 0 ; i < MULTIPOOL_ENTRY_COUNT ; i++) {
         free_mem_pool(multipool->pools[i]);
     }
+    large_cache_free(&multipool->large);
+    pthread_mutex_destroy(&multipool->trimmer_lock);
+    pthread_cond_destroy(&multipool->trimmer_stop);
     free(multipool);
 }
 
@@ -323,23 +1511,210 @@ uint32_t find_multipool_index_for_size(uint32_t size) {
  * @brief Acquire memory in a multipool setup. Acquired memory should be returned calling pool_mem_return
  *
  * @param multipool the multipool to be used
- * @param size size of the memory allocated. It will be rounded up to the next power of 2 bit
+ * @param size size of the memory allocated. It will be rounded up to the next power of 2 bit, or to the page size for large blocks
  * @return void* allocated memory or NULL if allocation fail
  */
 void* multipool_mem_acquire(struct MultiPool* multipool, uint32_t size) {
     assert(multipool != NULL);
 
     uint32_t index = find_multipool_index_for_size(size);
-
-    assert(index < MULTIPOOL_ENTRY_COUNT);
     if (__builtin_expect(index >= MULTIPOOL_ENTRY_COUNT, 0)) {
-        return NULL;
+        return large_mem_acquire(&multipool->large, size);
     }
     struct MemPool* pool = multipool->pools[index];
 
     return pool_mem_acquire(pool);
 }
 
+/**
+ * @brief Pre-allocates memory blocks of a given size in a multipool setup
+ *
+ * @param multipool the multipool to be used
+ * @param size size of the memory blocks, rounded up the same way as in multipool_mem_acquire
+ * @param count minimum number of blocks to add to the pool
+ * @return true if all blocks were allocated, false if the size is too large or the memory cannot be allocated
+ */
+bool multipool_reserve(struct MultiPool* multipool, uint32_t size, uint32_t count) {
+    assert(multipool != NULL);
+
+    uint32_t index = find_multipool_index_for_size(size);
+    if (index >= MULTIPOOL_ENTRY_COUNT) {
+        return false;
+    }
+
+    return pool_mem_reserve(multipool->pools[index], count);
+}
+
+/**
+ * @brief Takes a snapshot of the usage statistics of every pool in a multipool, see pool_get_stats
+ *
+ * @param multipool the multipool
+ * @param stats array of MULTIPOOL_ENTRY_COUNT entries, ordered by increasing block size, set to the statistics of each pool
+ */
+void multipool_get_stats(struct MultiPool* multipool, struct MemPoolStats* stats) {
+    assert(multipool != NULL);
+
+    for(uint32_t i = 0 ; i < MULTIPOOL_ENTRY_COUNT ; i++) {
+        pool_get_stats(multipool->pools[i], &stats[i]);
+    }
+}
+
+/**
+ * @brief Releases the memory of blocks in the free list of every pool in a multipool to the system.
+ * Cached large blocks are unmapped the same way, keeping up to keep_bytes of them
+ *
+ * @param multipool the multipool to be trimmed
+ * @param keep_bytes amount of memory to keep in each pool, blocks returned most recently are kept first
+ * @return number of bytes released to the system
+ */
+size_t multipool_trim(struct MultiPool* multipool, size_t keep_bytes) {
+    assert(multipool != NULL);
+
+    size_t released_bytes = 0;
+    for(uint32_t i = 0 ; i < MULTIPOOL_ENTRY_COUNT ; i++) {
+        released_bytes += pool_mem_trim(multipool->pools[i], keep_bytes, keep_bytes, 0);
+    }
+    released_bytes += large_cache_trim(&multipool->large, keep_bytes);
+    return released_bytes;
+}
+
+/**
+ * @brief Sets the background trim watermarks for the pool holding blocks of a given size.
+ * When the untrimmed memory in the pool free list exceeds the high watermark, idle blocks are trimmed until the low watermark is reached
+ *
+ * @param multipool the multipool to be configured
+ * @param size size of the blocks, rounded up the same way as in multipool_mem_acquire
+ * @param high_watermark trigger amount of memory in bytes, zero disables background trimming for the pool
+ * @param low_watermark amount of memory in bytes kept after trimming
+ * @return false if the size is too large
+ */
+bool multipool_set_trim_watermarks(struct MultiPool* multipool, uint32_t size, size_t high_watermark, size_t low_watermark) {
+    assert(multipool != NULL);
+
+    uint32_t index = find_multipool_index_for_size(size);
+    if (index >= MULTIPOOL_ENTRY_COUNT) {
+        return false;
+    }
+
+    __atomic_store_n(&multipool->trim_low_watermarks[index], low_watermark, __ATOMIC_RELAXED);
+    __atomic_store_n(&multipool->trim_high_watermarks[index], high_watermark, __ATOMIC_RELAXED);
+    return true;
+}
+
+/**
+ * @brief Sets the same background trim watermarks for all pools in a multipool, see multipool_set_trim_watermarks
+ *
+ * @param multipool the multipool to be configured
+ * @param high_watermark trigger amount of memory in bytes, zero disables background trimming
+ * @param low_watermark amount of memory in bytes kept in each pool after trimming
+ */
+void multipool_set_all_trim_watermarks(struct MultiPool* multipool, size_t high_watermark, size_t low_watermark) {
+    assert(multipool != NULL);
+
+    for(uint32_t i = 0 ; i < MULTIPOOL_ENTRY_COUNT ; i++) {
+        __atomic_store_n(&multipool->trim_low_watermarks[i], low_watermark, __ATOMIC_RELAXED);
+        __atomic_store_n(&multipool->trim_high_watermarks[i], high_watermark, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Runs one pass of the background trim policy: advances the epoch and trims the pools above their high watermark
+ *
+ * @param multipool the multipool to be trimmed
+ * @return number of bytes released to the system
+ */
+size_t multipool_trim_tick(struct MultiPool* multipool) {
+    assert(multipool != NULL);
+
+    size_t released_bytes = 0;
+    for(uint32_t i = 0 ; i < MULTIPOOL_ENTRY_COUNT ; i++) {
+        struct MemPool* pool = multipool->pools[i];
+        pool_advance_epoch(pool);
+
+        size_t high_watermark = __atomic_load_n(&multipool->trim_high_watermarks[i], __ATOMIC_RELAXED);
+        if (high_watermark > 0) {
+            size_t low_watermark = __atomic_load_n(&multipool->trim_low_watermarks[i], __ATOMIC_RELAXED);
+            uint32_t min_idle_epochs = __atomic_load_n(&multipool->trim_min_idle_epochs, __ATOMIC_RELAXED);
+            released_bytes += pool_mem_trim(pool, high_watermark, low_watermark, min_idle_epochs);
+        }
+    }
+    return released_bytes;
+}
+
+static void* multipool_trimmer_run(void* arg) {
+    struct MultiPool* multipool = arg;
+
+    pthread_mutex_lock(&multipool->trimmer_lock);
+    while (multipool->trimmer_running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += (time_t)(multipool->trim_interval_ms / 1000);
+        deadline.tv_nsec += (long)(multipool->trim_interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        if (pthread_cond_timedwait(&multipool->trimmer_stop, &multipool->trimmer_lock, &deadline) != 0 && multipool->trimmer_running) {
+            multipool_trim_tick(multipool);
+        }
+    }
+    pthread_mutex_unlock(&multipool->trimmer_lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Starts a background thread applying the trim policy of a multipool every interval_ms milliseconds.
+ * Memory idle for at least min_idle_ticks passes is trimmed from pools above their high watermark, see multipool_set_trim_watermarks
+ *
+ * @param multipool the multipool to be trimmed
+ * @param interval_ms time between passes, must be greater than zero
+ * @param min_idle_ticks number of passes a block must stay in the pool before it can be trimmed
+ * @return true if the thread was started or was already running
+ */
+bool multipool_start_trimmer(struct MultiPool* multipool, uint32_t interval_ms, uint32_t min_idle_ticks) {
+    assert(multipool != NULL);
+    assert(interval_ms > 0);
+
+    pthread_mutex_lock(&multipool->trimmer_lock);
+    multipool->trim_interval_ms = interval_ms;
+    __atomic_store_n(&multipool->trim_min_idle_epochs, min_idle_ticks, __ATOMIC_RELAXED);
+    if (multipool->trimmer_running) {
+        pthread_mutex_unlock(&multipool->trimmer_lock);
+        return true;
+    }
+
+    multipool->trimmer_running = true;
+    if (pthread_create(&multipool->trimmer, NULL, multipool_trimmer_run, multipool) != 0) {
+        multipool->trimmer_running = false;
+    }
+    bool running = multipool->trimmer_running;
+    pthread_mutex_unlock(&multipool->trimmer_lock);
+
+    return running;
+}
+
+/**
+ * @brief Stops the background trim thread of a multipool, if running, and waits for it to finish
+ *
+ * @param multipool the multipool
+ */
+void multipool_stop_trimmer(struct MultiPool* multipool) {
+    assert(multipool != NULL);
+
+    pthread_mutex_lock(&multipool->trimmer_lock);
+    if (!multipool->trimmer_running) {
+        pthread_mutex_unlock(&multipool->trimmer_lock);
+        return;
+    }
+    multipool->trimmer_running = false;
+    pthread_cond_signal(&multipool->trimmer_stop);
+    pthread_mutex_unlock(&multipool->trimmer_lock);
+
+    pthread_join(multipool->trimmer, NULL);
+}
+
 /**
  * @brief Global multipool support
  *
@@ -352,6 +1727,13 @@ struct MultiPool* _global_multipool = NULL; //NOLINT(bugprone-reserved-identifie
  */
 void global_multipool_create(void) {
     _global_multipool = multipool_create();
+
+    if (_global_multipool != NULL) {
+        // the global multipool lives for the entire process so it can use thread caches
+        for(uint32_t i = 0 ; i < MULTIPOOL_ENTRY_COUNT ; i++) {
+            pool_enable_thread_cache(_global_multipool->pools[i]);
+        }
+    }
 }
 
 /**
@@ -365,6 +1747,17 @@ void* global_multipool_mem_acquire(uint32_t size) {
     return multipool_mem_acquire(_global_multipool, size);
 }
 
+/**
+ * @brief Releases the memory of blocks in the global multipool to the system, see multipool_trim
+ *
+ * @param keep_bytes amount of memory to keep in each pool
+ * @return number of bytes released to the system
+ */
+size_t global_multipool_trim(size_t keep_bytes) {
+    assert(_global_multipool != NULL);
+    return multipool_trim(_global_multipool, keep_bytes);
+}
+
 /**
  * @brief Destroys the global multipool releasing all memory stored in the pool
  *
@@ -2,12 +2,23 @@
 #include "dyn_mem_pool.h"
 #include "gozlib_interop.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 #include <zconf.h>
 #include <zlib.h>
 
+#ifdef GOZLIB_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
 #ifdef __GNUC__
 #define LIKELY(x) __builtin_expect(!!(x), 1)
 #define UNLIKELY(x) __builtin_expect(!!(x), 0)
@@ -27,11 +38,21 @@ __attribute__((constructor)) void create_mem_pools(void) {
   global_multipool_create();
 
   _zstreamstate_pool = alloc_mem_pool(sizeof(ZStreamState));
-  _z_stream_pool = alloc_mem_pool(sizeof(z_stream));
+  _z_stream_pool = alloc_mem_pool(sizeof(GoZLibContext));
   _gozlib_transformer_pool = alloc_mem_pool(sizeof(GoZLibTransformer));
+
+  pool_enable_thread_cache(_zstreamstate_pool);
+  pool_enable_thread_cache(_z_stream_pool);
+  pool_enable_thread_cache(_gozlib_transformer_pool);
 }
 
+static void free_zcontext_pools(void);
+static void free_libdeflate_pools(void);
+
 __attribute__((destructor)) void free_mem_pools(void) {
+  // pooled contexts hold zlib state allocated from the global multipool so they go first
+  free_zcontext_pools();
+  free_libdeflate_pools();
   global_multipool_free();
 
   free_mem_pool(_zstreamstate_pool);
@@ -39,346 +60,2472 @@ __attribute__((destructor)) void free_mem_pools(void) {
   free_mem_pool(_gozlib_transformer_pool);
 }
 
-void *pool_alloc(size_t size) {
-  return global_multipool_mem_acquire((uint32_t)size);
+/*
+  instrumentation
+  Counters are only updated while enabled, so the disabled cost is one relaxed load per call. Time is taken from the
+  monotonic clock in nanoseconds, which unlike a cycle counter is comparable across cores and frequency changes.
+  Each stream or transformer counts into its own stats, the deltas are then added to the global ones
+*/
+static bool _stats_enabled = false;
+// indexed by deflating
+static GoZLibStats _global_stats[2] = {{0}, {0}};
+
+void set_stats_enabled(bool enabled) {
+  __atomic_store_n(&_stats_enabled, enabled, __ATOMIC_RELAXED);
 }
 
-void pool_free(void *data) {
-  pool_mem_return(data);
+bool get_stats_enabled(void) {
+  return __atomic_load_n(&_stats_enabled, __ATOMIC_RELAXED);
 }
 
-static inline void *zlib_custom_alloc(__attribute__((unused)) void *q, unsigned int nmembers, unsigned int msize) {
-  return pool_alloc(nmembers * msize);
+static inline bool stats_enabled(void) {
+  return UNLIKELY(__atomic_load_n(&_stats_enabled, __ATOMIC_RELAXED));
 }
 
-static inline void zlib_custom_free(__attribute__((unused)) void *q, void *p) {
-  pool_free(p);
+static inline uint64_t stats_clock(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000U + (uint64_t)now.tv_nsec;
 }
 
-static inline void init_default_zstream(z_streamp zs) {
-  zs->zalloc = zlib_custom_alloc;
-  zs->zfree = zlib_custom_free;
-  zs->opaque = NULL;
+static inline void count_zlib_call(GoZLibStats *stats, uint64_t bytes_in, uint64_t bytes_out, uint64_t start) {
+  stats->zlib_calls++;
+  stats->bytes_in += bytes_in;
+  stats->bytes_out += bytes_out;
+  stats->zlib_ns += stats_clock() - start;
 }
 
-static inline z_stream make_zstream(void) {
-  z_stream zs;
-  init_default_zstream(&zs);
+static void add_global_stats(bool deflating, const GoZLibStats *stats) {
+  GoZLibStats *global = &_global_stats[deflating ? 1 : 0];
+  __atomic_fetch_add(&global->zlib_calls, stats->zlib_calls, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&global->bytes_in, stats->bytes_in, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&global->bytes_out, stats->bytes_out, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&global->zlib_ns, stats->zlib_ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&global->handler_calls, stats->handler_calls, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&global->handler_ns, stats->handler_ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&global->pool_misses, stats->pool_misses, __ATOMIC_RELAXED);
+}
 
-  return zs;
+static inline void count_global_zlib_call(bool deflating, uint64_t bytes_in, uint64_t bytes_out, uint64_t start) {
+  GoZLibStats stats = {0};
+  count_zlib_call(&stats, bytes_in, bytes_out, start);
+  add_global_stats(deflating, &stats);
 }
 
-ZStreamState *pool_acquire_zstream_state(void) {
-  return pool_mem_acquire(_zstreamstate_pool);
+static inline void count_pool_miss(bool deflating) {
+  if (stats_enabled()) {
+    __atomic_fetch_add(&_global_stats[deflating ? 1 : 0].pool_misses, 1, __ATOMIC_RELAXED);
+  }
 }
 
-void pool_release_zstream_state(ZStreamState *state) {
-  pool_mem_return(state);
+void get_global_stats(bool deflating, GoZLibStats *stats) {
+  const GoZLibStats *global = &_global_stats[deflating ? 1 : 0];
+  stats->zlib_calls = __atomic_load_n(&global->zlib_calls, __ATOMIC_RELAXED);
+  stats->bytes_in = __atomic_load_n(&global->bytes_in, __ATOMIC_RELAXED);
+  stats->bytes_out = __atomic_load_n(&global->bytes_out, __ATOMIC_RELAXED);
+  stats->zlib_ns = __atomic_load_n(&global->zlib_ns, __ATOMIC_RELAXED);
+  stats->handler_calls = __atomic_load_n(&global->handler_calls, __ATOMIC_RELAXED);
+  stats->handler_ns = __atomic_load_n(&global->handler_ns, __ATOMIC_RELAXED);
+  stats->pool_misses = __atomic_load_n(&global->pool_misses, __ATOMIC_RELAXED);
 }
 
-static inline uLong compress_buffer(int level, void *restrict input, uInt input_len, void *restrict output, uInt output_len, int window_bits, int *error_code) {
-  z_stream zs = make_zstream();
-  int init_res = deflateInit2(&zs, level, Z_DEFLATED, window_bits, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+// calls a stream data handler, timing it into the stream stats when instrumented
+static inline uInt call_stream_handler(ZStreamState *state, StreamDataHandler handler, void *restrict buffer, uInt length, bool instrumented) {
+  if (LIKELY(!instrumented)) {
+    return handler(state, buffer, length);
+  }
 
-  if (init_res != Z_OK) {
-    *error_code = init_res;
-    return 0;
+  const uint64_t start = stats_clock();
+  const uInt handled = handler(state, buffer, length);
+  state->stats.handler_calls++;
+  state->stats.handler_ns += stats_clock() - start;
+  return handled;
+}
+
+void *pool_alloc(size_t size) {
+  return global_multipool_mem_acquire((uint32_t)size);
+}
+
+void pool_free(void *data) {
+  pool_mem_return(data);
+}
+
+static inline bool pool_alloc_stream_buffers(void **input_buf, uInt work_input_buffer_cap, void **output_buf, uInt work_output_buffer_cap) {
+  *input_buf = pool_alloc((size_t)work_input_buffer_cap);
+  *output_buf = pool_alloc((size_t)work_output_buffer_cap);
+  if (LIKELY(*input_buf != NULL && *output_buf != NULL)) {
+    return true;
+  }
+
+  if (*input_buf != NULL) {
+    pool_free(*input_buf);
+  }
+  if (*output_buf != NULL) {
+    pool_free(*output_buf);
   }
+  return false;
+}
 
-  zs.next_in = input;
-  zs.avail_in = input_len;
-  zs.next_out = output;
-  zs.avail_out = output_len;
+/*
+  zlib allocates its internal state in a handful of calls with sizes that only depend on the window bits and memory level.
+  The total requested by a context is learned per (deflating, window bits, memory level) and later contexts allocate it
+  upfront as one contiguous arena, carving each zlib allocation from it. This avoids rounding each allocation up to a
+  multipool size class and keeps the state of a stream together in memory. Allocations that don't fit, for instance while
+  the size is still being learned, fall back to the multipool.
+*/
+#define ZCONTEXT_ARENA_ALIGNMENT 16
+#define ZCONTEXT_ARENA_MIN_WINDOW_BITS 8
+
+uint32_t _zcontext_arena_sizes[2][MAX_WBITS + 1][MAX_MEM_LEVEL + 1]; // NOLINT
+
+static inline uint32_t *find_learned_arena_size(bool deflating, int window_bits, int mem_level) {
+  // raw, zlib, gzip and automatic header detection differ only in the window bits high bits or sign
+  const int bits = window_bits < 0 ? -window_bits : window_bits & MAX_WBITS;
+  if (bits < ZCONTEXT_ARENA_MIN_WINDOW_BITS || bits > MAX_WBITS || mem_level < 0 || mem_level > MAX_MEM_LEVEL) {
+    return NULL;
+  }
+  return &_zcontext_arena_sizes[deflating ? 1 : 0][bits][mem_level];
+}
 
-  const int def_code = deflate(&zs, Z_FINISH);
+static inline void learn_arena_size(GoZLibContext *context) {
+  if (context->learned_arena_size == NULL || context->requested_size > UINT32_MAX) {
+    return;
+  }
 
-  uLong out_len = zs.total_out;
-  if (def_code != Z_STREAM_END) {
-    *error_code = def_code;
-    // the output buffer should be large enough
-    if (def_code == Z_OK) {
-      *error_code = Z_MEM_ERROR;
+  uint32_t learned = __atomic_load_n(context->learned_arena_size, __ATOMIC_RELAXED);
+  while (learned < context->requested_size) {
+    if (__atomic_compare_exchange_n(context->learned_arena_size, &learned, (uint32_t)context->requested_size, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      break;
     }
-    out_len = 0;
   }
+}
 
-  deflateEnd(&zs);
+static inline void *zlib_custom_alloc(void *q, unsigned int nmembers, unsigned int msize) {
+  GoZLibContext *context = q;
+  const size_t size = (size_t)nmembers * msize;
+  const size_t aligned_size = (size + ZCONTEXT_ARENA_ALIGNMENT - 1) & ~((size_t)ZCONTEXT_ARENA_ALIGNMENT - 1);
+  context->requested_size += aligned_size;
 
-  return out_len;
+  if (LIKELY(context->arena_used + aligned_size <= context->arena_size)) {
+    void *data = context->arena + context->arena_used;
+    context->arena_used += aligned_size;
+    return data;
+  }
+
+  return pool_alloc(size);
 }
 
-uLong zlib_compress_buffer(int level, void *restrict input, uInt input_len, void *restrict output, uInt output_len, int *error_code) {
-  return compress_buffer(level, input, input_len, output, output_len, MAX_WBITS, error_code);
+static inline void zlib_custom_free(void *q, void *p) {
+  GoZLibContext *context = q;
+  // arena allocations are released with the arena when the context is ended
+  if (LIKELY((char *)p >= context->arena && (char *)p < context->arena + context->arena_size)) {
+    return;
+  }
+  pool_free(p);
 }
 
-uLong gzip_compress_buffer(int level, void *restrict input, uInt input_len, void *restrict output, uInt output_len, int *restrict error_code) {
-  return compress_buffer(level, input, input_len, output, output_len, COMPRESS_GZIP_WINDOW_BITS, error_code);
+static inline void init_context_zstream(GoZLibContext *context, bool deflating, int window_bits, int mem_level) {
+  z_streamp zs = &context->zs;
+  zs->zalloc = zlib_custom_alloc;
+  zs->zfree = zlib_custom_free;
+  zs->opaque = context;
+
+  context->arena = NULL;
+  context->arena_size = 0;
+  context->arena_used = 0;
+  context->requested_size = 0;
+  context->learned_arena_size = find_learned_arena_size(deflating, window_bits, mem_level);
+
+  if (LIKELY(context->learned_arena_size != NULL)) {
+    const uint32_t arena_size = __atomic_load_n(context->learned_arena_size, __ATOMIC_RELAXED);
+    if (arena_size > 0) {
+      // a failed allocation is not an error, zlib allocations will come from the multipool
+      context->arena = malloc(arena_size);
+      context->arena_size = context->arena == NULL ? 0 : arena_size;
+    }
+  }
 }
 
-uLong uncompress_buffer_any(void *restrict input, uInt input_len, void *restrict output, uInt output_len, int *restrict error_code) {
-  z_stream zs = make_zstream();
-  int init_res = inflateInit2(&zs, UNCOMPRESS_ANY_WINDOW_BITS);
+ZStreamState *pool_acquire_zstream_state(void) {
+  return pool_mem_acquire(_zstreamstate_pool);
+}
 
-  if (init_res != Z_OK) {
-    *error_code = init_res;
-    return 0;
-  }
+void pool_release_zstream_state(ZStreamState *state) {
+  pool_mem_return(state);
+}
 
-  zs.next_in = input;
-  zs.avail_in = input_len;
-  zs.next_out = output;
-  zs.avail_out = output_len;
+// pooled deflate and inflate contexts
 
-  const int inf_code = inflate(&zs, Z_FINISH);
+/*
+  Contexts are kept in pools keyed by the parameters used to initialize them. The pools are stored in a small open addressing table
+  so the key lookup doesn't need locking. Contexts with parameters that can't be keyed, or when the table is full, come from _z_stream_pool
+  and are initialized and ended on every use.
+*/
+#define ZCONTEXT_POOL_TABLE_SIZE 64
 
-  uLong out_len = zs.total_out;
-  if (UNLIKELY(inf_code != Z_STREAM_END)) {
-    *error_code = inf_code;
-    // the output buffer should be large enough
-    if (inf_code == Z_OK) {
-      *error_code = Z_MEM_ERROR;
-    }
+typedef struct {
+  uint32_t key;
+  struct MemPool *pool;
+} ZContextPoolEntry;
 
-    // if the input data is not valid, there's not use in hinting the caller about how much we compressed
-    if (inf_code != Z_DATA_ERROR) {
-      out_len = zs.avail_in;
-    }
+ZContextPoolEntry *_zcontext_pools[ZCONTEXT_POOL_TABLE_SIZE];
+
+static inline bool make_zcontext_key(bool deflating, int level, int window_bits, int mem_level, int strategy, uint32_t *key) {
+  if (level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION || window_bits < -63 || window_bits > 63 || mem_level < 0 || mem_level > 15 || strategy < 0 || strategy > 7) {
+    return false;
   }
 
-  inflateEnd(&zs);
-  return out_len;
+  // window bits are offset so that negative (raw deflate) values fit in the key, which also guarantees the key is never zero
+  *key = (deflating ? 1U : 0U) << 24 | (uint32_t)(level + 1) << 16 | (uint32_t)(window_bits + 64) << 8 | (uint32_t)mem_level << 4 | (uint32_t)strategy;
+  return true;
 }
 
-int compress_to_outstream(ZStreamState *state, z_streamp zs, int flush, StreamDataHandler output_handler, void *restrict output_buf, uInt output_len) {
-  while (true) {
-    zs->avail_out = output_len;
-    zs->next_out = output_buf;
-    int def_code = deflate(zs, flush);
+static struct MemPool *find_zcontext_pool(uint32_t key) {
+  const uint32_t start_slot = (key * 2654435761U) % ZCONTEXT_POOL_TABLE_SIZE;
 
-    if (def_code == Z_STREAM_ERROR) {
-      return def_code;
-    }
+  for (uint32_t probe = 0; probe < ZCONTEXT_POOL_TABLE_SIZE; probe++) {
+    ZContextPoolEntry **slot = &_zcontext_pools[(start_slot + probe) % ZCONTEXT_POOL_TABLE_SIZE];
+    ZContextPoolEntry *entry = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
 
-    uInt outstream_len = output_len - zs->avail_out;
+    if (UNLIKELY(entry == NULL)) {
+      ZContextPoolEntry *new_entry = malloc(sizeof(ZContextPoolEntry));
+      if (new_entry == NULL) {
+        return NULL;
+      }
 
-    if (outstream_len > 0) {
-      if (UNLIKELY(output_handler(state, output_buf, outstream_len) == 0)) {
-        return GOZLIB_STREAM_OUTPUT_WRITE_ERROR;
+      new_entry->key = key;
+      new_entry->pool = alloc_mem_pool(sizeof(GoZLibContext));
+      if (new_entry->pool == NULL) {
+        free(new_entry);
+        return NULL;
+      }
+      pool_enable_thread_cache(new_entry->pool);
+
+      if (__atomic_compare_exchange_n(slot, &entry, new_entry, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return new_entry->pool;
       }
+
+      // another thread took the slot first, entry now points to what it stored
+      free_mem_pool(new_entry->pool);
+      free(new_entry);
     }
 
-    // there's room in the buffer but it's not time to flush it yet
-    if (zs->avail_out > 0) {
-      return def_code;
+    if (entry->key == key) {
+      return entry->pool;
     }
   }
-}
 
-static inline uLong compress_stream(ZStreamState *state, int level, int window_bits, StreamDataHandler input_handler, StreamDataHandler output_handler, uInt work_input_buffer_cap,
-                                    uInt work_output_buffer_cap, int *error_code) {
-  z_stream zs = make_zstream();
+  return NULL;
+}
 
-  int init_code = deflateInit2(&zs, level, Z_DEFLATED, window_bits, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
-  if (init_code != Z_OK) {
-    *error_code = init_code;
-    return 0;
+static inline void end_zlib_context(GoZLibContext *context) {
+  if (context->deflating) {
+    deflateEnd(&context->zs);
+  } else {
+    inflateEnd(&context->zs);
   }
 
-  void *input_buf = pool_alloc((size_t)work_input_buffer_cap);
-  void *output_buf = pool_alloc((size_t)work_output_buffer_cap);
-
-  bool do_compress = true;
+  free(context->arena);
+  context->arena = NULL;
+  context->arena_size = 0;
+}
 
-  while (do_compress) {
-    zs.avail_in = input_handler(state, input_buf, work_input_buffer_cap);
-    zs.next_in = input_buf;
+// sets the context dictionary on a newly initialized or reset stream
+static inline int prime_zlib_context(GoZLibContext *context) {
+  const GoZLibDictionary *dictionary = context->dictionary;
+  if (LIKELY(dictionary == NULL)) {
+    return Z_OK;
+  }
 
-    do_compress = zs.avail_in > 0;
-    int flush = do_compress ? Z_NO_FLUSH : Z_FINISH;
-    int comp_code = compress_to_outstream(state, &zs, flush, output_handler, output_buf, work_output_buffer_cap);
+  if (context->deflating) {
+    return deflateSetDictionary(&context->zs, dictionary->data, dictionary->length);
+  }
 
-    if (comp_code < Z_OK) {
-      do_compress = false;
-      *error_code = comp_code;
-    }
+  // zlib streams ask for the dictionary after reading its id from the header, raw streams need it upfront
+  if (dictionary->window_bits < 0) {
+    return inflateSetDictionary(&context->zs, dictionary->data, dictionary->length);
   }
+  return Z_OK;
+}
 
-  uLong compressed_len = zs.total_out;
-  deflateEnd(&zs);
+static inline int init_zlib_context(GoZLibContext *context, bool deflating, int level, int window_bits, int mem_level, int strategy, GoZLibDictionary *dictionary) {
+  init_context_zstream(context, deflating, window_bits, mem_level);
+  context->deflating = deflating;
+  context->dictionary = dictionary;
+  context->used = false;
 
-  pool_free(input_buf);
-  pool_free(output_buf);
+  int init_code = deflating ? deflateInit2(&context->zs, level, Z_DEFLATED, window_bits, mem_level, strategy) : inflateInit2(&context->zs, window_bits);
+  if (UNLIKELY(init_code != Z_OK)) {
+    return init_code;
+  }
 
-  return compressed_len;
-}
+  // deflate allocates all its state on init
+  learn_arena_size(context);
 
-uLong zlib_compress_stream(ZStreamState *state, int level, StreamDataHandler input_handler, StreamDataHandler output_handler, uInt work_input_buffer_cap, uInt work_output_buffer_cap,
-                           int *error_code) {
-  return compress_stream(state, level, MAX_WBITS, input_handler, output_handler, work_input_buffer_cap, work_output_buffer_cap, error_code);
+  init_code = prime_zlib_context(context);
+  if (UNLIKELY(init_code != Z_OK)) {
+    end_zlib_context(context);
+  }
+  return init_code;
 }
 
-uLong gzip_compress_stream(ZStreamState *state, int level, StreamDataHandler input_handler, StreamDataHandler output_handler, uInt work_input_buffer_cap, uInt work_output_buffer_cap,
-                           int *error_code) {
-  return compress_stream(state, level, COMPRESS_GZIP_WINDOW_BITS, input_handler, output_handler, work_input_buffer_cap, work_output_buffer_cap, error_code);
+static inline bool zlib_context_initialized(GoZLibContext *context) {
+  // pool blocks that were never used are zero filled
+  return context->zs.state != Z_NULL;
 }
 
-static inline bool is_inflate_result_fatal(int inf_code) {
-  return inf_code == Z_DATA_ERROR || inf_code == Z_STREAM_ERROR || inf_code == Z_MEM_ERROR || inf_code == Z_NEED_DICT;
+// marks the context as used and returns its stream, to be called before the stream is driven
+static inline z_streamp use_zlib_context(GoZLibContext *context) {
+  context->used = true;
+  return &context->zs;
 }
 
-int uncompress_to_outstream_step(ZStreamState *state, z_streamp zs, StreamDataHandler output_handler, void *restrict output_buf, uInt output_len) {
-  zs->avail_out = output_len;
-  zs->next_out = output_buf;
-  int inf_code = inflate(zs, Z_NO_FLUSH);
+static inline int reset_zlib_context(GoZLibContext *context) {
+  // a context that wasn't used is still in its initial state
+  if (!context->used) {
+    return Z_OK;
+  }
 
-  if (UNLIKELY(is_inflate_result_fatal(inf_code))) {
-    if (inf_code == Z_NEED_DICT) { // consider the need for dictionary an error too
-      return Z_DATA_ERROR;
-    }
-    return inf_code;
+  int reset_code = context->deflating ? deflateReset(&context->zs) : inflateReset(&context->zs);
+  if (UNLIKELY(reset_code != Z_OK)) {
+    return reset_code;
   }
 
-  uInt outstream_len = output_len - zs->avail_out;
+  // re-priming hashes the dictionary again, which happens once per use when the context is released
+  reset_code = prime_zlib_context(context);
+  if (LIKELY(reset_code == Z_OK)) {
+    context->used = false;
+  }
+  return reset_code;
+}
 
-  if (outstream_len > 0) {
-    if (UNLIKELY(output_handler(state, output_buf, outstream_len) == 0)) {
-      return GOZLIB_STREAM_OUTPUT_WRITE_ERROR;
+static GoZLibContext *acquire_pooled_zlib_context(struct MemPool *pool, bool deflating, int level, int window_bits, int mem_level, int strategy, GoZLibDictionary *dictionary,
+                                                 int *error_code) {
+  GoZLibContext *context = NULL;
+  const bool keyed = pool != NULL;
+  if (LIKELY(keyed)) {
+    context = pool_mem_try_acquire(pool);
+    if (LIKELY(context != NULL && zlib_context_initialized(context))) {
+      return context;
+    }
+    if (context == NULL) {
+      context = pool_mem_try_alloc_data(pool);
     }
+  } else {
+    context = pool_mem_acquire(_z_stream_pool);
   }
 
-  // there's room in the buffer but it's not end of the stream yet
-  if (zs->avail_out > 0) {
-    return Z_OK;
+  if (UNLIKELY(context == NULL)) {
+    *error_code = Z_MEM_ERROR;
+    return NULL;
   }
 
-  return GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA;
+  context->keyed = keyed;
+  count_pool_miss(deflating);
+  int init_code = init_zlib_context(context, deflating, level, window_bits, mem_level, strategy, dictionary);
+  if (UNLIKELY(init_code != Z_OK)) {
+    *error_code = init_code;
+    // a failed init leaves the stream state unset, keyed pools initialize such blocks again when acquired
+    pool_mem_return(context);
+    return NULL;
+  }
+
+  return context;
 }
 
-int uncompress_to_outstream(ZStreamState *state, z_streamp zs, StreamDataHandler output_handler, void *restrict output_buf, uInt output_len) {
-  int output_code = GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA;
-  while (output_code == GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA) {
-    output_code = uncompress_to_outstream_step(state, zs, output_handler, output_buf, output_len);
+static GoZLibContext *acquire_zlib_context(bool deflating, int level, int window_bits, int mem_level, int strategy, int *error_code) {
+  uint32_t key = 0;
+  struct MemPool *pool = NULL;
+
+  if (LIKELY(make_zcontext_key(deflating, level, window_bits, mem_level, strategy, &key))) {
+    pool = find_zcontext_pool(key);
   }
-  return output_code;
+
+  return acquire_pooled_zlib_context(pool, deflating, level, window_bits, mem_level, strategy, NULL, error_code);
 }
 
-uLong uncompress_stream_any(ZStreamState *state, StreamDataHandler input_handler, StreamDataHandler output_handler, uInt work_input_buffer_cap, uInt work_output_buffer_cap, int *error_code) {
-  z_stream zs = make_zstream();
+static void end_pooled_zlib_contexts(struct MemPool *pool) {
+  // contexts cached by other threads are ended too
+  pool_flush_thread_caches(pool);
 
-  int init_code = inflateInit2(&zs, UNCOMPRESS_ANY_WINDOW_BITS);
-  if (init_code != Z_OK) {
-    *error_code = init_code;
-    return 0;
+  GoZLibContext *context = NULL;
+  while ((context = pool_mem_try_acquire(pool)) != NULL) {
+    if (zlib_context_initialized(context)) {
+      end_zlib_context(context);
+    }
   }
+}
 
-  void *input_buf = pool_alloc((size_t)work_input_buffer_cap);
-  void *output_buf = pool_alloc((size_t)work_output_buffer_cap);
+static void free_zcontext_pools(void) {
+  for (uint32_t i = 0; i < ZCONTEXT_POOL_TABLE_SIZE; i++) {
+    ZContextPoolEntry *entry = _zcontext_pools[i];
+    if (entry == NULL) {
+      continue;
+    }
 
-  zs.avail_in = input_handler(state, input_buf, work_input_buffer_cap);
-  zs.next_in = input_buf;
+    end_pooled_zlib_contexts(entry->pool);
+    free_mem_pool(entry->pool);
+    free(entry);
+    _zcontext_pools[i] = NULL;
+  }
+}
 
-  while (zs.avail_in > 0) {
-    int uncomp_code = uncompress_to_outstream(state, &zs, output_handler, output_buf, work_output_buffer_cap);
+GoZLibContext *acquire_deflate_context(int level, int window_bits, int mem_level, int strategy, int *error_code) {
+  return acquire_zlib_context(true, level, window_bits, mem_level, strategy, error_code);
+}
 
-    if (uncomp_code < Z_OK) {
-      *error_code = uncomp_code;
-      break;
-    }
+GoZLibContext *acquire_inflate_context(int window_bits, int *error_code) {
+  // inflate state doesn't depend on the compression parameters
+  return acquire_zlib_context(false, 0, window_bits, 0, 0, error_code);
+}
 
-    if (uncomp_code == Z_STREAM_END) {
-      break;
-    }
-    zs.avail_in = input_handler(state, input_buf, work_input_buffer_cap);
-    zs.next_in = input_buf;
+// dictionaries
+
+GoZLibDictionary *create_zlib_dictionary(void *data, uInt length, int level, int window_bits, int mem_level, int strategy, int *error_code) {
+  // gzip streams have no way to reference a dictionary
+  if (window_bits > MAX_WBITS || window_bits < -MAX_WBITS || length == 0) {
+    *error_code = Z_STREAM_ERROR;
+    return NULL;
   }
 
-  uLong uncompressed_len = zs.total_out;
-  inflateEnd(&zs);
+  GoZLibDictionary *dictionary = calloc(1, sizeof(GoZLibDictionary));
+  if (UNLIKELY(dictionary == NULL)) {
+    *error_code = Z_MEM_ERROR;
+    return NULL;
+  }
 
-  pool_free(input_buf);
-  pool_free(output_buf);
+  dictionary->data = malloc(length);
+  dictionary->deflate_pool = alloc_mem_pool(sizeof(GoZLibContext));
+  dictionary->inflate_pool = alloc_mem_pool(sizeof(GoZLibContext));
+  if (UNLIKELY(dictionary->data == NULL || dictionary->deflate_pool == NULL || dictionary->inflate_pool == NULL)) {
+    free_zlib_dictionary(dictionary);
+    *error_code = Z_MEM_ERROR;
+    return NULL;
+  }
 
-  return uncompressed_len;
+  memcpy(dictionary->data, data, length);
+  dictionary->length = length;
+  dictionary->level = level;
+  dictionary->window_bits = window_bits;
+  dictionary->mem_level = mem_level;
+  dictionary->strategy = strategy;
+
+  // fail early on invalid parameters, the context is kept in the pool for the next user
+  GoZLibContext *context = acquire_dictionary_deflate_context(dictionary, error_code);
+  if (UNLIKELY(context == NULL)) {
+    free_zlib_dictionary(dictionary);
+    return NULL;
+  }
+  release_zlib_context(context);
+
+  return dictionary;
 }
 
-// transformers
+void free_zlib_dictionary(GoZLibDictionary *dictionary) {
+  if (dictionary->deflate_pool != NULL) {
+    end_pooled_zlib_contexts(dictionary->deflate_pool);
+    free_mem_pool(dictionary->deflate_pool);
+  }
+  if (dictionary->inflate_pool != NULL) {
+    end_pooled_zlib_contexts(dictionary->inflate_pool);
+    free_mem_pool(dictionary->inflate_pool);
+  }
 
-static inline z_streamp pool_alloc_zstream(void) {
-  return pool_mem_acquire(_z_stream_pool);
+  free(dictionary->data);
+  free(dictionary);
 }
 
-static inline GoZLibTransformer *pool_alloc_transformer(uInt work_buffer_cap) {
-  // this should come from a pool
-  GoZLibTransformer *transformer = pool_mem_acquire(_gozlib_transformer_pool);
-  transformer->work_buffer = pool_alloc(work_buffer_cap);
-  transformer->work_buffer_cap = work_buffer_cap;
-  transformer->state = pool_acquire_zstream_state();
-  transformer->zs = pool_alloc_zstream();
-  init_default_zstream(transformer->zs);
+GoZLibContext *acquire_dictionary_deflate_context(GoZLibDictionary *dictionary, int *error_code) {
+  return acquire_pooled_zlib_context(dictionary->deflate_pool, true, dictionary->level, dictionary->window_bits, dictionary->mem_level, dictionary->strategy, dictionary,
+                                     error_code);
+}
 
-  return transformer;
+GoZLibContext *acquire_dictionary_inflate_context(GoZLibDictionary *dictionary, int *error_code) {
+  return acquire_pooled_zlib_context(dictionary->inflate_pool, false, 0, dictionary->window_bits, 0, 0, dictionary, error_code);
 }
 
-static inline void pool_release_zstream(z_streamp zs) {
-  pool_mem_return(zs);
+// concatenated gzip members are uncompressed as a single stream
+static inline bool is_multi_member_window(int window_bits) {
+  return window_bits > MAX_WBITS;
 }
 
-static inline void pool_release_transformer(GoZLibTransformer *transformer) {
-  // this will return the transformer to the pool
-  pool_release_zstream(transformer->zs);
-  pool_release_zstream_state(transformer->state);
-  pool_free(transformer->work_buffer);
+// starts inflating the next member of a gzip stream, the totals keep counting from the previous members
+static inline int inflate_next_member(z_streamp zs) {
+  const uLong total_in = zs->total_in;
+  const uLong total_out = zs->total_out;
+  int reset_code = inflateReset(zs);
+  zs->total_in = total_in;
+  zs->total_out = total_out;
+  return reset_code;
+}
 
-  pool_mem_return(transformer);
+// inflates providing the context dictionary if the stream asks for one
+static inline int inflate_context(GoZLibContext *context, int flush) {
+  z_streamp zs = use_zlib_context(context);
+  int inf_code = inflate(zs, flush);
+
+  if (inf_code == Z_NEED_DICT && context->dictionary != NULL) {
+    // the dictionary id in the stream header doesn't match this dictionary when this fails
+    if (LIKELY(inflateSetDictionary(zs, context->dictionary->data, context->dictionary->length) == Z_OK)) {
+      inf_code = inflate(zs, flush);
+    }
+  }
+
+  // a stream compressed with an unknown dictionary can't be uncompressed
+  if (UNLIKELY(inf_code == Z_NEED_DICT)) {
+    return Z_DATA_ERROR;
+  }
+  return inf_code;
 }
 
-GoZLibTransformer *acquire_gzip_compression_transformer(int level, uInt work_buffer_cap, int *error_code) {
-  GoZLibTransformer *transformer = pool_alloc_transformer(work_buffer_cap);
+void release_zlib_context(GoZLibContext *context) {
+  // inflate only allocates its window on first use
+  learn_arena_size(context);
 
-  int init_code = deflateInit2(transformer->zs, level, Z_DEFLATED, COMPRESS_GZIP_WINDOW_BITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
-  if (init_code != Z_OK) {
-    *error_code = init_code;
+  if (LIKELY(context->keyed)) {
+    if (LIKELY(reset_zlib_context(context) == Z_OK)) {
+      pool_mem_return(context);
+      return;
+    }
+
+    // the ended context is initialized again by the next acquire
+    end_zlib_context(context);
+    pool_mem_return(context);
+    return;
   }
 
-  return transformer;
+  end_zlib_context(context);
+  pool_mem_return(context);
 }
 
-GoZLibTransformer *acquire_zlib_compression_transformer(int level, uInt work_buffer_cap, int *error_code) {
-  GoZLibTransformer *transformer = pool_alloc_transformer(work_buffer_cap);
+uLong context_compress_buffer(GoZLibContext *context, void *restrict input, uInt input_len, void *restrict output, uInt output_len, int *error_code) {
+  int reset_code = reset_zlib_context(context);
+  if (UNLIKELY(reset_code != Z_OK)) {
+    *error_code = reset_code;
+    return 0;
+  }
 
-  int init_code = deflateInit2(transformer->zs, level, Z_DEFLATED, MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
-  if (init_code != Z_OK) {
-    *error_code = init_code;
+  z_streamp zs = use_zlib_context(context);
+
+  zs->next_in = input;
+  zs->avail_in = input_len;
+  zs->next_out = output;
+  zs->avail_out = output_len;
+
+  const bool instrumented = stats_enabled();
+  const uint64_t start = instrumented ? stats_clock() : 0;
+  const int def_code = deflate(zs, Z_FINISH);
+  if (instrumented) {
+    count_global_zlib_call(true, input_len - zs->avail_in, zs->total_out, start);
   }
 
-  return transformer;
+  uLong out_len = zs->total_out;
+  if (def_code != Z_STREAM_END) {
+    *error_code = def_code;
+    // the output buffer should be large enough
+    if (def_code == Z_OK) {
+      *error_code = Z_MEM_ERROR;
+    }
+    out_len = 0;
+  }
+
+  return out_len;
 }
 
-GoZLibTransformer *acquire_uncompression_transformer(uInt work_buffer_cap, int *error_code) {
-  GoZLibTransformer *transformer = pool_alloc_transformer(work_buffer_cap);
-  int init_res = inflateInit2(transformer->zs, UNCOMPRESS_ANY_WINDOW_BITS);
+uLong context_uncompress_buffer(GoZLibContext *context, void *restrict input, uInt input_len, void *restrict output, uInt output_len, int *error_code) {
+  int reset_code = reset_zlib_context(context);
+  if (UNLIKELY(reset_code != Z_OK)) {
+    *error_code = reset_code;
+    return 0;
+  }
+
+  z_streamp zs = use_zlib_context(context);
+
+  zs->next_in = input;
+  zs->avail_in = input_len;
+  zs->next_out = output;
+  zs->avail_out = output_len;
 
-  if (init_res != Z_OK) {
-    *error_code = init_res;
+  const bool instrumented = stats_enabled();
+  const uint64_t start = instrumented ? stats_clock() : 0;
+  const int inf_code = inflate_context(context, Z_FINISH);
+  if (instrumented) {
+    count_global_zlib_call(false, input_len - zs->avail_in, zs->total_out, start);
   }
 
-  return transformer;
+  uLong out_len = zs->total_out;
+  if (UNLIKELY(inf_code != Z_STREAM_END)) {
+    *error_code = inf_code;
+    // the output buffer should be large enough
+    if (inf_code == Z_OK) {
+      *error_code = Z_MEM_ERROR;
+    }
+
+    // if the input data is not valid, there's not use in hinting the caller about how much we compressed
+    if (inf_code != Z_DATA_ERROR) {
+      out_len = zs->avail_in;
+    }
+  }
+
+  return out_len;
 }
 
-void release_compression_transformer(GoZLibTransformer *transformer) {
-  deflateEnd(transformer->zs);
-  pool_release_transformer(transformer);
+/*
+  buffer compression backends
+  Streams and transformers keep their state across calls through the zlib API, which zlib-ng built in compatibility
+  mode provides as a drop in replacement, selected by linking against it instead of zlib. One-shot buffer compression
+  keeps no state, so when built with GOZLIB_LIBDEFLATE it's done by libdeflate, which compresses whole buffers faster
+  than deflate. libdeflate has no window size, memory level or strategy parameters and is only used for the defaults.
+  Its compressors are allocated for a single level and aren't thread safe, so they're pooled per level.
+*/
+static int _buffer_backend = GOZLIB_BUFFER_BACKEND_ZLIB;
+
+#ifdef GOZLIB_LIBDEFLATE
+#define LIBDEFLATE_DEFAULT_LEVEL 6
+
+typedef struct {
+  struct libdeflate_compressor *compressor;
+} LibDeflateCompressor;
+
+static struct MemPool *_libdeflate_pools[Z_BEST_COMPRESSION + 1] = {NULL};
+
+__attribute__((constructor)) static void create_libdeflate_pools(void) {
+  for (int level = 0; level <= Z_BEST_COMPRESSION; level++) {
+    _libdeflate_pools[level] = alloc_mem_pool(sizeof(LibDeflateCompressor));
+  }
+  _buffer_backend = GOZLIB_BUFFER_BACKEND_LIBDEFLATE;
 }
 
-void release_uncompression_transformer(GoZLibTransformer *transformer) {
-  inflateEnd(transformer->zs);
-  pool_release_transformer(transformer);
+static void free_libdeflate_pools(void) {
+  for (int level = 0; level <= Z_BEST_COMPRESSION; level++) {
+    LibDeflateCompressor *holder = NULL;
+    while ((holder = pool_mem_try_acquire(_libdeflate_pools[level])) != NULL) {
+      if (holder->compressor != NULL) {
+        libdeflate_free_compressor(holder->compressor);
+      }
+    }
+    free_mem_pool(_libdeflate_pools[level]);
+    _libdeflate_pools[level] = NULL;
+  }
 }
 
-void reset_compression_transformer(GoZLibTransformer *transformer) {
-  deflateReset(transformer->zs);
+static inline bool libdeflate_supports(int level, int window_bits, int strategy) {
+  const bool default_window = window_bits == MAX_WBITS || window_bits == -MAX_WBITS || window_bits == COMPRESS_GZIP_WINDOW_BITS;
+  return default_window && strategy == Z_DEFAULT_STRATEGY && level >= Z_DEFAULT_COMPRESSION && level <= Z_BEST_COMPRESSION;
 }
 
-void reset_uncompression_transformer(GoZLibTransformer *transformer) {
-  inflateReset(transformer->zs);
+static LibDeflateCompressor *acquire_libdeflate_compressor(int level, int *error_code) {
+  if (level == Z_DEFAULT_COMPRESSION) {
+    level = LIBDEFLATE_DEFAULT_LEVEL;
+  }
+
+  // blocks that were never acquired are zero filled and get their compressor allocated on first use
+  LibDeflateCompressor *holder = pool_mem_acquire(_libdeflate_pools[level]);
+  if (UNLIKELY(holder == NULL)) {
+    *error_code = Z_MEM_ERROR;
+    return NULL;
+  }
+  if (holder->compressor == NULL) {
+    count_pool_miss(true);
+    holder->compressor = libdeflate_alloc_compressor(level);
+    if (UNLIKELY(holder->compressor == NULL)) {
+      pool_mem_return(holder);
+      *error_code = Z_MEM_ERROR;
+      return NULL;
+    }
+  }
+  return holder;
+}
+
+static uLong libdeflate_compress_bound(int level, int window_bits, uLong input_len, int *error_code) {
+  LibDeflateCompressor *holder = acquire_libdeflate_compressor(level, error_code);
+  if (UNLIKELY(holder == NULL)) {
+    return 0;
+  }
+
+  size_t bound = 0;
+  if (window_bits == COMPRESS_GZIP_WINDOW_BITS) {
+    bound = libdeflate_gzip_compress_bound(holder->compressor, input_len);
+  } else if (window_bits == MAX_WBITS) {
+    bound = libdeflate_zlib_compress_bound(holder->compressor, input_len);
+  } else {
+    bound = libdeflate_deflate_compress_bound(holder->compressor, input_len);
+  }
+  pool_mem_return(holder);
+  return bound;
+}
+
+static uLong libdeflate_compress_buffer(int level, int window_bits, void *restrict input, uInt input_len, void *restrict output, uInt output_len, int *error_code) {
+  LibDeflateCompressor *holder = acquire_libdeflate_compressor(level, error_code);
+  if (UNLIKELY(holder == NULL)) {
+    return 0;
+  }
+
+  const bool instrumented = stats_enabled();
+  const uint64_t start = instrumented ? stats_clock() : 0;
+  size_t out_len = 0;
+  if (window_bits == COMPRESS_GZIP_WINDOW_BITS) {
+    out_len = libdeflate_gzip_compress(holder->compressor, input, input_len, output, output_len);
+  } else if (window_bits == MAX_WBITS) {
+    out_len = libdeflate_zlib_compress(holder->compressor, input, input_len, output, output_len);
+  } else {
+    out_len = libdeflate_deflate_compress(holder->compressor, input, input_len, output, output_len);
+  }
+  pool_mem_return(holder);
+  if (instrumented) {
+    count_global_zlib_call(true, out_len > 0 ? input_len : 0, out_len, start);
+  }
+
+  // the output buffer should be large enough, reported the same way as context_compress_buffer
+  if (UNLIKELY(out_len == 0)) {
+    *error_code = Z_MEM_ERROR;
+  }
+  return out_len;
+}
+#else
+static void free_libdeflate_pools(void) {
+}
+#endif
+
+bool set_buffer_backend(int backend) {
+  switch (backend) {
+  case GOZLIB_BUFFER_BACKEND_ZLIB:
+    break;
+#ifdef GOZLIB_LIBDEFLATE
+  case GOZLIB_BUFFER_BACKEND_LIBDEFLATE:
+    break;
+#endif
+  default:
+    return false;
+  }
+
+  __atomic_store_n(&_buffer_backend, backend, __ATOMIC_RELAXED);
+  return true;
+}
+
+int get_buffer_backend(void) {
+  return __atomic_load_n(&_buffer_backend, __ATOMIC_RELAXED);
+}
+
+/*
+  checksums
+  libdeflate computes CRC32 with carry-less multiplication and Adler32 with vector instructions when the CPU supports
+  them, so it's preferred when built in. Otherwise zlib's crc32_z and adler32_z are used, which are SIMD accelerated
+  too when running with zlib-ng. Both libraries start from the same initial values and produce the same checksums.
+*/
+uLong checksum_crc32(uLong crc, const void *data, size_t len) {
+#ifdef GOZLIB_LIBDEFLATE
+  return libdeflate_crc32((uint32_t)crc, data, len);
+#else
+  return crc32_z(crc, data, len);
+#endif
+}
+
+uLong checksum_adler32(uLong adler, const void *data, size_t len) {
+#ifdef GOZLIB_LIBDEFLATE
+  return libdeflate_adler32((uint32_t)adler, data, len);
+#else
+  return adler32_z(adler, data, len);
+#endif
+}
+
+/*
+  stored gzip
+  Data that won't compress is wrapped in a gzip container as a sequence of stored deflate blocks, each one a byte with
+  the final block flag followed by the block length and its one's complement, and then the data itself.
+*/
+#define STORED_BLOCK_MAX_LEN 65535U
+#define STORED_BLOCK_HEADER_LEN 5U
+#define GZIP_HEADER_LEN 10U
+#define GZIP_TRAILER_LEN 8U
+
+uLong gzip_store_bound(uLong input_len) {
+  const uLong blocks = input_len == 0 ? 1 : (input_len + STORED_BLOCK_MAX_LEN - 1) / STORED_BLOCK_MAX_LEN;
+  return GZIP_HEADER_LEN + blocks * STORED_BLOCK_HEADER_LEN + input_len + GZIP_TRAILER_LEN;
+}
+
+static inline unsigned char *put_le32(unsigned char *output, uLong value) {
+  output[0] = (unsigned char)(value & 0xff);
+  output[1] = (unsigned char)((value >> 8) & 0xff);
+  output[2] = (unsigned char)((value >> 16) & 0xff);
+  output[3] = (unsigned char)((value >> 24) & 0xff);
+  return output + 4;
+}
+
+uLong gzip_store_buffer(void *restrict input, uInt input_len, void *restrict output, uInt output_len, int *error_code) {
+  if (UNLIKELY(gzip_store_bound(input_len) > output_len)) {
+    // reported the same way as context_compress_buffer
+    *error_code = Z_MEM_ERROR;
+    return 0;
+  }
+
+  // no modification time, no extra flags and the unix OS code
+  static const unsigned char header[GZIP_HEADER_LEN] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3};
+  unsigned char *out = output;
+  memcpy(out, header, GZIP_HEADER_LEN);
+  out += GZIP_HEADER_LEN;
+
+  const unsigned char *in = input;
+  uInt remaining = input_len;
+  do {
+    const uInt block_len = remaining < STORED_BLOCK_MAX_LEN ? remaining : STORED_BLOCK_MAX_LEN;
+    remaining -= block_len;
+    out[0] = remaining == 0 ? 1 : 0;
+    out[1] = (unsigned char)(block_len & 0xff);
+    out[2] = (unsigned char)(block_len >> 8);
+    out[3] = (unsigned char)(~block_len & 0xff);
+    out[4] = (unsigned char)((~block_len >> 8) & 0xff);
+    memcpy(out + STORED_BLOCK_HEADER_LEN, in, block_len);
+    out += STORED_BLOCK_HEADER_LEN + block_len;
+    in += block_len;
+  } while (remaining > 0);
+
+  out = put_le32(out, checksum_crc32(0, input, input_len));
+  out = put_le32(out, input_len);
+  return (uLong)(out - (unsigned char *)output);
+}
+
+uLong deflate_compress_buffer(int level, int window_bits, int mem_level, int strategy, void *restrict input, uInt input_len, void *restrict output, uInt output_len, int *error_code) {
+#ifdef GOZLIB_LIBDEFLATE
+  if (get_buffer_backend() == GOZLIB_BUFFER_BACKEND_LIBDEFLATE && libdeflate_supports(level, window_bits, strategy)) {
+    return libdeflate_compress_buffer(level, window_bits, input, input_len, output, output_len, error_code);
+  }
+#endif
+
+  GoZLibContext *context = acquire_deflate_context(level, window_bits, mem_level, strategy, error_code);
+  if (UNLIKELY(context == NULL)) {
+    return 0;
+  }
+
+  uLong out_len = context_compress_buffer(context, input, input_len, output, output_len, error_code);
+  release_zlib_context(context);
+
+  return out_len;
+}
+
+uLong context_compress_vector(GoZLibContext *context, const GoZLibSegment *input, uInt input_count, GoZLibSegment *output, uInt output_count, int *error_code) {
+  int reset_code = reset_zlib_context(context);
+  if (UNLIKELY(reset_code != Z_OK)) {
+    *error_code = reset_code;
+    return 0;
+  }
+
+  z_streamp zs = use_zlib_context(context);
+
+  zs->avail_in = 0;
+  zs->avail_out = 0;
+  uInt next_input = 0;
+  uInt next_output = 0;
+  uInt output_cap = 0;
+  uint64_t bytes_in = 0;
+
+  const bool instrumented = stats_enabled();
+  const uint64_t start = instrumented ? stats_clock() : 0;
+  int def_code = Z_OK;
+  for (;;) {
+    // empty segments are skipped, the stream is finished along with the last segment
+    while (zs->avail_in == 0 && next_input < input_count) {
+      zs->next_in = (Bytef *)input[next_input].data; // NOLINT(performance-no-int-to-ptr)
+      zs->avail_in = input[next_input].len;
+      bytes_in += input[next_input].len;
+      next_input++;
+    }
+
+    if (zs->avail_out == 0) {
+      if (next_output == output_count) {
+        def_code = Z_MEM_ERROR;
+        break;
+      }
+      zs->next_out = (Bytef *)output[next_output].data; // NOLINT(performance-no-int-to-ptr)
+      output_cap = output[next_output].len;
+      zs->avail_out = output_cap;
+      next_output++;
+    }
+
+    def_code = deflate(zs, next_input == input_count ? Z_FINISH : Z_NO_FLUSH);
+    output[next_output - 1].len = output_cap - zs->avail_out;
+    if (def_code == Z_STREAM_END || (def_code != Z_OK && def_code != Z_BUF_ERROR)) {
+      break;
+    }
+  }
+
+  if (instrumented) {
+    count_global_zlib_call(true, bytes_in - zs->avail_in, zs->total_out, start);
+  }
+
+  // segments past the last one used are left empty
+  for (uInt i = next_output; i < output_count; i++) {
+    output[i].len = 0;
+  }
+
+  if (def_code != Z_STREAM_END) {
+    // the output segments should be large enough, reported the same way as context_compress_buffer
+    *error_code = def_code == Z_BUF_ERROR ? Z_MEM_ERROR : def_code;
+    return 0;
+  }
+
+  return zs->total_out;
+}
+
+uLong deflate_compress_vector(int level, int window_bits, int mem_level, int strategy, const GoZLibSegment *input, uInt input_count, GoZLibSegment *output, uInt output_count,
+                              int *error_code) {
+  GoZLibContext *context = acquire_deflate_context(level, window_bits, mem_level, strategy, error_code);
+  if (UNLIKELY(context == NULL)) {
+    return 0;
+  }
+
+  uLong out_len = context_compress_vector(context, input, input_count, output, output_count, error_code);
+  release_zlib_context(context);
+
+  return out_len;
+}
+
+uLong deflate_compress_bound(int level, int window_bits, int mem_level, int strategy, uLong input_len, int *error_code) {
+  GoZLibContext *context = acquire_deflate_context(level, window_bits, mem_level, strategy, error_code);
+  if (UNLIKELY(context == NULL)) {
+    return 0;
+  }
+
+  uLong bound = deflateBound(&context->zs, input_len);
+  release_zlib_context(context);
+
+  // adaptive compression stores incompressible gzip inputs, which always fits in deflateBound, checked for safety
+  if (window_bits == COMPRESS_GZIP_WINDOW_BITS && gzip_store_bound(input_len) > bound) {
+    bound = gzip_store_bound(input_len);
+  }
+
+#ifdef GOZLIB_LIBDEFLATE
+  if (get_buffer_backend() == GOZLIB_BUFFER_BACKEND_LIBDEFLATE && libdeflate_supports(level, window_bits, strategy)) {
+    const uLong libdeflate_bound = libdeflate_compress_bound(level, window_bits, input_len, error_code);
+    if (UNLIKELY(libdeflate_bound == 0)) {
+      return 0;
+    }
+    if (libdeflate_bound > bound) {
+      bound = libdeflate_bound;
+    }
+  }
+#endif
+
+  return bound;
+}
+
+uLong deflate_compress_pooled(struct MultiPool *pool, int level, int window_bits, int mem_level, int strategy, bool adaptive, void *restrict input, uInt input_len, void **output,
+                              int *error_code) {
+  *output = NULL;
+  const uLong bound = deflate_compress_bound(level, window_bits, mem_level, strategy, input_len, error_code);
+  if (UNLIKELY(bound == 0)) {
+    return 0;
+  }
+
+  void *buffer = bound <= UINT32_MAX ? multipool_mem_acquire(pool, (uint32_t)bound) : NULL;
+  if (UNLIKELY(buffer == NULL)) {
+    *error_code = Z_MEM_ERROR;
+    return 0;
+  }
+
+  uLong out_len = 0;
+  if (adaptive) {
+    out_len = adaptive_deflate_compress_buffer(level, window_bits, mem_level, strategy, input, input_len, buffer, (uInt)bound, error_code);
+  } else {
+    out_len = deflate_compress_buffer(level, window_bits, mem_level, strategy, input, input_len, buffer, (uInt)bound, error_code);
+  }
+
+  if (UNLIKELY(*error_code != Z_OK)) {
+    pool_mem_return(buffer);
+    return 0;
+  }
+
+  *output = buffer;
+  return out_len;
+}
+
+uLong zlib_compress_buffer(int level, void *restrict input, uInt input_len, void *restrict output, uInt output_len, int *error_code) {
+  return deflate_compress_buffer(level, MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, input, input_len, output, output_len, error_code);
+}
+
+uLong gzip_compress_buffer(int level, void *restrict input, uInt input_len, void *restrict output, uInt output_len, int *restrict error_code) {
+  return deflate_compress_buffer(level, COMPRESS_GZIP_WINDOW_BITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, input, input_len, output, output_len, error_code);
+}
+
+/*
+  adaptive compression
+  Input is sampled before being compressed and classified by its order 2 Renyi entropy, H2 = -log2(sum(p^2)) over the
+  byte frequencies, which can be compared against a threshold without logarithms: H2 >= log2(factor) is the same as
+  sum(count^2) * factor <= n^2. Samples above 7.5 bits per byte are stored, above 7.2 bits per byte they are
+  Huffman coded only, skipping the match search that finds nothing in them, and anything else is deflated with the
+  configured parameters. Large inputs are sampled in runs spread over the whole input.
+*/
+#define ADAPTIVE_SAMPLE_MIN 1024U
+#define ADAPTIVE_SAMPLE_RUNS 16U
+#define ADAPTIVE_SAMPLE_RUN_LEN 256U
+// 2^7.5 and 2^7.2
+#define ADAPTIVE_STORED_FACTOR 181U
+#define ADAPTIVE_HUFFMAN_ONLY_FACTOR 147U
+
+#define ADAPTIVE_MODE_DEFLATE 0
+#define ADAPTIVE_MODE_HUFFMAN_ONLY 1
+#define ADAPTIVE_MODE_STORED 2
+
+static GoZLibAdaptiveStats _adaptive_buffer_stats = {0};
+
+static inline void sample_histogram(const unsigned char *data, uInt len, uint32_t *counts) {
+  for (uInt i = 0; i < len; i++) {
+    counts[data[i]]++;
+  }
+}
+
+static int classify_sample(const unsigned char *data, uInt len) {
+  uint32_t counts[256] = {0};
+  uint64_t sampled = 0;
+  if (len <= ADAPTIVE_SAMPLE_RUNS * ADAPTIVE_SAMPLE_RUN_LEN) {
+    sample_histogram(data, len, counts);
+    sampled = len;
+  } else {
+    const uInt stride = len / ADAPTIVE_SAMPLE_RUNS;
+    for (uInt run = 0; run < ADAPTIVE_SAMPLE_RUNS; run++) {
+      sample_histogram(data + run * stride, ADAPTIVE_SAMPLE_RUN_LEN, counts);
+    }
+    sampled = ADAPTIVE_SAMPLE_RUNS * ADAPTIVE_SAMPLE_RUN_LEN;
+  }
+
+  uint64_t collisions = 0;
+  for (int i = 0; i < 256; i++) {
+    collisions += (uint64_t)counts[i] * counts[i];
+  }
+
+  const uint64_t squared = sampled * sampled;
+  if (collisions * ADAPTIVE_STORED_FACTOR <= squared) {
+    return ADAPTIVE_MODE_STORED;
+  }
+  if (collisions * ADAPTIVE_HUFFMAN_ONLY_FACTOR <= squared) {
+    return ADAPTIVE_MODE_HUFFMAN_ONLY;
+  }
+  return ADAPTIVE_MODE_DEFLATE;
+}
+
+static inline void count_adaptive_sample(GoZLibAdaptiveStats *stats, int mode) {
+  __atomic_fetch_add(&stats->samples, 1, __ATOMIC_RELAXED);
+  if (mode == ADAPTIVE_MODE_STORED) {
+    __atomic_fetch_add(&stats->stored, 1, __ATOMIC_RELAXED);
+  } else if (mode == ADAPTIVE_MODE_HUFFMAN_ONLY) {
+    __atomic_fetch_add(&stats->huffman_only, 1, __ATOMIC_RELAXED);
+  }
+}
+
+static inline void adaptive_parameters(int mode, int *level, int *strategy) {
+  if (mode == ADAPTIVE_MODE_STORED) {
+    *level = Z_NO_COMPRESSION;
+    *strategy = Z_DEFAULT_STRATEGY;
+  } else if (mode == ADAPTIVE_MODE_HUFFMAN_ONLY) {
+    *strategy = Z_HUFFMAN_ONLY;
+  }
+}
+
+uLong adaptive_deflate_compress_buffer(int level, int window_bits, int mem_level, int strategy, void *restrict input, uInt input_len, void *restrict output, uInt output_len,
+                                       int *error_code) {
+  // a whole buffer is a single block, so the context pooled for the parameters of its mode is used instead of deflateParams
+  if (input_len >= ADAPTIVE_SAMPLE_MIN) {
+    const int mode = classify_sample(input, input_len);
+    count_adaptive_sample(&_adaptive_buffer_stats, mode);
+    adaptive_parameters(mode, &level, &strategy);
+  }
+
+  return deflate_compress_buffer(level, window_bits, mem_level, strategy, input, input_len, output, output_len, error_code);
+}
+
+void get_adaptive_buffer_stats(GoZLibAdaptiveStats *stats) {
+  stats->samples = __atomic_load_n(&_adaptive_buffer_stats.samples, __ATOMIC_RELAXED);
+  stats->stored = __atomic_load_n(&_adaptive_buffer_stats.stored, __ATOMIC_RELAXED);
+  stats->huffman_only = __atomic_load_n(&_adaptive_buffer_stats.huffman_only, __ATOMIC_RELAXED);
+}
+
+// batch compression
+
+#define BATCH_MAX_THREADS 64
+
+typedef struct BatchRange BatchRange;
+
+// the items of a batch processed by one thread, all ranges of a batch share the same parameters
+struct BatchRange {
+  GoZLibBatchItem *items;
+  uInt begin;
+  uInt end;
+  int level;
+  int window_bits;
+  struct MultiPool *pool;
+  void (*process)(BatchRange *range);
+};
+
+static void compress_batch_range(BatchRange *range) {
+#ifdef GOZLIB_LIBDEFLATE
+  if (get_buffer_backend() == GOZLIB_BUFFER_BACKEND_LIBDEFLATE && libdeflate_supports(range->level, range->window_bits, Z_DEFAULT_STRATEGY)) {
+    for (uInt i = range->begin; i < range->end; i++) {
+      GoZLibBatchItem *item = &range->items[i];
+      item->error_code = Z_OK;
+      item->result_len = libdeflate_compress_buffer(range->level, range->window_bits, (void *)item->input, item->input_len, (void *)item->output, item->output_len, // NOLINT(performance-no-int-to-ptr)
+                                                    &item->error_code);
+    }
+    return;
+  }
+#endif
+
+  int ec = Z_OK;
+  GoZLibContext *context = acquire_deflate_context(range->level, range->window_bits, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, &ec);
+
+  for (uInt i = range->begin; i < range->end; i++) {
+    GoZLibBatchItem *item = &range->items[i];
+    item->result_len = 0;
+    item->error_code = ec;
+    if (UNLIKELY(context == NULL)) {
+      continue;
+    }
+
+    item->result_len = context_compress_buffer(context, (void *)item->input, item->input_len, (void *)item->output, item->output_len, &item->error_code); // NOLINT(performance-no-int-to-ptr)
+  }
+
+  if (LIKELY(context != NULL)) {
+    release_zlib_context(context);
+  }
+}
+
+static void *batch_range_thread(void *range) {
+  BatchRange *batch_range = range;
+  batch_range->process(batch_range);
+  return NULL;
+}
+
+// splits the batch described by the whole range in contiguous ranges processed concurrently by up to max_threads threads
+static void run_batch(BatchRange whole, uInt count, uInt max_threads) {
+  uInt threads = max_threads < count ? max_threads : count;
+  if (threads > BATCH_MAX_THREADS) {
+    threads = BATCH_MAX_THREADS;
+  }
+
+  whole.begin = 0;
+  whole.end = count;
+  if (threads <= 1) {
+    whole.process(&whole);
+    return;
+  }
+
+  BatchRange ranges[BATCH_MAX_THREADS];
+  pthread_t thread_ids[BATCH_MAX_THREADS];
+  bool started[BATCH_MAX_THREADS];
+
+  for (uInt t = 0; t < threads; t++) {
+    ranges[t] = whole;
+    ranges[t].begin = (uInt)((uLong)count * t / threads);
+    ranges[t].end = (uInt)((uLong)count * (t + 1) / threads);
+  }
+
+  // the calling thread processes the first range
+  for (uInt t = 1; t < threads; t++) {
+    started[t] = pthread_create(&thread_ids[t], NULL, batch_range_thread, &ranges[t]) == 0;
+  }
+  whole.process(&ranges[0]);
+
+  for (uInt t = 1; t < threads; t++) {
+    if (started[t]) {
+      pthread_join(thread_ids[t], NULL);
+    } else {
+      whole.process(&ranges[t]);
+    }
+  }
+}
+
+static void compress_batch(int level, int window_bits, GoZLibBatchItem *items, uInt count, uInt max_threads) {
+  BatchRange whole = {.items = items, .level = level, .window_bits = window_bits, .pool = NULL, .process = compress_batch_range};
+  run_batch(whole, count, max_threads);
+}
+
+void gzip_compress_batch(int level, GoZLibBatchItem *items, uInt count, uInt max_threads) {
+  compress_batch(level, COMPRESS_GZIP_WINDOW_BITS, items, count, max_threads);
+}
+
+void zlib_compress_batch(int level, GoZLibBatchItem *items, uInt count, uInt max_threads) {
+  compress_batch(level, MAX_WBITS, items, count, max_threads);
+}
+
+uLong deflate_raw_block_bound(uLong input_len) {
+  // compressBound covers a zlib wrapper, larger than the empty stored block emitted by a sync flush
+  return compressBound(input_len) + 8;
+}
+
+uLong deflate_raw_block(int level, void *restrict dictionary, uInt dictionary_len, void *restrict input, uInt input_len, void *restrict output, uInt output_len, bool last, uLong *crc, int *error_code) {
+  GoZLibContext *context = acquire_deflate_context(level, -MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, error_code);
+  if (UNLIKELY(context == NULL)) {
+    return 0;
+  }
+  z_streamp zs = use_zlib_context(context);
+
+  if (dictionary_len > 0) {
+    int dict_code = deflateSetDictionary(zs, dictionary, dictionary_len);
+    if (UNLIKELY(dict_code != Z_OK)) {
+      *error_code = dict_code;
+      release_zlib_context(context);
+      return 0;
+    }
+  }
+
+  zs->next_in = input;
+  zs->avail_in = input_len;
+  zs->next_out = output;
+  zs->avail_out = output_len;
+
+  // the sync flush ends non final blocks on a byte boundary so they can be concatenated
+  const int def_code = deflate(zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+
+  uLong out_len = zs->total_out;
+  const bool complete = last ? def_code == Z_STREAM_END : (def_code == Z_OK && zs->avail_in == 0 && zs->avail_out > 0);
+  if (UNLIKELY(!complete)) {
+    // the output buffer should be large enough
+    *error_code = def_code < Z_OK ? def_code : Z_BUF_ERROR;
+    out_len = 0;
+  }
+  release_zlib_context(context);
+
+  *crc = checksum_crc32(0, input, input_len);
+  return out_len;
+}
+
+uLong inflate_uncompress_buffer(int window_bits, void *restrict input, uInt input_len, void *restrict output, uInt output_len, int *restrict error_code) {
+  GoZLibContext *context = acquire_inflate_context(window_bits, error_code);
+  if (UNLIKELY(context == NULL)) {
+    return 0;
+  }
+
+  uLong out_len = context_uncompress_buffer(context, input, input_len, output, output_len, error_code);
+  release_zlib_context(context);
+
+  return out_len;
+}
+
+uLong uncompress_buffer_any(void *restrict input, uInt input_len, void *restrict output, uInt output_len, int *restrict error_code) {
+  return inflate_uncompress_buffer(UNCOMPRESS_ANY_WINDOW_BITS, input, input_len, output, output_len, error_code);
+}
+
+/*
+  pooled output
+  The output buffer is acquired from a multipool and doubled whenever it fills up, copying what was already uncompressed,
+  so that the input is only inflated once. Gzip inputs are sized from the ISIZE trailer, the uncompressed length modulo
+  2^32 of the last member, ignored beyond the maximum deflate compression ratio. The trailer isn't verified until the
+  stream ends, so a crafted one can't make the first buffer larger than POOLED_OUTPUT_MAX_HINT_RATIO times the input,
+  more compressible inputs grow from there.
+*/
+#define POOLED_OUTPUT_MIN_SIZE 4096U
+#define POOLED_OUTPUT_RATIO_GUESS 4U
+#define POOLED_OUTPUT_MAX_HINT_RATIO 64U
+#define DEFLATE_MAX_RATIO 1032U
+
+static inline uint32_t pooled_output_size_hint(const unsigned char *input, uInt input_len) {
+  uint64_t hint = (uint64_t)input_len * POOLED_OUTPUT_RATIO_GUESS;
+  if (input_len >= GZIP_HEADER_LEN + GZIP_TRAILER_LEN && input[0] == 0x1f && input[1] == 0x8b) {
+    const unsigned char *isize = input + input_len - 4;
+    const uint64_t trailer_size = (uint64_t)isize[0] | (uint64_t)isize[1] << 8 | (uint64_t)isize[2] << 16 | (uint64_t)isize[3] << 24;
+    if (trailer_size <= (uint64_t)input_len * DEFLATE_MAX_RATIO) {
+      const uint64_t max_hint = (uint64_t)input_len * POOLED_OUTPUT_MAX_HINT_RATIO;
+      hint = trailer_size < max_hint ? trailer_size : max_hint;
+    }
+  }
+
+  if (hint < POOLED_OUTPUT_MIN_SIZE) {
+    return POOLED_OUTPUT_MIN_SIZE;
+  }
+  return hint > UINT32_MAX ? UINT32_MAX : (uint32_t)hint;
+}
+
+static int grow_pooled_output(struct MultiPool *pool, z_streamp zs, unsigned char **buffer, uint32_t *buffer_cap) {
+  if (UNLIKELY(*buffer_cap > UINT32_MAX / 2)) {
+    return Z_MEM_ERROR;
+  }
+
+  const uint32_t grown_cap = *buffer_cap * 2;
+  unsigned char *grown = multipool_mem_acquire(pool, grown_cap);
+  if (UNLIKELY(grown == NULL)) {
+    return Z_MEM_ERROR;
+  }
+
+  const size_t used = (size_t)(zs->next_out - *buffer);
+  memcpy(grown, *buffer, used);
+  pool_mem_return(*buffer);
+
+  zs->next_out = grown + used;
+  zs->avail_out = grown_cap - (uInt)used;
+  *buffer = grown;
+  *buffer_cap = grown_cap;
+  return Z_OK;
+}
+
+// uncompresses into a pooled output with an acquired inflate context, which is reset but not released.
+// The whole input must be consumed, with multi_member concatenated gzip members are uncompressed as a single stream
+static uLong context_uncompress_pooled(GoZLibContext *context, bool multi_member, struct MultiPool *pool, void *restrict input, uInt input_len, void **output,
+                                       int *error_code) {
+  *output = NULL;
+  int inf_code = reset_zlib_context(context);
+  z_streamp zs = use_zlib_context(context);
+  uint32_t buffer_cap = pooled_output_size_hint(input, input_len);
+  unsigned char *buffer = inf_code == Z_OK ? multipool_mem_acquire(pool, buffer_cap) : NULL;
+  if (UNLIKELY(buffer == NULL)) {
+    *error_code = inf_code == Z_OK ? Z_MEM_ERROR : inf_code;
+    return 0;
+  }
+
+  zs->next_in = input;
+  zs->avail_in = input_len;
+  zs->next_out = buffer;
+  zs->avail_out = buffer_cap;
+
+  const bool instrumented = stats_enabled();
+  const uint64_t start = instrumented ? stats_clock() : 0;
+  for (;;) {
+    inf_code = inflate_context(context, Z_NO_FLUSH);
+    if (inf_code == Z_STREAM_END && zs->avail_in > 0) {
+      // anything after the end of the stream but another gzip member is invalid
+      if (!multi_member || zs->avail_in < 2 || zs->next_in[0] != 0x1f || zs->next_in[1] != 0x8b) {
+        inf_code = Z_DATA_ERROR;
+        break;
+      }
+      inf_code = inflate_next_member(zs);
+      if (UNLIKELY(inf_code != Z_OK)) {
+        break;
+      }
+      continue;
+    }
+    if (inf_code == Z_STREAM_END || (inf_code != Z_OK && inf_code != Z_BUF_ERROR)) {
+      break;
+    }
+
+    // there's still room in the output so the input ended before the stream did
+    if (zs->avail_out > 0) {
+      inf_code = Z_BUF_ERROR;
+      break;
+    }
+
+    inf_code = grow_pooled_output(pool, zs, &buffer, &buffer_cap);
+    if (UNLIKELY(inf_code != Z_OK)) {
+      break;
+    }
+  }
+
+  const uLong out_len = (uLong)(zs->next_out - buffer);
+  if (instrumented) {
+    count_global_zlib_call(false, input_len - zs->avail_in, out_len, start);
+  }
+
+  if (UNLIKELY(inf_code != Z_STREAM_END)) {
+    *error_code = inf_code;
+    pool_mem_return(buffer);
+    return 0;
+  }
+
+  *output = buffer;
+  return out_len;
+}
+
+uLong inflate_uncompress_pooled(struct MultiPool *pool, int window_bits, void *restrict input, uInt input_len, void **output, int *error_code) {
+  *output = NULL;
+  GoZLibContext *context = acquire_inflate_context(window_bits, error_code);
+  if (UNLIKELY(context == NULL)) {
+    return 0;
+  }
+
+  uLong out_len = context_uncompress_pooled(context, is_multi_member_window(window_bits), pool, input, input_len, output, error_code);
+  release_zlib_context(context);
+  return out_len;
+}
+
+static void uncompress_batch_range(BatchRange *range) {
+  int ec = Z_OK;
+  GoZLibContext *context = acquire_inflate_context(range->window_bits, &ec);
+  const bool multi_member = is_multi_member_window(range->window_bits);
+
+  for (uInt i = range->begin; i < range->end; i++) {
+    GoZLibBatchItem *item = &range->items[i];
+    void *output = NULL;
+    item->result_len = 0;
+    item->error_code = ec;
+    if (LIKELY(context != NULL)) {
+      item->result_len = context_uncompress_pooled(context, multi_member, range->pool, (void *)item->input, item->input_len, &output, &item->error_code); // NOLINT(performance-no-int-to-ptr)
+    }
+    item->output = (uintptr_t)output;
+  }
+
+  if (LIKELY(context != NULL)) {
+    release_zlib_context(context);
+  }
+}
+
+void inflate_uncompress_batch(struct MultiPool *pool, int window_bits, GoZLibBatchItem *items, uInt count, uInt max_threads) {
+  BatchRange whole = {.items = items, .window_bits = window_bits, .pool = pool, .process = uncompress_batch_range};
+  run_batch(whole, count, max_threads);
+}
+
+uLong dictionary_compress_buffer(GoZLibDictionary *dictionary, void *restrict input, uInt input_len, void *restrict output, uInt output_len, int *error_code) {
+  GoZLibContext *context = acquire_dictionary_deflate_context(dictionary, error_code);
+  if (UNLIKELY(context == NULL)) {
+    return 0;
+  }
+
+  uLong out_len = context_compress_buffer(context, input, input_len, output, output_len, error_code);
+  release_zlib_context(context);
+
+  return out_len;
+}
+
+uLong dictionary_uncompress_buffer(GoZLibDictionary *dictionary, void *restrict input, uInt input_len, void *restrict output, uInt output_len, int *error_code) {
+  GoZLibContext *context = acquire_dictionary_inflate_context(dictionary, error_code);
+  if (UNLIKELY(context == NULL)) {
+    return 0;
+  }
+
+  uLong out_len = context_uncompress_buffer(context, input, input_len, output, output_len, error_code);
+  release_zlib_context(context);
+
+  return out_len;
+}
+
+int compress_to_outstream(ZStreamState *state, z_streamp zs, int flush, StreamDataHandler output_handler, void *restrict output_buf, uInt output_len) {
+  const bool instrumented = stats_enabled();
+  while (true) {
+    zs->avail_out = output_len;
+    zs->next_out = output_buf;
+    const uInt avail_in = zs->avail_in;
+    const uint64_t start = instrumented ? stats_clock() : 0;
+    int def_code = deflate(zs, flush);
+    if (instrumented) {
+      count_zlib_call(&state->stats, avail_in - zs->avail_in, output_len - zs->avail_out, start);
+    }
+
+    if (def_code == Z_STREAM_ERROR) {
+      return def_code;
+    }
+
+    uInt outstream_len = output_len - zs->avail_out;
+
+    if (outstream_len > 0) {
+      if (UNLIKELY(call_stream_handler(state, output_handler, output_buf, outstream_len, instrumented) == 0)) {
+        return GOZLIB_STREAM_OUTPUT_WRITE_ERROR;
+      }
+    }
+
+    // there's room in the buffer but it's not time to flush it yet
+    if (zs->avail_out > 0) {
+      return def_code;
+    }
+  }
+}
+
+static uLong context_compress_stream(GoZLibContext *context, ZStreamState *state, StreamDataHandler input_handler, StreamDataHandler output_handler, uInt work_input_buffer_cap,
+                                     uInt work_output_buffer_cap, int *error_code) {
+  if (context == NULL) {
+    return 0;
+  }
+  z_streamp zs = use_zlib_context(context);
+
+  void *input_buf = NULL;
+  void *output_buf = NULL;
+  if (UNLIKELY(!pool_alloc_stream_buffers(&input_buf, work_input_buffer_cap, &output_buf, work_output_buffer_cap))) {
+    *error_code = Z_MEM_ERROR;
+    release_zlib_context(context);
+    return 0;
+  }
+
+  const bool instrumented = stats_enabled();
+  memset(&state->stats, 0, sizeof(GoZLibStats));
+  bool do_compress = true;
+
+  while (do_compress) {
+    zs->avail_in = call_stream_handler(state, input_handler, input_buf, work_input_buffer_cap, instrumented);
+    zs->next_in = input_buf;
+
+    do_compress = zs->avail_in > 0;
+    int flush = do_compress ? Z_NO_FLUSH : Z_FINISH;
+    int comp_code = compress_to_outstream(state, zs, flush, output_handler, output_buf, work_output_buffer_cap);
+
+    if (comp_code < Z_OK) {
+      do_compress = false;
+      *error_code = comp_code;
+    }
+  }
+
+  uLong compressed_len = zs->total_out;
+  release_zlib_context(context);
+  if (instrumented) {
+    add_global_stats(true, &state->stats);
+  }
+
+  pool_free(input_buf);
+  pool_free(output_buf);
+
+  return compressed_len;
+}
+
+static inline uLong compress_stream(ZStreamState *state, int level, int window_bits, StreamDataHandler input_handler, StreamDataHandler output_handler, uInt work_input_buffer_cap,
+                                    uInt work_output_buffer_cap, int *error_code) {
+  GoZLibContext *context = acquire_deflate_context(level, window_bits, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, error_code);
+  return context_compress_stream(context, state, input_handler, output_handler, work_input_buffer_cap, work_output_buffer_cap, error_code);
+}
+
+uLong zlib_compress_stream(ZStreamState *state, int level, StreamDataHandler input_handler, StreamDataHandler output_handler, uInt work_input_buffer_cap, uInt work_output_buffer_cap,
+                           int *error_code) {
+  return compress_stream(state, level, MAX_WBITS, input_handler, output_handler, work_input_buffer_cap, work_output_buffer_cap, error_code);
+}
+
+uLong gzip_compress_stream(ZStreamState *state, int level, StreamDataHandler input_handler, StreamDataHandler output_handler, uInt work_input_buffer_cap, uInt work_output_buffer_cap,
+                           int *error_code) {
+  return compress_stream(state, level, COMPRESS_GZIP_WINDOW_BITS, input_handler, output_handler, work_input_buffer_cap, work_output_buffer_cap, error_code);
+}
+
+uLong dictionary_compress_stream(ZStreamState *state, GoZLibDictionary *dictionary, StreamDataHandler input_handler, StreamDataHandler output_handler, uInt work_input_buffer_cap,
+                                 uInt work_output_buffer_cap, int *error_code) {
+  GoZLibContext *context = acquire_dictionary_deflate_context(dictionary, error_code);
+  return context_compress_stream(context, state, input_handler, output_handler, work_input_buffer_cap, work_output_buffer_cap, error_code);
+}
+
+static inline bool is_inflate_result_fatal(int inf_code) {
+  return inf_code == Z_DATA_ERROR || inf_code == Z_STREAM_ERROR || inf_code == Z_MEM_ERROR || inf_code == Z_NEED_DICT;
+}
+
+static inline int context_uncompress_to_outstream_step(ZStreamState *state, GoZLibContext *context, z_streamp zs, StreamDataHandler output_handler, void *restrict output_buf,
+                                                       uInt output_len) {
+  zs->avail_out = output_len;
+  zs->next_out = output_buf;
+  const bool instrumented = stats_enabled();
+  const uInt avail_in = zs->avail_in;
+  const uint64_t start = instrumented ? stats_clock() : 0;
+  int inf_code = context != NULL ? inflate_context(context, Z_NO_FLUSH) : inflate(zs, Z_NO_FLUSH);
+  if (instrumented) {
+    count_zlib_call(&state->stats, avail_in - zs->avail_in, output_len - zs->avail_out, start);
+  }
+
+  if (UNLIKELY(is_inflate_result_fatal(inf_code))) {
+    if (inf_code == Z_NEED_DICT) { // consider the need for dictionary an error too
+      return Z_DATA_ERROR;
+    }
+    return inf_code;
+  }
+
+  uInt outstream_len = output_len - zs->avail_out;
+
+  if (outstream_len > 0) {
+    if (UNLIKELY(call_stream_handler(state, output_handler, output_buf, outstream_len, instrumented) == 0)) {
+      return GOZLIB_STREAM_OUTPUT_WRITE_ERROR;
+    }
+  }
+
+  if (inf_code == Z_STREAM_END) {
+    return Z_STREAM_END;
+  }
+
+  // there's room in the buffer but it's not end of the stream yet
+  if (zs->avail_out > 0) {
+    return Z_OK;
+  }
+
+  return GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA;
+}
+
+int uncompress_to_outstream_step(ZStreamState *state, z_streamp zs, StreamDataHandler output_handler, void *restrict output_buf, uInt output_len) {
+  return context_uncompress_to_outstream_step(state, NULL, zs, output_handler, output_buf, output_len);
+}
+
+static int context_uncompress_to_outstream(ZStreamState *state, GoZLibContext *context, StreamDataHandler output_handler, void *restrict output_buf, uInt output_len) {
+  int output_code = GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA;
+  while (output_code == GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA) {
+    output_code = context_uncompress_to_outstream_step(state, context, use_zlib_context(context), output_handler, output_buf, output_len);
+  }
+  return output_code;
+}
+
+int uncompress_to_outstream(ZStreamState *state, z_streamp zs, StreamDataHandler output_handler, void *restrict output_buf, uInt output_len) {
+  int output_code = GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA;
+  while (output_code == GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA) {
+    output_code = uncompress_to_outstream_step(state, zs, output_handler, output_buf, output_len);
+  }
+  return output_code;
+}
+
+// switches the deflate parameters to the mode of the new input, the data deflated so far ends its block with the previous ones
+static inline bool adapt_transformer_input(GoZLibTransformer *transformer, void *restrict input, uInt input_len) {
+  // the remaining input of a step that filled the output was already sampled
+  const bool sampled = input_len == transformer->adaptive_unconsumed;
+  transformer->adaptive_unconsumed = 0;
+  if (sampled || input_len < ADAPTIVE_SAMPLE_MIN) {
+    return true;
+  }
+
+  const int mode = classify_sample(input, input_len);
+  count_adaptive_sample(&transformer->adaptive_stats, mode);
+  if (mode == transformer->adaptive_mode) {
+    return true;
+  }
+
+  int level = transformer->level;
+  int strategy = transformer->strategy;
+  adaptive_parameters(mode, &level, &strategy);
+
+  z_streamp zs = transformer->zs;
+  zs->avail_in = 0;
+  int params_code = deflateParams(zs, level, strategy);
+  if (params_code == Z_OK) {
+    transformer->adaptive_mode = mode;
+  }
+
+  // the pending data didn't fit the output, the input is sampled again on the next step
+  return zs->avail_out > 0;
+}
+
+// puts back the parameters of a pooled context switched by adaptive compression
+static inline void restore_adaptive_transformer(GoZLibTransformer *transformer) {
+  transformer->adaptive_unconsumed = 0;
+  if (transformer->adaptive_mode == ADAPTIVE_MODE_DEFLATE) {
+    return;
+  }
+
+  // parameters changed right after a reset apply without deflating anything
+  if (reset_zlib_context(transformer->context) == Z_OK) {
+    deflateParams(transformer->zs, transformer->level, transformer->strategy);
+  }
+  transformer->adaptive_mode = ADAPTIVE_MODE_DEFLATE;
+}
+
+void enable_adaptive_compression(GoZLibTransformer *transformer, int level, int strategy) {
+  transformer->adaptive = true;
+  transformer->level = level;
+  transformer->strategy = strategy;
+}
+
+static inline void count_transformer_call(GoZLibTransformer *transformer, bool deflating, uInt bytes_in, uInt bytes_out, uint64_t start) {
+  GoZLibStats stats = {0};
+  count_zlib_call(&stats, bytes_in, bytes_out, start);
+  count_zlib_call(&transformer->stats, bytes_in, bytes_out, start);
+  add_global_stats(deflating, &stats);
+}
+
+GoZLibStepResult transformer_compress_step(GoZLibTransformer *transformer, void *restrict input, uInt input_len, void *restrict output, uInt output_len, int flush) {
+  z_streamp zs = use_zlib_context(transformer->context);
+  zs->next_out = output;
+  zs->avail_out = output_len;
+
+  if (transformer->adaptive && !adapt_transformer_input(transformer, input, input_len)) {
+    transformer->started = true;
+    transformer->at_boundary = false;
+    GoZLibStepResult full = {.consumed = 0, .produced = output_len, .status = GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA};
+    return full;
+  }
+
+  zs->next_in = input;
+  zs->avail_in = input_len;
+
+  const bool instrumented = stats_enabled();
+  const uint64_t start = instrumented ? stats_clock() : 0;
+  int def_code = deflate(zs, flush);
+  if (instrumented) {
+    count_transformer_call(transformer, true, input_len - zs->avail_in, output_len - zs->avail_out, start);
+  }
+
+  GoZLibStepResult result = {.consumed = input_len - zs->avail_in, .produced = output_len - zs->avail_out, .status = def_code};
+  // no progress possible is not an error, it means all the input was consumed
+  if (def_code == Z_BUF_ERROR || (def_code == Z_OK && zs->avail_out > 0)) {
+    result.status = Z_OK;
+  }
+
+  if (def_code == Z_OK && zs->avail_out == 0) {
+    result.status = GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA;
+    transformer->adaptive_unconsumed = zs->avail_in;
+  }
+
+  transformer->started |= result.consumed > 0 || result.produced > 0;
+  if (flush == Z_SYNC_FLUSH || flush == Z_FULL_FLUSH) {
+    transformer->at_boundary = result.status == Z_OK;
+  } else if (result.consumed > 0 || result.produced > 0 || flush != Z_NO_FLUSH) {
+    // a partial flush doesn't end on a byte and a finished stream can't be continued
+    transformer->at_boundary = false;
+  }
+
+  return result;
+}
+
+GoZLibStepResult transformer_uncompress_step(GoZLibTransformer *transformer, void *restrict output, uInt output_len) {
+  z_streamp zs = use_zlib_context(transformer->context);
+  uInt input_len = zs->avail_in;
+  zs->next_out = output;
+  zs->avail_out = output_len;
+
+  // the previous member ended with input left over or new input arrived after it
+  if (transformer->member_ended && zs->avail_in > 0) {
+    inflate_next_member(zs);
+    transformer->member_ended = false;
+  }
+
+  const bool instrumented = stats_enabled();
+  const uint64_t start = instrumented ? stats_clock() : 0;
+  int inf_code = inflate_context(transformer->context, Z_NO_FLUSH);
+  while (inf_code == Z_STREAM_END && transformer->multi_member && zs->avail_in > 0 && zs->avail_out > 0) {
+    inflate_next_member(zs);
+    inf_code = inflate_context(transformer->context, Z_NO_FLUSH);
+  }
+  if (instrumented) {
+    count_transformer_call(transformer, false, input_len - zs->avail_in, output_len - zs->avail_out, start);
+  }
+
+  GoZLibStepResult result = {.consumed = input_len - zs->avail_in, .produced = output_len - zs->avail_out, .status = Z_OK};
+  if (UNLIKELY(is_inflate_result_fatal(inf_code))) {
+    // consider the need for dictionary an error too
+    result.status = inf_code == Z_NEED_DICT ? Z_DATA_ERROR : inf_code;
+    return result;
+  }
+
+  if (inf_code == Z_STREAM_END) {
+    transformer->member_ended = transformer->multi_member;
+    // the next member starts in the remaining input, which must not be replaced yet
+    result.status = transformer->member_ended && zs->avail_in > 0 ? GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA : Z_STREAM_END;
+  } else if (zs->avail_out == 0) {
+    result.status = GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA;
+  }
+
+  transformer->started |= result.consumed > 0 || result.produced > 0;
+  // data_type tells whether inflate stopped right after the end of a block that wasn't the last one, its low bits
+  // are the number of bits left over in the last input byte
+  transformer->at_boundary = transformer->window_bits < 0 && zs->avail_in == 0 && inf_code == Z_OK && (zs->data_type & (128 | 64 | 63)) == 128;
+
+  return result;
+}
+
+static uLong context_uncompress_stream(GoZLibContext *context, bool multi_member, ZStreamState *state, StreamDataHandler input_handler, StreamDataHandler output_handler,
+                                       uInt work_input_buffer_cap, uInt work_output_buffer_cap, int *error_code) {
+  if (context == NULL) {
+    return 0;
+  }
+  z_streamp zs = use_zlib_context(context);
+
+  void *input_buf = NULL;
+  void *output_buf = NULL;
+  if (UNLIKELY(!pool_alloc_stream_buffers(&input_buf, work_input_buffer_cap, &output_buf, work_output_buffer_cap))) {
+    *error_code = Z_MEM_ERROR;
+    release_zlib_context(context);
+    return 0;
+  }
+
+  const bool instrumented = stats_enabled();
+  memset(&state->stats, 0, sizeof(GoZLibStats));
+  zs->avail_in = call_stream_handler(state, input_handler, input_buf, work_input_buffer_cap, instrumented);
+  zs->next_in = input_buf;
+
+  while (zs->avail_in > 0) {
+    int uncomp_code = context_uncompress_to_outstream(state, context, output_handler, output_buf, work_output_buffer_cap);
+
+    if (uncomp_code < Z_OK) {
+      *error_code = uncomp_code;
+      break;
+    }
+
+    if (uncomp_code == Z_STREAM_END) {
+      if (!multi_member) {
+        break;
+      }
+
+      if (zs->avail_in == 0) {
+        zs->avail_in = call_stream_handler(state, input_handler, input_buf, work_input_buffer_cap, instrumented);
+        zs->next_in = input_buf;
+      }
+      if (zs->avail_in > 0) {
+        inflate_next_member(zs);
+      }
+      continue;
+    }
+    zs->avail_in = call_stream_handler(state, input_handler, input_buf, work_input_buffer_cap, instrumented);
+    zs->next_in = input_buf;
+  }
+
+  uLong uncompressed_len = zs->total_out;
+  release_zlib_context(context);
+  if (instrumented) {
+    add_global_stats(false, &state->stats);
+  }
+
+  pool_free(input_buf);
+  pool_free(output_buf);
+
+  return uncompressed_len;
+}
+
+uLong uncompress_stream_any(ZStreamState *state, StreamDataHandler input_handler, StreamDataHandler output_handler, uInt work_input_buffer_cap, uInt work_output_buffer_cap, int *error_code) {
+  GoZLibContext *context = acquire_inflate_context(UNCOMPRESS_ANY_WINDOW_BITS, error_code);
+  return context_uncompress_stream(context, true, state, input_handler, output_handler, work_input_buffer_cap, work_output_buffer_cap, error_code);
+}
+
+uLong dictionary_uncompress_stream(ZStreamState *state, GoZLibDictionary *dictionary, StreamDataHandler input_handler, StreamDataHandler output_handler, uInt work_input_buffer_cap,
+                                   uInt work_output_buffer_cap, int *error_code) {
+  GoZLibContext *context = acquire_dictionary_inflate_context(dictionary, error_code);
+  return context_uncompress_stream(context, false, state, input_handler, output_handler, work_input_buffer_cap, work_output_buffer_cap, error_code);
+}
+
+// transformers
+
+static inline GoZLibTransformer *pool_alloc_transformer(GoZLibContext *context, uInt work_buffer_cap, int *error_code) {
+  GoZLibTransformer *transformer = pool_mem_acquire(_gozlib_transformer_pool);
+  if (UNLIKELY(transformer == NULL)) {
+    if (context != NULL) {
+      release_zlib_context(context);
+    }
+    *error_code = Z_MEM_ERROR;
+    return NULL;
+  }
+
+  transformer->work_buffer = pool_alloc(work_buffer_cap);
+  transformer->work_buffer_cap = work_buffer_cap;
+  transformer->state = pool_acquire_zstream_state();
+  transformer->context = context;
+  transformer->zs = context == NULL ? NULL : &context->zs;
+  transformer->multi_member = false;
+  transformer->member_ended = false;
+  transformer->adaptive = false;
+  transformer->adaptive_mode = ADAPTIVE_MODE_DEFLATE;
+  transformer->adaptive_unconsumed = 0;
+  memset(&transformer->adaptive_stats, 0, sizeof(GoZLibAdaptiveStats));
+  memset(&transformer->stats, 0, sizeof(GoZLibStats));
+  transformer->deflating = context != NULL && context->deflating;
+  transformer->window_bits = 0;
+  transformer->mem_level = 0;
+  transformer->started = false;
+  transformer->at_boundary = true;
+  transformer->parked = false;
+  transformer->parked_window = NULL;
+  transformer->parked_window_len = 0;
+
+  // the transformer is still returned so it can be released like any other failed transformer
+  if (UNLIKELY(transformer->work_buffer == NULL || transformer->state == NULL)) {
+    *error_code = Z_MEM_ERROR;
+  }
+
+  return transformer;
+}
+
+static inline void free_parked_window(GoZLibTransformer *transformer) {
+  if (transformer->parked_window != NULL) {
+    pool_free(transformer->parked_window);
+    transformer->parked_window = NULL;
+    transformer->parked_window_len = 0;
+  }
+}
+
+static inline void pool_release_transformer(GoZLibTransformer *transformer) {
+  if (UNLIKELY(transformer == NULL)) {
+    return;
+  }
+
+  // this will return the transformer and its context to their pools
+  if (LIKELY(transformer->context != NULL)) {
+    restore_adaptive_transformer(transformer);
+    release_zlib_context(transformer->context);
+  }
+  if (LIKELY(transformer->state != NULL)) {
+    pool_release_zstream_state(transformer->state);
+  }
+  if (LIKELY(transformer->work_buffer != NULL)) {
+    pool_free(transformer->work_buffer);
+  }
+  free_parked_window(transformer);
+
+  pool_mem_return(transformer);
+}
+
+GoZLibTransformer *acquire_compression_transformer(int level, int window_bits, int mem_level, int strategy, uInt work_buffer_cap, int *error_code) {
+  GoZLibContext *context = acquire_deflate_context(level, window_bits, mem_level, strategy, error_code);
+  GoZLibTransformer *transformer = pool_alloc_transformer(context, work_buffer_cap, error_code);
+  if (LIKELY(transformer != NULL)) {
+    transformer->deflating = true;
+    transformer->level = level;
+    transformer->window_bits = window_bits;
+    transformer->mem_level = mem_level;
+    transformer->strategy = strategy;
+  }
+  return transformer;
+}
+
+GoZLibTransformer *acquire_gzip_compression_transformer(int level, uInt work_buffer_cap, int *error_code) {
+  return acquire_compression_transformer(level, COMPRESS_GZIP_WINDOW_BITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, work_buffer_cap, error_code);
+}
+
+GoZLibTransformer *acquire_zlib_compression_transformer(int level, uInt work_buffer_cap, int *error_code) {
+  return acquire_compression_transformer(level, MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, work_buffer_cap, error_code);
+}
+
+GoZLibTransformer *acquire_window_uncompression_transformer(int window_bits, uInt work_buffer_cap, int *error_code) {
+  GoZLibContext *context = acquire_inflate_context(window_bits, error_code);
+  GoZLibTransformer *transformer = pool_alloc_transformer(context, work_buffer_cap, error_code);
+  if (LIKELY(transformer != NULL)) {
+    transformer->multi_member = is_multi_member_window(window_bits);
+    transformer->window_bits = window_bits;
+  }
+  return transformer;
+}
+
+GoZLibTransformer *acquire_uncompression_transformer(uInt work_buffer_cap, int *error_code) {
+  return acquire_window_uncompression_transformer(UNCOMPRESS_ANY_WINDOW_BITS, work_buffer_cap, error_code);
+}
+
+GoZLibTransformer *acquire_dictionary_compression_transformer(GoZLibDictionary *dictionary, uInt work_buffer_cap, int *error_code) {
+  return pool_alloc_transformer(acquire_dictionary_deflate_context(dictionary, error_code), work_buffer_cap, error_code);
+}
+
+GoZLibTransformer *acquire_dictionary_uncompression_transformer(GoZLibDictionary *dictionary, uInt work_buffer_cap, int *error_code) {
+  return pool_alloc_transformer(acquire_dictionary_inflate_context(dictionary, error_code), work_buffer_cap, error_code);
+}
+
+void release_compression_transformer(GoZLibTransformer *transformer) {
+  pool_release_transformer(transformer);
+}
+
+void release_uncompression_transformer(GoZLibTransformer *transformer) {
+  pool_release_transformer(transformer);
+}
+
+// returns false for a parked transformer, which is reset by dropping its history and gets a reset context when unparked
+static inline bool reset_transformer_stream(GoZLibTransformer *transformer) {
+  transformer->started = false;
+  transformer->at_boundary = true;
+  if (transformer->parked) {
+    free_parked_window(transformer);
+    return false;
+  }
+  return true;
+}
+
+void reset_compression_transformer(GoZLibTransformer *transformer) {
+  memset(&transformer->adaptive_stats, 0, sizeof(GoZLibAdaptiveStats));
+  memset(&transformer->stats, 0, sizeof(GoZLibStats));
+  if (reset_transformer_stream(transformer)) {
+    restore_adaptive_transformer(transformer);
+    reset_zlib_context(transformer->context);
+  }
+}
+
+void reset_uncompression_transformer(GoZLibTransformer *transformer) {
+  transformer->member_ended = false;
+  memset(&transformer->stats, 0, sizeof(GoZLibStats));
+  if (reset_transformer_stream(transformer)) {
+    reset_zlib_context(transformer->context);
+  }
+}
+
+static inline int get_transformer_window(GoZLibTransformer *transformer, void *window, uInt *window_len) {
+  return transformer->deflating ? deflateGetDictionary(transformer->zs, window, window_len) : inflateGetDictionary(transformer->zs, window, window_len);
+}
+
+bool park_transformer(GoZLibTransformer *transformer) {
+  if (transformer->parked) {
+    return true;
+  }
+
+  // only raw streams, without header nor checksum, can be continued by a new context
+  const bool continued = transformer->started;
+  if (transformer->context == NULL || transformer->context->dictionary != NULL || !transformer->at_boundary || (continued && transformer->window_bits >= 0)) {
+    return false;
+  }
+
+  void *window = NULL;
+  uInt window_len = 0;
+  if (continued) {
+    int window_code = get_transformer_window(transformer, NULL, &window_len);
+    if (window_code == Z_OK && window_len > 0) {
+      window = pool_alloc(window_len);
+      if (UNLIKELY(window == NULL)) {
+        return false;
+      }
+      window_code = get_transformer_window(transformer, window, &window_len);
+    }
+    if (UNLIKELY(window_code != Z_OK)) {
+      if (window != NULL) {
+        pool_free(window);
+      }
+      return false;
+    }
+  }
+
+  if (transformer->deflating) {
+    restore_adaptive_transformer(transformer);
+  }
+  release_zlib_context(transformer->context);
+  transformer->context = NULL;
+  transformer->zs = NULL;
+  pool_free(transformer->work_buffer);
+  transformer->work_buffer = NULL;
+
+  transformer->parked = true;
+  transformer->parked_window = window;
+  transformer->parked_window_len = window_len;
+  return true;
+}
+
+static inline int set_context_window(GoZLibContext *context, bool deflating, void *window, uInt window_len) {
+  z_streamp zs = use_zlib_context(context);
+  return deflating ? deflateSetDictionary(zs, window, window_len) : inflateSetDictionary(zs, window, window_len);
+}
+
+int unpark_transformer(GoZLibTransformer *transformer) {
+  if (!transformer->parked) {
+    return Z_OK;
+  }
+
+  void *work_buffer = pool_alloc(transformer->work_buffer_cap);
+  if (UNLIKELY(work_buffer == NULL)) {
+    return Z_MEM_ERROR;
+  }
+
+  int error_code = Z_OK;
+  GoZLibContext *context = transformer->deflating ? acquire_deflate_context(transformer->level, transformer->window_bits, transformer->mem_level, transformer->strategy, &error_code)
+                                                  : acquire_inflate_context(transformer->window_bits, &error_code);
+  if (UNLIKELY(context == NULL)) {
+    pool_free(work_buffer);
+    return error_code;
+  }
+
+  if (transformer->parked_window != NULL) {
+    // setting the window marks the context as used, so it's cleared if released before any call or when setting the window fails
+    error_code = set_context_window(context, transformer->deflating, transformer->parked_window, transformer->parked_window_len);
+    if (UNLIKELY(error_code != Z_OK)) {
+      release_zlib_context(context);
+      pool_free(work_buffer);
+      return error_code;
+    }
+    free_parked_window(transformer);
+  }
+
+  transformer->context = context;
+  transformer->zs = &context->zs;
+  transformer->work_buffer = work_buffer;
+  transformer->parked = false;
+  return Z_OK;
+}
+
+/*
+  files
+  Input files are mapped and fed to zlib in chunks of at most UINT_MAX bytes, avail_in being an uInt. Output is
+  collected in a FILE_OUTPUT_BUFFER_SIZE buffer, served page aligned by the multipool large block tier, and written
+  with pwrite once full. With direct_io the output file is switched to O_DIRECT, falling back to buffered writes if
+  the file system doesn't support it, and back to buffered writes for the last partial buffer since O_DIRECT requires
+  block aligned lengths.
+*/
+#define FILE_OUTPUT_BUFFER_SIZE (8 * 1024 * 1024)
+
+typedef struct {
+  int fd;
+  off_t offset;
+  unsigned char *buffer;
+  size_t used;
+  bool direct_io;
+  uint64_t written;
+} FileOutput;
+
+static inline bool map_input_file(int fd, void **map, size_t *length) {
+  struct stat st;
+  if (UNLIKELY(fstat(fd, &st) != 0)) {
+    return false;
+  }
+
+  *map = NULL;
+  *length = (size_t)st.st_size;
+  if (*length == 0) {
+    return true;
+  }
+
+  void *mem = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (UNLIKELY(mem == MAP_FAILED)) {
+    return false;
+  }
+#ifdef MADV_SEQUENTIAL
+  madvise(mem, *length, MADV_SEQUENTIAL);
+#endif
+  *map = mem;
+  return true;
+}
+
+static inline void unmap_input_file(void *map, size_t length) {
+  if (map != NULL) {
+    munmap(map, length);
+  }
+}
+
+static inline void feed_mapped_input(z_streamp zs, void *map, size_t length, size_t *fed) {
+  if (zs->avail_in > 0 || *fed == length) {
+    return;
+  }
+
+  const size_t chunk = length - *fed > UINT_MAX ? UINT_MAX : length - *fed;
+  zs->next_in = (unsigned char *)map + *fed;
+  zs->avail_in = (uInt)chunk;
+  *fed += chunk;
+}
+
+static inline bool init_file_output(FileOutput *output, int fd, bool direct_io) {
+  output->fd = fd;
+  output->offset = lseek(fd, 0, SEEK_CUR);
+  output->used = 0;
+  output->written = 0;
+  output->direct_io = false;
+  // files that are not seekable can't be written with pwrite
+  if (UNLIKELY(output->offset < 0)) {
+    return false;
+  }
+
+  output->buffer = pool_alloc(FILE_OUTPUT_BUFFER_SIZE);
+  if (UNLIKELY(output->buffer == NULL)) {
+    errno = ENOMEM;
+    return false;
+  }
+
+#ifdef O_DIRECT
+  const int flags = fcntl(fd, F_GETFL);
+  // direct writes need a block aligned file offset as well
+  if (direct_io && flags >= 0 && ((size_t)output->offset % pool_page_size()) == 0 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0) {
+    output->direct_io = true;
+  }
+#else
+  (void)direct_io;
+#endif
+  return true;
+}
+
+static inline void set_file_output_buffered(FileOutput *output) {
+#ifdef O_DIRECT
+  if (output->direct_io) {
+    const int flags = fcntl(output->fd, F_GETFL);
+    if (flags >= 0) {
+      fcntl(output->fd, F_SETFL, flags & ~O_DIRECT);
+    }
+    output->direct_io = false;
+  }
+#endif
+}
+
+static inline bool write_file_output(FileOutput *output) {
+  // O_DIRECT requires block aligned lengths, only full buffers qualify
+  if (output->used < FILE_OUTPUT_BUFFER_SIZE) {
+    set_file_output_buffered(output);
+  }
+
+  size_t written = 0;
+  while (written < output->used) {
+    ssize_t count = pwrite(output->fd, output->buffer + written, output->used - written, output->offset);
+    if (count < 0 && errno == EINVAL && output->direct_io) {
+      // the file system accepted O_DIRECT but not these writes
+      set_file_output_buffered(output);
+      continue;
+    }
+    if (UNLIKELY(count < 0)) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    written += (size_t)count;
+    output->offset += count;
+  }
+
+  output->written += output->used;
+  output->used = 0;
+  return true;
+}
+
+static inline void end_file_output(FileOutput *output) {
+  set_file_output_buffered(output);
+  if (output->buffer != NULL) {
+    pool_free(output->buffer);
+  }
+}
+
+// runs deflate or inflate over a mapped input until the end of the stream, writing the output to a file
+static uint64_t context_file_transform(GoZLibContext *context, bool multi_member, int input_fd, int output_fd, bool direct_io, int *error_code) {
+  if (context == NULL) {
+    return 0;
+  }
+
+  void *map = NULL;
+  size_t length = 0;
+  FileOutput output = {0};
+  if (UNLIKELY(!map_input_file(input_fd, &map, &length) || !init_file_output(&output, output_fd, direct_io))) {
+    *error_code = Z_ERRNO;
+    unmap_input_file(map, length);
+    end_file_output(&output);
+    release_zlib_context(context);
+    return 0;
+  }
+
+  z_streamp zs = use_zlib_context(context);
+  // pooled contexts can hold the input of their last use
+  zs->avail_in = 0;
+  size_t fed = 0;
+  int code = Z_OK;
+  // an empty file has nothing to uncompress, the same as an empty stream
+  bool transform = context->deflating || length > 0;
+
+  while (transform) {
+    feed_mapped_input(zs, map, length, &fed);
+
+    zs->next_out = output.buffer + output.used;
+    zs->avail_out = (uInt)(FILE_OUTPUT_BUFFER_SIZE - output.used);
+    if (context->deflating) {
+      code = deflate(zs, fed == length ? Z_FINISH : Z_NO_FLUSH);
+    } else {
+      code = inflate_context(context, Z_NO_FLUSH);
+      // no progress with all input consumed means the stream is truncated
+      if (code == Z_BUF_ERROR && zs->avail_in == 0 && fed == length) {
+        code = Z_DATA_ERROR;
+      }
+      if (code == Z_STREAM_END && multi_member && (zs->avail_in > 0 || fed < length)) {
+        inflate_next_member(zs);
+        code = Z_OK;
+      }
+    }
+    output.used = FILE_OUTPUT_BUFFER_SIZE - zs->avail_out;
+
+    if (UNLIKELY(code < Z_OK && code != Z_BUF_ERROR)) {
+      *error_code = code;
+      break;
+    }
+
+    transform = code != Z_STREAM_END;
+    if (output.used == FILE_OUTPUT_BUFFER_SIZE || !transform) {
+      if (UNLIKELY(!write_file_output(&output))) {
+        *error_code = Z_ERRNO;
+        break;
+      }
+    }
+  }
+
+  unmap_input_file(map, length);
+  end_file_output(&output);
+  release_zlib_context(context);
+
+  return output.written;
+}
+
+uint64_t file_compress(int input_fd, int output_fd, int level, int window_bits, int mem_level, int strategy, bool direct_io, int *error_code) {
+  GoZLibContext *context = acquire_deflate_context(level, window_bits, mem_level, strategy, error_code);
+  return context_file_transform(context, false, input_fd, output_fd, direct_io, error_code);
+}
+
+uint64_t file_uncompress(int input_fd, int output_fd, int window_bits, bool direct_io, int *error_code) {
+  GoZLibContext *context = acquire_inflate_context(window_bits, error_code);
+  return context_file_transform(context, is_multi_member_window(window_bits), input_fd, output_fd, direct_io, error_code);
+}
+
+GoZLibFileReader *open_file_reader(int input_fd, int window_bits, int *error_code) {
+  GoZLibFileReader *reader = pool_alloc(sizeof(GoZLibFileReader));
+  if (UNLIKELY(reader == NULL)) {
+    *error_code = Z_MEM_ERROR;
+    return NULL;
+  }
+
+  reader->fed = 0;
+  reader->finished = false;
+  reader->multi_member = is_multi_member_window(window_bits);
+  if (UNLIKELY(!map_input_file(input_fd, &reader->map, &reader->length))) {
+    *error_code = Z_ERRNO;
+    pool_free(reader);
+    return NULL;
+  }
+
+  reader->context = acquire_inflate_context(window_bits, error_code);
+  if (UNLIKELY(reader->context == NULL)) {
+    unmap_input_file(reader->map, reader->length);
+    pool_free(reader);
+    return NULL;
+  }
+  reader->context->zs.avail_in = 0;
+  // an empty file has nothing to uncompress, the same as an empty stream
+  reader->finished = reader->length == 0;
+
+  return reader;
+}
+
+GoZLibStepResult file_reader_read(GoZLibFileReader *reader, void *output, uInt output_len) {
+  GoZLibStepResult result = {.consumed = 0, .produced = 0, .status = Z_STREAM_END};
+  if (reader->finished) {
+    return result;
+  }
+
+  z_streamp zs = use_zlib_context(reader->context);
+  zs->next_out = output;
+  zs->avail_out = output_len;
+
+  int code = Z_OK;
+  while (zs->avail_out > 0 && code == Z_OK) {
+    feed_mapped_input(zs, reader->map, reader->length, &reader->fed);
+    code = inflate_context(reader->context, Z_NO_FLUSH);
+    if (code == Z_BUF_ERROR && zs->avail_in == 0 && reader->fed == reader->length) {
+      code = Z_DATA_ERROR;
+    }
+    if (code == Z_STREAM_END && reader->multi_member && (zs->avail_in > 0 || reader->fed < reader->length)) {
+      inflate_next_member(zs);
+      code = Z_OK;
+    }
+  }
+
+  result.produced = output_len - zs->avail_out;
+  reader->finished = code == Z_STREAM_END;
+  // the end of the stream is reported once all its data was read
+  result.status = code == Z_BUF_ERROR || (code == Z_STREAM_END && result.produced > 0) ? Z_OK : code;
+  return result;
+}
+
+void close_file_reader(GoZLibFileReader *reader) {
+  if (reader == NULL) {
+    return;
+  }
+
+  unmap_input_file(reader->map, reader->length);
+  release_zlib_context(reader->context);
+  pool_free(reader);
+}
+
+/*
+  random access index
+  Like zlib's zran example, the index is built by inflating the whole stream with Z_BLOCK, which returns at the end of
+  the header and of every deflate block. An access point is recorded at the end of the header and then at the first
+  block boundary after each span of uncompressed bytes. Each point holds the compressed and uncompressed offsets, the
+  number of bits of the last compressed byte belonging to the previous block and the last 32K of uncompressed data,
+  read with inflateGetDictionary. A raw inflate stream primed with the point resumes uncompressing from there.
+  Members of a multi member gzip stream are inflated one after the other, each one starting with an access point at
+  the end of its header, so no segment between two consecutive points spans more than one member.
+*/
+#define INDEX_WINDOW_SIZE 32768U
+#define INDEX_INITIAL_POINTS 16
+
+static inline bool add_index_access_point(GoZLibIndexBuilder *builder) {
+  if (builder->count == builder->capacity) {
+    const size_t capacity = builder->capacity == 0 ? INDEX_INITIAL_POINTS : builder->capacity * 2;
+    GoZLibAccessPoint *points = realloc(builder->points, capacity * sizeof(GoZLibAccessPoint));
+    if (UNLIKELY(points == NULL)) {
+      return false;
+    }
+    builder->points = points;
+    builder->capacity = capacity;
+  }
+
+  z_streamp zs = &builder->context->zs;
+  GoZLibAccessPoint *point = &builder->points[builder->count];
+  point->in = zs->total_in;
+  point->out = zs->total_out;
+  point->bits = zs->data_type & 7;
+  point->window_len = INDEX_WINDOW_SIZE;
+  if (UNLIKELY(inflateGetDictionary(zs, point->window, &point->window_len) != Z_OK)) {
+    return false;
+  }
+
+  builder->count++;
+  builder->last_out = point->out;
+  builder->member_start = false;
+  return true;
+}
+
+GoZLibIndexBuilder *create_index_builder(uint64_t span, int *error_code) {
+  GoZLibIndexBuilder *builder = pool_alloc(sizeof(GoZLibIndexBuilder));
+  if (UNLIKELY(builder == NULL)) {
+    *error_code = Z_MEM_ERROR;
+    return NULL;
+  }
+
+  builder->span = span;
+  builder->last_out = 0;
+  builder->points = NULL;
+  builder->count = 0;
+  builder->capacity = 0;
+  builder->member_start = true;
+  builder->member_ended = false;
+  builder->scratch = pool_alloc(INDEX_WINDOW_SIZE);
+  builder->context = acquire_inflate_context(UNCOMPRESS_ANY_WINDOW_BITS, error_code);
+  if (UNLIKELY(builder->scratch == NULL || builder->context == NULL)) {
+    // a failed context acquire sets its own error code
+    if (builder->scratch == NULL) {
+      *error_code = Z_MEM_ERROR;
+    }
+    free_index_builder(builder);
+    return NULL;
+  }
+
+  builder->context->zs.avail_in = 0;
+  return builder;
+}
+
+GoZLibStepResult index_builder_step(GoZLibIndexBuilder *builder, void *input, uInt input_len) {
+  z_streamp zs = use_zlib_context(builder->context);
+  zs->next_in = input;
+  zs->avail_in = input_len;
+
+  GoZLibStepResult result = {.consumed = 0, .produced = 0, .status = Z_OK};
+  while (zs->avail_in > 0 && result.status == Z_OK) {
+    if (builder->member_ended) {
+      inflate_next_member(zs);
+      builder->member_ended = false;
+      builder->member_start = true;
+    }
+
+    // the uncompressed data is discarded, only the window is kept in the access points
+    zs->next_out = builder->scratch;
+    zs->avail_out = INDEX_WINDOW_SIZE;
+    const uLong total_out = zs->total_out;
+
+    int inf_code = inflate(zs, Z_BLOCK);
+    result.produced += (uInt)(zs->total_out - total_out);
+    if (UNLIKELY(inf_code == Z_NEED_DICT || (inf_code < Z_OK && inf_code != Z_BUF_ERROR))) {
+      result.status = inf_code == Z_NEED_DICT ? Z_DATA_ERROR : inf_code;
+      break;
+    }
+    if (inf_code == Z_STREAM_END) {
+      // any input left belongs to the next member
+      builder->member_ended = true;
+      result.status = zs->avail_in == 0 ? Z_STREAM_END : Z_OK;
+      continue;
+    }
+
+    // at the end of the header or of a block that isn't the last one
+    const bool block_boundary = (zs->data_type & 128) && !(zs->data_type & 64);
+    if (block_boundary && (builder->member_start || zs->total_out - builder->last_out >= builder->span)) {
+      if (UNLIKELY(!add_index_access_point(builder))) {
+        result.status = Z_MEM_ERROR;
+      }
+    }
+  }
+
+  result.consumed = input_len - zs->avail_in;
+  return result;
+}
+
+void free_index_builder(GoZLibIndexBuilder *builder) {
+  if (builder == NULL) {
+    return;
+  }
+
+  if (builder->context != NULL) {
+    release_zlib_context(builder->context);
+  }
+  if (builder->scratch != NULL) {
+    pool_free(builder->scratch);
+  }
+  free(builder->points);
+  pool_free(builder);
+}
+
+int transformer_prime_access_point(GoZLibTransformer *transformer, uint64_t in, uint64_t out, int bits, int prime_byte, void *window, uInt window_len) {
+  z_streamp zs = use_zlib_context(transformer->context);
+  if (bits > 0) {
+    int prime_code = inflatePrime(zs, bits, prime_byte >> (8 - bits));
+    if (UNLIKELY(prime_code != Z_OK)) {
+      return prime_code;
+    }
+  }
+  if (window_len > 0) {
+    int dict_code = inflateSetDictionary(zs, window, window_len);
+    if (UNLIKELY(dict_code != Z_OK)) {
+      return dict_code;
+    }
+  }
+
+  // the totals reflect the position in the whole stream
+  zs->total_in = (uLong)in;
+  zs->total_out = (uLong)out;
+  return Z_OK;
 }
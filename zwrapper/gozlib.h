@@ -1,7 +1,13 @@
 #ifndef GOZLIB_H
 #define GOZLIB_H
 
+#ifndef _GNU_SOURCE
+// O_DIRECT, used by the file API
+#define _GNU_SOURCE
+#endif
+
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <zconf.h>
 #include <zlib.h>
@@ -12,6 +18,34 @@
 #define GOZLIB_STREAM_OUTPUT_WRITE_ERROR (-(GOZLIB_CUSTOM_CODE_BASE + 1))
 #define GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA (GOZLIB_CUSTOM_CODE_BASE + 1)
 
+// one-shot buffer compression backends
+#define GOZLIB_BUFFER_BACKEND_ZLIB 0
+#define GOZLIB_BUFFER_BACKEND_LIBDEFLATE 1
+
+// native slice pool used by the pooled output functions, implemented in dyn_mem_pool.h
+struct MultiPool;
+struct MultiPool* multipool_create(void);
+void multipool_free(struct MultiPool* multipool);
+bool multipool_in_use(struct MultiPool* multipool);
+void pool_mem_return(void* data);
+
+
+/**
+ * @brief Instrumentation counters, only updated while enabled with set_stats_enabled. zlib_calls counts the deflate or
+ * inflate calls, which consumed bytes_in and produced bytes_out in zlib_ns nanoseconds. handler_calls and handler_ns
+ * measure the stream data handlers and pool_misses counts contexts initialized because none was pooled,
+ * which is only tracked globally
+ *
+ */
+typedef struct {
+    uint64_t zlib_calls;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t zlib_ns;
+    uint64_t handler_calls;
+    uint64_t handler_ns;
+    uint64_t pool_misses;
+} GoZLibStats;
 
 /**
  * @brief Struct to track a zlib stream state for streaming operations
@@ -19,8 +53,168 @@
  */
 typedef struct  {
     void* data_handler;
+    // counters of the stream currently using this state, cleared when it starts
+    GoZLibStats stats;
 } ZStreamState;
 
+/**
+ * @brief Enables or disables the instrumentation counters of the buffer, stream and transformer functions.
+ * Disabled by default, when it costs a single relaxed load per call
+ *
+ * @param enabled
+ */
+void set_stats_enabled(bool enabled);
+
+/**
+ * @brief Returns true if the instrumentation counters are enabled
+ *
+ */
+bool get_stats_enabled(void);
+
+/**
+ * @brief Copies the counters aggregated over all buffers, streams and transformers since the process started
+ *
+ * @param deflating true for the compression counters, false for uncompression
+ * @param stats
+ */
+void get_global_stats(bool deflating, GoZLibStats* stats);
+
+
+/**
+ * @brief Preset dictionary shared by zlib or raw deflate streams, holding its own pools of primed contexts
+ *
+ */
+typedef struct {
+    void* data;
+    uInt length;
+    int level;
+    int window_bits;
+    int mem_level;
+    int strategy;
+    struct MemPool* deflate_pool;
+    struct MemPool* inflate_pool;
+} GoZLibDictionary;
+
+/**
+ * @brief Pre-initialized deflate or inflate stream kept in a pool keyed by its stream parameters.
+ * Contexts are reset instead of re-initialized between uses, keeping the zlib internal state allocated.
+ * Contexts created for a dictionary are primed with it again when reset.
+ * The zlib internal state is carved from a single arena sized after the allocations made by previous
+ * contexts with the same window bits and memory level.
+ * used tells whether the stream was driven since it was initialized or last reset, only used contexts are reset
+ *
+ */
+typedef struct {
+    z_stream zs;
+    bool deflating;
+    bool keyed;
+    bool used;
+    GoZLibDictionary* dictionary;
+    char* arena;
+    size_t arena_size;
+    size_t arena_used;
+    size_t requested_size;
+    uint32_t* learned_arena_size;
+} GoZLibContext;
+
+/**
+ * @brief Creates a dictionary for compressing and uncompressing with the given deflateInit2 parameters.
+ * Only zlib (8..15) and raw deflate (-15..-8) window bits are supported, gzip streams can't use a preset dictionary.
+ * The dictionary data is copied. If the dictionary cannot be created, NULL is returned and error_code is set to the zlib error code
+ *
+ * @param data
+ * @param length
+ * @param level
+ * @param window_bits
+ * @param mem_level
+ * @param strategy
+ * @param error_code
+ * @return GoZLibDictionary*
+ */
+GoZLibDictionary* create_zlib_dictionary(void* data, uInt length, int level, int window_bits, int mem_level, int strategy, int* error_code);
+
+/**
+ * @brief Frees a dictionary and its pooled contexts. All contexts and transformers acquired with it must have been released
+ *
+ * @param dictionary
+ */
+void free_zlib_dictionary(GoZLibDictionary* dictionary);
+
+/**
+ * @brief Acquires a deflate context primed with the dictionary, see acquire_deflate_context
+ *
+ * @param dictionary
+ * @param error_code
+ * @return GoZLibContext*
+ */
+GoZLibContext* acquire_dictionary_deflate_context(GoZLibDictionary* dictionary, int* error_code);
+
+/**
+ * @brief Acquires an inflate context that uses the dictionary, see acquire_inflate_context
+ *
+ * @param dictionary
+ * @param error_code
+ * @return GoZLibContext*
+ */
+GoZLibContext* acquire_dictionary_inflate_context(GoZLibDictionary* dictionary, int* error_code);
+
+/**
+ * @brief Acquires a pooled deflate context for the given parameters, initializing a new one if none is available.
+ * If the context cannot be created, NULL is returned and error_code is set to the zlib error code
+ *
+ * @param level
+ * @param window_bits
+ * @param mem_level
+ * @param strategy
+ * @param error_code
+ * @return GoZLibContext*
+ */
+GoZLibContext* acquire_deflate_context(int level, int window_bits, int mem_level, int strategy, int* error_code);
+
+/**
+ * @brief Acquires a pooled inflate context for the given window bits, initializing a new one if none is available.
+ * If the context cannot be created, NULL is returned and error_code is set to the zlib error code
+ *
+ * @param window_bits
+ * @param error_code
+ * @return GoZLibContext*
+ */
+GoZLibContext* acquire_inflate_context(int window_bits, int* error_code);
+
+/**
+ * @brief Resets a deflate or inflate context and returns it to its pool
+ *
+ * @param context
+ */
+void release_zlib_context(GoZLibContext* context);
+
+/**
+ * @brief Compress input into the output buffer using an acquired deflate context. The context is reset before returning
+ * If the length of output is too small, zero is returned and eror_code is set to the zlib error code
+ *
+ * @param context
+ * @param input
+ * @param input_len
+ * @param output
+ * @param output_len
+ * @param error_code
+ * @return uLong length of compressed output or 0 on error
+ */
+uLong context_compress_buffer(GoZLibContext* context, void* restrict input, uInt input_len, void* restrict output, uInt output_len, int* error_code);
+
+/**
+ * @brief Uncompress input into the output buffer using an acquired inflate context. The context is reset before returning
+ * Errors are reported the same way as uncompress_buffer_any
+ *
+ * @param context
+ * @param input
+ * @param input_len
+ * @param output
+ * @param output_len
+ * @param error_code
+ * @return uLong
+ */
+uLong context_uncompress_buffer(GoZLibContext* context, void* restrict input, uInt input_len, void* restrict output, uInt output_len, int* error_code);
 
 /**
  * @brief Compress input into the output buffer using the standard zlib compression
@@ -64,6 +258,335 @@ uLong uncompress_buffer_any(void* restrict input, uInt input_len, void* restrict
  */
 uLong gzip_compress_buffer(int level, void* restrict input, uInt input_len, void* restrict output, uInt output_len, int* error_code);
 
+/**
+ * @brief Compress input into the output buffer with the given deflateInit2 parameters. The window bits select the format,
+ * 8..15 for zlib, 24..31 for gzip and -15..-8 for raw deflate. Errors are reported the same way as gzip_compress_buffer
+ *
+ * @param level
+ * @param window_bits
+ * @param mem_level
+ * @param strategy
+ * @param input
+ * @param input_len
+ * @param output
+ * @param output_len
+ * @param error_code
+ * @return uLong length of compressed output or 0 on error
+ */
+uLong deflate_compress_buffer(int level, int window_bits, int mem_level, int strategy, void* restrict input, uInt input_len, void* restrict output, uInt output_len, int* error_code);
+
+/**
+ * @brief Number of input samples classified by adaptive compression and how many of them were stored or Huffman coded only
+ *
+ */
+typedef struct {
+    uint64_t samples;
+    uint64_t stored;
+    uint64_t huffman_only;
+} GoZLibAdaptiveStats;
+
+/**
+ * @brief Compresses input like deflate_compress_buffer, after sampling it. Inputs that look incompressible are stored
+ * or Huffman coded only instead of being deflated with the given level and strategy
+ *
+ * @param level
+ * @param window_bits
+ * @param mem_level
+ * @param strategy
+ * @param input
+ * @param input_len
+ * @param output
+ * @param output_len
+ * @param error_code
+ * @return uLong length of compressed output or 0 on error
+ */
+uLong adaptive_deflate_compress_buffer(int level, int window_bits, int mem_level, int strategy, void* restrict input, uInt input_len, void* restrict output, uInt output_len,
+                                       int* error_code);
+
+/**
+ * @brief Copies the adaptive_deflate_compress_buffer sampling counters, shared by all calls
+ *
+ * @param stats
+ */
+void get_adaptive_buffer_stats(GoZLibAdaptiveStats* stats);
+
+/**
+ * @brief Maximum length of the compressed output of an input of input_len bytes with the given deflateInit2 parameters, see
+ * deflate_compress_buffer. It's the deflateBound of a pooled context, raised to the worst case of the libdeflate backend when it's selected.
+ * Zero is returned and error_code is set if the parameters are not valid
+ *
+ * @param level
+ * @param window_bits
+ * @param mem_level
+ * @param strategy
+ * @param input_len
+ * @param error_code
+ * @return uLong
+ */
+uLong deflate_compress_bound(int level, int window_bits, int mem_level, int strategy, uLong input_len, int* error_code);
+
+/**
+ * @brief Compress input like deflate_compress_buffer, or adaptive_deflate_compress_buffer if adaptive is set, into an output buffer of
+ * deflate_compress_bound bytes acquired from pool. On success output is set to the buffer, which must be returned with pool_mem_return.
+ * On error, zero is returned, output is set to NULL and error_code is set to the zlib error code
+ *
+ * @param pool
+ * @param level
+ * @param window_bits
+ * @param mem_level
+ * @param strategy
+ * @param adaptive
+ * @param input
+ * @param input_len
+ * @param output
+ * @param error_code
+ * @return uLong length of compressed output
+ */
+uLong deflate_compress_pooled(struct MultiPool* pool, int level, int window_bits, int mem_level, int strategy, bool adaptive, void* restrict input, uInt input_len, void** output,
+                              int* error_code);
+
+/**
+ * @brief Selects the library used by the one-shot buffer compression functions. Streams, transformers and dictionaries always use zlib
+ *
+ * @param backend GOZLIB_BUFFER_BACKEND_ZLIB or GOZLIB_BUFFER_BACKEND_LIBDEFLATE
+ * @return true if the backend was selected, false if it's not available in this build
+ */
+bool set_buffer_backend(int backend);
+
+/**
+ * @brief Returns the library currently used by the one-shot buffer compression functions
+ *
+ * @return int GOZLIB_BUFFER_BACKEND_ZLIB or GOZLIB_BUFFER_BACKEND_LIBDEFLATE
+ */
+int get_buffer_backend(void);
+
+/**
+ * @brief Uncompress input into the output buffer with the given inflateInit2 window bits, which allows raw deflate inputs.
+ * Errors are reported the same way as uncompress_buffer_any
+ *
+ * @param window_bits
+ * @param input
+ * @param input_len
+ * @param output
+ * @param output_len
+ * @param error_code
+ * @return uLong
+ */
+uLong inflate_uncompress_buffer(int window_bits, void* restrict input, uInt input_len, void* restrict output, uInt output_len, int* error_code);
+
+/**
+ * @brief Uncompress input with the given inflateInit2 window bits in a single pass into an output buffer acquired from pool.
+ * The buffer starts at the size in the trailer of gzip inputs, or a guess for other formats, and is doubled whenever it fills up.
+ * The whole input must be consumed: concatenated gzip members are uncompressed as a single stream when window_bits allows gzip,
+ * any other data after the end of the stream fails with Z_DATA_ERROR.
+ * On success output is set to the buffer, which must be returned with pool_mem_return. On error, zero is returned,
+ * output is set to NULL and error_code is set to the zlib error code, Z_BUF_ERROR if the input is truncated
+ *
+ * @param pool
+ * @param window_bits
+ * @param input
+ * @param input_len
+ * @param output
+ * @param error_code
+ * @return uLong length of the uncompressed data in output
+ */
+uLong inflate_uncompress_pooled(struct MultiPool* pool, int window_bits, void* restrict input, uInt input_len, void** output, int* error_code);
+
+/**
+ * @brief Compress input into the output buffer with the dictionary and its parameters.
+ * Errors are reported the same way as gzip_compress_buffer
+ *
+ * @param dictionary
+ * @param input
+ * @param input_len
+ * @param output
+ * @param output_len
+ * @param error_code
+ * @return uLong length of compressed output or 0 on error
+ */
+uLong dictionary_compress_buffer(GoZLibDictionary* dictionary, void* restrict input, uInt input_len, void* restrict output, uInt output_len, int* error_code);
+
+/**
+ * @brief Uncompress input compressed with the dictionary into the output buffer.
+ * Errors are reported the same way as uncompress_buffer_any, using a different dictionary is a Z_DATA_ERROR
+ *
+ * @param dictionary
+ * @param input
+ * @param input_len
+ * @param output
+ * @param output_len
+ * @param error_code
+ * @return uLong
+ */
+uLong dictionary_uncompress_buffer(GoZLibDictionary* dictionary, void* restrict input, uInt input_len, void* restrict output, uInt output_len, int* error_code);
+
+/**
+ * @brief One entry of a batch compression. Input and output are addresses of caller owned buffers, stored as integers so that
+ * batches can be built in Go memory. result_len and error_code are set by the batch functions
+ *
+ */
+typedef struct {
+    uintptr_t input;
+    uintptr_t output;
+    uInt input_len;
+    uInt output_len;
+    uLong result_len;
+    int error_code;
+} GoZLibBatchItem;
+
+/**
+ * @brief Compress each item input into its output buffer in gzip format, reusing one deflate context for all items.
+ * Items are split in contiguous ranges compressed concurrently by up to max_threads threads, each one with its own context.
+ * Each item result_len is set to the compressed length and error_code to the zlib error code, or Z_OK
+ *
+ * @param level
+ * @param items
+ * @param count
+ * @param max_threads
+ */
+void gzip_compress_batch(int level, GoZLibBatchItem* items, uInt count, uInt max_threads);
+
+/**
+ * @brief Same as gzip_compress_batch, using the standard zlib format
+ *
+ * @param level
+ * @param items
+ * @param count
+ * @param max_threads
+ */
+void zlib_compress_batch(int level, GoZLibBatchItem* items, uInt count, uInt max_threads);
+
+/**
+ * @brief Uncompress each item input with the given inflateInit2 window bits into an output buffer acquired from pool, like
+ * inflate_uncompress_pooled. Items are split in contiguous ranges uncompressed concurrently by up to max_threads threads,
+ * each one reusing a single inflate context for its items. The gzip CRC-32 and ISIZE and the zlib Adler-32 trailers are
+ * verified by inflate, a mismatch fails the item with Z_DATA_ERROR.
+ * Each item output is set to the address of its buffer, to be returned with pool_mem_return, or 0 on error, result_len to
+ * the uncompressed length and error_code to the zlib error code, or Z_OK. The item output_len is not used
+ *
+ * @param pool
+ * @param window_bits
+ * @param items
+ * @param count
+ * @param max_threads
+ */
+void inflate_uncompress_batch(struct MultiPool* pool, int window_bits, GoZLibBatchItem* items, uInt count, uInt max_threads);
+
+/**
+ * @brief One segment of a vectored input or output. The address is stored as an integer so that segment arrays can be
+ * built in Go memory. For inputs len is the segment length, for outputs it's the segment capacity and is set to the
+ * number of bytes written to the segment by the vector functions
+ *
+ */
+typedef struct {
+    uintptr_t data;
+    uInt len;
+} GoZLibSegment;
+
+/**
+ * @brief Compress the concatenation of the input segments into the chain of output segments using an acquired deflate context,
+ * filling each output segment before moving to the next. Segments are fed to zlib in turn, without being copied.
+ * If the output segments are too small, zero is returned and error_code is set to Z_MEM_ERROR
+ *
+ * @param context
+ * @param input
+ * @param input_count
+ * @param output
+ * @param output_count
+ * @param error_code
+ * @return uLong total length of compressed output or 0 on error
+ */
+uLong context_compress_vector(GoZLibContext* context, const GoZLibSegment* input, uInt input_count, GoZLibSegment* output, uInt output_count, int* error_code);
+
+/**
+ * @brief Same as context_compress_vector with a pooled context for the given deflateInit2 parameters, see deflate_compress_buffer.
+ * Vectors are always compressed with zlib, regardless of the buffer backend
+ *
+ * @param level
+ * @param window_bits
+ * @param mem_level
+ * @param strategy
+ * @param input
+ * @param input_count
+ * @param output
+ * @param output_count
+ * @param error_code
+ * @return uLong total length of compressed output or 0 on error
+ */
+uLong deflate_compress_vector(int level, int window_bits, int mem_level, int strategy, const GoZLibSegment* input, uInt input_count, GoZLibSegment* output, uInt output_count,
+                              int* error_code);
+
+/**
+ * @brief Maximum size of the output of deflate_raw_block for a given input length
+ *
+ * @param input_len
+ * @return uLong
+ */
+uLong deflate_raw_block_bound(uLong input_len);
+
+/**
+ * @brief Updates a CRC32 checksum with the given data, the same as zlib's crc32_z but hardware accelerated when
+ * built with libdeflate. The initial value is zero
+ *
+ * @param crc
+ * @param data
+ * @param len
+ * @return uLong the updated checksum
+ */
+uLong checksum_crc32(uLong crc, const void* data, size_t len);
+
+/**
+ * @brief Updates an Adler32 checksum with the given data, the same as zlib's adler32_z but hardware accelerated when
+ * built with libdeflate. The initial value is one
+ *
+ * @param adler
+ * @param data
+ * @param len
+ * @return uLong the updated checksum
+ */
+uLong checksum_adler32(uLong adler, const void* data, size_t len);
+
+/**
+ * @brief Size of the output of gzip_store_buffer for a given input length
+ *
+ * @param input_len
+ * @return uLong
+ */
+uLong gzip_store_bound(uLong input_len);
+
+/**
+ * @brief Writes input into the output buffer as a gzip stream of stored blocks, without compressing it.
+ * If the output is smaller than gzip_store_bound, zero is returned and error_code is set to Z_MEM_ERROR
+ *
+ * @param input
+ * @param input_len
+ * @param output
+ * @param output_len
+ * @param error_code
+ * @return uLong length of the gzip output or 0 on error
+ */
+uLong gzip_store_buffer(void* restrict input, uInt input_len, void* restrict output, uInt output_len, int* error_code);
+
+/**
+ * @brief Compress one block of a larger input as raw deflate data, so that independently compressed blocks can be concatenated
+ * into a single deflate stream. The dictionary, usually the end of the previous block, is used to find matches across blocks.
+ * Non last blocks end with a sync flush and the last block terminates the stream. crc is set to the crc32 of the input.
+ * If the output is too small to hold the whole compressed block, zero is returned and error_code is set to the zlib error code
+ *
+ * @param level
+ * @param dictionary
+ * @param dictionary_len
+ * @param input
+ * @param input_len
+ * @param output
+ * @param output_len
+ * @param last
+ * @param crc
+ * @param error_code
+ * @return uLong length of compressed output or 0 on error
+ */
+uLong deflate_raw_block(int level, void* restrict dictionary, uInt dictionary_len, void* restrict input, uInt input_len, void* restrict output, uInt output_len, bool last, uLong* crc, int* error_code);
+
 ZStreamState* pool_acquire_zstream_state(void);
 void pool_release_zstream_state(ZStreamState* state);
 
@@ -119,6 +642,34 @@ uLong gzip_compress_stream(ZStreamState* state, int level, StreamDataHandler inp
  */
 uLong uncompress_stream_any(ZStreamState* state, StreamDataHandler input_handler, StreamDataHandler output_handler, uInt work_input_buffer_cap, uInt work_output_buffer_cap, int* error_code);
 
+/**
+ * @brief Compress a stream of data with the dictionary and its parameters
+ *
+ * @param state
+ * @param dictionary
+ * @param input_handler
+ * @param output_handler
+ * @param work_input_buffer_cap
+ * @param work_output_buffer_cap
+ * @param error_code
+ * @return uLong
+ */
+uLong dictionary_compress_stream(ZStreamState* state, GoZLibDictionary* dictionary, StreamDataHandler input_handler, StreamDataHandler output_handler, uInt work_input_buffer_cap, uInt work_output_buffer_cap, int* error_code);
+
+/**
+ * @brief Uncompress a stream compressed with the dictionary
+ *
+ * @param state
+ * @param dictionary
+ * @param input_handler
+ * @param output_handler
+ * @param work_input_buffer_cap
+ * @param work_output_buffer_cap
+ * @param error_code
+ * @return uLong
+ */
+uLong dictionary_uncompress_stream(ZStreamState* state, GoZLibDictionary* dictionary, StreamDataHandler input_handler, StreamDataHandler output_handler, uInt work_input_buffer_cap, uInt work_output_buffer_cap, int* error_code);
+
 
 /**
  * @brief Performs one compression step writing to the given output handler
@@ -134,7 +685,8 @@ uLong uncompress_stream_any(ZStreamState* state, StreamDataHandler input_handler
 int compress_to_outstream(ZStreamState *state, z_streamp zs, int flush, StreamDataHandler output_handler, void *restrict output_buf, uInt output_len);
 
 /**
- * @brief Performs one uncompression step writing directly to the output buffer and making it available to the given output handler
+ * @brief Performs one uncompression step writing directly to the output buffer and making it available to the given output handler.
+ * Returns Z_STREAM_END once the end of the compressed stream is reached
  *
  * @param state
  * @param zs
@@ -152,11 +704,76 @@ int uncompress_to_outstream_step(ZStreamState *state, z_streamp zs, StreamDataHa
  */
 typedef struct {
     z_streamp zs;
+    GoZLibContext* context;
     ZStreamState* state;
     void* work_buffer;
     uInt work_buffer_cap;
+    // gzip members following the first one are uncompressed as part of the same stream
+    bool multi_member;
+    bool member_ended;
+    // compression parameters adapted to each input, restored before the context goes back to its pool
+    bool adaptive;
+    int level;
+    int strategy;
+    int adaptive_mode;
+    uInt adaptive_unconsumed;
+    GoZLibAdaptiveStats adaptive_stats;
+    // instrumentation counters since the transformer was acquired or last reset
+    GoZLibStats stats;
+    // stream parameters, used to acquire a context again for a parked transformer
+    bool deflating;
+    int window_bits;
+    int mem_level;
+    // set once a step read or wrote any data, cleared when reset
+    bool started;
+    // set while all the data processed so far ends on a byte aligned block boundary
+    bool at_boundary;
+    // parked transformers have no context nor work buffer, only the history window of raw streams
+    bool parked;
+    void* parked_window;
+    uInt parked_window_len;
 } GoZLibTransformer;
 
+/**
+ * @brief Result of a single transformer step
+ *
+ */
+typedef struct {
+    uInt consumed;
+    uInt produced;
+    int status;
+} GoZLibStepResult;
+
+/**
+ * @brief Performs one compression step from input into the caller provided output, without invoking any handler.
+ * The status is GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA if the output was filled and the step should be repeated with the
+ * remaining input and the same flush, Z_STREAM_END once Z_FINISH was requested and all data was written, Z_OK if all
+ * the input was consumed, and flushed if requested, or a negative zlib error code.
+ * Z_SYNC_FLUSH, Z_PARTIAL_FLUSH and Z_FULL_FLUSH complete the output written so far without ending the stream
+ *
+ * @param transformer
+ * @param input
+ * @param input_len
+ * @param output
+ * @param output_len
+ * @param flush the deflate flush mode, Z_NO_FLUSH, Z_PARTIAL_FLUSH, Z_SYNC_FLUSH, Z_FULL_FLUSH or Z_FINISH
+ * @return GoZLibStepResult
+ */
+GoZLibStepResult transformer_compress_step(GoZLibTransformer* transformer, void* restrict input, uInt input_len, void* restrict output, uInt output_len, int flush);
+
+/**
+ * @brief Performs one uncompression step of the input currently assigned to the transformer into the caller
+ * provided output, without invoking any handler. The status is GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA if the output was filled
+ * or a gzip member ended with input left, Z_STREAM_END at the end of the compressed stream, Z_OK if more input is needed
+ * or a negative zlib error code. With gzip window bits, input following the end of a member starts the next member
+ *
+ * @param transformer
+ * @param output
+ * @param output_len
+ * @return GoZLibStepResult
+ */
+GoZLibStepResult transformer_uncompress_step(GoZLibTransformer* transformer, void* restrict output, uInt output_len);
+
 /**
  * @brief Acquires a gzip compression transformer
  *
@@ -182,6 +799,38 @@ void release_compression_transformer(GoZLibTransformer* transformer);
  */
 void reset_compression_transformer(GoZLibTransformer* transformer);
 
+/**
+ * @brief Makes a compression transformer sample each new input of transformer_compress_step, switching with deflateParams
+ * to storing or Huffman only coding while the input looks incompressible and back to level and strategy otherwise.
+ * The sampling counters are kept in the transformer and cleared when it's reset
+ *
+ * @param transformer
+ * @param level the level the transformer was acquired with
+ * @param strategy the strategy the transformer was acquired with
+ */
+void enable_adaptive_compression(GoZLibTransformer* transformer, int level, int strategy);
+
+/**
+ * @brief Parks an idle transformer: its context goes back to the pool and its work buffer is freed, only the history
+ * window of a raw deflate stream is kept. Transformers can be parked before their first step or after being reset and,
+ * for raw deflate streams, at a block boundary: after a Z_SYNC_FLUSH or Z_FULL_FLUSH compression step or an uncompression
+ * step that consumed all its input at the end of a block. Transformers created with a dictionary are never parked.
+ * Returns true if the transformer is parked and false, leaving it untouched, if it can't be
+ *
+ * @param transformer
+ * @return bool
+ */
+bool park_transformer(GoZLibTransformer* transformer);
+
+/**
+ * @brief Acquires a context and a work buffer for a parked transformer, primed with the history window it kept.
+ * Does nothing if the transformer isn't parked. Returns Z_OK or the zlib error code, the transformer stays parked on error
+ *
+ * @param transformer
+ * @return int
+ */
+int unpark_transformer(GoZLibTransformer* transformer);
+
 /**
  * @brief Resets an uncompressor transformer so that it can be reused
  *
@@ -209,6 +858,49 @@ GoZLibTransformer* acquire_zlib_compression_transformer(int level, uInt work_buf
  */
 GoZLibTransformer* acquire_uncompression_transformer(uInt work_buffer_cap, int* error_code);
 
+/**
+ * @brief Acquires a compression transformer with the given deflateInit2 parameters, see deflate_compress_buffer
+ *
+ * @param level
+ * @param window_bits
+ * @param mem_level
+ * @param strategy
+ * @param work_buffer_cap
+ * @param error_code
+ * @return GoZLibTransformer*
+ */
+GoZLibTransformer* acquire_compression_transformer(int level, int window_bits, int mem_level, int strategy, uInt work_buffer_cap, int* error_code);
+
+/**
+ * @brief Acquires an uncompression transformer with the given inflateInit2 window bits
+ *
+ * @param window_bits
+ * @param work_buffer_cap
+ * @param error_code
+ * @return GoZLibTransformer*
+ */
+GoZLibTransformer* acquire_window_uncompression_transformer(int window_bits, uInt work_buffer_cap, int* error_code);
+
+/**
+ * @brief Acquires a compression transformer primed with the dictionary
+ *
+ * @param dictionary
+ * @param work_buffer_cap
+ * @param error_code
+ * @return GoZLibTransformer*
+ */
+GoZLibTransformer* acquire_dictionary_compression_transformer(GoZLibDictionary* dictionary, uInt work_buffer_cap, int* error_code);
+
+/**
+ * @brief Acquires an uncompression transformer that uses the dictionary
+ *
+ * @param dictionary
+ * @param work_buffer_cap
+ * @param error_code
+ * @return GoZLibTransformer*
+ */
+GoZLibTransformer* acquire_dictionary_uncompression_transformer(GoZLibDictionary* dictionary, uInt work_buffer_cap, int* error_code);
+
 /**
  * @brief Releases an uncompression transformer
  *
@@ -216,5 +908,146 @@ GoZLibTransformer* acquire_uncompression_transformer(uInt work_buffer_cap, int*
  */
 void release_uncompression_transformer(GoZLibTransformer* transformer);
 
+/**
+ * @brief Compresses a whole file into another. The input is mapped and fed to deflate directly, the output is
+ * written with pwrite from large page aligned buffers, starting at the output file current offset.
+ * File errors set error_code to Z_ERRNO, with errno set by the failed call
+ *
+ * @param input_fd file descriptor of the file to be compressed, opened for reading
+ * @param output_fd file descriptor of the compressed file, opened for writing
+ * @param level, window_bits, mem_level, strategy deflateInit2 parameters
+ * @param direct_io bypass the page cache when writing, if the file system supports it
+ * @param error_code
+ * @return uint64_t number of bytes written to the output file
+ */
+uint64_t file_compress(int input_fd, int output_fd, int level, int window_bits, int mem_level, int strategy, bool direct_io, int* error_code);
+
+/**
+ * @brief Uncompresses a whole file into another, see file_compress.
+ * Data after the end of the compressed stream is ignored and a truncated stream sets error_code to Z_DATA_ERROR
+ *
+ * @param input_fd file descriptor of the compressed file, opened for reading
+ * @param output_fd file descriptor of the uncompressed file, opened for writing
+ * @param window_bits inflateInit2 window bits
+ * @param direct_io bypass the page cache when writing, if the file system supports it
+ * @param error_code
+ * @return uint64_t number of bytes written to the output file
+ */
+uint64_t file_uncompress(int input_fd, int output_fd, int window_bits, bool direct_io, int* error_code);
+
+/**
+ * @brief Uncompresses a mapped file into caller provided buffers
+ *
+ */
+typedef struct {
+    GoZLibContext* context;
+    void* map;
+    size_t length;
+    size_t fed;
+    bool finished;
+    bool multi_member;
+} GoZLibFileReader;
+
+/**
+ * @brief Maps a compressed file for reading. The mapping stays valid after the file descriptor is closed
+ *
+ * @param input_fd file descriptor of the compressed file, opened for reading
+ * @param window_bits inflateInit2 window bits
+ * @param error_code set to Z_ERRNO if the file can't be mapped
+ * @return GoZLibFileReader* the reader or NULL on error
+ */
+GoZLibFileReader* open_file_reader(int input_fd, int window_bits, int* error_code);
+
+/**
+ * @brief Uncompresses the next bytes of the file into output. The status is Z_OK while there's more data to read,
+ * Z_STREAM_END once the end of the compressed stream was reached and no more data is produced, or an error code.
+ * A truncated stream has status Z_DATA_ERROR
+ *
+ * @param reader
+ * @param output
+ * @param output_len
+ * @return GoZLibStepResult with the number of bytes produced
+ */
+GoZLibStepResult file_reader_read(GoZLibFileReader* reader, void* output, uInt output_len);
+
+/**
+ * @brief Unmaps the file and releases the reader
+ *
+ * @param reader
+ */
+void close_file_reader(GoZLibFileReader* reader);
+
+/**
+ * @brief Random access point in a gzip or zlib stream, see create_index_builder
+ *
+ */
+typedef struct {
+    // offset of the first compressed byte after the point, including the header
+    uint64_t in;
+    // offset of the uncompressed data at the point
+    uint64_t out;
+    // number of bits of the byte before in that belong to the data after the point
+    int bits;
+    uInt window_len;
+    unsigned char window[32768];
+} GoZLibAccessPoint;
+
+/**
+ * @brief Inflates a stream recording access points to resume uncompressing from
+ *
+ */
+typedef struct {
+    GoZLibContext* context;
+    void* scratch;
+    uint64_t span;
+    uint64_t last_out;
+    GoZLibAccessPoint* points;
+    size_t count;
+    size_t capacity;
+    bool member_start;
+    bool member_ended;
+} GoZLibIndexBuilder;
+
+/**
+ * @brief Creates an index builder for a gzip or zlib stream.
+ * An access point is recorded at the start of the compressed data of each member and then about every span uncompressed bytes
+ *
+ * @param span minimum distance between access points, in uncompressed bytes
+ * @param error_code
+ * @return GoZLibIndexBuilder* the builder or NULL on error
+ */
+GoZLibIndexBuilder* create_index_builder(uint64_t span, int* error_code);
+
+/**
+ * @brief Inflates the next input bytes of the stream, recording access points. The uncompressed data is discarded.
+ * The status is Z_OK if all the input was consumed and more is expected, Z_STREAM_END if the input ended with the end of
+ * a stream or an error code. Input following the end of a gzip member is indexed as the next member, starting with an access point
+ *
+ * @param builder
+ * @param input
+ * @param input_len
+ * @return GoZLibStepResult with the number of bytes consumed and the number of uncompressed bytes
+ */
+GoZLibStepResult index_builder_step(GoZLibIndexBuilder* builder, void* input, uInt input_len);
+
+/**
+ * @brief Releases the builder and its access points
+ *
+ * @param builder
+ */
+void free_index_builder(GoZLibIndexBuilder* builder);
+
+/**
+ * @brief Primes a raw uncompression transformer to resume uncompressing the stream at an access point.
+ * The transformer input must start at the point in offset
+ *
+ * @param transformer acquired with raw deflate window bits
+ * @param in, out, bits, window_len access point fields
+ * @param prime_byte the compressed byte before in, used if bits is not zero
+ * @param window access point window
+ * @return int zlib result code
+ */
+int transformer_prime_access_point(GoZLibTransformer* transformer, uint64_t in, uint64_t out, int bits, int prime_byte, void* window, uInt window_len);
+
 
 #endif // GOZLIB_H
@@ -10,6 +10,11 @@
 extern uInt GoStreamDataInputHandler(void *token, void* restrict buffer, uInt buffer_length);
 extern uInt GoStreamDataOutputHandler(void *token, void* restrict buffer, uInt buffer_length);
 
+// the data handler is an integer ID into the Go side handler table, not an address
+static inline void set_stream_data_handler(ZStreamState *state, uintptr_t handler_id) {
+    state->data_handler = (void *)handler_id; // NOLINT(performance-no-int-to-ptr)
+}
+
 static inline uInt go_stream_data_input_handler(ZStreamState *state, void* restrict buffer, uInt buffer_length) {
     return GoStreamDataInputHandler(state->data_handler, buffer, buffer_length);
 }
@@ -26,13 +31,56 @@ uLong go_uncompress_stream(ZStreamState* state, uInt input_cap, uInt output_cap,
     return uncompress_stream_any(state, go_stream_data_input_handler, go_stream_data_output_handler, input_cap, output_cap, error_code);
 }
 
-int go_transformer_compress_to_outstream(GoZLibTransformer* transformer, void* restrict buffer, uInt buffer_length) {
-    transformer->zs->avail_in = buffer_length;
-    transformer->zs->next_in = buffer;
-    int flush = buffer_length > 0 ? Z_NO_FLUSH : Z_FINISH;
-    return compress_to_outstream(transformer->state, transformer->zs, flush, go_stream_data_output_handler, transformer->work_buffer, transformer->work_buffer_cap);
+uLong go_dictionary_compress_stream(ZStreamState *state, GoZLibDictionary *dictionary, uInt input_cap, uInt output_cap, int *error_code) {
+    return dictionary_compress_stream(state, dictionary, go_stream_data_input_handler, go_stream_data_output_handler, input_cap, output_cap, error_code);
 }
 
+uLong go_dictionary_uncompress_stream(ZStreamState *state, GoZLibDictionary *dictionary, uInt input_cap, uInt output_cap, int *error_code) {
+    return dictionary_uncompress_stream(state, dictionary, go_stream_data_input_handler, go_stream_data_output_handler, input_cap, output_cap, error_code);
+}
+
+// buffer results are returned by value, an error code pointer passed from Go would always escape to the heap
+typedef struct {
+    uLong len;
+    int error_code;
+} GoZLibBufferResult;
+
+GoZLibBufferResult go_deflate_compress_buffer(int level, int window_bits, int mem_level, int strategy, void* restrict input, uInt input_len, void* restrict output, uInt output_len) {
+    GoZLibBufferResult result = {0, Z_OK};
+    result.len = deflate_compress_buffer(level, window_bits, mem_level, strategy, input, input_len, output, output_len, &result.error_code);
+    return result;
+}
+
+GoZLibBufferResult go_adaptive_deflate_compress_buffer(int level, int window_bits, int mem_level, int strategy, void* restrict input, uInt input_len, void* restrict output, uInt output_len) {
+    GoZLibBufferResult result = {0, Z_OK};
+    result.len = adaptive_deflate_compress_buffer(level, window_bits, mem_level, strategy, input, input_len, output, output_len, &result.error_code);
+    return result;
+}
+
+GoZLibBufferResult go_deflate_compress_vector(int level, int window_bits, int mem_level, int strategy, const GoZLibSegment* input, uInt input_count, GoZLibSegment* output,
+                                              uInt output_count) {
+    GoZLibBufferResult result = {0, Z_OK};
+    result.len = deflate_compress_vector(level, window_bits, mem_level, strategy, input, input_count, output, output_count, &result.error_code);
+    return result;
+}
+
+typedef struct {
+    void* data;
+    uLong len;
+    int error_code;
+} GoZLibPooledResult;
+
+GoZLibPooledResult go_deflate_compress_pooled(struct MultiPool* pool, int level, int window_bits, int mem_level, int strategy, bool adaptive, void* restrict input, uInt input_len) {
+    GoZLibPooledResult result = {NULL, 0, Z_OK};
+    result.len = deflate_compress_pooled(pool, level, window_bits, mem_level, strategy, adaptive, input, input_len, &result.data, &result.error_code);
+    return result;
+}
+
+GoZLibPooledResult go_inflate_uncompress_pooled(struct MultiPool* pool, int window_bits, void* restrict input, uInt input_len) {
+    GoZLibPooledResult result = {NULL, 0, Z_OK};
+    result.len = inflate_uncompress_pooled(pool, window_bits, input, input_len, &result.data, &result.error_code);
+    return result;
+}
 
 void go_assign_uncompress_input(GoZLibTransformer* transformer, uInt work_buffer_len) {
     // input data is in the work buffer but we don't know how much of it can be used
@@ -40,10 +88,6 @@ void go_assign_uncompress_input(GoZLibTransformer* transformer, uInt work_buffer
     transformer->zs->next_in = transformer->work_buffer;
 }
 
-int go_uncompress_to_outstream_step(GoZLibTransformer* transformer, void *restrict output_buf, uInt output_len) {
-    return uncompress_to_outstream_step(transformer->state, transformer->zs, go_stream_data_output_handler, output_buf, output_len);
-}
-
 #endif // GOZLIB_GO_INTEROP
 
 
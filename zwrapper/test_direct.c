@@ -3,6 +3,7 @@
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <zconf.h>
 #include <zlib.h>
@@ -138,6 +139,573 @@ void test_fail_transform_uncompress_invalid_input(void) {
   ASSERT_MSG(uncompressed_len == 0, "uncompressing invalid data should return zero");
 }
 
+void test_context_compress_uncompress_reuse(void) {
+  PRINT_TEST_NAME;
+
+  const uInt length = 1024;
+  const uInt output_length = length + 100;
+  char input[length];
+  char compressed[output_length];
+  char uncompressed[length];
+
+  int ec = Z_OK;
+  GoZLibContext *deflate_ctx = acquire_deflate_context(Z_BEST_SPEED, MAX_WBITS + 16, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, &ec);
+  ASSERT_MSG(deflate_ctx != NULL, "deflate context should be acquired");
+  GoZLibContext *inflate_ctx = acquire_inflate_context(MAX_WBITS + 32, &ec);
+  ASSERT_MSG(inflate_ctx != NULL, "inflate context should be acquired");
+
+  // the same contexts should work for multiple independent buffers
+  for (int run = 0; run < 3; run++) {
+    init_input_buffer_rand(input, length);
+
+    uLong compressed_len = context_compress_buffer(deflate_ctx, input, length, compressed, output_length, &ec);
+    ASSERT_MSG(ec == Z_OK, "context compression should return Z_OK");
+
+    uLong uncompressed_len = context_uncompress_buffer(inflate_ctx, compressed, (uInt)compressed_len, uncompressed, length, &ec);
+    ASSERT_MSG(ec == Z_OK, "context uncompression should return Z_OK");
+    ASSERT_MSG(uncompressed_len == length, "uncompressed length should be equal to input length");
+    ASSERT_MSG(memcmp(input, uncompressed, length) == 0, "uncompressed data should be equal to input");
+  }
+
+  release_zlib_context(deflate_ctx);
+  release_zlib_context(inflate_ctx);
+
+  // released contexts are pooled by their parameters and handed out again
+  GoZLibContext *reused_ctx = acquire_deflate_context(Z_BEST_SPEED, MAX_WBITS + 16, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, &ec);
+  ASSERT_MSG(reused_ctx == deflate_ctx, "released deflate context should be reused");
+  GoZLibContext *other_ctx = acquire_deflate_context(Z_BEST_COMPRESSION, MAX_WBITS + 16, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, &ec);
+  ASSERT_MSG(other_ctx != deflate_ctx, "contexts with different parameters should not be shared");
+
+  release_zlib_context(reused_ctx);
+  release_zlib_context(other_ctx);
+}
+
+void test_fail_acquire_context_invalid_parameters(void) {
+  PRINT_TEST_NAME;
+
+  int ec = Z_OK;
+  GoZLibContext *context = acquire_deflate_context(Z_BEST_SPEED, MAX_WBITS, 42, Z_DEFAULT_STRATEGY, &ec);
+  ASSERT_MSG(context == NULL, "invalid parameters should not produce a context");
+  ASSERT_MSG(ec == Z_STREAM_ERROR, "invalid parameters should return Z_STREAM_ERROR");
+}
+
+void test_deflate_raw_blocks_concatenate(void) {
+  PRINT_TEST_NAME;
+
+  const uInt block_length = 4096;
+  const uInt length = block_length * 2;
+  char input[length];
+  char compressed[length * 2];
+  init_input_buffer_rand(input, length);
+  ASSERT_MSG(deflate_raw_block_bound(block_length) * 2 <= sizeof(compressed), "compressed buffer should be large enough");
+
+  int ec = Z_OK;
+  uLong first_crc = 0;
+  uLong first_len = deflate_raw_block(Z_BEST_SPEED, NULL, 0, input, block_length, compressed, (uInt)sizeof(compressed), false, &first_crc, &ec);
+  ASSERT_MSG(ec == Z_OK && first_len > 0, "first block should be compressed");
+
+  // the end of the first block is the dictionary for the second one
+  uLong second_crc = 0;
+  uLong second_len = deflate_raw_block(Z_BEST_SPEED, input, block_length, input + block_length, block_length, compressed + first_len, (uInt)(sizeof(compressed) - first_len), true, &second_crc, &ec);
+  ASSERT_MSG(ec == Z_OK && second_len > 0, "last block should be compressed");
+  ASSERT_MSG(crc32_combine(first_crc, second_crc, block_length) == crc32(0L, (const Bytef *)input, length), "block crcs should combine into the input crc");
+
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  ASSERT_MSG(inflateInit2(&zs, -MAX_WBITS) == Z_OK, "raw inflate should be initialized");
+
+  char uncompressed[length];
+  zs.next_in = (Bytef *)compressed;
+  zs.avail_in = (uInt)(first_len + second_len);
+  zs.next_out = (Bytef *)uncompressed;
+  zs.avail_out = length;
+  ASSERT_MSG(inflate(&zs, Z_FINISH) == Z_STREAM_END, "concatenated blocks should be a single deflate stream");
+  ASSERT_MSG(zs.total_out == length, "uncompressed length should be equal to input length");
+  ASSERT_MSG(memcmp(input, uncompressed, length) == 0, "uncompressed data should be equal to input");
+  inflateEnd(&zs);
+}
+
+void test_fail_deflate_raw_block_small_buffer(void) {
+  PRINT_TEST_NAME;
+
+  const uInt length = 1024;
+  char input[length];
+  char output[16];
+  init_input_buffer_high_entropy(input, length);
+
+  int ec = Z_OK;
+  uLong crc = 0;
+  ASSERT_MSG(deflate_raw_block(Z_BEST_SPEED, NULL, 0, input, length, output, sizeof(output), false, &crc, &ec) == 0, "small output should fail");
+  ASSERT_MSG(ec == Z_BUF_ERROR, "small output should return Z_BUF_ERROR");
+
+  ec = Z_OK;
+  ASSERT_MSG(deflate_raw_block(Z_BEST_SPEED, NULL, 0, input, length, output, sizeof(output), true, &crc, &ec) == 0, "small output should fail");
+  ASSERT_MSG(ec == Z_BUF_ERROR, "small output should return Z_BUF_ERROR");
+}
+
+void verify_compress_batch(uInt max_threads) {
+  enum { item_count = 9, item_length = 2048 };
+  char inputs[item_count][item_length];
+  char outputs[item_count][item_length + 100];
+  GoZLibBatchItem items[item_count];
+
+  for (uInt i = 0; i < item_count; i++) {
+    init_input_buffer_rand(inputs[i], item_length);
+    items[i].input = (uintptr_t)inputs[i];
+    items[i].input_len = item_length;
+    items[i].output = (uintptr_t)outputs[i];
+    items[i].output_len = (uInt)sizeof(outputs[i]);
+  }
+  // a failing item must not affect the items compressed after it with the same context
+  items[3].output_len = 10;
+
+  gzip_compress_batch(Z_BEST_SPEED, items, item_count, max_threads);
+
+  for (uInt i = 0; i < item_count; i++) {
+    if (i == 3) {
+      ASSERT_MSG(items[i].error_code == Z_MEM_ERROR && items[i].result_len == 0, "batch item with a small output buffer should return an error");
+      continue;
+    }
+
+    ASSERT_MSG(items[i].error_code == Z_OK, "batch item should be compressed");
+    char uncompressed[item_length];
+    int ec = 0;
+    uLong uncompressed_len = uncompress_buffer_any(outputs[i], (uInt)items[i].result_len, uncompressed, item_length, &ec);
+    ASSERT_MSG(ec == Z_OK && uncompressed_len == item_length, "batch item should be uncompressed");
+    ASSERT_MSG(memcmp(inputs[i], uncompressed, item_length) == 0, "uncompressed batch item should be equal to input");
+  }
+}
+
+void test_compress_batch(void) {
+  PRINT_TEST_NAME;
+
+  verify_compress_batch(1);
+  verify_compress_batch(4);
+}
+
+void test_deflate_compress_vector(void) {
+  PRINT_TEST_NAME;
+
+  enum { segment_count = 5, segment_length = 3000, output_segment_length = 512 };
+  const uInt input_len = (segment_count - 1) * segment_length;
+  char input[input_len];
+  init_input_buffer_rand(input, input_len);
+
+  // the input is split in contiguous segments with an empty one in the middle, which must be skipped
+  GoZLibSegment segments[segment_count] = {
+      {(uintptr_t)input, segment_length},
+      {(uintptr_t)(input + segment_length), segment_length},
+      {(uintptr_t)NULL, 0},
+      {(uintptr_t)(input + 2 * segment_length), segment_length},
+      {(uintptr_t)(input + 3 * segment_length), segment_length},
+  };
+
+  enum { output_count = 32 };
+  char output[output_count][output_segment_length];
+  GoZLibSegment outputs[output_count];
+  for (uInt i = 0; i < output_count; i++) {
+    outputs[i].data = (uintptr_t)output[i];
+    outputs[i].len = output_segment_length;
+  }
+
+  int ec = Z_OK;
+  uLong compressed_len = deflate_compress_vector(Z_BEST_SPEED, MAX_WBITS + 16, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, segments, segment_count, outputs, output_count, &ec);
+  ASSERT_MSG(ec == Z_OK && compressed_len > output_segment_length, "vector compression should succeed over several output segments");
+
+  // output segments are filled in order
+  char compressed[output_count * output_segment_length];
+  uLong gathered = 0;
+  for (uInt i = 0; i < output_count; i++) {
+    ASSERT_MSG((outputs[i].len == output_segment_length || gathered + outputs[i].len == compressed_len), "only the last used output segment should be partially filled");
+    memcpy(compressed + gathered, output[i], outputs[i].len);
+    gathered += outputs[i].len;
+  }
+  ASSERT_MSG(gathered == compressed_len, "output segment lengths should add up to the compressed length");
+
+  char uncompressed[input_len];
+  uLong uncompressed_len = uncompress_buffer_any(compressed, (uInt)compressed_len, uncompressed, (uInt)sizeof(uncompressed), &ec);
+  ASSERT_MSG(ec == Z_OK && uncompressed_len == input_len, "vector output should be uncompressed");
+  ASSERT_MSG(memcmp(input, uncompressed, input_len) == 0, "uncompressed vector should be equal to the concatenated input");
+
+  // not enough output segments
+  compressed_len = deflate_compress_vector(Z_BEST_SPEED, MAX_WBITS + 16, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, segments, segment_count, outputs, 2, &ec);
+  ASSERT_MSG(ec == Z_MEM_ERROR && compressed_len == 0, "small output vector should return Z_MEM_ERROR");
+
+  // no input at all is still a valid empty stream
+  ec = Z_OK;
+  compressed_len = deflate_compress_vector(Z_BEST_SPEED, MAX_WBITS + 16, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, NULL, 0, outputs, 1, &ec);
+  ASSERT_MSG(ec == Z_OK && compressed_len > 0, "empty vector should be compressed");
+}
+
+void test_compress_uncompress_pooled(void) {
+  PRINT_TEST_NAME;
+
+  struct MultiPool *pool = multipool_create();
+  const uInt length = 300000;
+  char *input = malloc(length);
+  init_input_buffer_rand(input, length);
+
+  int ec = Z_OK;
+  const uLong bound = deflate_compress_bound(Z_BEST_SPEED, MAX_WBITS + 16, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, length, &ec);
+  ASSERT_MSG(ec == Z_OK && bound >= length, "compress bound should cover the input");
+
+  void *compressed = NULL;
+  uLong compressed_len = deflate_compress_pooled(pool, Z_BEST_SPEED, MAX_WBITS + 16, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, false, input, length, &compressed, &ec);
+  ASSERT_MSG(ec == Z_OK && compressed != NULL && compressed_len > 0 && compressed_len <= bound, "pooled compression should succeed");
+
+  // gzip output is sized from its trailer
+  void *uncompressed = NULL;
+  uLong uncompressed_len = inflate_uncompress_pooled(pool, MAX_WBITS + 32, compressed, (uInt)compressed_len, &uncompressed, &ec);
+  ASSERT_MSG(ec == Z_OK && uncompressed != NULL && uncompressed_len == length, "pooled uncompression should succeed");
+  ASSERT_MSG(memcmp(input, uncompressed, length) == 0, "pooled uncompressed data should be equal to input");
+  pool_mem_return(uncompressed);
+
+  // a corrupted trailer only sets the initial size, the output grows until zlib checks the trailer at the end of the stream
+  unsigned char *isize = (unsigned char *)compressed + compressed_len - 4;
+  memset(isize, 0, 4);
+  uncompressed_len = inflate_uncompress_pooled(pool, MAX_WBITS + 16, compressed, (uInt)compressed_len, &uncompressed, &ec);
+  ASSERT_MSG(ec == Z_DATA_ERROR && uncompressed == NULL && uncompressed_len == 0, "gzip trailer mismatch should be a data error");
+  pool_mem_return(compressed);
+
+  // zlib output has no size hint, highly compressible data makes it grow several times
+  memset(input, 'a', length);
+  ec = Z_OK;
+  compressed_len = deflate_compress_pooled(pool, Z_BEST_COMPRESSION, MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, false, input, length, &compressed, &ec);
+  ASSERT_MSG(ec == Z_OK && compressed_len > 0, "pooled zlib compression should succeed");
+  uncompressed_len = inflate_uncompress_pooled(pool, MAX_WBITS, compressed, (uInt)compressed_len, &uncompressed, &ec);
+  ASSERT_MSG(ec == Z_OK && uncompressed_len == length, "grown pooled uncompression should succeed");
+  ASSERT_MSG(memcmp(input, uncompressed, length) == 0, "grown pooled uncompressed data should be equal to input");
+  pool_mem_return(uncompressed);
+
+  // truncated input
+  uncompressed_len = inflate_uncompress_pooled(pool, MAX_WBITS, compressed, (uInt)compressed_len / 2, &uncompressed, &ec);
+  ASSERT_MSG(ec == Z_BUF_ERROR && uncompressed == NULL && uncompressed_len == 0, "truncated input should return Z_BUF_ERROR");
+  pool_mem_return(compressed);
+
+  free(input);
+  multipool_free(pool);
+}
+
+void verify_uncompress_batch(struct MultiPool *pool, uInt max_threads) {
+  enum { item_count = 9, item_length = 2048 };
+  char inputs[item_count][item_length];
+  char compressed[item_count][item_length + 100];
+  GoZLibBatchItem items[item_count];
+
+  for (uInt i = 0; i < item_count; i++) {
+    init_input_buffer_rand(inputs[i], item_length);
+    items[i].input = (uintptr_t)inputs[i];
+    items[i].input_len = item_length;
+    items[i].output = (uintptr_t)compressed[i];
+    items[i].output_len = (uInt)sizeof(compressed[i]);
+  }
+  gzip_compress_batch(Z_BEST_SPEED, items, item_count, 1);
+
+  for (uInt i = 0; i < item_count; i++) {
+    ASSERT_MSG(items[i].error_code == Z_OK, "batch item should be compressed");
+    items[i].input = (uintptr_t)compressed[i];
+    items[i].input_len = (uInt)items[i].result_len;
+  }
+  // failing items must not affect the items uncompressed after them with the same context
+  compressed[2][items[2].input_len - 8] ^= 1;
+  items[5].input_len /= 2;
+
+  inflate_uncompress_batch(pool, MAX_WBITS + 16, items, item_count, max_threads);
+
+  for (uInt i = 0; i < item_count; i++) {
+    if (i == 2 || i == 5) {
+      ASSERT_MSG(items[i].output == 0 && items[i].result_len == 0, "failed batch item should have no output");
+      ASSERT_MSG(items[i].error_code == (i == 2 ? Z_DATA_ERROR : Z_BUF_ERROR), "crc mismatch and truncated input should fail");
+      continue;
+    }
+
+    ASSERT_MSG(items[i].error_code == Z_OK && items[i].result_len == item_length, "batch item should be uncompressed");
+    ASSERT_MSG(memcmp(inputs[i], (void *)items[i].output, item_length) == 0, "uncompressed batch item should be equal to input"); // NOLINT(performance-no-int-to-ptr)
+    pool_mem_return((void *)items[i].output); // NOLINT(performance-no-int-to-ptr)
+  }
+}
+
+void test_uncompress_batch(void) {
+  PRINT_TEST_NAME;
+
+  struct MultiPool *pool = multipool_create();
+  verify_uncompress_batch(pool, 1);
+  verify_uncompress_batch(pool, 4);
+  multipool_free(pool);
+}
+
+void test_deflate_compress_buffer_raw(void) {
+  PRINT_TEST_NAME;
+
+  const uInt length = 4096;
+  char input[length];
+  char compressed[length + 100];
+  char uncompressed[length];
+  init_input_buffer_rand(input, length);
+
+  int ec = Z_OK;
+  // small raw window and memory level, as used by websocket permessage-deflate
+  uLong compressed_len = deflate_compress_buffer(Z_BEST_SPEED, -9, 1, Z_RLE, input, length, compressed, (uInt)sizeof(compressed), &ec);
+  ASSERT_MSG(ec == Z_OK && compressed_len > 0, "raw deflate compression should succeed");
+
+  uLong uncompressed_len = inflate_uncompress_buffer(-9, compressed, (uInt)compressed_len, uncompressed, length, &ec);
+  ASSERT_MSG(ec == Z_OK && uncompressed_len == length, "raw deflate data should be uncompressed");
+  ASSERT_MSG(memcmp(input, uncompressed, length) == 0, "uncompressed data should be equal to input");
+
+  // raw data has no header so it can't be detected as gzip or zlib
+  uncompress_buffer_any(compressed, (uInt)compressed_len, uncompressed, length, &ec);
+  ASSERT_MSG(ec != Z_OK, "raw deflate data should not be uncompressed as gzip or zlib");
+}
+
+void verify_dictionary_compress_uncompress(int window_bits) {
+  char dictionary_data[] = "{\"request_id\":\"\",\"user_name\":\"\",\"created_at\":\"\",\"status\":\"active\"}";
+  char input[] = "{\"request_id\":\"42\",\"user_name\":\"bob\",\"created_at\":\"today\",\"status\":\"active\"}";
+  const uInt input_len = (uInt)strlen(input);
+
+  int ec = Z_OK;
+  GoZLibDictionary *dictionary = create_zlib_dictionary(dictionary_data, (uInt)strlen(dictionary_data), Z_BEST_COMPRESSION, window_bits, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, &ec);
+  ASSERT_MSG(dictionary != NULL && ec == Z_OK, "dictionary should be created");
+
+  char compressed[256];
+  uLong plain_len = deflate_compress_buffer(Z_BEST_COMPRESSION, window_bits, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, input, input_len, compressed, sizeof(compressed), &ec);
+  ASSERT_MSG(ec == Z_OK, "compressing without dictionary should succeed");
+
+  // the primed contexts are reused, each use must start from the dictionary again
+  for (int run = 0; run < 3; run++) {
+    uLong compressed_len = dictionary_compress_buffer(dictionary, input, input_len, compressed, sizeof(compressed), &ec);
+    ASSERT_MSG(ec == Z_OK, "compressing with dictionary should succeed");
+    ASSERT_MSG(compressed_len < plain_len, "compressing with dictionary should reduce the output length");
+
+    char uncompressed[256];
+    uLong uncompressed_len = dictionary_uncompress_buffer(dictionary, compressed, (uInt)compressed_len, uncompressed, sizeof(uncompressed), &ec);
+    ASSERT_MSG(ec == Z_OK && uncompressed_len == input_len, "uncompressing with dictionary should succeed");
+    ASSERT_MSG(memcmp(input, uncompressed, input_len) == 0, "uncompressed data should be equal to input");
+  }
+
+  free_zlib_dictionary(dictionary);
+}
+
+void test_dictionary_compress_uncompress(void) {
+  PRINT_TEST_NAME;
+
+  verify_dictionary_compress_uncompress(MAX_WBITS);
+  verify_dictionary_compress_uncompress(-MAX_WBITS);
+}
+
+void test_fail_dictionary_mismatch(void) {
+  PRINT_TEST_NAME;
+
+  const uInt length = 1024;
+  char input[length];
+  char dictionary_data[length];
+  init_input_buffer_rand(input, length);
+  init_input_buffer_rand(dictionary_data, length);
+
+  int ec = Z_OK;
+  GoZLibDictionary *dictionary = create_zlib_dictionary(dictionary_data, length, Z_BEST_SPEED, MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, &ec);
+  dictionary_data[0]++;
+  GoZLibDictionary *other = create_zlib_dictionary(dictionary_data, length, Z_BEST_SPEED, MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, &ec);
+  ASSERT_MSG(dictionary != NULL && other != NULL, "dictionaries should be created");
+
+  char compressed[length + 100];
+  char uncompressed[length];
+  uLong compressed_len = dictionary_compress_buffer(dictionary, input, length, compressed, sizeof(compressed), &ec);
+  ASSERT_MSG(ec == Z_OK, "compressing with dictionary should succeed");
+
+  dictionary_uncompress_buffer(other, compressed, (uInt)compressed_len, uncompressed, length, &ec);
+  ASSERT_MSG(ec == Z_DATA_ERROR, "uncompressing with a different dictionary should fail");
+
+  uncompress_buffer_any(compressed, (uInt)compressed_len, uncompressed, length, &ec);
+  ASSERT_MSG(ec == Z_DATA_ERROR, "uncompressing without the dictionary should fail");
+
+  ASSERT_MSG(create_zlib_dictionary(dictionary_data, length, Z_BEST_SPEED, MAX_WBITS + 16, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, &ec) == NULL && ec == Z_STREAM_ERROR,
+             "gzip dictionaries should not be supported");
+
+  free_zlib_dictionary(dictionary);
+  free_zlib_dictionary(other);
+}
+
+void test_context_used_until_reset(void) {
+  PRINT_TEST_NAME;
+
+  const uInt length = 1024;
+  char input[length];
+  char dictionary_data[length];
+  char compressed[length + 100];
+  char dictionary_compressed[length + 100];
+  char uncompressed[length];
+  init_input_buffer_rand(input, length);
+  init_input_buffer_rand(dictionary_data, length);
+
+  // parameters not used by other tests so the context comes freshly initialized
+  int ec = Z_OK;
+  GoZLibContext *deflate_ctx = acquire_deflate_context(3, MAX_WBITS, 5, Z_DEFAULT_STRATEGY, &ec);
+  ASSERT_MSG(deflate_ctx != NULL && !deflate_ctx->used, "new context should not be used");
+  uLong compressed_len = context_compress_buffer(deflate_ctx, input, length, compressed, sizeof(compressed), &ec);
+  ASSERT_MSG(ec == Z_OK && deflate_ctx->used, "compressing should mark the context as used");
+  release_zlib_context(deflate_ctx);
+  ASSERT_MSG(!deflate_ctx->used, "released context should be reset");
+
+  GoZLibDictionary *dictionary = create_zlib_dictionary(dictionary_data, length, Z_BEST_SPEED, MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, &ec);
+  ASSERT_MSG(dictionary != NULL, "dictionary should be created");
+  uLong dictionary_compressed_len = dictionary_compress_buffer(dictionary, input, length, dictionary_compressed, sizeof(dictionary_compressed), &ec);
+  ASSERT_MSG(ec == Z_OK, "compressing with dictionary should succeed");
+
+  // zlib asks for the dictionary without consuming or producing anything, the context must still be reset
+  GoZLibContext *inflate_ctx = acquire_inflate_context(MAX_WBITS, &ec);
+  ASSERT_MSG(inflate_ctx != NULL, "inflate context should be acquired");
+  context_uncompress_buffer(inflate_ctx, dictionary_compressed, (uInt)dictionary_compressed_len, uncompressed, length, &ec);
+  ASSERT_MSG(ec == Z_DATA_ERROR && inflate_ctx->used, "uncompressing without the dictionary should fail and mark the context as used");
+  ec = Z_OK;
+  uLong uncompressed_len = context_uncompress_buffer(inflate_ctx, compressed, (uInt)compressed_len, uncompressed, length, &ec);
+  ASSERT_MSG(ec == Z_OK && uncompressed_len == length, "failed context should be reset before its next use");
+  ASSERT_MSG(memcmp(input, uncompressed, length) == 0, "uncompressed data should be equal to input");
+
+  release_zlib_context(inflate_ctx);
+  free_zlib_dictionary(dictionary);
+}
+
+void verify_context_arena(GoZLibContext *first, GoZLibContext *second, int window_bits) {
+  const uInt length = 4096;
+  char input[length];
+  char compressed[length + 100];
+  char uncompressed[length];
+  init_input_buffer_rand(input, length);
+
+  int ec = Z_OK;
+  uLong compressed_len = deflate_compress_buffer(Z_BEST_SPEED, window_bits, 2, Z_DEFAULT_STRATEGY, input, length, compressed, (uInt)sizeof(compressed), &ec);
+  ASSERT_MSG(ec == Z_OK, "compression should succeed");
+
+  GoZLibContext *contexts[] = {first, second};
+  for (size_t i = 0; i < 2; i++) {
+    if (contexts[i]->deflating) {
+      char output[length + 100];
+      uLong output_len = context_compress_buffer(contexts[i], input, length, output, (uInt)sizeof(output), &ec);
+      ASSERT_MSG(ec == Z_OK && output_len == compressed_len && memcmp(output, compressed, output_len) == 0, "arena context should compress like a regular context");
+    } else {
+      uLong uncompressed_len = context_uncompress_buffer(contexts[i], compressed, (uInt)compressed_len, uncompressed, length, &ec);
+      ASSERT_MSG(ec == Z_OK && uncompressed_len == length, "arena context should uncompress");
+      ASSERT_MSG(memcmp(input, uncompressed, length) == 0, "uncompressed data should be equal to input");
+    }
+  }
+
+  // the second context was created after the first one learned the allocation size
+  ASSERT_MSG(second->arena != NULL, "context should allocate its state from an arena");
+  ASSERT_MSG(second->arena_used == second->requested_size && second->arena_used == second->arena_size, "all zlib allocations should fit the arena");
+}
+
+void test_context_arena_allocation(void) {
+  PRINT_TEST_NAME;
+
+  // parameters not used by other tests so the first contexts have no learned size yet
+  const int window_bits = 10;
+  int ec = Z_OK;
+  GoZLibContext *deflate_ctx = acquire_deflate_context(Z_BEST_SPEED, window_bits, 2, Z_DEFAULT_STRATEGY, &ec);
+  GoZLibContext *other_deflate_ctx = acquire_deflate_context(Z_BEST_SPEED, window_bits, 2, Z_DEFAULT_STRATEGY, &ec);
+  ASSERT_MSG(deflate_ctx != NULL && other_deflate_ctx != NULL, "deflate contexts should be acquired");
+  ASSERT_MSG(deflate_ctx->arena == NULL, "first deflate context should not have an arena");
+
+  // inflate allocates its window lazily, the size is learned when the context is released
+  GoZLibContext *inflate_ctx = acquire_inflate_context(window_bits, &ec);
+  ASSERT_MSG(inflate_ctx != NULL, "inflate context should be acquired");
+  verify_context_arena(deflate_ctx, other_deflate_ctx, window_bits);
+  release_zlib_context(inflate_ctx);
+
+  inflate_ctx = acquire_inflate_context(window_bits, &ec);
+  GoZLibContext *other_inflate_ctx = acquire_inflate_context(window_bits, &ec);
+  ASSERT_MSG(inflate_ctx != NULL && other_inflate_ctx != NULL, "inflate contexts should be acquired");
+  verify_context_arena(inflate_ctx, other_inflate_ctx, window_bits);
+
+  release_zlib_context(deflate_ctx);
+  release_zlib_context(other_deflate_ctx);
+  release_zlib_context(inflate_ctx);
+  release_zlib_context(other_inflate_ctx);
+}
+
+void verify_gzip_store_buffer(uInt length) {
+  char *input = malloc(length + 1);
+  const uInt output_length = (uInt)gzip_store_bound(length);
+  char *output = malloc(output_length);
+  char *uncompressed = malloc(length + 1);
+  ASSERT_MSG(input != NULL && output != NULL && uncompressed != NULL, "buffers should be allocated");
+  init_input_buffer_rand(input, length);
+
+  int ec = Z_OK;
+  uLong stored_len = gzip_store_buffer(input, length, output, output_length, &ec);
+  ASSERT_MSG(ec == Z_OK, "storing should not fail");
+  ASSERT_MSG(stored_len == output_length, "stored length should be the bound");
+
+  uLong uncompressed_len = uncompress_buffer_any(output, (uInt)stored_len, uncompressed, length + 1, &ec);
+  ASSERT_MSG(ec == Z_OK, "stored gzip data should be valid");
+  ASSERT_MSG(uncompressed_len == length, "uncompressed length should be the same as the input");
+  ASSERT_MSG(memcmp(input, uncompressed, length) == 0, "uncompressed data should be the same as the input");
+
+  ec = Z_OK;
+  ASSERT_MSG(gzip_store_buffer(input, length, output, output_length - 1, &ec) == 0 && ec == Z_MEM_ERROR, "storing should fail with a small output");
+
+  free(input);
+  free(output);
+  free(uncompressed);
+}
+
+void test_gzip_store_buffer(void) {
+  PRINT_TEST_NAME;
+  verify_gzip_store_buffer(0);
+  verify_gzip_store_buffer(1000);
+  // multiple stored blocks, the last one full
+  verify_gzip_store_buffer(65535 * 3);
+  verify_gzip_store_buffer(65535 * 3 + 17);
+}
+
+void test_checksums(void) {
+  PRINT_TEST_NAME;
+  const uInt length = 100000;
+  const uInt split = 33333;
+  char input[length];
+  init_input_buffer_rand(input, length);
+
+  const uLong crc = checksum_crc32(0, input, length);
+  const uLong adler = checksum_adler32(1, input, length);
+  ASSERT_MSG(crc == crc32(0, (const Bytef *)input, length), "crc32 should be the same as zlib's");
+  ASSERT_MSG(adler == adler32(1, (const Bytef *)input, length), "adler32 should be the same as zlib's");
+
+  // checksums of separate chunks can be combined
+  const uLong first_crc = checksum_crc32(0, input, split);
+  const uLong second_crc = checksum_crc32(0, input + split, length - split);
+  ASSERT_MSG(crc32_combine(first_crc, second_crc, length - split) == crc, "combined crc32 should be the same as the whole buffer crc32");
+  const uLong first_adler = checksum_adler32(1, input, split);
+  const uLong second_adler = checksum_adler32(1, input + split, length - split);
+  ASSERT_MSG(adler32_combine(first_adler, second_adler, length - split) == adler, "combined adler32 should be the same as the whole buffer adler32");
+}
+
+void test_adaptive_compress_buffer(void) {
+  PRINT_TEST_NAME;
+  const uInt length = 32 * 1024;
+  unsigned char input[length];
+  char output[length + 1024];
+  char uncompressed[length];
+  for (uInt i = 0; i < length; i++) {
+    input[i] = (unsigned char)(rand() & 0xff);
+  }
+
+  GoZLibAdaptiveStats before = {0};
+  get_adaptive_buffer_stats(&before);
+
+  int ec = Z_OK;
+  uLong compressed_len = adaptive_deflate_compress_buffer(Z_BEST_COMPRESSION, MAX_WBITS + 16, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, input, length, output, length + 1024, &ec);
+  ASSERT_MSG(ec == Z_OK, "adaptive compression should not fail");
+  // stored blocks only add their headers to the input
+  ASSERT_MSG(compressed_len == gzip_store_bound(length), "incompressible input should be stored");
+
+  uLong uncompressed_len = uncompress_buffer_any(output, (uInt)compressed_len, uncompressed, length, &ec);
+  ASSERT_MSG(ec == Z_OK && uncompressed_len == length, "stored data should be uncompressed");
+  ASSERT_MSG(memcmp(input, uncompressed, length) == 0, "uncompressed data should be the same as the input");
+
+  GoZLibAdaptiveStats after = {0};
+  get_adaptive_buffer_stats(&after);
+  ASSERT_MSG(after.samples == before.samples + 1 && after.stored == before.stored + 1, "the stored sample should be counted");
+}
+
 int main(void) {
   test_zlib_compress();
   test_gzip_compress();
@@ -152,5 +720,23 @@ int main(void) {
 
   test_fail_transform_uncompress_invalid_input();
 
+  test_context_compress_uncompress_reuse();
+  test_fail_acquire_context_invalid_parameters();
+
+  test_deflate_raw_blocks_concatenate();
+  test_fail_deflate_raw_block_small_buffer();
+  test_compress_batch();
+  test_deflate_compress_vector();
+  test_compress_uncompress_pooled();
+  test_uncompress_batch();
+  test_deflate_compress_buffer_raw();
+  test_dictionary_compress_uncompress();
+  test_fail_dictionary_mismatch();
+  test_context_arena_allocation();
+  test_context_used_until_reset();
+  test_gzip_store_buffer();
+  test_checksums();
+  test_adaptive_compress_buffer();
+
   return 0;
 }
@@ -0,0 +1,589 @@
+#define TRACK_POOL_USAGE
+#include "dyn_mem_pool.h"
+#include "test_only_utils.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+enum {
+  TEST_BLOCK_SIZE = 256,
+  TEST_TRIM_BLOCK_SIZE = 64 * 1024,
+  TEST_TRIM_BLOCK_COUNT = 4,
+  TEST_TRIM_RESERVED_BLOCKS = 256,
+  TEST_TRIM_THREAD_COUNT = 4,
+  TEST_TRIM_ROUNDS = 20,
+  TEST_THREAD_COUNT = 8,
+  TEST_BLOCKS_PER_THREAD = 64,
+  TEST_ITERATIONS = 2000
+};
+
+static uint32_t count_free_list(struct MemPool *pool) {
+  uint32_t count = 0;
+  for (struct MemNode *node = pool_free_list_first(pool); node != NULL; node = node->next) {
+    count++;
+  }
+  return count;
+}
+
+typedef struct {
+  struct MemPool *pool;
+  unsigned char tag;
+} PoolWorker;
+
+static void *pool_worker_run(void *arg) {
+  PoolWorker *worker = arg;
+  void *blocks[TEST_BLOCKS_PER_THREAD];
+
+  for (int iteration = 0; iteration < TEST_ITERATIONS; iteration++) {
+    uint32_t count = (uint32_t)(iteration % TEST_BLOCKS_PER_THREAD) + 1;
+    for (uint32_t i = 0; i < count; i++) {
+      blocks[i] = pool_mem_acquire(worker->pool);
+      ASSERT_MSG(blocks[i] != NULL, "acquire should not fail");
+      memset(blocks[i], worker->tag, TEST_BLOCK_SIZE);
+    }
+
+    // no other thread should be able to hand out a block while we own it
+    for (uint32_t i = 0; i < count; i++) {
+      const unsigned char *block = blocks[i];
+      for (uint32_t b = 0; b < TEST_BLOCK_SIZE; b++) {
+        ASSERT_MSG(block[b] == worker->tag, "acquired block was modified by another thread");
+      }
+      pool_mem_return(blocks[i]);
+    }
+  }
+
+  return NULL;
+}
+
+void test_pool_acquire_return_reuse(void) {
+  PRINT_TEST_NAME;
+
+  struct MemPool *pool = alloc_mem_pool(TEST_BLOCK_SIZE);
+  pool_enable_thread_cache(pool);
+
+  void *first = pool_mem_acquire(pool);
+  void *second = pool_mem_acquire(pool);
+  ASSERT_MSG(first != second, "acquired blocks should be different");
+
+  pool_mem_return(first);
+  pool_mem_return(second);
+
+  // the most recently returned block is handed out first
+  ASSERT_MSG(pool_mem_acquire(pool) == second, "returned block should be reused");
+  ASSERT_MSG(pool_mem_acquire(pool) == first, "returned block should be reused");
+  ASSERT_MSG(pool->num_allocs == pool->blocks_per_slab, "only one slab should have been allocated");
+
+  pool_mem_return(first);
+  pool_mem_return(second);
+  free_mem_pool(pool);
+}
+
+void test_pool_try_acquire_does_not_allocate(void) {
+  PRINT_TEST_NAME;
+
+  struct MemPool *pool = alloc_mem_pool(TEST_BLOCK_SIZE);
+  pool_enable_thread_cache(pool);
+
+  ASSERT_MSG(pool_mem_try_acquire(pool) == NULL, "empty pool should not return a block");
+  ASSERT_MSG(pool->num_allocs == 0, "try acquire should not allocate");
+
+  void *data = pool_mem_acquire(pool);
+  pool_mem_return(data);
+  ASSERT_MSG(pool_mem_try_acquire(pool) == data, "returned block should be available");
+
+  pool_mem_return(data);
+  free_mem_pool(pool);
+}
+
+void test_pool_concurrent_acquire_return(void) {
+  PRINT_TEST_NAME;
+
+  struct MemPool *pool = alloc_mem_pool(TEST_BLOCK_SIZE);
+  pool_enable_thread_cache(pool);
+
+  pthread_t threads[TEST_THREAD_COUNT];
+  PoolWorker workers[TEST_THREAD_COUNT];
+  for (int i = 0; i < TEST_THREAD_COUNT; i++) {
+    workers[i].pool = pool;
+    workers[i].tag = (unsigned char)(i + 1);
+    pthread_create(&threads[i], NULL, pool_worker_run, &workers[i]);
+  }
+
+  for (int i = 0; i < TEST_THREAD_COUNT; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  // every block should be back in the shared list, including the ones cached by threads that exited
+  ASSERT_MSG(count_free_list(pool) == pool->num_allocs, "all allocated blocks should be back in the pool");
+  ASSERT_MSG(pool->num_available == pool->num_allocs, "all allocated blocks should be available");
+  ASSERT_MSG(pool->num_allocs <= TEST_THREAD_COUNT * TEST_BLOCKS_PER_THREAD * 2 + pool->blocks_per_slab * TEST_THREAD_COUNT,
+             "pool should not allocate much more than the working set");
+
+  free_mem_pool(pool);
+}
+
+void test_pool_blocks_carved_from_slab(void) {
+  PRINT_TEST_NAME;
+
+  struct MemPool *pool = alloc_mem_pool(TEST_BLOCK_SIZE);
+  ASSERT_MSG(pool->blocks_per_slab > 1, "small blocks should share a slab");
+
+  void *blocks[TEST_BLOCKS_PER_THREAD];
+  const uint32_t count = pool->blocks_per_slab < TEST_BLOCKS_PER_THREAD ? pool->blocks_per_slab : TEST_BLOCKS_PER_THREAD;
+  for (uint32_t i = 0; i < count; i++) {
+    blocks[i] = pool_mem_acquire(pool);
+    ASSERT_MSG(((uintptr_t)blocks[i] % PoolBlockAlignment) == 0, "blocks should be aligned");
+    memset(blocks[i], (int)i, TEST_BLOCK_SIZE);
+  }
+  ASSERT_MSG(pool->num_allocs == pool->blocks_per_slab, "blocks should come from a single slab");
+
+  for (uint32_t i = 0; i < count; i++) {
+    const unsigned char *block = blocks[i];
+    ASSERT_MSG(block[0] == (unsigned char)i && block[TEST_BLOCK_SIZE - 1] == (unsigned char)i, "blocks should not overlap");
+    ASSERT_MSG(get_memnode_in_data(blocks[i])->pool == pool, "blocks should be owned by the pool");
+    pool_mem_return(blocks[i]);
+  }
+
+  free_mem_pool(pool);
+}
+
+void test_pool_reserve_warms_up_pool(void) {
+  PRINT_TEST_NAME;
+
+  struct MemPool *pool = alloc_mem_pool(TEST_BLOCK_SIZE);
+  const uint32_t count = pool->blocks_per_slab + 1;
+
+  ASSERT_MSG(pool_mem_reserve(pool, count), "reserve should not fail");
+  ASSERT_MSG(pool->num_allocs == pool->blocks_per_slab * 2, "reserve should allocate whole slabs");
+  ASSERT_MSG(count_free_list(pool) == pool->num_allocs, "reserved blocks should be available");
+
+  void *data = pool_mem_try_acquire(pool);
+  ASSERT_MSG(data != NULL, "reserved block should be available without allocating");
+  pool_mem_return(data);
+
+  free_mem_pool(pool);
+}
+
+void test_pool_large_blocks(void) {
+  PRINT_TEST_NAME;
+
+  const uint32_t size = 4 * 1024 * 1024;
+  struct MemPool *pool = alloc_mem_pool(size);
+  ASSERT_MSG(pool->blocks_per_slab == 1, "large blocks should have their own slab");
+
+  unsigned char *first = pool_mem_acquire(pool);
+  unsigned char *second = pool_mem_acquire(pool);
+  ASSERT_MSG(first != NULL && second != NULL, "large acquire should not fail");
+  first[0] = 1;
+  first[size - 1] = 1;
+  second[0] = 2;
+  second[size - 1] = 2;
+  ASSERT_MSG(first[size - 1] == 1 && second[0] == 2, "large blocks should not overlap");
+
+  pool_mem_return(first);
+  pool_mem_return(second);
+  free_mem_pool(pool);
+}
+
+void test_multipool_large_blocks(void) {
+  PRINT_TEST_NAME;
+
+  const uint32_t size = 16 * 1024 * 1024;
+  struct MultiPool *multipool = multipool_create();
+
+  unsigned char *first = multipool_mem_acquire(multipool, size);
+  unsigned char *second = multipool_mem_acquire(multipool, size + 1);
+  ASSERT_MSG(first != NULL && second != NULL, "blocks above the largest pool should be allocated");
+  ASSERT_MSG(((uintptr_t)first & ((uintptr_t)sysconf(_SC_PAGESIZE) - 1)) == 0, "large blocks should be page aligned");
+  first[size - 1] = 1;
+  second[size] = 2;
+
+  pool_mem_return(first);
+  unsigned char *reused = multipool_mem_acquire(multipool, size);
+  ASSERT_MSG(reused == first, "returned large blocks should be reused");
+  unsigned char *larger = multipool_mem_acquire(multipool, size * 4);
+  ASSERT_MSG(larger != NULL && larger != first, "cached large blocks should not be used for larger sizes");
+
+  struct MemPoolStats stats;
+  large_cache_get_stats(&multipool->large, &stats);
+  ASSERT_MSG(stats.acquires == 4 && stats.misses == 3, "large block acquires should be counted");
+  ASSERT_MSG(stats.in_use_blocks == 3 && stats.allocated_blocks == 3, "large blocks in use should be counted");
+
+  pool_mem_return(reused);
+  pool_mem_return(second);
+  ASSERT_MSG(multipool_trim(multipool, (size_t)size * 3) == 0, "cached blocks within keep bytes should be kept");
+  ASSERT_MSG(multipool_trim(multipool, 0) > (size_t)size * 2, "cached large blocks should be released");
+
+  large_cache_get_stats(&multipool->large, &stats);
+  ASSERT_MSG(stats.in_use_blocks == 1 && stats.allocated_blocks == 1, "released large blocks should not be counted");
+
+  pool_mem_return(larger);
+
+  multipool_free(multipool);
+}
+
+void test_multipool_reserve(void) {
+  PRINT_TEST_NAME;
+
+  struct MultiPool *multipool = multipool_create();
+  ASSERT_MSG(multipool_reserve(multipool, 1000, 4), "reserve should not fail");
+  ASSERT_MSG(pool_free_list_first(multipool->pools[find_multipool_index_for_size(1000)]) != NULL, "reserved blocks should be available");
+  ASSERT_MSG(!multipool_reserve(multipool, UINT32_MAX, 1), "reserve should fail for sizes above the largest pool");
+
+  multipool_free(multipool);
+}
+
+void test_multipool_in_use(void) {
+  PRINT_TEST_NAME;
+
+  struct MultiPool *multipool = multipool_create();
+  ASSERT_MSG(!multipool_in_use(multipool), "new multipool should have no blocks in use");
+
+  void *data = multipool_mem_acquire(multipool, 1000);
+  void *large = multipool_mem_acquire(multipool, 16 * 1024 * 1024);
+  ASSERT_MSG(multipool_in_use(multipool), "acquired block should be in use");
+  pool_mem_return(data);
+  ASSERT_MSG(multipool_in_use(multipool), "acquired large block should be in use");
+  pool_mem_return(large);
+  ASSERT_MSG(!multipool_in_use(multipool), "returned blocks should not be in use");
+
+  multipool_free(multipool);
+}
+
+static void acquire_and_return_trim_blocks(struct MemPool *pool, unsigned char **blocks) {
+  for (uint32_t i = 0; i < TEST_TRIM_BLOCK_COUNT; i++) {
+    blocks[i] = pool_mem_acquire(pool);
+    memset(blocks[i], 0xAB, TEST_TRIM_BLOCK_SIZE);
+  }
+  for (uint32_t i = 0; i < TEST_TRIM_BLOCK_COUNT; i++) {
+    pool_mem_return(blocks[i]);
+  }
+}
+
+void test_pool_trim_releases_free_blocks(void) {
+  PRINT_TEST_NAME;
+
+  struct MemPool *pool = alloc_mem_pool(TEST_TRIM_BLOCK_SIZE);
+  unsigned char *blocks[TEST_TRIM_BLOCK_COUNT];
+  acquire_and_return_trim_blocks(pool, blocks);
+
+  uint32_t free_count = count_free_list(pool);
+  ASSERT_MSG(pool_mem_trim(pool, 0, 0, 0) >= TEST_TRIM_BLOCK_COUNT * (TEST_TRIM_BLOCK_SIZE / 2), "trim should release the free blocks memory");
+  ASSERT_MSG(count_free_list(pool) == free_count, "trimmed blocks should stay in the pool");
+  ASSERT_MSG(pool_mem_trim(pool, 0, 0, 0) == 0, "trimmed blocks should not be trimmed again");
+
+  // trimmed blocks are still usable
+  unsigned char *data = pool_mem_acquire(pool);
+  ASSERT_MSG(data == blocks[TEST_TRIM_BLOCK_COUNT - 1], "trimmed block should be reused");
+  memset(data, 1, TEST_TRIM_BLOCK_SIZE);
+  ASSERT_MSG(data[TEST_TRIM_BLOCK_SIZE - 1] == 1, "trimmed block should be writable");
+  pool_mem_return(data);
+
+  free_mem_pool(pool);
+}
+
+void test_pool_trim_keeps_recent_blocks(void) {
+  PRINT_TEST_NAME;
+
+  struct MemPool *pool = alloc_mem_pool(TEST_TRIM_BLOCK_SIZE);
+  unsigned char *blocks[TEST_TRIM_BLOCK_COUNT];
+  acquire_and_return_trim_blocks(pool, blocks);
+
+  ASSERT_MSG(pool_mem_trim(pool, 0, TEST_TRIM_BLOCK_SIZE * 2, 0) > 0, "trim should release memory above keep bytes");
+
+  // the last two returned blocks are at the head of the free list
+  ASSERT_MSG(!get_memnode_in_data(blocks[TEST_TRIM_BLOCK_COUNT - 1])->trimmed, "most recent block should be kept");
+  ASSERT_MSG(!get_memnode_in_data(blocks[TEST_TRIM_BLOCK_COUNT - 2])->trimmed, "most recent block should be kept");
+  ASSERT_MSG(get_memnode_in_data(blocks[0])->trimmed, "older block should be trimmed");
+  ASSERT_MSG(blocks[TEST_TRIM_BLOCK_COUNT - 1][TEST_TRIM_BLOCK_SIZE / 2] == 0xAB, "kept block content should be unchanged");
+
+  ASSERT_MSG(pool_mem_trim(pool, TEST_TRIM_BLOCK_SIZE * 2, 0, 0) == 0, "trim should not happen below the trigger amount");
+
+  free_mem_pool(pool);
+}
+
+void test_pool_trim_min_idle_epochs(void) {
+  PRINT_TEST_NAME;
+
+  struct MemPool *pool = alloc_mem_pool(TEST_TRIM_BLOCK_SIZE);
+  unsigned char *blocks[TEST_TRIM_BLOCK_COUNT];
+  acquire_and_return_trim_blocks(pool, blocks);
+
+  ASSERT_MSG(pool_mem_trim(pool, 0, 0, 1) == 0, "recently returned blocks should not be trimmed");
+  pool_advance_epoch(pool);
+  ASSERT_MSG(pool_mem_trim(pool, 0, 0, 1) > 0, "idle blocks should be trimmed");
+
+  free_mem_pool(pool);
+}
+
+typedef struct {
+  struct MemPool *pool;
+  bool *stop;
+} TrimWorker;
+
+static void *trim_worker_run(void *arg) {
+  TrimWorker *worker = arg;
+  while (!__atomic_load_n(worker->stop, __ATOMIC_ACQUIRE)) {
+    unsigned char *first = pool_mem_acquire(worker->pool);
+    unsigned char *second = pool_mem_acquire(worker->pool);
+    ASSERT_MSG(first != NULL && second != NULL, "acquire should not fail");
+    memset(first, 1, TEST_TRIM_BLOCK_SIZE);
+    memset(second, 2, TEST_TRIM_BLOCK_SIZE);
+    pool_mem_return(second);
+    pool_mem_return(first);
+  }
+  return NULL;
+}
+
+void test_pool_trim_concurrent_acquire(void) {
+  PRINT_TEST_NAME;
+
+  struct MemPool *pool = alloc_mem_pool(TEST_TRIM_BLOCK_SIZE);
+  ASSERT_MSG(pool_mem_reserve(pool, TEST_TRIM_RESERVED_BLOCKS), "reserve should not fail");
+  uint64_t allocated_blocks = pool->stats.allocated_blocks;
+
+  bool stop = false;
+  pthread_t threads[TEST_TRIM_THREAD_COUNT];
+  TrimWorker workers[TEST_TRIM_THREAD_COUNT];
+  for (int i = 0; i < TEST_TRIM_THREAD_COUNT; i++) {
+    workers[i].pool = pool;
+    workers[i].stop = &stop;
+    pthread_create(&threads[i], NULL, trim_worker_run, &workers[i]);
+  }
+
+  unsigned char *blocks[TEST_TRIM_RESERVED_BLOCKS];
+  for (int round = 0; round < TEST_TRIM_ROUNDS; round++) {
+    // touch the free blocks so every trim has to release them, leaving two blocks per worker
+    uint32_t count = 0;
+    while (count < TEST_TRIM_RESERVED_BLOCKS - TEST_TRIM_THREAD_COUNT * 2 && (blocks[count] = pool_mem_try_acquire(pool)) != NULL) {
+      memset(blocks[count], 0xAB, TEST_TRIM_BLOCK_SIZE);
+      count++;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      pool_mem_return(blocks[i]);
+    }
+    pool_mem_trim(pool, 0, 0, 0);
+  }
+
+  __atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+  for (int i = 0; i < TEST_TRIM_THREAD_COUNT; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  // the free list always had enough blocks for the workers, trimming should not make them allocate more
+  ASSERT_MSG(pool->stats.allocated_blocks == allocated_blocks, "acquires should not allocate while the pool is trimmed");
+  ASSERT_MSG(count_free_list(pool) == allocated_blocks, "all blocks should be back in the pool");
+
+  free_mem_pool(pool);
+}
+
+void test_multipool_trim_watermarks(void) {
+  PRINT_TEST_NAME;
+
+  struct MultiPool *multipool = multipool_create();
+  struct MemPool *pool = multipool->pools[find_multipool_index_for_size(TEST_TRIM_BLOCK_SIZE)];
+
+  void *data = multipool_mem_acquire(multipool, TEST_TRIM_BLOCK_SIZE);
+  pool_mem_return(data);
+  ASSERT_MSG(multipool_trim_tick(multipool) == 0, "pools without watermarks should not be trimmed");
+
+  ASSERT_MSG(multipool_set_trim_watermarks(multipool, TEST_TRIM_BLOCK_SIZE, TEST_TRIM_BLOCK_SIZE / 2, 0), "watermarks should be set");
+  ASSERT_MSG(!multipool_set_trim_watermarks(multipool, UINT32_MAX, 1, 0), "watermarks should not be set above the largest pool");
+  ASSERT_MSG(multipool_trim_tick(multipool) > 0, "pool above high watermark should be trimmed");
+  ASSERT_MSG(get_memnode_in_data(data)->trimmed, "idle block should be trimmed");
+
+  data = multipool_mem_acquire(multipool, TEST_TRIM_BLOCK_SIZE);
+  pool_mem_return(data);
+  ASSERT_MSG(multipool_start_trimmer(multipool, 1, 0), "trimmer should start");
+  for (int i = 0; i < 1000 && !get_memnode_in_data(data)->trimmed; i++) {
+    usleep(1000);
+  }
+  multipool_stop_trimmer(multipool);
+  ASSERT_MSG(get_memnode_in_data(data)->trimmed, "background trimmer should trim idle blocks");
+  ASSERT_MSG(pool->epoch > 1, "background trimmer should advance the pool epoch");
+
+  ASSERT_MSG(multipool_trim(multipool, 0) == 0, "trimmed pools should have nothing else to release");
+
+  multipool_free(multipool);
+}
+
+void test_pool_stats(void) {
+  PRINT_TEST_NAME;
+
+  struct MemPool *pool = alloc_mem_pool(TEST_TRIM_BLOCK_SIZE);
+  pool_enable_thread_cache(pool);
+
+  struct MemPoolStats stats;
+  pool_get_stats(pool, &stats);
+  ASSERT_MSG(stats.acquires == 0 && stats.allocated_blocks == 0, "new pool should have no activity");
+
+  void *first = pool_mem_acquire(pool);
+  void *second = pool_mem_acquire(pool);
+  pool_mem_return(first);
+  void *third = pool_mem_acquire(pool);
+
+  pool_get_stats(pool, &stats);
+  ASSERT_MSG(stats.acquires == 3, "acquires should be counted");
+  ASSERT_MSG(stats.misses == (pool->blocks_per_slab == 1 ? 2 : 1), "acquires from an empty pool should be counted as misses");
+  ASSERT_MSG(stats.allocated_blocks == pool->num_allocs, "allocated blocks should be counted");
+  ASSERT_MSG(stats.in_use_blocks == 2, "blocks in use should be counted");
+  ASSERT_MSG(stats.high_water_blocks == 2, "high water should be the maximum blocks in use");
+
+  pool_mem_return(second);
+  pool_mem_return(third);
+  ASSERT_MSG(pool_mem_try_acquire(pool) != NULL, "returned block should be available");
+  pool_get_stats(pool, &stats);
+  ASSERT_MSG(stats.in_use_blocks == 1 && stats.high_water_blocks == 2, "high water should not decrease");
+
+  free_mem_pool(pool);
+}
+
+void test_multipool_stats(void) {
+  PRINT_TEST_NAME;
+
+  struct MultiPool *multipool = multipool_create();
+  void *data = multipool_mem_acquire(multipool, TEST_TRIM_BLOCK_SIZE);
+  pool_mem_return(data);
+  multipool_trim(multipool, 0);
+
+  struct MemPoolStats stats[MULTIPOOL_ENTRY_COUNT];
+  multipool_get_stats(multipool, stats);
+
+  uint32_t index = find_multipool_index_for_size(TEST_TRIM_BLOCK_SIZE);
+  for (uint32_t i = 0; i < MULTIPOOL_ENTRY_COUNT; i++) {
+    ASSERT_MSG(stats[i].acquires == (i == index ? 1 : 0), "only the pool for the acquired size should be used");
+  }
+  ASSERT_MSG(stats[index].released_bytes > 0, "trimmed memory should be counted");
+  ASSERT_MSG(stats[index].in_use_blocks == 0, "no blocks should be in use");
+
+  multipool_free(multipool);
+}
+
+#ifdef POOL_THREAD_CACHE
+void test_pool_thread_cache_keeps_shared_list_untouched(void) {
+  PRINT_TEST_NAME;
+
+  struct MemPool *pool = alloc_mem_pool(TEST_BLOCK_SIZE);
+  pool_enable_thread_cache(pool);
+
+  void *data = pool_mem_acquire(pool);
+  struct MemNode *free_head = pool_free_list_first(pool);
+  pool_mem_return(data);
+  ASSERT_MSG(pool_free_list_first(pool) == free_head, "returned block should stay in the thread cache");
+
+  ASSERT_MSG(pool_mem_acquire(pool) == data, "cached block should be reused");
+  pool_mem_return(data);
+
+  free_mem_pool(pool);
+}
+
+void test_pool_thread_cache_spills_to_shared_list(void) {
+  PRINT_TEST_NAME;
+
+  struct MemPool *pool = alloc_mem_pool(TEST_BLOCK_SIZE);
+  pool_enable_thread_cache(pool);
+
+  const uint32_t count = POOL_THREAD_CACHE_BATCH * 2 + 1;
+  void *blocks[POOL_THREAD_CACHE_BATCH * 2 + 1];
+  for (uint32_t i = 0; i < count; i++) {
+    blocks[i] = pool_mem_acquire(pool);
+  }
+  uint32_t free_count = count_free_list(pool);
+  for (uint32_t i = 0; i < count; i++) {
+    pool_mem_return(blocks[i]);
+  }
+
+  ASSERT_MSG(count_free_list(pool) == free_count + POOL_THREAD_CACHE_BATCH, "a full thread cache should spill one batch");
+
+  free_mem_pool(pool);
+}
+
+typedef struct {
+  struct MemPool *pool;
+  pthread_barrier_t *cached;
+  pthread_barrier_t *flushed;
+} CachingWorker;
+
+static void *caching_worker_run(void *arg) {
+  CachingWorker *worker = arg;
+  pool_mem_return(pool_mem_acquire(worker->pool));
+
+  // stay alive while the other thread flushes, so the block is not returned by the thread exit
+  pthread_barrier_wait(worker->cached);
+  pthread_barrier_wait(worker->flushed);
+  return NULL;
+}
+
+void test_pool_thread_cache_flush_all_threads(void) {
+  PRINT_TEST_NAME;
+
+  struct MemPool *pool = alloc_mem_pool(TEST_BLOCK_SIZE);
+  pool_enable_thread_cache(pool);
+
+  pthread_barrier_t cached;
+  pthread_barrier_t flushed;
+  pthread_barrier_init(&cached, NULL, 2);
+  pthread_barrier_init(&flushed, NULL, 2);
+  CachingWorker worker = {.pool = pool, .cached = &cached, .flushed = &flushed};
+  pthread_t thread;
+  pthread_create(&thread, NULL, caching_worker_run, &worker);
+
+  pthread_barrier_wait(&cached);
+  ASSERT_MSG(count_free_list(pool) == pool->blocks_per_slab - 1, "returned block should be in the other thread cache");
+  pool_flush_thread_caches(pool);
+  ASSERT_MSG(count_free_list(pool) == pool->blocks_per_slab, "flush should return the blocks cached by other threads");
+
+  pthread_barrier_wait(&flushed);
+  pthread_join(thread, NULL);
+  ASSERT_MSG(count_free_list(pool) == pool->blocks_per_slab, "flushed blocks should not be returned again");
+
+  pthread_barrier_destroy(&cached);
+  pthread_barrier_destroy(&flushed);
+  free_mem_pool(pool);
+}
+
+void test_pool_thread_cache_byte_budget(void) {
+  PRINT_TEST_NAME;
+
+  struct MemPool *pool = alloc_mem_pool(POOL_THREAD_CACHE_MAX_BYTES / 8);
+  pool_enable_thread_cache(pool);
+  ASSERT_MSG(pool->thread_cache_batch == 4, "large blocks should be cached in smaller batches");
+  free_mem_pool(pool);
+
+  pool = alloc_mem_pool(POOL_THREAD_CACHE_MAX_BYTES);
+  pool_enable_thread_cache(pool);
+  void *data = pool_mem_acquire(pool);
+  pool_mem_return(data);
+  ASSERT_MSG(pool_free_list_first(pool) == get_memnode_in_data(data), "blocks above the budget should not be cached");
+  free_mem_pool(pool);
+}
+#endif
+
+int main(void) {
+  test_pool_acquire_return_reuse();
+  test_pool_try_acquire_does_not_allocate();
+  test_pool_concurrent_acquire_return();
+  test_pool_blocks_carved_from_slab();
+  test_pool_reserve_warms_up_pool();
+  test_pool_large_blocks();
+  test_multipool_large_blocks();
+  test_multipool_reserve();
+  test_multipool_in_use();
+  test_pool_trim_releases_free_blocks();
+  test_pool_trim_keeps_recent_blocks();
+  test_pool_trim_min_idle_epochs();
+  test_pool_trim_concurrent_acquire();
+  test_multipool_trim_watermarks();
+  test_pool_stats();
+  test_multipool_stats();
+
+#ifdef POOL_THREAD_CACHE
+  test_pool_thread_cache_keeps_shared_list_untouched();
+  test_pool_thread_cache_spills_to_shared_list();
+  test_pool_thread_cache_flush_all_threads();
+  test_pool_thread_cache_byte_budget();
+#endif
+
+  return 0;
+}
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <zconf.h>
 #include <zlib.h>
 
@@ -220,6 +221,41 @@ void test_uncompress_zlib_stream(void) {
   verify_uncompress_stream(zlib_compress_buffer, init_input_buffer_rand);
 }
 
+void test_uncompress_multi_member_gzip_stream(void) {
+  PRINT_TEST_NAME;
+  const uInt len = 2048 + 17;
+  const uInt member_len = 1000;
+  const uInt compressed_input_len = 2 * len;
+  char original_input[len];
+  char compressed_input[compressed_input_len];
+  char output[len];
+
+  init_input_buffer_rand(original_input, len);
+
+  // the first member_len bytes in one gzip member and the remaining ones in another
+  int ec = Z_OK;
+  uLong first_len = gzip_compress_buffer(Z_BEST_COMPRESSION, original_input, member_len, compressed_input, compressed_input_len, &ec);
+  ASSERT_MSG(ec == Z_OK, "first member compression error code should be Z_OK");
+  uLong second_len = gzip_compress_buffer(Z_BEST_COMPRESSION, original_input + member_len, len - member_len, compressed_input + first_len,
+                                          (uInt)(compressed_input_len - first_len), &ec);
+  ASSERT_MSG(ec == Z_OK, "second member compression error code should be Z_OK");
+
+  ZStreamState zss;
+  DataStreamer streamer = make_data_streamer();
+  streamer.input = compressed_input;
+  streamer.in_len = (uInt)(first_len + second_len);
+  streamer.output = output;
+  streamer.out_len = len;
+
+  zss.data_handler = &streamer;
+
+  // work buffers smaller than the members, so the first one ends in the middle of an input chunk
+  uLong uncompressed_len = uncompress_stream_any(&zss, in_handler, out_handler, 333, 256, &ec);
+  ASSERT_MSG(ec == Z_OK, "uncompress multi member stream should have error code Z_OK");
+  ASSERT_MSG(uncompressed_len == len, "all members should be uncompressed");
+  ASSERT_MSG(memcmp(original_input, output, len) == 0, "uncompressed members should be the same as original input");
+}
+
 void test_uncompress_fail_invalid_stream(void) {
   PRINT_TEST_NAME;
   const uInt len = 1024;
@@ -283,6 +319,330 @@ void test_zlib_compress_stream_compressed_larger_than_input(void) {
   verify_uncompress_stream(zlib_compress_buffer, init_input_buffer_high_entropy);
 }
 
+void test_transformer_compress_uncompress_steps(void) {
+  PRINT_TEST_NAME;
+
+  const uInt length = 1024 * 16;
+  const uInt step_out_len = 256;
+  char input[length];
+  char compressed[length * 2];
+  init_input_buffer_rand(input, length);
+
+  int ec = Z_OK;
+  GoZLibTransformer *compressor = acquire_gzip_compression_transformer(Z_BEST_SPEED, step_out_len, &ec);
+  ASSERT_MSG(ec == Z_OK, "compression transformer should be acquired");
+
+  // compress in steps, each one producing at most step_out_len bytes
+  uInt consumed = 0;
+  uInt produced = 0;
+  int steps = 0;
+  GoZLibStepResult step;
+  do {
+    step = transformer_compress_step(compressor, input + consumed, length - consumed, compressed + produced, step_out_len, Z_NO_FLUSH);
+    consumed += step.consumed;
+    produced += step.produced;
+    steps++;
+  } while (step.status == GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA);
+  ASSERT_MSG(step.status == Z_OK && consumed == length, "compression steps should consume all the input");
+
+  do {
+    step = transformer_compress_step(compressor, NULL, 0, compressed + produced, step_out_len, Z_FINISH);
+    produced += step.produced;
+    steps++;
+  } while (step.status == GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA);
+  ASSERT_MSG(step.status == Z_STREAM_END, "finishing the compression should end the stream");
+  ASSERT_MSG(steps > 1, "compressed output should take more than one step to be written");
+  release_compression_transformer(compressor);
+
+  GoZLibTransformer *uncompressor = acquire_uncompression_transformer(step_out_len, &ec);
+  ASSERT_MSG(ec == Z_OK, "uncompression transformer should be acquired");
+  uncompressor->zs->next_in = (Bytef *)compressed;
+  uncompressor->zs->avail_in = produced;
+
+  char uncompressed[length];
+  uInt uncompressed_len = 0;
+  do {
+    step = transformer_uncompress_step(uncompressor, uncompressed + uncompressed_len, step_out_len);
+    uncompressed_len += step.produced;
+  } while (step.status == GOZLIB_STREAM_OUTPUT_HAS_MORE_DATA);
+  ASSERT_MSG(step.status == Z_STREAM_END, "uncompression steps should reach the end of the stream");
+  ASSERT_MSG(uncompressed_len == length && memcmp(input, uncompressed, length) == 0, "uncompressed data should be equal to input");
+
+  // invalid input is reported in the step status
+  reset_uncompression_transformer(uncompressor);
+  uncompressor->zs->next_in = (Bytef *)input;
+  uncompressor->zs->avail_in = length;
+  step = transformer_uncompress_step(uncompressor, uncompressed, step_out_len);
+  ASSERT_MSG(step.status == Z_DATA_ERROR, "uncompressing invalid input should fail");
+  release_uncompression_transformer(uncompressor);
+}
+
+void test_transformer_sync_flush_keeps_stream_open(void) {
+  PRINT_TEST_NAME;
+
+  const uInt length = 2048;
+  char message[length];
+  char compressed[length * 4];
+  init_input_buffer_rand(message, length);
+
+  int ec = Z_OK;
+  // raw deflate, as framed by websocket permessage-deflate
+  GoZLibTransformer *compressor = acquire_compression_transformer(Z_DEFAULT_COMPRESSION, -MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, length, &ec);
+  ASSERT_MSG(ec == Z_OK, "compression transformer should be acquired");
+
+  z_stream inflater;
+  memset(&inflater, 0, sizeof(inflater));
+  ASSERT_MSG(inflateInit2(&inflater, -MAX_WBITS) == Z_OK, "inflater should be initialized");
+
+  uInt produced = 0;
+  uInt flushed_len[2];
+  for (int i = 0; i < 2; i++) {
+    GoZLibStepResult step = transformer_compress_step(compressor, message, length, compressed + produced, sizeof(compressed) - produced, Z_SYNC_FLUSH);
+    ASSERT_MSG(step.status == Z_OK && step.consumed == length, "sync flush should consume the whole message");
+    const unsigned char *marker = (unsigned char *)compressed + produced + step.produced - 4;
+    ASSERT_MSG(marker[0] == 0 && marker[1] == 0 && marker[2] == 0xff && marker[3] == 0xff, "sync flush should end with an empty stored block");
+
+    // everything written so far can be uncompressed without the end of the stream
+    char uncompressed[length];
+    inflater.next_in = (Bytef *)compressed + produced;
+    inflater.avail_in = step.produced;
+    inflater.next_out = (Bytef *)uncompressed;
+    inflater.avail_out = length;
+    int inf_code = inflate(&inflater, Z_SYNC_FLUSH);
+    ASSERT_MSG(inf_code == Z_OK && inflater.avail_out == 0 && memcmp(message, uncompressed, length) == 0, "flushed message should be uncompressed");
+
+    flushed_len[i] = step.produced;
+    produced += step.produced;
+  }
+  // the window is kept, the repeated message is a single match
+  ASSERT_MSG(flushed_len[1] < flushed_len[0] / 4, "second message should reference the first one");
+
+  inflateEnd(&inflater);
+  release_compression_transformer(compressor);
+}
+
+void test_transformer_park_at_flush_boundaries(void) {
+  PRINT_TEST_NAME;
+
+  const uInt length = 4096;
+  char message[length];
+  char compressed[length * 4];
+  char uncompressed[length * 2];
+  init_input_buffer_rand(message, length);
+
+  int ec = Z_OK;
+  GoZLibTransformer *compressor = acquire_compression_transformer(Z_DEFAULT_COMPRESSION, -MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, length, &ec);
+  ASSERT_MSG(ec == Z_OK, "compression transformer should be acquired");
+  GoZLibTransformer *uncompressor = acquire_window_uncompression_transformer(-MAX_WBITS, length, &ec);
+  ASSERT_MSG(ec == Z_OK, "uncompression transformer should be acquired");
+
+  uInt flushed_len[2];
+  for (int i = 0; i < 2; i++) {
+    GoZLibStepResult step = transformer_compress_step(compressor, message, length, compressed, sizeof(compressed), Z_NO_FLUSH);
+    ASSERT_MSG(step.status == Z_OK, "message should be compressed");
+    ASSERT_MSG(!park_transformer(compressor), "compressor should not be parked in the middle of a block");
+
+    GoZLibStepResult flushed = transformer_compress_step(compressor, NULL, 0, compressed + step.produced, sizeof(compressed) - step.produced, Z_SYNC_FLUSH);
+    ASSERT_MSG(flushed.status == Z_OK, "message should be flushed");
+    flushed_len[i] = step.produced + flushed.produced;
+    ASSERT_MSG(park_transformer(compressor), "compressor should be parked after a sync flush");
+    ASSERT_MSG(compressor->context == NULL && compressor->work_buffer == NULL && compressor->parked_window_len > 0, "parked compressor should only keep its window");
+    ASSERT_MSG(unpark_transformer(compressor) == Z_OK, "compressor should be unparked");
+
+    ASSERT_MSG(unpark_transformer(uncompressor) == Z_OK, "uncompressor should be unparked");
+    uncompressor->zs->next_in = (Bytef *)compressed;
+    uncompressor->zs->avail_in = flushed_len[i];
+    step = transformer_uncompress_step(uncompressor, uncompressed, sizeof(uncompressed));
+    ASSERT_MSG(step.status == Z_OK && step.produced == length && memcmp(message, uncompressed, length) == 0, "message should be uncompressed");
+    ASSERT_MSG(park_transformer(uncompressor), "uncompressor should be parked at the end of the flushed block");
+  }
+  // the history survived parking, the repeated message is a single match
+  ASSERT_MSG(flushed_len[1] < flushed_len[0] / 4, "second message should reference the first one");
+
+  release_uncompression_transformer(uncompressor);
+  release_compression_transformer(compressor);
+
+  // gzip streams can only be parked while nothing was written
+  GoZLibTransformer *gzip_compressor = acquire_gzip_compression_transformer(Z_BEST_SPEED, length, &ec);
+  ASSERT_MSG(park_transformer(gzip_compressor) && unpark_transformer(gzip_compressor) == Z_OK, "new compressor should be parked");
+  transformer_compress_step(gzip_compressor, message, length, compressed, sizeof(compressed), Z_SYNC_FLUSH);
+  ASSERT_MSG(!park_transformer(gzip_compressor), "started gzip compressor should not be parked");
+  reset_compression_transformer(gzip_compressor);
+  ASSERT_MSG(park_transformer(gzip_compressor), "reset compressor should be parked");
+  // released while parked
+  release_compression_transformer(gzip_compressor);
+}
+
+static int create_temp_file(char *path_template) {
+  int fd = mkstemp(path_template);
+  ASSERT_MSG(fd >= 0, "temporary file should be created");
+  unlink(path_template);
+  return fd;
+}
+
+void verify_file_compress_uncompress(bool direct_io) {
+  // larger than a file output buffer so the output is written more than once
+  const uInt length = 24 * 1024 * 1024;
+  char *input = malloc(length);
+  init_input_buffer_rand(input, length);
+
+  char input_path[] = "/tmp/gozlib_file_input_XXXXXX";
+  char compressed_path[] = "/tmp/gozlib_file_compressed_XXXXXX";
+  char uncompressed_path[] = "/tmp/gozlib_file_uncompressed_XXXXXX";
+  int input_fd = create_temp_file(input_path);
+  int compressed_fd = create_temp_file(compressed_path);
+  int uncompressed_fd = create_temp_file(uncompressed_path);
+  ASSERT_MSG(write(input_fd, input, length) == (ssize_t)length, "input file should be written");
+
+  int ec = Z_OK;
+  uint64_t compressed_len = file_compress(input_fd, compressed_fd, Z_BEST_SPEED, MAX_WBITS + 16, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY, direct_io, &ec);
+  ASSERT_MSG(ec == Z_OK && compressed_len > 0, "file compression should succeed");
+  ASSERT_MSG(lseek(compressed_fd, 0, SEEK_END) == (off_t)compressed_len, "compressed length should match the file size");
+
+  lseek(compressed_fd, 0, SEEK_SET);
+  uint64_t uncompressed_len = file_uncompress(compressed_fd, uncompressed_fd, MAX_WBITS + 32, direct_io, &ec);
+  ASSERT_MSG(ec == Z_OK && uncompressed_len == length, "file uncompression should succeed");
+
+  char *uncompressed = malloc(length);
+  ASSERT_MSG(pread(uncompressed_fd, uncompressed, length, 0) == (ssize_t)length, "uncompressed file should be read");
+  ASSERT_MSG(memcmp(input, uncompressed, length) == 0, "uncompressed file should be equal to input");
+
+  // the reader uncompresses the mapped file into small buffers
+  GoZLibFileReader *reader = open_file_reader(compressed_fd, MAX_WBITS + 32, &ec);
+  ASSERT_MSG(reader != NULL, "file reader should be opened");
+  memset(uncompressed, 0, length);
+  size_t read_len = 0;
+  GoZLibStepResult step;
+  do {
+    const uInt remaining = length - (uInt)read_len;
+    step = file_reader_read(reader, uncompressed + read_len, remaining < 4096 ? remaining : 4096);
+    read_len += step.produced;
+  } while (step.status == Z_OK);
+  ASSERT_MSG(step.status == Z_STREAM_END && read_len == length, "file reader should read until the end of the stream");
+  ASSERT_MSG(memcmp(input, uncompressed, length) == 0, "file reader data should be equal to input");
+  close_file_reader(reader);
+
+  // a truncated stream is an error
+  ASSERT_MSG(ftruncate(compressed_fd, (off_t)compressed_len / 2) == 0, "compressed file should be truncated");
+  lseek(uncompressed_fd, 0, SEEK_SET);
+  file_uncompress(compressed_fd, uncompressed_fd, MAX_WBITS + 32, direct_io, &ec);
+  ASSERT_MSG(ec == Z_DATA_ERROR, "uncompressing a truncated file should fail");
+
+  close(input_fd);
+  close(compressed_fd);
+  close(uncompressed_fd);
+  free(input);
+  free(uncompressed);
+}
+
+void test_file_compress_uncompress(void) {
+  PRINT_TEST_NAME;
+
+  verify_file_compress_uncompress(false);
+  verify_file_compress_uncompress(true);
+}
+
+void test_index_resume_at_access_point(void) {
+  PRINT_TEST_NAME;
+
+  const uInt length = 1024 * 1024;
+  const uint64_t span = 64 * 1024;
+  char *input = malloc(length);
+  char *compressed = malloc(length + 1024);
+  init_input_buffer_rand(input, length);
+
+  int ec = Z_OK;
+  uLong compressed_len = zlib_compress_buffer(Z_BEST_SPEED, input, length, compressed, length + 1024, &ec);
+  ASSERT_MSG(ec == Z_OK, "compression should succeed");
+
+  GoZLibIndexBuilder *builder = create_index_builder(span, &ec);
+  ASSERT_MSG(builder != NULL, "index builder should be created");
+  // feed the compressed data in small chunks
+  GoZLibStepResult step = {.consumed = 0, .produced = 0, .status = Z_OK};
+  for (uLong fed = 0; fed < compressed_len && step.status == Z_OK; fed += step.consumed) {
+    const uInt chunk = compressed_len - fed < 1000 ? (uInt)(compressed_len - fed) : 1000;
+    step = index_builder_step(builder, compressed + fed, chunk);
+  }
+  ASSERT_MSG(step.status == Z_STREAM_END, "the whole stream should be indexed");
+  ASSERT_MSG(builder->count > 2 && builder->points[0].out == 0 && builder->points[0].window_len == 0, "access points should be recorded from the start");
+
+  GoZLibAccessPoint *point = &builder->points[builder->count / 2];
+  ASSERT_MSG(point->out >= span && point->window_len == 32768, "access points should be at least a span apart");
+
+  GoZLibTransformer *uncompressor = acquire_window_uncompression_transformer(-MAX_WBITS, 4096, &ec);
+  ASSERT_MSG(ec == Z_OK, "raw uncompression transformer should be acquired");
+  ec = transformer_prime_access_point(uncompressor, point->in, point->out, point->bits, (unsigned char)compressed[point->in - 1], point->window, point->window_len);
+  ASSERT_MSG(ec == Z_OK, "transformer should be primed with the access point");
+
+  uncompressor->zs->next_in = (Bytef *)compressed + point->in;
+  uncompressor->zs->avail_in = (uInt)(compressed_len - point->in);
+  char uncompressed[4096];
+  step = transformer_uncompress_step(uncompressor, uncompressed, sizeof(uncompressed));
+  ASSERT_MSG(step.produced == sizeof(uncompressed), "uncompressing should resume at the access point");
+  ASSERT_MSG(memcmp(input + point->out, uncompressed, sizeof(uncompressed)) == 0, "resumed data should match the input at the access point");
+
+  release_uncompression_transformer(uncompressor);
+  free_index_builder(builder);
+  free(input);
+  free(compressed);
+}
+
+void test_stream_and_transformer_stats(void) {
+  PRINT_TEST_NAME;
+
+  const uInt length = 1024 * 16;
+  const uInt work_len = 1024;
+  char input[length];
+  char compressed[length * 2];
+  init_input_buffer_rand(input, length);
+
+  GoZLibStats global_before;
+  get_global_stats(true, &global_before);
+  set_stats_enabled(true);
+  ASSERT_MSG(get_stats_enabled(), "stats should be enabled");
+
+  ZStreamState zss;
+  DataStreamer streamer = make_data_streamer();
+  streamer.input = input;
+  streamer.output = compressed;
+  streamer.in_len = length;
+  streamer.out_len = length * 2;
+  zss.data_handler = &streamer;
+
+  int ec = Z_OK;
+  uLong compressed_len = gzip_compress_stream(&zss, Z_BEST_SPEED, in_handler, out_handler, work_len, work_len, &ec);
+  ASSERT_MSG(ec == Z_OK, "stream should be compressed");
+  ASSERT_MSG(zss.stats.bytes_in == length && zss.stats.bytes_out == compressed_len, "stream stats should count all the bytes in and out");
+  ASSERT_MSG(zss.stats.zlib_calls > 1 && zss.stats.handler_calls > 1, "stream stats should count deflate and handler calls");
+
+  GoZLibStats global_after;
+  get_global_stats(true, &global_after);
+  ASSERT_MSG(global_after.bytes_in - global_before.bytes_in == length, "global stats should include the stream bytes");
+  ASSERT_MSG(global_after.handler_calls - global_before.handler_calls == zss.stats.handler_calls, "global stats should include the stream handler calls");
+
+  // parameters no other test uses need a newly initialized context
+  GoZLibTransformer *compressor = acquire_compression_transformer(Z_BEST_SPEED, 9, 1, Z_FILTERED, work_len, &ec);
+  ASSERT_MSG(ec == Z_OK, "compression transformer should be acquired");
+  get_global_stats(true, &global_before);
+  ASSERT_MSG(global_before.pool_misses > global_after.pool_misses, "creating a context should count a pool miss");
+
+  GoZLibStepResult step = transformer_compress_step(compressor, input, length, compressed, length * 2, Z_FINISH);
+  ASSERT_MSG(step.status == Z_STREAM_END, "transformer should compress in a single step");
+  ASSERT_MSG(compressor->stats.zlib_calls == 1 && compressor->stats.bytes_in == length && compressor->stats.bytes_out == step.produced,
+             "transformer stats should count its deflate calls");
+
+  reset_compression_transformer(compressor);
+  ASSERT_MSG(compressor->stats.zlib_calls == 0, "resetting the transformer should clear its stats");
+  release_compression_transformer(compressor);
+
+  // nothing is counted while disabled
+  set_stats_enabled(false);
+  get_global_stats(true, &global_before);
+  gzip_compress_buffer(Z_BEST_SPEED, input, length, compressed, length * 2, &ec);
+  get_global_stats(true, &global_after);
+  ASSERT_MSG(global_after.zlib_calls == global_before.zlib_calls, "disabled stats should not be counted");
+}
+
 int main(void) {
   test_gzip_compress_stream();
   test_gzip_compress_stream_zero_input();
@@ -296,11 +656,19 @@ int main(void) {
 
   test_uncompress_gzip_stream();
   test_uncompress_zlib_stream();
+  test_uncompress_multi_member_gzip_stream();
   test_uncompress_fail_invalid_stream();
   test_uncompress_fail_stream_output();
 
   test_gzip_compress_stream_compressed_larger_than_input();
   test_zlib_compress_stream_compressed_larger_than_input();
 
+  test_transformer_compress_uncompress_steps();
+  test_transformer_sync_flush_keeps_stream_open();
+  test_transformer_park_at_flush_boundaries();
+  test_file_compress_uncompress();
+  test_index_resume_at_access_point();
+  test_stream_and_transformer_stats();
+
   return 0;
 }